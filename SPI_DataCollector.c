@@ -10,6 +10,8 @@
 #include "pico/unique_id.h"   // Biblioteca com recursos para trabalhar com os pinos GPIO do Raspberry Pi Pico
 #include "pico/bootrom.h"     // Biblioteca com recursos para trabalhar com o bootrom da Raspberry Pi Pico
 #include "pico/binary_info.h" // Biblioteca para informações binárias do Raspberry Pi Pico
+#include "pico/stdio_usb.h"   // Saída direta pela USB (exportação de arquivos)
+#include "tusb.h"             // Pilha USB (TinyUSB): serial e cartão como pendrive
 
 #include "ssd1306.h" // Biblioteca para o display OLED SSD1306
 #include "font.h"    // Biblioteca de fontes para o display OLED
@@ -26,7 +28,25 @@
 #include "my_debug.h"  // Biblioteca de depuração personalizada
 #include "rtc.h"       // Biblioteca de RTC
 #include "sd_card.h"   // Biblioteca de cartão SD
+#include "sd_stats.h"  // Histogramas de latência do cartão SD
+#include "sd_trace.h"  // Registro binário dos comandos do cartão SD
 #include "gy33.h"      // Biblioteca do sensor GY-33
+#include "mount_cache.h" // Montagem acelerada (cache de clusters livres)
+#include "session.h"     // Arquivos de sessão numerados (/AAAAMMDD/NNNN.log)
+#include "ring_log.h"    // Arquivo circular pré-alocado
+#include "sync_policy.h" // Intervalo de sincronização adaptativo
+#include "hotplug.h"     // Detecção de remoção/reinserção do cartão
+#include "spill.h"       // Reserva de amostras enquanto o cartão está ausente
+#include "flash_log.h"   // Reserva secundária na memória flash
+#include "sink.h"        // Destinos da gravação (sessão, anel, flash)
+#include "export.h"      // Exportação de arquivos em quadros pela USB
+#include "telemetry.h"   // Amostras em quadros binários pela USB
+#include "shell.h"       // Terminal de comandos pela serial
+#include "msc_disk.h"    // Cartão SD como pendrive (USB MSC)
+#include "dlog.h"        // Mensagens adiadas (fora do caminho da amostragem)
+#include "stage_timer.h" // Tempo de cada etapa da amostra
+#include "prof.h"        // Perfil por amostragem do PC (interrupção de timer)
+#include "kbench.h"      // Microbenchmarks das rotinas de CPU
 
 //-------------------------------------------Definições-------------------------------------------
 #define I2C_PORT i2c0 // Porta I2C para sensor gy-33
@@ -50,6 +70,89 @@
 #define BUZZER_A 21      // Pino do buzzer A
 #define BUZZER_B 10      // Pino do buzzer B
 
+// Gravação circular: em vez de um arquivo por sessão, um único arquivo
+// pré-alocado em que os dados mais antigos são sobrescritos quando ele enche.
+// O custo de cada escrita é constante (sem FAT nem diretório); os dados são
+// recuperados no PC com host/tools/ring_dump.
+#define GRAVACAO_CIRCULAR 0
+#define ARQUIVO_ANEL "ring.log"
+#define TAMANHO_ANEL (64u * 1024 * 1024) // Usado apenas na criação do arquivo
+
+// Sessão pré-alocada (sem gravação circular): cada arquivo de sessão é
+// reservado inteiro, contíguo, ao abrir, e as amostras vão direto para os
+// setores em escritas de vários blocos, sem o FatFs até o fechamento, que
+// devolve a parte não usada. Sem espaço contíguo, volta ao arquivo comum.
+#define GRAVACAO_EXTENSAO 0
+#define TAMANHO_EXTENSAO (16u * 1024 * 1024) // ~15 h a 10 Hz; cheio, continua em outro arquivo
+
+// Sincronização adaptativa: o intervalo se ajusta à duração medida de cada
+// sincronização, respeitando os dois limites abaixo
+#define SYNC_MAX_RISCO_MS 2000 // Idade máxima de dados ainda não sincronizados
+#define SYNC_MIN_MS 100        // Intervalo mínimo entre sincronizações
+#define SYNC_MAX_CUSTO 50      // Fração máxima do tempo gasta sincronizando (por mil)
+
+// Registro dos últimos comandos do cartão, salvo quando a gravação termina com
+// erros do cartão ou quando ele volta depois de uma falha (decodificado no PC
+// com host/tools/sd_trace_decode)
+#define ARQUIVO_TRACE "sdtrace.bin"
+
+// Cartão removido durante a gravação: as amostras ficam numa reserva em RAM
+// e são gravadas assim que o cartão volta e é remontado
+#define TAMANHO_RESERVA (16 * 1024) // ~400 amostras (~40 s a 10 Hz)
+#define HOTPLUG_POLL_MS 500         // Verificação periódica da presença do cartão
+
+// Sem cartão, a reserva em RAM é transferida para a parte livre da memória
+// flash (FLASH_LOG_SIZE bytes no fim dela, ~10 h a 10 Hz), que é gravada no
+// cartão quando ele volta ou na próxima gravação
+#define FLASH_SYNC_AMOSTRAS 10 // Amostras entre gravações na flash
+
+// Terminal de comandos pela serial (USB ou UART), uma linha por comando;
+// "help" lista os comandos. A cada volta do laço principal são lidos no
+// máximo ORCAMENTO_TERMINAL caracteres e executado no máximo um comando ou
+// um passo de um comando longo (ls, bench), para não atrasar a amostragem.
+// "export <caminho> [início [bytes]]" envia um arquivo em quadros com CRC
+// pela USB (recebido no PC com host/tools/export_recv, que retoma a
+// transferência de onde parou); "telemetry on" troca a linha de texto de
+// cada amostra por lotes binários (host/tools/telemetry_recv).
+#define ORCAMENTO_TERMINAL 32 // Caracteres lidos por volta do laço
+#define LS_POR_PASSO 8        // Entradas de diretório listadas por passo
+#define TRACE_POR_PASSO 16    // Registros do cartão impressos por passo do sdtrace
+#define PERFIL_POR_PASSO 16   // Pilhas impressas por passo do "prof dump"
+#define BENCH_BLOCO 4096      // Bytes escritos/lidos por passo do bench
+#define PERIODO_LACO_MS 10    // Pausa do laço principal
+
+#define INTERVALO_AMOSTRA_MS 100 // Intervalo inicial entre amostras ("rate")
+
+// Modo pendrive ("usb on"): o cartão aparece no PC como disco USB, para
+// copiar as sessões sem tirá-lo do soquete. Enquanto isso o FatFs não usa o
+// volume: gravação e montagem ficam bloqueadas até "usb off" ou até o PC
+// ejetar o disco.
+#define ESPERA_INICIAL_MS 2000 // Enumeração USB e conexão do terminal
+
+// Mensagens da amostragem, das interrupções e do driver do cartão são
+// adiadas (dlog.h): a chamada só guarda o formato e os argumentos, e o laço
+// principal as imprime depois do trabalho da volta. "dlog bin" troca o texto
+// por linhas hexadecimais, decodificadas no PC por host/tools/dlog_decode com
+// o dicionário gerado na compilação (spi_data_collector.dlog).
+#define DLOG_POR_VOLTA 8 // Mensagens adiadas impressas por volta do laço
+
+// Tempo de cada etapa da amostra (stage_timer.h): mínimo, média, máximo e
+// histograma por etapa. "etapas" imprime a tabela, "etapas tela" a mostra no
+// display no lugar dos valores, "etapas reset" zera. Compilado com
+// STAGE_TIMER=0, não resta nada.
+enum
+{
+    ETAPA_AMOSTRA,   // A amostra inteira
+    ETAPA_SENSOR,    // gy33_read_color
+    ETAPA_COR,       // classificar_cor
+    ETAPA_TEXTO,     // Linha CSV (sprintf)
+    ETAPA_GRAVACAO,  // Reserva e escrita no destino (f_write)
+    ETAPA_SYNC,      // sincronizar (f_sync)
+    ETAPA_DESENHO,   // Tela montada na memória
+    ETAPA_ENVIO,     // ssd1306_send_data
+    N_ETAPAS
+};
+
 //-------------------------------------------Variáveis Globais-------------------------------------------
 static int addr = 0x74; // Endereço I2C do gy-33
 ssd1306_t ssd;          // Estrutura para o display SSD1306
@@ -60,6 +163,7 @@ volatile uint32_t ultimo_tempo_clique = 0; // Debounce dos botões
 
 bool captura_dados = false;         // Variável para controle de captura de dados
 bool montar_sd = false;             // Variável para controle de montagem do SD
+static bool sd_montado = false;     // Estado de montagem tratado pelo laço principal
 static bool gravacao_ativa = false; // Controla se a gravação está ativa
 
 // Variáveis para controle de tempo
@@ -67,11 +171,38 @@ static absolute_time_t next_log_time;
 volatile static absolute_time_t last_time = 0;
 static absolute_time_t last_buzzer_time = 0;
 
-// Nome do arquivo para gravação contínua
-static char filename[30] = "test.txt";
-
-static FIL arquivo_dados;         // Arquivo para gravação contínua
+// Destino da gravação: a captura só usa a interface sink_t
+static sink_t destino;
+#if GRAVACAO_CIRCULAR
+static sink_ring_t anel; // Arquivo circular
+#else
+// Sessão de gravação contínua: cada captura vai para um novo arquivo
+static session_t sessao;
+#if GRAVACAO_EXTENSAO
+static sink_extent_t extensao; // Arquivo da sessão pré-alocado
+#endif
+#endif
 static int contador_amostras = 0; // Contador de amostras gravadas
+static sync_policy_t politica_sync; // Decide quando sincronizar
+static hotplug_t hotplug;           // Presença do cartão
+static spill_t reserva;             // Amostras ainda não sincronizadas ou sem cartão
+static uint8_t reserva_buf[TAMANHO_RESERVA];
+static bool cartao_ok = false;      // Destino da gravação aberto e acessível
+static flash_log_t reserva_flash;   // Amostras guardadas na flash
+static sink_t destino_flash;        // A reserva na flash como destino
+static bool flash_ok = false;       // Reserva na flash disponível
+static bool falha_flash = false;    // Última manutenção da flash falhou
+static bool trace_pendente = false; // Registro do cartão congelado numa falha, ainda não salvo
+static const char cabecalho[] = "Amostra,Clear,Red,Green,Blue,cor\n";
+static bool telemetria_binaria = false; // Amostras em quadros binários pela USB
+static telemetry_t telemetria;
+static uint32_t intervalo_amostra_ms = INTERVALO_AMOSTRA_MS; // Intervalo entre amostras
+static shell_t terminal;                                       // Comandos pela serial
+static msc_disk_t disco_usb;                                   // O cartão como pendrive
+static bool modo_usb = false;                                  // Pedido de "usb on"
+static const char *const nomes_etapas[N_ETAPAS] = {"total", "sens", "cor", "texto",
+                                                   "grava", "sync", "desen", "envio"};
+static bool tela_diagnostico = false; // Display mostra os tempos das etapas
 
 //-------------------------------------------Prototipos de Funções-------------------------------------------
 void gpio_irq_handler(uint gpio, uint32_t events);        // Função de tratamento de interrupção de GPIO
@@ -83,14 +214,66 @@ static void run_unmount();                                // Função para desmo
 static void start_continuous_capture();                   // Função para iniciar a captura contínua
 static void stop_continuous_capture();                    // Função para parar a captura contínua
 static void process_continuous_capture();                 // Função para processar a captura contínua
+static FRESULT abrir_gravacao();                          // Abre o destino da gravação (sessão ou anel)
+static FRESULT gravar(const char *dados);                 // Grava uma linha no destino
+static FRESULT sincronizar();                             // Garante que os dados gravados estão no cartão
+static FRESULT fechar_gravacao();                         // Fecha o destino da gravação
+static void verificar_cartao();                           // Trata remoção/reinserção do cartão
+static void cartao_perdido();                             // Passa a guardar as amostras na reserva
+static void reconectar_cartao();                          // Remonta e grava a reserva
+static void guardar_na_flash(bool forcar);                // Transfere a reserva para a flash
+static FRESULT salvar_trace(const char *caminho);         // Grava o registro do cartão num arquivo
+static void iniciar_terminal();                           // Prepara o terminal de comandos
+static void entrar_modo_usb();                            // Passa o cartão ao PC (pendrive)
+static void sair_modo_usb();                              // Devolve o cartão ao FatFs
+static void desenhar_amostra(const char *nome_da_cor, uint16_t c, uint16_t r, uint16_t g,
+                             uint16_t b);                 // Valores da amostra no display
+static void desenhar_diagnostico();                       // Tempos das etapas no display
 
 //-------------------------------------------Função Principal-------------------------------------------
 int main()
 {
+    tusb_init();      // Pilha USB da aplicação: serial do stdio e pendrive
     stdio_init_all(); // Inicializa a biblioteca padrão de entrada e saída
-    sleep_ms(2000);   // Aguarda 2 segundos para estabilização
+    dlog_init();      // Mensagens adiadas
+
+    // Aguarda a estabilização atendendo a USB, que sem tud_task() não enumera
+    absolute_time_t fim_espera = make_timeout_time_ms(ESPERA_INICIAL_MS);
+    while (!time_reached(fim_espera))
+        tud_task();
 
     setup(); // Chama a função de configuração inicial
+    stage_timer_init(nomes_etapas, N_ETAPAS);
+
+    // Monta o cartão SD em segundo plano (core 1) para que ele já esteja
+    // pronto quando o botão B for pressionado
+    mount_cache_start_background(sd_get_by_num(0));
+    hotplug_sd_init(&hotplug, sd_get_by_num(0), HOTPLUG_POLL_MS);
+
+#if GRAVACAO_CIRCULAR
+    char caminho_anel[24];
+    snprintf(caminho_anel, sizeof(caminho_anel), "%s" ARQUIVO_ANEL, sd_get_by_num(0)->pcName);
+    sink_ring_init(&destino, &anel, caminho_anel, TAMANHO_ANEL);
+#elif GRAVACAO_EXTENSAO
+    sink_extent_init(&destino, &extensao, &sessao, sd_get_by_num(0), TAMANHO_EXTENSAO);
+#else
+    sink_session_init(&destino, &sessao, sd_get_by_num(0));
+#endif
+
+    // Reserva na flash: pode conter amostras de uma gravação sem cartão
+    flash_log_dev_t flash_dev;
+    flash_ok = flash_log_pico_dev(&flash_dev, FLASH_LOG_SIZE) &&
+               flash_log_mount(&reserva_flash, &flash_dev) == 0;
+    if (!flash_ok)
+        printf("[AVISO] Reserva na flash indisponível\n");
+    else if (flash_log_pending(&reserva_flash))
+        printf("Reserva na flash: %lu amostras aguardando o cartão\n",
+               (unsigned long)flash_log_pending(&reserva_flash));
+    if (flash_ok)
+    {
+        sink_flash_init(&destino_flash, &reserva_flash);
+        sink_open(&destino_flash);
+    }
 
     // Inicializa o sensor de cor GY-33
     gy33_init(I2C_PORT);
@@ -100,6 +283,10 @@ int main()
     ssd1306_draw_string(&ssd, "Aguardando...", 0, 0);
     ssd1306_send_data(&ssd);
 
+    iniciar_terminal();
+    msc_disk_init(&disco_usb, 0, 0, 0);
+    msc_disk_usb_bind(&disco_usb);
+
     // Configura os LEDs iniciais em amarelo
     gpio_put(LED_PIN_RED, 1);
     gpio_put(LED_PIN_GREEN, 1);
@@ -112,6 +299,29 @@ int main()
         if (gravacao_ativa)
         {
             process_continuous_capture();
+            verificar_cartao();
+        }
+        // Apaga setores da flash com antecedência, fora do caminho da gravação.
+        // Uma falha é avisada uma vez; a próxima volta tenta de novo
+        if (flash_ok)
+        {
+            int rc = flash_log_maintain(&reserva_flash);
+            if (rc < 0 && !falha_flash)
+                printf("[AVISO] Reserva na flash: falha ao apagar setor (%d)\n", rc);
+            falha_flash = rc < 0;
+        }
+
+        // Modo pendrive: entra a pedido, sai com "usb off" ou quando o PC ejeta
+        msc_disk_state_t estado_usb = msc_disk_state(&disco_usb);
+        if (modo_usb && MSC_DISK_OFF == estado_usb)
+            entrar_modo_usb();
+        else if (MSC_DISK_OFF != estado_usb && (!modo_usb || MSC_DISK_EJECTED == estado_usb))
+            sair_modo_usb();
+        if (MSC_DISK_OFF != msc_disk_state(&disco_usb) && (captura_dados || montar_sd))
+        {
+            printf("[ERRO] Cartão em uso pelo PC: ejete-o ou use \"usb off\"\n");
+            captura_dados = false;
+            montar_sd = false;
         }
 
         // Verifica se deve iniciar ou parar a captura
@@ -127,7 +337,6 @@ int main()
         }
 
         // Verifica se deve montar ou desmontar o SD
-        static bool sd_montado = false;
         if (montar_sd && !sd_montado)
         {
             // Monta o SD
@@ -141,7 +350,23 @@ int main()
             sd_montado = false;
         }
 
-        sleep_ms(100); // Delay de 100ms
+        // Mensagens adiadas, depois do trabalho da volta
+        dlog_drain(DLOG_POR_VOLTA);
+
+        // Comandos da serial, com trabalho limitado por volta
+        shell_poll(&terminal, ORCAMENTO_TERMINAL);
+
+        // Pilha USB. Com o cartão no PC não há gravação: a pausa do laço é
+        // toda usada atendendo as transferências
+        tud_task();
+        if (MSC_DISK_OFF != msc_disk_state(&disco_usb))
+        {
+            absolute_time_t fim = make_timeout_time_ms(PERIODO_LACO_MS);
+            while (!time_reached(fim))
+                tud_task();
+        }
+        else
+            sleep_ms(PERIODO_LACO_MS);
     }
     return 0;
 }
@@ -224,9 +449,8 @@ static void run_mount()
     gpio_put(LED_PIN_RED, 1);
     gpio_put(LED_PIN_GREEN, 1);
 
-    const char *arg1 = strtok(NULL, " ");
-    if (!arg1)
-        arg1 = sd_get_by_num(0)->pcName;
+    // Sempre o primeiro cartão (não há linha de comando a continuar com strtok)
+    const char *arg1 = sd_get_by_num(0)->pcName;
     FATFS *p_fs = sd_get_fs_by_name(arg1);
     if (!p_fs)
     {
@@ -247,7 +471,26 @@ static void run_mount()
         ssd1306_send_data(&ssd);
         return;
     }
-    FRESULT fr = f_mount(p_fs, arg1, 1);
+    sd_card_t *pSD = sd_get_by_name(arg1);
+    myASSERT(pSD);
+
+    // Aproveita a montagem em segundo plano, se ela foi feita para este cartão
+    FRESULT fr;
+    while (mount_cache_background_busy())
+        sleep_ms(10);
+    bool bg_mount = mount_cache_background_done(&fr) && p_fs->fs_type;
+    if (!bg_mount)
+        fr = mount_cache_mount(pSD, false, NULL);
+    const mount_cache_stats_t *ms = mount_cache_last_stats();
+    printf("Montagem: %lu us (f_mount %lu us, cache %lu us, getfree %lu us), livres: %lu clusters (%s)%s\n",
+           (unsigned long)(ms->mount_us + ms->restore_us + ms->getfree_us),
+           (unsigned long)ms->mount_us, (unsigned long)ms->restore_us,
+           (unsigned long)ms->getfree_us, (unsigned long)ms->free_clst,
+           mount_cache_src_str(ms->source), bg_mount ? " [segundo plano]" : "");
+    if (!(pSD->m_Status & STA_NOINIT))
+        printf("Inicialização do cartão: %s, %lu us\n",
+               pSD->warm_init ? "rápida (parâmetros em cache)" : "completa",
+               (unsigned long)pSD->init_us);
     if (FR_OK != fr)
     {
         printf("f_mount error: %s (%d)\n", FRESULT_str(fr), fr);
@@ -268,11 +511,36 @@ static void run_mount()
         ssd1306_send_data(&ssd);
         return;
     }
-    sd_card_t *pSD = sd_get_by_name(arg1);
-    myASSERT(pSD);
     pSD->mounted = true;
     printf("Processo de montagem do SD ( %s ) concluído\n", pSD->pcName);
 
+    // Sessão interrompida por falta de energia: recupera os dados até o
+    // último bloco válido e corrige o tamanho do arquivo
+    bool recuperada;
+    session_info_t info;
+    crash_log_recovery_t rec;
+    fr = session_recover(pSD, &recuperada, &info, &rec);
+    if (FR_OK != fr)
+        printf("[ERRO] Recuperação da última sessão: %s (%d)\n", FRESULT_str(fr), fr);
+    else if (recuperada)
+        printf("Sessão %04lu recuperada: %lu registros, %lu blocos%s\n",
+               (unsigned long)info.seq, (unsigned long)rec.records,
+               (unsigned long)rec.blocks, rec.trimmed ? ", tamanho corrigido" : "");
+
+    // Catálogo de sessões: lido por posição, sem percorrer os diretórios
+    uint32_t n_sessoes, proxima;
+    if (FR_OK == session_count(pSD, &n_sessoes, &proxima))
+    {
+        printf("Sessões gravadas: %lu, próxima: %04lu\n",
+               (unsigned long)n_sessoes, (unsigned long)proxima);
+        session_info_t ultima;
+        if (n_sessoes && FR_OK == session_get(pSD, n_sessoes - 1, &ultima))
+            printf("Última sessão: %08lu/%04lu, %lu registros, %lu bytes%s\n",
+                   (unsigned long)ultima.date, (unsigned long)ultima.seq,
+                   (unsigned long)ultima.records, (unsigned long)ultima.size,
+                   SESSION_RECOVERED == ultima.closed ? " (recuperada)" : "");
+    }
+
     // LED verde para sucesso / Sistema pronto
     gpio_put(LED_PIN_BLUE, 0);
     gpio_put(LED_PIN_RED, 0);
@@ -290,16 +558,19 @@ static void run_unmount()
 {
     printf("Desmontando cartão SD...\n");
 
-    const char *arg1 = strtok(NULL, " ");
-    if (!arg1)
-        arg1 = sd_get_by_num(0)->pcName;
+    // Sempre o primeiro cartão (não há linha de comando a continuar com strtok)
+    const char *arg1 = sd_get_by_num(0)->pcName;
     FATFS *p_fs = sd_get_fs_by_name(arg1);
     if (!p_fs)
     {
         printf("Unknown logical drive number: \"%s\"\n", arg1);
         return;
     }
-    FRESULT fr = f_unmount(arg1);
+    // Guarda a contagem de clusters livres para acelerar a próxima montagem
+    FRESULT fr = mount_cache_save(sd_get_by_name(arg1));
+    if (FR_OK != fr)
+        printf("mount_cache_save error: %s (%d)\n", FRESULT_str(fr), fr);
+    fr = f_unmount(arg1);
     if (FR_OK != fr)
     {
         printf("f_unmount error: %s (%d)\n", FRESULT_str(fr), fr);
@@ -331,8 +602,16 @@ static void start_continuous_capture()
         return;
     }
 
+    // O FatFs não é reentrante: espera a montagem em segundo plano (core 1)
+    if (mount_cache_background_busy())
+    {
+        printf("Montagem do SD em andamento, tente novamente.\n");
+        captura_dados = false;
+        return;
+    }
+
     printf("\nIniciando gravação contínua do GY-33...\n");
-    FRESULT res = f_open(&arquivo_dados, filename, FA_WRITE | FA_CREATE_ALWAYS);
+    FRESULT res = abrir_gravacao();
     if (res != FR_OK)
     {
         printf("\n[ERRO] Não foi possível abrir o arquivo para escrita. Monte o Cartao.\n");
@@ -340,22 +619,42 @@ static void start_continuous_capture()
     }
 
     // Escreve cabeçalho do arquivo CSV
-    char header[] = "Amostra,Clear,Red,Green,Blue,cor\n";
-    UINT bw;
-    res = f_write(&arquivo_dados, header, strlen(header), &bw);
+    res = gravar(cabecalho);
     if (res != FR_OK)
     {
         printf("[ERRO] Não foi possível escrever cabeçalho no arquivo.\n");
-        f_close(&arquivo_dados);
+        contador_amostras = 0;
+        fechar_gravacao();
         return;
     }
 
+    // Amostras que ficaram na flash numa gravação anterior sem cartão
+    if (flash_ok && flash_log_pending(&reserva_flash))
+    {
+        uint32_t recuperadas = flash_log_pending(&reserva_flash);
+        if (flash_log_drain(&reserva_flash, sink_write, &destino) == 0 && sincronizar() == FR_OK)
+        {
+            flash_log_commit(&reserva_flash);
+            printf("%lu amostras recuperadas da flash\n", (unsigned long)recuperadas);
+        }
+        else
+            flash_log_rewind(&reserva_flash);
+    }
+
     gpio_put(LED_PIN_GREEN, 0);
     gpio_put(LED_PIN_BLUE, 0);
     gpio_put(LED_PIN_RED, 1);
 
     gravacao_ativa = true;
+    cartao_ok = true;
     contador_amostras = 0;
+    spill_init(&reserva, reserva_buf, sizeof(reserva_buf));
+    sync_policy_cfg_t cfg = {
+        .max_risk_ms = SYNC_MAX_RISCO_MS,
+        .min_interval_ms = SYNC_MIN_MS,
+        .max_cost_permille = SYNC_MAX_CUSTO};
+    sync_policy_init(&politica_sync, &cfg);
+    sd_stats_reset(); // Histogramas de latência apenas desta gravação
     printf("Gravação iniciada! Pressione o botão A novamente para parar.\n");
 }
 
@@ -368,10 +667,43 @@ static void stop_continuous_capture()
         return;
     }
 
+    // Últimas amostras da telemetria, se o lote não completou
+    if (telemetria_binaria)
+        telemetry_flush(&telemetria);
+
     gravacao_ativa = false;
-    f_close(&arquivo_dados);
+    FRESULT res = FR_NOT_READY;
+    if (cartao_ok)
+        res = fechar_gravacao();
+    else if (flash_ok)
+    {
+        guardar_na_flash(true);
+        printf("Cartão ausente: %lu amostras guardadas na flash, gravadas na próxima sessão\n",
+               (unsigned long)flash_log_pending(&reserva_flash));
+        if (spill_pending(&reserva))
+            printf("[ERRO] Flash cheia: %lu amostras da reserva não foram gravadas\n",
+                   (unsigned long)spill_pending(&reserva));
+    }
+    else
+        printf("[ERRO] Cartão ausente: %lu amostras da reserva não foram gravadas\n",
+               (unsigned long)spill_pending(&reserva));
+    if (res != FR_OK)
+        printf("[ERRO] Falha ao fechar a gravação: %s (%d)\n", FRESULT_str(res), res);
     printf("\nGravação interrompida! Total de amostras: %d\n", contador_amostras);
-    printf("Dados salvos no arquivo %s.\n\n", filename);
+    const spill_stats_t *rs = spill_stats(&reserva);
+    printf("Reserva: pico %lu bytes, %lu amostras descartadas, %lu regravadas; "
+           "cartão removido %lu vez(es)\n",
+           (unsigned long)rs->peak, (unsigned long)rs->dropped, (unsigned long)rs->rewound,
+           (unsigned long)hotplug.removals);
+    const sync_policy_metrics_t *m = sync_policy_metrics(&politica_sync);
+    printf("Sincronizações: %lu (%lu lentas), média %lu us, máx %lu us, total %llu us, "
+           "intervalo %lu ms, maior atraso %lu ms\n",
+           (unsigned long)m->syncs, (unsigned long)m->stalls, (unsigned long)m->avg_us,
+           (unsigned long)m->max_us, (unsigned long long)m->total_us,
+           (unsigned long)m->interval_ms, (unsigned long)m->max_risk_ms);
+    sd_stats_print();
+    if (trace_pendente || sd_stats.errors[SD_STATS_READ] || sd_stats.errors[SD_STATS_WRITE])
+        salvar_trace(ARQUIVO_TRACE);
 
     // Duplo beep para indicar fim da gravação
 
@@ -404,36 +736,70 @@ static void process_continuous_capture()
 {
     static absolute_time_t last_sample_time = 0;
 
-    // Verifica se é hora de coletar uma nova amostra (100ms)
-    if (absolute_time_diff_us(last_sample_time, get_absolute_time()) < 100000)
+    // Verifica se é hora de coletar uma nova amostra
+    absolute_time_t agora = get_absolute_time();
+    int64_t atraso = absolute_time_diff_us(last_sample_time, agora) - intervalo_amostra_ms * 1000ll;
+    if (atraso < 0)
     {
         return;
     }
-    last_sample_time = get_absolute_time();
+    // Prazos fixos, para o tempo de cada volta do laço não se acumular no
+    // intervalo; depois de um atraso de mais de um intervalo (início da
+    // gravação, remontagem), recomeça a contar de agora em vez de tirar
+    // amostras seguidas
+    if (atraso < intervalo_amostra_ms * 1000ll)
+        last_sample_time = delayed_by_ms(last_sample_time, intervalo_amostra_ms);
+    else
+        last_sample_time = agora;
+    STAGE_SCOPE(ETAPA_AMOSTRA);
     // Lê dados do SENSOR GY-33
     uint16_t r, g, b, c;
-    gy33_read_color(I2C_PORT, &r, &g, &b, &c);
-    const char *nome_da_cor = identificar_cor(r, g, b, c);
-    printf("GY33 -> C:%u R:%u G:%u B:%u cor:%s\n", c, r, g, b, nome_da_cor);
+    {
+        STAGE_SCOPE(ETAPA_SENSOR);
+        gy33_read_color(I2C_PORT, &r, &g, &b, &c);
+    }
+    cor_t cor;
+    {
+        STAGE_SCOPE(ETAPA_COR);
+        cor = classificar_cor(r, g, b, c);
+    }
+    const char *nome_da_cor = nomes_cores[cor];
+    if (telemetria_binaria)
+        telemetry_put(&telemetria, contador_amostras + 1, to_ms_since_boot(get_absolute_time()),
+                      c, r, g, b, cor);
+    else
+        DLOG_PRINTF("GY33 -> C:%u R:%u G:%u B:%u cor:%s\n", c, r, g, b, nome_da_cor);
 
     // Cria a string para salvar no cartão SD
     // Inclui o número da amostra e os 4 valores de cor
     char buffer[100]; // Ajustamos o tamanho do buffer, pois os dados são menores
-    sprintf(buffer, "%d,%u,%u,%u,%u,%s\n",
-            contador_amostras + 1,
-            c, r, g, b, nome_da_cor);
+    {
+        STAGE_SCOPE(ETAPA_TEXTO);
+        sprintf(buffer, "%d,%u,%u,%u,%u,%s\n",
+                contador_amostras + 1,
+                c, r, g, b, nome_da_cor);
+    }
     // Adiciona o nome da cor à string
     // strcat(buffer, nome_da_cor);
     // strcat(buffer, "\n");
 
-    UINT bw;
-    FRESULT res = f_write(&arquivo_dados, buffer, strlen(buffer), &bw);
-    if (res != FR_OK)
+    // A amostra passa pela reserva: vai direto para o cartão se ele estiver
+    // acessível e fica guardada até ser sincronizada
+    bool escrita_ok = true;
     {
-        printf("\n[ERRO] Falha na escrita. Interrompendo gravação.\n");
-        stop_continuous_capture();
-        return;
+        STAGE_SCOPE(ETAPA_GRAVACAO);
+        if (!spill_put(&reserva, buffer, strlen(buffer)))
+            DLOG_PRINTF("[ERRO] Reserva cheia: amostra %d descartada\n", contador_amostras + 1);
+        if (cartao_ok)
+            escrita_ok = spill_drain(&reserva, sink_write, &destino) == FR_OK;
+    }
+    if (!escrita_ok)
+    {
+        DLOG_PRINTF("\n[ERRO] Falha na escrita.\n");
+        cartao_perdido();
     }
+    if (!cartao_ok && flash_ok)
+        guardar_na_flash(false);
 
     contador_amostras++;
 
@@ -442,17 +808,57 @@ static void process_continuous_capture()
     gpio_put(LED_PIN_BLUE, 0);
     gpio_put(LED_PIN_RED, 1);
 
-    // Força a escrita no cartão SD a cada 10 amostras
-    if (contador_amostras % 10 == 0)
+    // Torna duráveis as amostras quando a política de sincronização pedir
+    if (cartao_ok && sync_policy_wrote(&politica_sync, time_us_64()))
     {
-        f_sync(&arquivo_dados);
-        printf("Amostras coletadas: %d\n", contador_amostras);
+        uint64_t inicio = time_us_64();
+        FRESULT res;
+        {
+            STAGE_SCOPE(ETAPA_SYNC);
+            res = sincronizar();
+        }
+        if (res == FR_OK)
+            spill_commit(&reserva); // Amostras no cartão: libera a reserva
+        else
+            cartao_perdido();
+        sync_policy_synced(&politica_sync, inicio, time_us_64());
+        const sync_policy_metrics_t *m = sync_policy_metrics(&politica_sync);
+        DLOG_PRINTF("Amostras coletadas: %d (sync %lu us, intervalo %lu ms)\n", contador_amostras,
+                    (unsigned long)m->last_us, (unsigned long)m->interval_ms);
+    }
+    // Atualiza o display SSD1306 com os valores de cor e o nome, ou com os
+    // tempos das etapas
+    {
+        STAGE_SCOPE(ETAPA_DESENHO);
+        ssd1306_fill(&ssd, false); // Limpa a tela para a próxima atualização
+        if (tela_diagnostico)
+            desenhar_diagnostico();
+        else
+            desenhar_amostra(nome_da_cor, c, r, g, b);
     }
-    // Atualiza o display SSD1306 com os valores de cor e o nome
-    ssd1306_fill(&ssd, false); // Limpa a tela para a próxima atualização
 
+    // Envia todos os dados para o display de uma vez
+    {
+        STAGE_SCOPE(ETAPA_ENVIO);
+        ssd1306_send_data(&ssd);
+    }
+}
+
+// Tela da captura: estado, cor, número da amostra e valores
+static void desenhar_amostra(const char *nome_da_cor, uint16_t c, uint16_t r, uint16_t g, uint16_t b)
+{
     // Linha 0: Mensagem de status
-    ssd1306_draw_string(&ssd, "Gravando Dados...", 0, 0);
+    if (cartao_ok)
+        ssd1306_draw_string(&ssd, "Gravando Dados...", 0, 0);
+    else
+    {
+        char reserva_txt[24];
+        uint32_t pendentes = spill_pending(&reserva);
+        if (flash_ok)
+            pendentes += flash_log_pending(&reserva_flash);
+        snprintf(reserva_txt, sizeof(reserva_txt), "Sem cartao: %lu", (unsigned long)pendentes);
+        ssd1306_draw_string(&ssd, reserva_txt, 0, 0);
+    }
 
     // Linha 1: Nome da cor (sempre visível)
     ssd1306_draw_string(&ssd, nome_da_cor, 0, 10);
@@ -471,8 +877,827 @@ static void process_continuous_capture()
     char gb_buffer[20];
     snprintf(gb_buffer, sizeof(gb_buffer), "G: %u B: %u", g, b);
     ssd1306_draw_string(&ssd, gb_buffer, 0, 40);
+}
 
-    // Envia todos os dados para o display de uma vez
+// Tela de diagnóstico: média e máximo (us) de cada etapa da amostra
+static void desenhar_diagnostico()
+{
+    char linhas[7][24];
+    unsigned n = stage_timer_lines(linhas, 7, 16);
+    ssd1306_draw_string(&ssd, "Etapa media max", 0, 0);
+    for (unsigned i = 0; i < n; ++i)
+        ssd1306_draw_string(&ssd, linhas[i], 0, 8 * (i + 1));
+}
+
+// Abre o destino da gravação: nova sessão ou o arquivo circular
+static FRESULT abrir_gravacao()
+{
+#if GRAVACAO_EXTENSAO
+    // A extensão é tentada de novo a cada abertura: a falta de espaço
+    // contíguo pode ter sido só de uma gravação ou de um cartão anterior
+    sink_extent_init(&destino, &extensao, &sessao, sd_get_by_num(0), TAMANHO_EXTENSAO);
+#endif
+    FRESULT res = sink_open(&destino);
+#if GRAVACAO_EXTENSAO
+    if (res == FR_DENIED)
+    {
+        printf("[AVISO] Sem %u MB contíguos no cartão: sessão em arquivo comum\n",
+               (unsigned)(TAMANHO_EXTENSAO >> 20));
+        sink_session_init(&destino, &sessao, sd_get_by_num(0));
+        res = sink_open(&destino);
+    }
+#endif
+    if (res != FR_OK)
+        return res;
+#if GRAVACAO_CIRCULAR
+    printf("Arquivo circular: %s (%lu blocos, próximo %lu)\n", anel.path,
+           (unsigned long)anel.rl.nslots, (unsigned long)anel.rl.seq);
+#else
+    printf("Arquivo da sessão: %s\n", sessao.path);
+#endif
+    return res;
+}
+
+// Grava uma linha no destino da gravação
+static FRESULT gravar(const char *dados)
+{
+    return sink_write(&destino, dados, strlen(dados));
+}
+
+// Garante que os dados gravados até aqui estão no cartão
+static FRESULT sincronizar()
+{
+    return sink_flush(&destino);
+}
+
+// Fecha o destino da gravação
+static FRESULT fechar_gravacao()
+{
+    FRESULT res = sink_close(&destino);
+#if !GRAVACAO_CIRCULAR
+    printf("Dados salvos no arquivo %s.\n", sessao.path);
+#endif
+    return res;
+}
+
+// Verifica se o cartão foi removido ou reinserido durante a gravação
+static void verificar_cartao()
+{
+    switch (hotplug_poll(&hotplug, time_us_64()))
+    {
+    case HOTPLUG_REMOVED:
+        if (cartao_ok)
+            cartao_perdido();
+        break;
+    case HOTPLUG_INSERTED:
+        reconectar_cartao();
+        break;
+    default:
+        break;
+    }
+}
+
+// O cartão deixou de responder: as amostras passam a ficar na reserva
+static void cartao_perdido()
+{
+    cartao_ok = false;
+    // O que foi escrito desde a última sincronização pode não estar no
+    // cartão: volta a ser pendente e será gravado de novo
+    spill_rewind(&reserva);
+    hotplug_lost(&hotplug);
+    printf("[AVISO] Cartão SD inacessível: amostras guardadas na reserva (%u bytes)\n",
+           (unsigned)sizeof(reserva_buf));
+    // Congela o registro do cartão na falha: é salvo quando ele voltar ou ao
+    // fim da gravação. Imprimi-lo aqui pela serial atrasaria a amostragem
+    sd_trace_freeze();
+    trace_pendente = true;
+
+    gpio_put(LED_PIN_RED, 1);
+    gpio_put(LED_PIN_GREEN, 1);
+}
+
+// O cartão voltou: remonta, abre um novo destino e grava a reserva
+static void reconectar_cartao()
+{
+    sd_card_t *pSD = sd_get_by_num(0);
+    printf("Cartão SD detectado, remontando...\n");
+    f_unmount(pSD->pcName);
+    pSD->m_Status |= STA_NOINIT;
+    // O que já foi para a flash sai da reserva em RAM
+    if (flash_ok && flash_log_flush(&reserva_flash) == 0)
+        spill_commit(&reserva);
+    FRESULT res = mount_cache_mount(pSD, false, NULL);
+#if !GRAVACAO_CIRCULAR
+    // A sessão interrompida é fechada até o último bloco válido
+    bool recuperada;
+    session_info_t info;
+    crash_log_recovery_t rec;
+    if (res == FR_OK)
+        res = session_recover(pSD, &recuperada, &info, &rec);
+#endif
+    if (res == FR_OK)
+        res = abrir_gravacao();
+    if (res == FR_OK)
+        res = gravar(cabecalho);
+    // Primeiro a flash, com as amostras mais antigas, depois a RAM
+    uint32_t pendentes = spill_pending(&reserva);
+    if (flash_ok)
+        pendentes += flash_log_pending(&reserva_flash);
+    if (res == FR_OK && flash_ok && flash_log_drain(&reserva_flash, sink_write, &destino) != 0)
+        res = FR_DISK_ERR;
+    if (res == FR_OK)
+        res = spill_drain(&reserva, sink_write, &destino);
+    if (res == FR_OK)
+        res = sincronizar();
+    if (res != FR_OK)
+    {
+        printf("[ERRO] Remontagem falhou: %s (%d)\n", FRESULT_str(res), res);
+        spill_rewind(&reserva);
+        if (flash_ok)
+            flash_log_rewind(&reserva_flash);
+        hotplug_lost(&hotplug); // Tenta de novo na próxima verificação
+        return;
+    }
+    spill_commit(&reserva);
+    if (flash_ok)
+        flash_log_commit(&reserva_flash);
+    pSD->mounted = true;
+    cartao_ok = true;
+    gpio_put(LED_PIN_GREEN, 0);
+    printf("Gravação retomada: %lu amostras da reserva gravadas\n", (unsigned long)pendentes);
+    if (trace_pendente)
+        salvar_trace(ARQUIVO_TRACE);
+}
+
+static FRESULT salvar_trace(const char *caminho)
+{
+    FRESULT res = sd_trace_save(caminho);
+    printf("Registro do cartão SD em %s: %s\n", caminho, FRESULT_str(res));
+    trace_pendente = false;
+    return res;
+}
+
+// Sem cartão: a reserva em RAM é transferida para a flash, e liberada a cada
+// FLASH_SYNC_AMOSTRAS amostras, quando elas estão de fato gravadas
+static void guardar_na_flash(bool forcar)
+{
+    static uint32_t amostras = 0;
+    if (spill_drain(&reserva, sink_write, &destino_flash) != 0)
+        forcar = true; // Flash cheia: o que coube precisa ser gravado
+    if ((forcar || ++amostras % FLASH_SYNC_AMOSTRAS == 0) && sink_flush(&destino_flash) == FR_OK)
+        spill_commit(&reserva);
+}
+
+// Entrada do terminal: um caractere já recebido, sem esperar
+static int ler_caractere()
+{
+    int c = getchar_timeout_us(0);
+    return c == PICO_ERROR_TIMEOUT ? -1 : c;
+}
+
+// Comandos que usam o cartão exigem que ele esteja montado; alguns, também,
+// que a gravação esteja parada
+static bool cartao_disponivel(bool sem_gravacao)
+{
+    if (sem_gravacao && gravacao_ativa)
+    {
+        printf("[ERRO] Indisponível durante a gravação\n");
+        return false;
+    }
+    if (!sd_get_by_num(0)->mounted)
+    {
+        printf("[ERRO] Monte o cartão antes (mount)\n");
+        return false;
+    }
+    return true;
+}
+
+// start / stop: o mesmo que o botão A, tratado no laço principal
+static int cmd_start(int argc, char **argv)
+{
+    captura_dados = true;
+    return 0;
+}
+
+static int cmd_stop(int argc, char **argv)
+{
+    captura_dados = false;
+    return 0;
+}
+
+// mount / unmount: o mesmo que o botão B
+static int cmd_mount(int argc, char **argv)
+{
+    montar_sd = true;
+    return 0;
+}
+
+static int cmd_unmount(int argc, char **argv)
+{
+    if (gravacao_ativa)
+    {
+        printf("[ERRO] Pare a gravação antes (stop)\n");
+        return 1;
+    }
+    montar_sd = false;
+    return 0;
+}
+
+// rate <ms>: intervalo entre amostras
+static int cmd_rate(int argc, char **argv)
+{
+    uint32_t ms;
+    if (!shell_parse_u32(argv[1], 20, 60000, &ms))
+    {
+        printf("[ERRO] Intervalo entre 20 e 60000 ms\n");
+        return 1;
+    }
+    intervalo_amostra_ms = ms;
+    printf("Intervalo entre amostras: %lu ms\n", (unsigned long)ms);
+    return 0;
+}
+
+// gain <1|4|16|60>: ganho do sensor
+static int cmd_gain(int argc, char **argv)
+{
+    static const uint8_t ganhos[] = {1, 4, 16, 60};
+    uint32_t g = 0;
+    shell_parse_u32(argv[1], 1, 60, &g);
+    for (uint8_t codigo = 0; codigo < sizeof(ganhos); codigo++)
+        if (ganhos[codigo] == g)
+        {
+            gy33_set_ganho(I2C_PORT, codigo);
+            printf("Ganho: %lux\n", (unsigned long)g);
+            return 0;
+        }
+    printf("[ERRO] Ganho 1, 4, 16 ou 60\n");
+    return 1;
+}
+
+// atime <ms>: tempo de integração, em passos de 2,4 ms
+static int cmd_atime(int argc, char **argv)
+{
+    uint32_t ms;
+    if (!shell_parse_u32(argv[1], 3, 614, &ms))
+    {
+        printf("[ERRO] Tempo de integração entre 3 e 614 ms\n");
+        return 1;
+    }
+    uint32_t passos = (ms * 10 + 12) / 24; // Arredondado para o passo mais próximo
+    gy33_set_atime(I2C_PORT, (uint8_t)(256 - passos));
+    printf("Tempo de integração: %lu.%lu ms\n", (unsigned long)(passos * 24 / 10),
+           (unsigned long)(passos * 24 % 10));
+    return 0;
+}
+
+// ls [dir]: lista LS_POR_PASSO entradas por volta do laço
+static DIR ls_dir;
+static uint32_t ls_total;
+
+static bool passo_ls()
+{
+    for (int i = 0; i < LS_POR_PASSO; i++)
+    {
+        FILINFO fno;
+        FRESULT fr = f_readdir(&ls_dir, &fno);
+        if (FR_OK != fr || !fno.fname[0])
+        {
+            if (FR_OK != fr)
+                printf("[ERRO] ls: %s (%d)\n", FRESULT_str(fr), fr);
+            printf("%lu entradas\n", (unsigned long)ls_total);
+            f_closedir(&ls_dir);
+            return true;
+        }
+        ls_total++;
+        if (fno.fattrib & AM_DIR)
+            printf("  %-24s <dir>\n", fno.fname);
+        else
+            printf("  %-24s %10llu\n", fno.fname, (unsigned long long)fno.fsize);
+    }
+    return false;
+}
+
+static int cmd_ls(int argc, char **argv)
+{
+    if (!cartao_disponivel(false))
+        return 1;
+    const char *dir = argc > 1 ? argv[1] : sd_get_by_num(0)->pcName;
+    FRESULT fr = f_opendir(&ls_dir, dir);
+    if (FR_OK != fr)
+    {
+        printf("[ERRO] ls %s: %s (%d)\n", dir, FRESULT_str(fr), fr);
+        return 1;
+    }
+    ls_total = 0;
+    shell_job(&terminal, passo_ls);
+    return 0;
+}
+
+// stat <caminho>: tamanho, data e atributos
+static int cmd_stat(int argc, char **argv)
+{
+    if (!cartao_disponivel(false))
+        return 1;
+    FILINFO fno;
+    FRESULT fr = f_stat(argv[1], &fno);
+    if (FR_OK != fr)
+    {
+        printf("[ERRO] stat %s: %s (%d)\n", argv[1], FRESULT_str(fr), fr);
+        return 1;
+    }
+    printf("%s: %llu bytes, %04u-%02u-%02u %02u:%02u:%02u%s%s\n", fno.fname,
+           (unsigned long long)fno.fsize, (fno.fdate >> 9) + 1980, (fno.fdate >> 5) & 15,
+           fno.fdate & 31, fno.ftime >> 11, (fno.ftime >> 5) & 63, (fno.ftime & 31) * 2,
+           fno.fattrib & AM_DIR ? ", diretório" : "", fno.fattrib & AM_RDO ? ", somente leitura" : "");
+    return 0;
+}
+
+// metrics [reset]: contadores da gravação, da reserva, da flash, das
+// sincronizações e as latências do cartão; "reset" zera as latências, que de
+// outra forma só recomeçam a cada gravação, para medir o cartão parado
+static int cmd_metrics(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        if (0 != strcmp(argv[1], "reset"))
+        {
+            printf("[ERRO] Uso: metrics [reset]\n");
+            return 1;
+        }
+        sd_stats_reset();
+        return 0;
+    }
+    printf("Gravação: %s, %d amostras, intervalo %lu ms, telemetria %s\n",
+           gravacao_ativa ? "ativa" : "parada", contador_amostras,
+           (unsigned long)intervalo_amostra_ms, telemetria_binaria ? "binária" : "texto");
+    const spill_stats_t *r = spill_stats(&reserva);
+    printf("Reserva: %lu pendentes, pico %lu bytes, %lu descartadas, %lu regravadas\n",
+           (unsigned long)spill_pending(&reserva), (unsigned long)r->peak,
+           (unsigned long)r->dropped, (unsigned long)r->rewound);
+    if (flash_ok)
+    {
+        const flash_log_stats_t *f = flash_log_stats(&reserva_flash);
+        printf("Flash: %lu pendentes, %lu gravações de página, %lu apagamentos\n",
+               (unsigned long)flash_log_pending(&reserva_flash), (unsigned long)f->programs,
+               (unsigned long)f->erases);
+    }
+    const sync_policy_metrics_t *m = sync_policy_metrics(&politica_sync);
+    printf("Sync: %lu (%lu lentas), última %lu us, máx %lu us, intervalo %lu ms\n",
+           (unsigned long)m->syncs, (unsigned long)m->stalls, (unsigned long)m->last_us,
+           (unsigned long)m->max_us, (unsigned long)m->interval_ms);
+    printf("Terminal: %lu comandos, %lu erros\n", (unsigned long)terminal.stats.lines,
+           (unsigned long)terminal.stats.errors);
+    sd_stats_print();
+    return 0;
+}
+
+// sdtrace [save [arquivo]]: o registro dos últimos comandos do cartão pela
+// serial, TRACE_POR_PASSO linhas por volta do laço (para o sd_trace_decode),
+// ou num arquivo do cartão (ARQUIVO_TRACE se não for dado)
+static bool passo_sdtrace()
+{
+    return sd_trace_print_step(TRACE_POR_PASSO);
+}
+
+static int cmd_sdtrace(int argc, char **argv)
+{
+    if (argc == 1)
+    {
+        sd_trace_print_begin();
+        shell_job(&terminal, passo_sdtrace);
+        return 0;
+    }
+    if (0 != strcmp(argv[1], "save"))
+    {
+        printf("[ERRO] Use sdtrace ou sdtrace save [arquivo]\n");
+        return 1;
+    }
+    if (!cartao_disponivel(false))
+        return 1;
+    return salvar_trace(argc > 2 ? argv[2] : ARQUIVO_TRACE) == FR_OK ? 0 : 1;
+}
+
+// bench [KiB]: grava e lê de volta um arquivo de teste, BENCH_BLOCO bytes
+// por volta do laço; o tempo medido é só o das escritas e leituras
+static struct
+{
+    FIL fil;
+    uint32_t total, feito;
+    bool lendo;
+    uint64_t us_escrita, us_leitura;
+} bench;
+static uint8_t bench_buf[BENCH_BLOCO];
+
+static bool bench_fim(FRESULT fr)
+{
+    f_close(&bench.fil);
+    f_unlink("bench.bin");
+    if (FR_OK != fr)
+        printf("[ERRO] bench: %s (%d)\n", FRESULT_str(fr), fr);
+    else
+        printf("bench: %lu KiB, escrita %lu KB/s, leitura %lu KB/s\n",
+               (unsigned long)(bench.total / 1024),
+               (unsigned long)(bench.total * 1000ull / (bench.us_escrita ? bench.us_escrita : 1)),
+               (unsigned long)(bench.total * 1000ull / (bench.us_leitura ? bench.us_leitura : 1)));
+    return true;
+}
+
+static bool passo_bench()
+{
+    if (gravacao_ativa)
+        return bench_fim(FR_DENIED); // Gravação iniciada pelo botão durante o teste
+    uint64_t inicio = time_us_64();
+    UINT n = 0;
+    FRESULT fr;
+    if (!bench.lendo)
+    {
+        memset(bench_buf, (uint8_t)bench.feito, sizeof(bench_buf));
+        fr = f_write(&bench.fil, bench_buf, sizeof(bench_buf), &n);
+        if (FR_OK == fr && bench.feito + n >= bench.total)
+        {
+            // Escrita completa (com sync): passa à leitura
+            fr = f_close(&bench.fil);
+            if (FR_OK == fr)
+                fr = f_open(&bench.fil, "bench.bin", FA_READ);
+            bench.lendo = true;
+            n = bench.feito = 0;
+        }
+        bench.us_escrita += time_us_64() - inicio;
+    }
+    else
+    {
+        fr = f_read(&bench.fil, bench_buf, sizeof(bench_buf), &n);
+        bench.us_leitura += time_us_64() - inicio;
+        if (FR_OK == fr && !n)
+            fr = FR_INT_ERR;
+        if (FR_OK == fr && bench.feito + n >= bench.total)
+            return bench_fim(FR_OK);
+    }
+    bench.feito += n;
+    if (FR_OK == fr && !bench.lendo && sizeof(bench_buf) != n)
+        fr = FR_DENIED; // Cartão cheio
+    return FR_OK == fr ? false : bench_fim(fr);
+}
+
+static int cmd_bench(int argc, char **argv)
+{
+    uint32_t kib = 1024;
+    if (argc > 1 && !shell_parse_u32(argv[1], 4, 65536, &kib))
+    {
+        printf("[ERRO] Tamanho entre 4 e 65536 KiB\n");
+        return 1;
+    }
+    if (!cartao_disponivel(true))
+        return 1;
+    memset(&bench, 0, sizeof(bench));
+    bench.total = (kib * 1024 + BENCH_BLOCO - 1) / BENCH_BLOCO * BENCH_BLOCO;
+    FRESULT fr = f_open(&bench.fil, "bench.bin", FA_CREATE_ALWAYS | FA_WRITE);
+    if (FR_OK != fr)
+    {
+        printf("[ERRO] bench: %s (%d)\n", FRESULT_str(fr), fr);
+        return 1;
+    }
+    shell_job(&terminal, passo_bench);
+    return 0;
+}
+
+// Saída dos quadros da exportação e da telemetria: direto no driver USB, sem
+// a conversão de fim de linha do stdio nem a cópia para a UART
+static void saida_usb(const void *dados, size_t len)
+{
+    stdio_usb.out_chars((const char *)dados, (int)len);
+}
+
+// telemetry [on|off]: sem argumento, informa o estado
+static int cmd_telemetry(int argc, char **argv)
+{
+    const char *arg = argc > 1 ? argv[1] : NULL;
+    if (arg && 0 == strcmp(arg, "on"))
+    {
+        if (!telemetria_binaria)
+            telemetry_init(&telemetria, saida_usb);
+        telemetria_binaria = true;
+    }
+    else if (arg && 0 == strcmp(arg, "off"))
+    {
+        if (telemetria_binaria)
+        {
+            telemetry_flush(&telemetria);
+            printf("Telemetria: %lu quadros, %llu bytes\n", (unsigned long)telemetria.frames,
+                   (unsigned long long)telemetria.bytes);
+        }
+        telemetria_binaria = false;
+    }
+    else if (!arg)
+        printf("Telemetria binária: %s\n", telemetria_binaria ? "ligada" : "desligada");
+    else
+    {
+        printf("[ERRO] Uso: telemetry [on|off]\n");
+        return 1;
+    }
+    return 0;
+}
+
+// export <caminho> [início [bytes]]: sem bytes, até o fim do arquivo. A
+// transferência ocupa o laço até terminar, por isso só com a gravação parada.
+static int cmd_export(int argc, char **argv)
+{
+    uint32_t inicio = 0, bytes = 0;
+    if ((argc > 2 && !shell_parse_u32(argv[2], 0, UINT32_MAX, &inicio)) ||
+        (argc > 3 && !shell_parse_u32(argv[3], 0, UINT32_MAX, &bytes)))
+    {
+        printf("[ERRO] Início e bytes são números\n");
+        return 1;
+    }
+    if (!cartao_disponivel(true))
+        return 1;
+    export_stats_t est;
+    FRESULT fr = export_file(argv[1], inicio, bytes, saida_usb, &est);
+    if (FR_OK != fr)
+    {
+        printf("[ERRO] Exportação de %s: %s (%d)\n", argv[1], FRESULT_str(fr), fr);
+        return 1;
+    }
+    printf("Exportados %llu bytes em %lu ms (%lu KB/s)\n", (unsigned long long)est.bytes,
+           (unsigned long)(est.us / 1000),
+           (unsigned long)(est.us ? est.bytes * 1000 / est.us : 0));
+    return 0;
+}
+
+// usb [on|off]: o cartão como pendrive no PC; sem argumento, informa o estado
+static int cmd_usb(int argc, char **argv)
+{
+    const char *arg = argc > 1 ? argv[1] : NULL;
+    if (arg && 0 == strcmp(arg, "on"))
+    {
+        if (gravacao_ativa)
+        {
+            printf("[ERRO] Pare a gravação antes (stop)\n");
+            return 1;
+        }
+        modo_usb = true;
+    }
+    else if (arg && 0 == strcmp(arg, "off"))
+        modo_usb = false;
+    else if (!arg)
+    {
+        static const char *const estados[] = {"desligado", "em uso pelo PC", "ejetado"};
+        const msc_disk_stats_t *s = msc_disk_stats(&disco_usb);
+        printf("Pendrive: %s; %llu KB lidos, %llu KB gravados; no cartão: %lu leituras, "
+               "%lu escritas, %lu erros\n",
+               estados[msc_disk_state(&disco_usb)], (unsigned long long)(s->bytes_out / 1024),
+               (unsigned long long)(s->bytes_in / 1024), (unsigned long)s->reads,
+               (unsigned long)s->writes, (unsigned long)s->errors);
+    }
+    else
+    {
+        printf("[ERRO] Uso: usb [on|off]\n");
+        return 1;
+    }
+    return 0;
+}
+
+// dlog [text|bin]: saída das mensagens adiadas; sem argumento, os contadores
+static int cmd_dlog(int argc, char **argv)
+{
+    const char *arg = argc > 1 ? argv[1] : NULL;
+    if (arg && 0 == strcmp(arg, "text"))
+        dlog_set_output(DLOG_OUT_TEXT);
+    else if (arg && 0 == strcmp(arg, "bin"))
+        dlog_set_output(DLOG_OUT_HEX);
+    else if (!arg)
+    {
+        dlog_stats_t s;
+        dlog_get_stats(&s);
+        printf("Mensagens adiadas: %lu, %lu perdidas, pico %lu de %u; saída %s\n",
+               (unsigned long)s.logged, (unsigned long)s.dropped, (unsigned long)s.peak,
+               DLOG_DEPTH, DLOG_OUT_HEX == dlog_output() ? "bin" : "text");
+    }
+    else
+    {
+        printf("[ERRO] Uso: dlog [text|bin]\n");
+        return 1;
+    }
+    return 0;
+}
+
+// etapas [reset|tela]: tempos das etapas da amostra; "tela" alterna o display
+// entre os valores e os tempos
+static int cmd_etapas(int argc, char **argv)
+{
+    const char *arg = argc > 1 ? argv[1] : NULL;
+    if (!arg)
+        stage_timer_print(ETAPA_AMOSTRA);
+    else if (0 == strcmp(arg, "reset"))
+        stage_timer_reset();
+    else if (0 == strcmp(arg, "tela"))
+    {
+        tela_diagnostico = !tela_diagnostico;
+        printf("Display: %s\n", tela_diagnostico ? "tempos das etapas" : "valores");
+    }
+    else
+    {
+        printf("[ERRO] Uso: etapas [reset|tela]\n");
+        return 1;
+    }
+    return 0;
+}
+
+// prof [start [hz]|stop|dump|reset]: amostragem do PC por interrupção de
+// timer; o dump vai para o prof_report com o .elf, PERFIL_POR_PASSO pilhas
+// por volta do laço. Sem argumento, os contadores
+static bool passo_perfil()
+{
+    return prof_print_step(PERFIL_POR_PASSO);
+}
+
+static int cmd_prof(int argc, char **argv)
+{
+    const char *arg = argc > 1 ? argv[1] : NULL;
+    if (!arg)
+    {
+        prof_stats_t s;
+        prof_get_stats(&s);
+        printf("Perfil: %s, %lu amostras, %lu descartadas (tabela cheia), %lu perdidas\n",
+               s.hz ? "ligado" : "desligado", (unsigned long)s.samples, (unsigned long)s.dropped,
+               (unsigned long)s.missed);
+    }
+    else if (0 == strcmp(arg, "start"))
+    {
+        uint32_t hz = 1000;
+        if (argc > 2 && !shell_parse_u32(argv[2], 10, 10000, &hz))
+        {
+            printf("[ERRO] Frequência entre 10 e 10000 Hz\n");
+            return 1;
+        }
+        if (!prof_start(hz))
+        {
+            printf("[ERRO] Nenhum alarme de timer livre\n");
+            return 1;
+        }
+        printf("Perfil ligado: %lu Hz\n", (unsigned long)hz);
+    }
+    else if (0 == strcmp(arg, "stop") && argc < 3)
+        prof_stop();
+    else if (0 == strcmp(arg, "dump") && argc < 3)
+    {
+        prof_print_begin();
+        shell_job(&terminal, passo_perfil);
+    }
+    else if (0 == strcmp(arg, "reset") && argc < 3)
+        prof_reset();
+    else
+    {
+        printf("[ERRO] Uso: prof [start [hz]|stop|dump|reset]\n");
+        return 1;
+    }
+    return 0;
+}
+
+// kbench [kernel]: ciclos por operação das rotinas de CPU (kbench.h), um
+// kernel por volta do laço. Só com a gravação parada: a amostragem atrasaria
+// e as interrupções dela entrariam nas medidas.
+static struct
+{
+    const kbench_kernel_t *unico; // NULL: todos
+    unsigned proximo;
+} kbench;
+
+static bool passo_kbench()
+{
+    if (gravacao_ativa)
+    {
+        printf("[ERRO] kbench: gravação iniciada durante o teste\n");
+        return true;
+    }
+    const kbench_kernel_t *k = kbench.unico ? kbench.unico : &kbench_kernels[kbench.proximo];
+    kbench_result_t r;
+    if (kbench_medir(k, &r))
+        kbench_imprimir(k, &r);
+    else
+        printf("[ERRO] kbench: %s rápido demais para medir\n", k->nome);
+    return kbench.unico || ++kbench.proximo >= kbench_num_kernels;
+}
+
+static int cmd_kbench(int argc, char **argv)
+{
+    if (gravacao_ativa || captura_dados)
+    {
+        printf("[ERRO] Pare a gravação antes (stop)\n");
+        return 1;
+    }
+    kbench.unico = NULL;
+    kbench.proximo = 0;
+    if (argc > 1 && !(kbench.unico = kbench_buscar(argv[1])))
+    {
+        printf("[ERRO] Kernels:");
+        for (unsigned i = 0; i < kbench_num_kernels; ++i)
+            printf(" %s", kbench_kernels[i].nome);
+        printf("\n");
+        return 1;
+    }
+    kbench_imprimir_cabecalho();
+    shell_job(&terminal, passo_kbench);
+    return 0;
+}
+
+static const shell_cmd_t comandos[] = {
+    {"start", NULL, "inicia a gravação (botão A)", 0, 0, cmd_start},
+    {"stop", NULL, "para a gravação", 0, 0, cmd_stop},
+    {"mount", NULL, "monta o cartão (botão B)", 0, 0, cmd_mount},
+    {"unmount", NULL, "desmonta o cartão", 0, 0, cmd_unmount},
+    {"rate", "<ms>", "intervalo entre amostras", 1, 1, cmd_rate},
+    {"gain", "<1|4|16|60>", "ganho do sensor", 1, 1, cmd_gain},
+    {"atime", "<ms>", "tempo de integração do sensor (3 a 614 ms)", 1, 1, cmd_atime},
+    {"ls", "[dir]", "lista um diretório do cartão", 0, 1, cmd_ls},
+    {"stat", "<caminho>", "tamanho e data de um arquivo", 1, 1, cmd_stat},
+    {"metrics", "[reset]", "contadores e latências do cartão", 0, 1, cmd_metrics},
+    {"sdtrace", "[save [arquivo]]", "últimos comandos do cartão (sd_trace_decode)", 0, 2, cmd_sdtrace},
+    {"bench", "[KiB]", "taxa de escrita e leitura do cartão", 0, 1, cmd_bench},
+    {"telemetry", "[on|off]", "amostras em quadros binários pela USB", 0, 1, cmd_telemetry},
+    {"export", "<caminho> [início [bytes]]", "envia um arquivo pela USB", 1, 3, cmd_export},
+    {"usb", "[on|off]", "o cartão como pendrive no PC", 0, 1, cmd_usb},
+    {"dlog", "[text|bin]", "mensagens adiadas em texto ou para o dlog_decode", 0, 1, cmd_dlog},
+    {"etapas", "[reset|tela]", "tempo de cada etapa da amostra", 0, 1, cmd_etapas},
+    {"prof", "[start [hz]|stop|dump|reset]", "onde o processador passa o tempo (prof_report)", 0, 2, cmd_prof},
+    {"kbench", "[kernel]", "ciclos por operação das rotinas de CPU", 0, 1, cmd_kbench},
+};
+
+static void iniciar_terminal()
+{
+    shell_init(&terminal, comandos, sizeof(comandos) / sizeof(comandos[0]), ler_caractere, printf);
+}
+
+// Passa o cartão ao PC. O FatFs larga o volume sem gravar o cache de
+// montagem, que fica marcado como sujo desde a montagem: o PC pode alterar o
+// volume, e a próxima montagem não deve confiar no registro.
+static void entrar_modo_usb()
+{
+    sd_card_t *pSD = sd_get_by_num(0);
+    if (gravacao_ativa || captura_dados)
+    {
+        printf("[ERRO] Pare a gravação antes (stop)\n");
+        modo_usb = false;
+        return;
+    }
+
+    // O FatFs não é reentrante: espera a montagem em segundo plano (core 1)
+    FRESULT fr;
+    while (mount_cache_background_busy())
+        sleep_ms(10);
+    mount_cache_background_done(&fr);
+    if (!pSD->fatfs.fs_type)
+        mount_cache_mount(pSD, false, NULL); // Só marca o registro; falha num cartão sem formatação
+    f_unmount(pSD->pcName);
+    pSD->mounted = false;
+    sd_montado = false;
+    montar_sd = false;
+
+    DRESULT dr = msc_disk_attach(&disco_usb);
+    if (RES_OK != dr)
+    {
+        printf("[ERRO] Cartão indisponível para a USB (%d)\n", dr);
+        modo_usb = false;
+        return;
+    }
+    printf("Cartão SD no PC como pendrive (%lu MB). Ejete-o no PC ou use \"usb off\".\n",
+           (unsigned long)(disco_usb.sectors / 2048));
+
+    // LED azul: cartão com o PC
+    gpio_put(LED_PIN_BLUE, 1);
+    gpio_put(LED_PIN_RED, 0);
+    gpio_put(LED_PIN_GREEN, 0);
+
+    ssd1306_fill(&ssd, false);
+    ssd1306_draw_string(&ssd, "Cartao SD", 0, 0);
+    ssd1306_draw_string(&ssd, "no PC (USB)", 0, 10);
+    ssd1306_send_data(&ssd);
+}
+
+// Devolve o cartão: grava o que estiver no buffer de escrita e sincroniza.
+// Depois disso ele pode ser montado de novo (botão B ou "mount").
+static void sair_modo_usb()
+{
+    bool ejetado = MSC_DISK_EJECTED == msc_disk_state(&disco_usb);
+    DRESULT dr = msc_disk_detach(&disco_usb);
+    modo_usb = false;
+    sd_get_by_num(0)->m_Status |= STA_NOINIT; // Reinicializado na próxima montagem
+    if (RES_OK != dr)
+        printf("[ERRO] Falha ao gravar os últimos dados do PC no cartão (%d)\n", dr);
+    else if (!ejetado)
+        printf("[AVISO] Cartão retirado do PC sem ejetar\n");
+    const msc_disk_stats_t *s = msc_disk_stats(&disco_usb);
+    printf("Cartão SD de volta: %llu KB lidos e %llu KB gravados pelo PC\n",
+           (unsigned long long)(s->bytes_out / 1024), (unsigned long long)(s->bytes_in / 1024));
+
+    // LED amarelo: desmontado
+    gpio_put(LED_PIN_BLUE, 0);
+    gpio_put(LED_PIN_RED, 1);
+    gpio_put(LED_PIN_GREEN, 1);
+
+    ssd1306_fill(&ssd, false);
+    ssd1306_draw_string(&ssd, "Cartao SD", 0, 0);
+    ssd1306_draw_string(&ssd, "Desmontado", 0, 10);
     ssd1306_send_data(&ssd);
 }
 
@@ -493,7 +1718,7 @@ void gpio_irq_handler(uint gpio, uint32_t events)
         if (events & GPIO_IRQ_EDGE_FALL)
         {
             captura_dados = !captura_dados; // Alterna entre iniciar/parar gravação
-            printf("Botão A pressionado. Captura dados: %s\n", captura_dados ? "ATIVADA" : "DESATIVADA");
+            DLOG_PRINTF("Botão A pressionado. Captura dados: %s\n", captura_dados ? "ATIVADA" : "DESATIVADA");
         }
     }
     else if (gpio == BOTAO_B_PIN)
@@ -501,7 +1726,7 @@ void gpio_irq_handler(uint gpio, uint32_t events)
         if (events & GPIO_IRQ_EDGE_FALL)
         {
             montar_sd = !montar_sd; // Alterna entre montar/desmontar SD
-            printf("Botão B pressionado. SD: %s\n", montar_sd ? "MONTAR" : "DESMONTAR");
+            DLOG_PRINTF("Botão B pressionado. SD: %s\n", montar_sd ? "MONTAR" : "DESMONTAR");
         }
     }
 }
@@ -0,0 +1,155 @@
+/* ramdisk.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+//
+#include "ff.h"
+#include "diskio.h"
+//
+#include "ramdisk.h"
+
+typedef struct {
+    uint8_t *data;
+    uint64_t sectors;
+    ramdisk_stats_t stats;
+    ramdisk_write_hook_t hook;
+    void *hook_ctx;
+    bool removed;
+} ramdisk_t;
+
+static ramdisk_t disks[RAMDISK_MAX_DRIVES];
+
+static ramdisk_t *get(uint8_t pdrv) {
+    if (pdrv >= RAMDISK_MAX_DRIVES || !disks[pdrv].data) return NULL;
+    return &disks[pdrv];
+}
+
+// The drive as seen by FatFs: missing while "removed"
+static ramdisk_t *get_io(uint8_t pdrv) {
+    ramdisk_t *d = get(pdrv);
+    return d && !d->removed ? d : NULL;
+}
+
+bool ramdisk_create(uint8_t pdrv, uint64_t sectors) {
+    if (pdrv >= RAMDISK_MAX_DRIVES) return false;
+    ramdisk_destroy(pdrv);
+    disks[pdrv].data = calloc(sectors, RAMDISK_SECTOR_SIZE);
+    if (!disks[pdrv].data) return false;
+    disks[pdrv].sectors = sectors;
+    return true;
+}
+
+bool ramdisk_load(uint8_t pdrv, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    bool ok = size > 0 && 0 == size % RAMDISK_SECTOR_SIZE &&
+              ramdisk_create(pdrv, size / RAMDISK_SECTOR_SIZE) &&
+              1 == fread(disks[pdrv].data, size, 1, f);
+    fclose(f);
+    return ok;
+}
+
+bool ramdisk_save(uint8_t pdrv, const char *path) {
+    ramdisk_t *d = get(pdrv);
+    if (!d) return false;
+    FILE *f = fopen(path, "wb");
+    if (!f) return false;
+    bool ok = 1 == fwrite(d->data, d->sectors * RAMDISK_SECTOR_SIZE, 1, f);
+    return 0 == fclose(f) && ok;
+}
+
+void ramdisk_destroy(uint8_t pdrv) {
+    if (pdrv >= RAMDISK_MAX_DRIVES) return;
+    free(disks[pdrv].data);
+    memset(&disks[pdrv], 0, sizeof disks[pdrv]);
+}
+
+uint8_t *ramdisk_data(uint8_t pdrv) {
+    ramdisk_t *d = get(pdrv);
+    return d ? d->data : NULL;
+}
+uint64_t ramdisk_sectors(uint8_t pdrv) {
+    ramdisk_t *d = get(pdrv);
+    return d ? d->sectors : 0;
+}
+ramdisk_stats_t *ramdisk_stats(uint8_t pdrv) {
+    return pdrv < RAMDISK_MAX_DRIVES ? &disks[pdrv].stats : NULL;
+}
+void ramdisk_reset_stats(uint8_t pdrv) {
+    if (pdrv < RAMDISK_MAX_DRIVES) memset(&disks[pdrv].stats, 0, sizeof disks[pdrv].stats);
+}
+void ramdisk_set_write_hook(uint8_t pdrv, ramdisk_write_hook_t hook, void *ctx) {
+    if (pdrv >= RAMDISK_MAX_DRIVES) return;
+    disks[pdrv].hook = hook;
+    disks[pdrv].hook_ctx = ctx;
+}
+
+void ramdisk_set_present(uint8_t pdrv, bool present) {
+    if (pdrv < RAMDISK_MAX_DRIVES) disks[pdrv].removed = !present;
+}
+
+/* FatFs disk I/O interface */
+
+DSTATUS disk_status(BYTE pdrv) { return get_io(pdrv) ? 0 : STA_NOINIT | STA_NODISK; }
+
+DSTATUS disk_initialize(BYTE pdrv) { return disk_status(pdrv); }
+
+DRESULT disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count) {
+    ramdisk_t *d = get_io(pdrv);
+    if (!d) return RES_NOTRDY;
+    if (sector + count > d->sectors) return RES_PARERR;
+    memcpy(buff, d->data + sector * RAMDISK_SECTOR_SIZE, (size_t)count * RAMDISK_SECTOR_SIZE);
+    d->stats.reads++;
+    d->stats.sectors_read += count;
+    return RES_OK;
+}
+
+DRESULT disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count) {
+    ramdisk_t *d = get_io(pdrv);
+    if (!d) return RES_NOTRDY;
+    if (sector + count > d->sectors) return RES_PARERR;
+    d->stats.writes++;
+    for (UINT i = 0; i < count; ++i) {
+        if (d->hook && !d->hook(pdrv, sector + i, buff + (size_t)i * RAMDISK_SECTOR_SIZE,
+                                d->hook_ctx))
+            return RES_ERROR;
+        memcpy(d->data + (sector + i) * RAMDISK_SECTOR_SIZE,
+               buff + (size_t)i * RAMDISK_SECTOR_SIZE, RAMDISK_SECTOR_SIZE);
+        d->stats.sectors_written++;
+    }
+    return RES_OK;
+}
+
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff) {
+    ramdisk_t *d = get_io(pdrv);
+    if (!d) return RES_NOTRDY;
+    switch (cmd) {
+        case CTRL_SYNC:
+            return RES_OK;
+        case GET_SECTOR_COUNT:
+            *(LBA_t *)buff = d->sectors;
+            return RES_OK;
+        case GET_BLOCK_SIZE:
+            *(DWORD *)buff = 1;
+            return RES_OK;
+        default:
+            return RES_PARERR;
+    }
+}
+
+// Called by FatFs: fixed time stamp (2022-01-01 00:00:00) for reproducible images
+DWORD get_fattime(void) { return ((DWORD)(2022 - 1980) << 25) | (1UL << 21) | (1UL << 16); }
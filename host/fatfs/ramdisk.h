@@ -0,0 +1,64 @@
+/* ramdisk.h
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+// Host (Linux) disk I/O glue for FatFs: each physical drive is a RAM image
+// that can be loaded from and saved to a file. Every access is counted so
+// tools can report I/O cost independently of host speed.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RAMDISK_SECTOR_SIZE 512
+#define RAMDISK_MAX_DRIVES 2
+
+typedef struct {
+    uint64_t reads;           // disk_read() calls
+    uint64_t writes;          // disk_write() calls
+    uint64_t sectors_read;
+    uint64_t sectors_written;
+} ramdisk_stats_t;
+
+// Creates a zero-filled image of the given number of sectors
+bool ramdisk_create(uint8_t pdrv, uint64_t sectors);
+// Loads a whole image file; its size must be a multiple of the sector size
+bool ramdisk_load(uint8_t pdrv, const char *path);
+bool ramdisk_save(uint8_t pdrv, const char *path);
+void ramdisk_destroy(uint8_t pdrv);
+
+uint8_t *ramdisk_data(uint8_t pdrv);
+uint64_t ramdisk_sectors(uint8_t pdrv);
+
+ramdisk_stats_t *ramdisk_stats(uint8_t pdrv);
+void ramdisk_reset_stats(uint8_t pdrv);
+
+// Optional hook called before every sector written, e.g. to inject faults.
+// data is the sector about to be written. Returning false fails the write;
+// the hook may have changed the image sector itself (ramdisk_data()) to
+// simulate a torn write.
+typedef bool (*ramdisk_write_hook_t)(uint8_t pdrv, uint64_t sector, const uint8_t *data,
+                                     void *ctx);
+void ramdisk_set_write_hook(uint8_t pdrv, ramdisk_write_hook_t hook, void *ctx);
+
+// Emulates removing and reinserting the card: while not present, every disk
+// I/O call fails with RES_NOTRDY / STA_NODISK. The image is kept.
+void ramdisk_set_present(uint8_t pdrv, bool present);
+
+#ifdef __cplusplus
+}
+#endif
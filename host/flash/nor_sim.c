@@ -0,0 +1,110 @@
+/* nor_sim.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+#include <stdlib.h>
+#include <string.h>
+//
+#include "nor_sim.h"
+
+// xorshift32: reproducible tearing for a given seed
+static uint32_t next_rand(nor_sim_t *nor) {
+    uint32_t x = nor->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return nor->rng = x;
+}
+
+// Counts down to the cut. Returns true if this operation is the torn one.
+static bool torn(nor_sim_t *nor) {
+    if (nor->cut_in < 0) return false;
+    if (nor->cut_in--) return false;
+    nor->off = true;
+    return true;
+}
+
+static int sim_erase(void *ctx, uint32_t offset) {
+    nor_sim_t *nor = ctx;
+    if (nor->off || offset % FLASH_LOG_SECTOR_SIZE || offset >= nor->size) return -1;
+    uint8_t *p = nor->data + offset;
+    nor->now_us += nor->erase_us;
+    nor->erases++;
+    nor->erase_counts[offset / FLASH_LOG_SECTOR_SIZE]++;
+    if (torn(nor)) {
+        // Part of the sector erased, the rest in any state
+        for (uint32_t i = 0; i < FLASH_LOG_SECTOR_SIZE; ++i) {
+            uint32_t r = next_rand(nor);
+            if (r & 1) p[i] = 0xFF;
+            else if (r & 2) p[i] = (uint8_t)(r >> 8);
+        }
+        return -1;
+    }
+    memset(p, 0xFF, FLASH_LOG_SECTOR_SIZE);
+    return 0;
+}
+
+static int sim_program(void *ctx, uint32_t offset, const uint8_t *data) {
+    nor_sim_t *nor = ctx;
+    if (nor->off || offset % FLASH_LOG_PAGE_SIZE || offset >= nor->size) return -1;
+    uint8_t *p = nor->data + offset;
+    nor->now_us += nor->program_us;
+    nor->programs++;
+    bool cut = torn(nor);
+    for (uint32_t i = 0; i < FLASH_LOG_PAGE_SIZE; ++i) {
+        if (0xFF != data[i] && (data[i] & ~p[i])) nor->violations++;  // Would not read back
+        uint8_t clear = ~data[i];
+        if (cut) clear &= (uint8_t)next_rand(nor);  // Only some bits made it
+        p[i] &= ~clear;
+    }
+    return cut ? -1 : 0;
+}
+
+bool nor_sim_init(nor_sim_t *nor, uint32_t size, uint32_t seed) {
+    memset(nor, 0, sizeof *nor);
+    if (!size || size % FLASH_LOG_SECTOR_SIZE) return false;
+    nor->data = malloc(size);
+    nor->erase_counts = calloc(size / FLASH_LOG_SECTOR_SIZE, sizeof *nor->erase_counts);
+    if (!nor->data || !nor->erase_counts) {
+        nor_sim_free(nor);
+        return false;
+    }
+    memset(nor->data, 0xFF, size);
+    nor->size = size;
+    nor->erase_us = NOR_SIM_ERASE_US;
+    nor->program_us = NOR_SIM_PROGRAM_US;
+    nor->cut_in = -1;
+    nor->rng = seed ? seed : 1;
+    return true;
+}
+
+void nor_sim_free(nor_sim_t *nor) {
+    free(nor->data);
+    free(nor->erase_counts);
+    memset(nor, 0, sizeof *nor);
+}
+
+void nor_sim_dev(nor_sim_t *nor, flash_log_dev_t *dev) {
+    dev->erase = sim_erase;
+    dev->program = sim_program;
+    dev->ctx = nor;
+    dev->base = nor->data;
+    dev->size = nor->size;
+}
+
+void nor_sim_cut_after(nor_sim_t *nor, uint32_t ops) { nor->cut_in = ops; }
+
+void nor_sim_power_on(nor_sim_t *nor) {
+    nor->cut_in = -1;
+    nor->off = false;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,69 @@
+/* nor_sim.h
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Simulated NOR flash for host builds, behind a flash_log_dev_t.
+//
+// Erase sets a 4 KiB sector to 0xFF; program ANDs a 256 byte page into the
+// array, so bits only go from 1 to 0, as on the chip: 0xFF bytes leave the
+// flash alone, and any other byte that would not read back as written is
+// counted as a violation. Every operation adds its typical duration to a
+// virtual clock; the defaults are the W25Q16JV's on the Pico W.
+//
+// A power cut can be scheduled: the chosen operation is torn (an erase
+// leaves random bytes behind, a program clears only some of its bits) and
+// everything after it fails until nor_sim_power_on().
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+//
+#include "flash_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NOR_SIM_ERASE_US 45000   // Sector erase, typical
+#define NOR_SIM_PROGRAM_US 400   // Page program, typical
+
+typedef struct nor_sim {
+    uint8_t *data;
+    uint32_t size;
+    uint32_t *erase_counts;  // Per sector
+    uint32_t erase_us;
+    uint32_t program_us;
+    uint64_t now_us;         // Virtual time spent in erase and program
+    uint64_t erases;
+    uint64_t programs;
+    uint64_t violations;     // Bytes programmed over non-erased flash
+    int64_t cut_in;          // Operations left before the torn one; < 0: none
+    bool off;                // After the cut
+    uint32_t rng;
+} nor_sim_t;
+
+// A blank (all 0xFF) chip of size bytes, a multiple of FLASH_LOG_SECTOR_SIZE
+bool nor_sim_init(nor_sim_t *nor, uint32_t size, uint32_t seed);
+void nor_sim_free(nor_sim_t *nor);
+
+// dev reads nor->data directly and erases/programs through nor
+void nor_sim_dev(nor_sim_t *nor, flash_log_dev_t *dev);
+
+// Tears the operation after the next ops ones, then fails every later one
+void nor_sim_cut_after(nor_sim_t *nor, uint32_t ops);
+void nor_sim_power_on(nor_sim_t *nor);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* [] END OF FILE */
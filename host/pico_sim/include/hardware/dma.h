@@ -0,0 +1,64 @@
+// Pico SDK stand-in for the host simulation. Starting a pair of channels
+// between memory and an SPI data register runs the whole exchange at once
+// (the bus time goes on the virtual clock) and then raises the channels'
+// completion interrupts. The status bits are cleared when the handlers
+// return: a plain store cannot be told from the hardware's write-one-to-clear.
+#pragma once
+
+#include "pico/types.h"
+
+#define NUM_DMA_CHANNELS 12
+
+enum dma_channel_transfer_size { DMA_SIZE_8 = 0, DMA_SIZE_16 = 1, DMA_SIZE_32 = 2 };
+enum { DREQ_SPI0_TX = 16, DREQ_SPI0_RX = 17, DREQ_SPI1_TX = 18, DREQ_SPI1_RX = 19 };
+
+typedef struct {
+    bool read_increment;
+    bool write_increment;
+    enum dma_channel_transfer_size size;
+    uint dreq;
+} dma_channel_config;
+
+typedef struct {
+    io_rw_32 intr, inte0, intf0, ints0;
+    io_rw_32 inte1, intf1, ints1;
+} dma_hw_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern dma_hw_t *dma_hw;
+
+int dma_claim_unused_channel(bool required);
+void dma_channel_unclaim(uint channel);
+dma_channel_config dma_channel_get_default_config(uint channel);
+static inline void channel_config_set_read_increment(dma_channel_config *c, bool incr) {
+    c->read_increment = incr;
+}
+static inline void channel_config_set_write_increment(dma_channel_config *c, bool incr) {
+    c->write_increment = incr;
+}
+static inline void channel_config_set_transfer_data_size(dma_channel_config *c,
+                                                         enum dma_channel_transfer_size size) {
+    c->size = size;
+}
+static inline void channel_config_set_dreq(dma_channel_config *c, uint dreq) { c->dreq = dreq; }
+void dma_channel_configure(uint channel, const dma_channel_config *config,
+                           volatile void *write_addr, const volatile void *read_addr,
+                           uint transfer_count, bool trigger);
+void dma_start_channel_mask(uint32_t chan_mask);
+bool dma_channel_is_busy(uint channel);
+static inline void dma_channel_wait_for_finish_blocking(uint channel) { (void)channel; }
+void dma_channel_set_irq0_enabled(uint channel, bool enabled);
+void dma_channel_set_irq1_enabled(uint channel, bool enabled);
+static inline bool dma_channel_get_irq0_status(uint channel) {
+    return dma_hw->ints0 & (1u << channel);
+}
+static inline bool dma_channel_get_irq1_status(uint channel) {
+    return dma_hw->ints1 & (1u << channel);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,27 @@
+// Pico SDK stand-in for the host simulation: the XIP window is an array, so
+// that reads through XIP_BASE see what flash_range_program() wrote
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FLASH_PAGE_SIZE (1u << 8)
+#define FLASH_SECTOR_SIZE (1u << 12)
+#define FLASH_BLOCK_SIZE (1u << 16)
+#ifndef PICO_FLASH_SIZE_BYTES
+#define PICO_FLASH_SIZE_BYTES (2u * 1024 * 1024)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern uint8_t sim_flash[PICO_FLASH_SIZE_BYTES];
+#define XIP_BASE ((uintptr_t)sim_flash)
+
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,62 @@
+// Pico SDK stand-in for the host simulation: pin levels, and edge interrupts
+// raised by inputs that sim_gpio_input() changes
+#pragma once
+
+#include "pico/types.h"
+
+#define NUM_BANK0_GPIOS 30
+#define GPIO_OUT 1
+#define GPIO_IN 0
+
+enum gpio_function {
+    GPIO_FUNC_SPI = 1,
+    GPIO_FUNC_UART = 2,
+    GPIO_FUNC_I2C = 3,
+    GPIO_FUNC_PWM = 4,
+    GPIO_FUNC_SIO = 5,
+    GPIO_FUNC_NULL = 0x1f,
+};
+enum gpio_irq_level {
+    GPIO_IRQ_LEVEL_LOW = 0x1u,
+    GPIO_IRQ_LEVEL_HIGH = 0x2u,
+    GPIO_IRQ_EDGE_FALL = 0x4u,
+    GPIO_IRQ_EDGE_RISE = 0x8u,
+};
+enum gpio_drive_strength {
+    GPIO_DRIVE_STRENGTH_2MA = 0,
+    GPIO_DRIVE_STRENGTH_4MA,
+    GPIO_DRIVE_STRENGTH_8MA,
+    GPIO_DRIVE_STRENGTH_12MA,
+};
+enum gpio_slew_rate { GPIO_SLEW_RATE_SLOW = 0, GPIO_SLEW_RATE_FAST = 1 };
+
+typedef void (*gpio_irq_callback_t)(uint gpio, uint32_t event_mask);
+#ifndef IRQ_HANDLER_T_DEFINED
+#define IRQ_HANDLER_T_DEFINED
+typedef void (*irq_handler_t)(void);
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void gpio_init(uint gpio);
+void gpio_set_function(uint gpio, enum gpio_function fn);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_put(uint gpio, bool value);
+bool gpio_get(uint gpio);
+void gpio_set_pulls(uint gpio, bool up, bool down);
+static inline void gpio_pull_up(uint gpio) { gpio_set_pulls(gpio, true, false); }
+static inline void gpio_pull_down(uint gpio) { gpio_set_pulls(gpio, false, true); }
+void gpio_set_drive_strength(uint gpio, enum gpio_drive_strength drive);
+void gpio_set_slew_rate(uint gpio, enum gpio_slew_rate slew);
+void gpio_set_irq_enabled(uint gpio, uint32_t events, bool enabled);
+void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t events, bool enabled,
+                                        gpio_irq_callback_t callback);
+void gpio_add_raw_irq_handler(uint gpio, irq_handler_t handler);
+uint32_t gpio_get_irq_event_mask(uint gpio);
+void gpio_acknowledge_irq(uint gpio, uint32_t events);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,29 @@
+// Pico SDK stand-in for the host simulation: transfers go to the devices
+// attached with sim_i2c_attach() and take their bus time on the virtual clock
+#pragma once
+
+#include "pico/types.h"
+
+typedef struct i2c_inst {
+    uint index;
+    uint baudrate;
+} i2c_inst_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern i2c_inst_t i2c0_inst, i2c1_inst;
+#define i2c0 (&i2c0_inst)
+#define i2c1 (&i2c1_inst)
+
+uint i2c_init(i2c_inst_t *i2c, uint baudrate);
+uint i2c_set_baudrate(i2c_inst_t *i2c, uint baudrate);
+static inline uint i2c_hw_index(i2c_inst_t *i2c) { return i2c->index; }
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len,
+                       bool nostop);
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop);
+
+#ifdef __cplusplus
+}
+#endif
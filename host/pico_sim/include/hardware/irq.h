@@ -0,0 +1,39 @@
+// Pico SDK stand-in for the host simulation. Handlers run synchronously when
+// the simulated hardware raises their interrupt.
+#pragma once
+
+#include "pico/types.h"
+
+#ifndef IRQ_HANDLER_T_DEFINED
+#define IRQ_HANDLER_T_DEFINED
+typedef void (*irq_handler_t)(void);
+#endif
+
+enum {
+    TIMER_IRQ_0 = 0,
+    TIMER_IRQ_1,
+    TIMER_IRQ_2,
+    TIMER_IRQ_3,
+    DMA_IRQ_0 = 11,
+    DMA_IRQ_1 = 12,
+    IO_IRQ_BANK0 = 13,
+    NUM_IRQS = 32,
+};
+
+#define PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY 0x80
+#define PICO_DEFAULT_IRQ_PRIORITY 0x80
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void irq_set_enabled(uint num, bool enabled);
+bool irq_is_enabled(uint num);
+void irq_set_priority(uint num, uint8_t hardware_priority);
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority);
+void irq_remove_handler(uint num, irq_handler_t handler);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,4 @@
+// Pico SDK stand-in for the host simulation
+#pragma once
+
+#include "pico/types.h"
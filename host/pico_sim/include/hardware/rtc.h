@@ -0,0 +1,18 @@
+// Pico SDK stand-in for the host simulation: runs on the virtual clock from
+// the date set with rtc_set_datetime() (or sim_rtc_set() before boot)
+#pragma once
+
+#include "pico/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void rtc_init(void);
+bool rtc_set_datetime(const datetime_t *t);
+bool rtc_get_datetime(datetime_t *t);
+bool rtc_running(void);
+
+#ifdef __cplusplus
+}
+#endif
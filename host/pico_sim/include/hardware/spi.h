@@ -0,0 +1,43 @@
+// Pico SDK stand-in for the host simulation: every byte is exchanged with the
+// device attached with sim_spi_attach() and takes its bus time on the virtual
+// clock. DMA to and from the data register does the same (hardware/dma.h).
+#pragma once
+
+#include "pico/types.h"
+
+typedef struct {
+    io_rw_32 dr;
+} spi_hw_t;
+
+typedef struct spi_inst {
+    uint index;
+    uint baudrate;
+    spi_hw_t hw;
+} spi_inst_t;
+
+typedef enum { SPI_CPHA_0 = 0, SPI_CPHA_1 = 1 } spi_cpha_t;
+typedef enum { SPI_CPOL_0 = 0, SPI_CPOL_1 = 1 } spi_cpol_t;
+typedef enum { SPI_LSB_FIRST = 0, SPI_MSB_FIRST = 1 } spi_order_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern spi_inst_t spi0_inst, spi1_inst;
+#define spi0 (&spi0_inst)
+#define spi1 (&spi1_inst)
+
+uint spi_init(spi_inst_t *spi, uint baudrate);
+uint spi_set_baudrate(spi_inst_t *spi, uint baudrate);
+static inline uint spi_get_baudrate(const spi_inst_t *spi) { return spi->baudrate; }
+static inline uint spi_get_index(const spi_inst_t *spi) { return spi->index; }
+static inline spi_hw_t *spi_get_hw(spi_inst_t *spi) { return &spi->hw; }
+void spi_set_format(spi_inst_t *spi, uint data_bits, spi_cpol_t cpol, spi_cpha_t cpha,
+                    spi_order_t order);
+int spi_write_blocking(spi_inst_t *spi, const uint8_t *src, size_t len);
+int spi_read_blocking(spi_inst_t *spi, uint8_t repeated_tx_data, uint8_t *dst, size_t len);
+int spi_write_read_blocking(spi_inst_t *spi, const uint8_t *src, uint8_t *dst, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
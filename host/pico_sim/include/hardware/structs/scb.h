@@ -0,0 +1,10 @@
+// Pico SDK stand-in for the host simulation
+#pragma once
+
+#include "pico/types.h"
+
+typedef struct {
+    io_rw_32 cpuid, icsr, vtor, aircr, scr;
+} armv6m_scb_hw_t;
+
+extern armv6m_scb_hw_t *scb_hw;
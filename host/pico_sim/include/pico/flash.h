@@ -0,0 +1,17 @@
+// Pico SDK stand-in for the host simulation: there is no other core to lock
+// out, the function just runs
+#pragma once
+
+#include "pico/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int flash_safe_execute(void (*func)(void *), void *param, uint32_t enter_exit_timeout_ms);
+bool flash_safe_execute_core_init(void);
+bool flash_safe_execute_core_deinit(void);
+
+#ifdef __cplusplus
+}
+#endif
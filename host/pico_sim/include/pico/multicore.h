@@ -0,0 +1,16 @@
+// Pico SDK stand-in for the host simulation: core 1's entry runs to its end
+// on the one thread, inside multicore_launch_core1()
+#pragma once
+
+#include "pico/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void multicore_reset_core1(void);
+void multicore_launch_core1(void (*entry)(void));
+
+#ifdef __cplusplus
+}
+#endif
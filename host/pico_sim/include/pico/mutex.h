@@ -0,0 +1,26 @@
+// Pico SDK stand-in for the host simulation: one thread, so locks only count
+#pragma once
+
+#include "pico/types.h"
+
+typedef struct {
+    int8_t owner;  // -1: free
+    bool init;
+    uint32_t depth;
+} mutex_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void mutex_init(mutex_t *mtx);
+static inline bool mutex_is_initialized(mutex_t *mtx) { return mtx->init; }
+void mutex_enter_blocking(mutex_t *mtx);
+bool mutex_try_enter(mutex_t *mtx, uint32_t *owner_out);
+void mutex_exit(mutex_t *mtx);
+
+#define auto_init_mutex(name) static mutex_t name = {-1, true, 0}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,26 @@
+// Pico SDK stand-in for the host simulation. Nothing can release a semaphore
+// while the one thread waits on it: a wait that would block runs the virtual
+// clock to its timeout.
+#pragma once
+
+#include "pico/types.h"
+
+typedef struct {
+    int16_t permits;
+    int16_t max_permits;
+} semaphore_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void sem_init(semaphore_t *sem, int16_t initial_permits, int16_t max_permits);
+int sem_available(semaphore_t *sem);
+bool sem_release(semaphore_t *sem);
+void sem_reset(semaphore_t *sem, int16_t permits);
+void sem_acquire_blocking(semaphore_t *sem);
+bool sem_acquire_timeout_ms(semaphore_t *sem, uint32_t timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,17 @@
+// Pico SDK stand-in for the host simulation: bytes sent straight to the USB
+// serial are counted (sim_stats()) and dropped
+#pragma once
+
+typedef struct stdio_driver {
+    void (*out_chars)(const char *buf, int len);
+} stdio_driver_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern stdio_driver_t stdio_usb;
+
+#ifdef __cplusplus
+}
+#endif
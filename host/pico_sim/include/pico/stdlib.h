@@ -0,0 +1,23 @@
+// Pico SDK stand-in for the host simulation. printf() is the host's: the
+// firmware's serial output goes to the simulation's stdout.
+#pragma once
+
+#include <stdio.h>
+//
+#include "hardware/gpio.h"
+#include "pico/sync.h"
+#include "pico/time.h"
+#include "pico/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool stdio_init_all(void);
+void stdio_flush(void);
+// Serial input scripted with sim_serial_input()
+int getchar_timeout_us(uint32_t timeout_us);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,34 @@
+// Pico SDK stand-in for the host simulation: one core, interrupts run inside
+// the calls that advance the virtual clock
+#pragma once
+
+#include "pico/mutex.h"
+#include "pico/sem.h"
+#include "pico/types.h"
+
+typedef volatile uint32_t spin_lock_t;
+
+static inline void __mem_fence_release(void) { __atomic_thread_fence(__ATOMIC_RELEASE); }
+static inline void __mem_fence_acquire(void) { __atomic_thread_fence(__ATOMIC_ACQUIRE); }
+static inline void __dmb(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+static inline void __wfe(void) {}
+static inline void __sev(void) {}
+static inline uint get_core_num(void) { return 0; }
+static inline uint32_t save_and_disable_interrupts(void) { return 0; }
+static inline void restore_interrupts(uint32_t status) { (void)status; }
+static inline int spin_lock_claim_unused(bool required) {
+    (void)required;
+    return 0;
+}
+static inline spin_lock_t *spin_lock_init(uint lock_num) {
+    static spin_lock_t locks[32];
+    return &locks[lock_num & 31];
+}
+static inline uint32_t spin_lock_blocking(spin_lock_t *lock) {
+    *lock = 1;
+    return 0;
+}
+static inline void spin_unlock(spin_lock_t *lock, uint32_t saved_irq) {
+    (void)saved_irq;
+    *lock = 0;
+}
@@ -0,0 +1,33 @@
+// Pico SDK stand-in for the host simulation: the virtual clock
+#pragma once
+
+#include "pico/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+absolute_time_t get_absolute_time(void);
+static inline uint64_t to_us_since_boot(absolute_time_t t) { return t; }
+static inline uint32_t to_ms_since_boot(absolute_time_t t) { return (uint32_t)(t / 1000); }
+static inline absolute_time_t delayed_by_us(absolute_time_t t, uint64_t us) { return t + us; }
+static inline absolute_time_t delayed_by_ms(absolute_time_t t, uint32_t ms) {
+    return t + 1000ull * ms;
+}
+static inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to) {
+    return (int64_t)(to - from);
+}
+absolute_time_t make_timeout_time_us(uint64_t us);
+absolute_time_t make_timeout_time_ms(uint32_t ms);
+bool time_reached(absolute_time_t t);
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+void busy_wait_us(uint64_t us);
+void busy_wait_us_32(uint32_t us);
+void busy_wait_ms(uint32_t ms);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,23 @@
+// Pico SDK stand-in for the host simulation (host/pico_sim/pico_sim.h)
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned int uint;
+typedef uint64_t absolute_time_t;  // Microseconds of virtual time
+typedef volatile uint32_t io_rw_32;
+
+typedef struct {
+    int16_t year;
+    int8_t month, day, dotw, hour, min, sec;
+} datetime_t;
+
+enum { PICO_OK = 0, PICO_ERROR_TIMEOUT = -1, PICO_ERROR_GENERIC = -2 };
+
+#define __not_in_flash(group)
+#define __not_in_flash_func(f) f
+#define __time_critical_func(f) f
+#define __uninitialized_ram(var) var
+#define count_of(a) (sizeof(a) / sizeof((a)[0]))
@@ -0,0 +1,6 @@
+// Pico SDK stand-in for the host simulation
+#pragma once
+
+#include "pico/types.h"
+
+#define PICO_UNIQUE_BOARD_ID_SIZE_BYTES 8
@@ -0,0 +1,35 @@
+// TinyUSB stand-in for the host simulation: no host on the bus. tud_task()
+// takes its time on the virtual clock and is where a run can end
+// (sim_run()); the mass storage callbacks are never called.
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>  // As tusb_common.h, which the firmware relies on
+
+#define OPT_MODE_DEVICE 1
+#define OPT_OS_PICO 1
+#include "tusb_config.h"
+
+enum {
+    SCSI_SENSE_NONE = 0x00,
+    SCSI_SENSE_NOT_READY = 0x02,
+    SCSI_SENSE_MEDIUM_ERROR = 0x03,
+    SCSI_SENSE_ILLEGAL_REQUEST = 0x05,
+    SCSI_SENSE_UNIT_ATTENTION = 0x06,
+};
+enum { SCSI_CMD_PREVENT_ALLOW_MEDIUM_REMOVAL = 0x1E };
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool tusb_init(void);
+void tud_task(void);
+bool tud_mounted(void);
+bool tud_msc_set_sense(uint8_t lun, uint8_t sense_key, uint8_t add_sense_code,
+                       uint8_t add_sense_qualifier);
+
+#ifdef __cplusplus
+}
+#endif
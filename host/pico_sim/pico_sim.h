@@ -0,0 +1,138 @@
+/* pico_sim.h
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Host simulation of the Pico: the parts of the SDK the data collector uses
+// (include/ has the headers, in the SDK's layout) on a virtual clock, so that
+// the whole firmware runs on Linux, deterministically and faster than real
+// time.
+//
+// The clock only moves when the firmware waits or talks to hardware: sleeps
+// and busy waits, I2C and SPI transfers (their bus time at the configured
+// baud rate), tud_task() and each read of the clock (a few tens of ns, so
+// that polling loops end). Everything in between costs nothing: the times
+// the firmware measures are bus and wait times, not CPU time.
+//
+// There is one thread. Interrupts run inside the call that makes them
+// happen: a DMA completion inside dma_start_channel_mask(), a GPIO edge in
+// sim_gpio_input(), an event scheduled with sim_at() inside the clock
+// advance that passes its time. Core 1's entry runs to its end inside
+// multicore_launch_core1().
+//
+// Devices hang off the buses as callbacks (sim_i2c_attach(),
+// sim_spi_attach()); every bus device counts its transfers, bytes and bus
+// time. sim_devices.h has the models of the collector's board.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+//
+#include "pico/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SIM_TIME_READ_NS 40    // Each read of the clock
+#define SIM_TUD_TASK_NS 10000  // Each tud_task()
+
+// Virtual time since boot
+uint64_t sim_now_ns(void);
+void sim_advance_ns(uint64_t ns);
+
+// Runs fn(arg) when the clock passes at_us, as an interrupt would. Events run
+// in time order; one scheduled for the same time as another runs after it.
+typedef void (*sim_event_fn_t)(void *arg);
+bool sim_at(uint64_t at_us, sim_event_fn_t fn, void *arg);
+
+// Calls entry (the firmware's main) and returns when it returns, or at the
+// first tud_task() (the end of a main loop pass) once the clock reaches
+// end_us. Returns true in the second case.
+bool sim_run(int (*entry)(void), uint64_t end_us);
+
+// Calls the handlers of an interrupt, if it is enabled
+void sim_irq_raise(uint num);
+
+// Drives an input pin; an edge raises the GPIO interrupt if it is enabled
+void sim_gpio_input(uint gpio, bool level);
+// Output level of a pin, or the level driven by sim_gpio_input()
+bool sim_gpio_level(uint gpio);
+
+// Characters the serial terminal receives from at_us on (getchar_timeout_us)
+void sim_serial_input(uint64_t at_us, const char *text);
+
+// Starts the RTC as if it had been set before the boot
+void sim_rtc_set(const datetime_t *t);
+
+// A device's traffic on its bus
+typedef struct sim_bus_stats {
+    uint64_t transfers;
+    uint64_t bytes;
+    uint64_t busy_ns;  // Bus time
+    uint64_t errors;   // Transfers the device refused (I2C: NACK)
+} sim_bus_stats_t;
+
+// An I2C target. write gets the bytes of a write (nostop: a repeated start
+// follows); read fills a read. Both return the bytes transferred or a
+// negative PICO_ERROR_*.
+typedef struct sim_i2c_dev {
+    const char *name;
+    uint8_t addr;
+    int (*write)(void *ctx, const uint8_t *src, size_t len, bool nostop);
+    int (*read)(void *ctx, uint8_t *dst, size_t len);
+    void *ctx;
+    sim_bus_stats_t stats;
+    struct sim_i2c_dev *next;
+} sim_i2c_dev_t;
+
+void sim_i2c_attach(uint bus, sim_i2c_dev_t *dev);
+
+// An SPI device: exchange gets the byte the host sends (MOSI) and returns
+// the one it reads (MISO). The device looks at its chip select itself.
+typedef struct sim_spi_dev {
+    const char *name;
+    uint8_t (*exchange)(void *ctx, uint8_t mosi);
+    void *ctx;
+    sim_bus_stats_t stats;
+} sim_spi_dev_t;
+
+void sim_spi_attach(uint bus, sim_spi_dev_t *dev);
+
+// Everything else the firmware did
+typedef struct sim_stats {
+    uint64_t sleep_ns;        // sleep_*() and busy_wait_*()
+    uint64_t tud_task_calls;
+    uint64_t time_reads;
+    uint64_t serial_in;       // Characters read by the terminal
+    uint64_t usb_out_bytes;   // Written straight to the USB serial (stdio_usb)
+    uint64_t i2c_unanswered;  // Transfers to an address with no device
+    uint64_t dma_transfers;
+    uint64_t irqs;            // Handlers called
+    uint64_t flash_erases;
+    uint64_t flash_programs;
+    uint64_t sem_timeouts;
+} sim_stats_t;
+
+const sim_stats_t *sim_stats(void);
+// Zeroes sim_stats() and the statistics of every attached bus device
+void sim_stats_reset(void);
+
+// Prints a line per bus device: transfers, bytes, bus time and its share of
+// the virtual time since the last sim_stats_reset()
+void sim_print_buses(FILE *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* [] END OF FILE */
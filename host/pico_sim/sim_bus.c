@@ -0,0 +1,288 @@
+/* sim_bus.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// I2C, SPI and the DMA the SPI driver uses, with the bus time of each
+// transfer on the virtual clock
+#include <stdlib.h>
+#include <string.h>
+//
+#include "hardware/dma.h"
+#include "hardware/i2c.h"
+#include "hardware/irq.h"
+#include "hardware/spi.h"
+//
+#include "sim_internal.h"
+
+#define SIM_CLK_PERI_HZ 125000000u
+
+static uint64_t since(void) { return sim_now_ns() - sim_stats_since_ns; }
+
+/* I2C */
+
+i2c_inst_t i2c0_inst = {0, 0}, i2c1_inst = {1, 0};
+static sim_i2c_dev_t *i2c_devs[2];
+
+void sim_i2c_attach(uint bus, sim_i2c_dev_t *dev) {
+    dev->next = i2c_devs[bus];
+    i2c_devs[bus] = dev;
+}
+
+uint i2c_init(i2c_inst_t *i2c, uint baudrate) { return i2c_set_baudrate(i2c, baudrate); }
+uint i2c_set_baudrate(i2c_inst_t *i2c, uint baudrate) { return i2c->baudrate = baudrate; }
+
+// Address byte and data bytes, 9 clocks each
+static uint64_t i2c_ns(const i2c_inst_t *i2c, size_t len) {
+    return (len + 1) * 9 * 1000000000ull / i2c->baudrate;
+}
+
+static sim_i2c_dev_t *i2c_find(const i2c_inst_t *i2c, uint8_t addr) {
+    if (!i2c->baudrate) return NULL;
+    for (sim_i2c_dev_t *d = i2c_devs[i2c->index]; d; d = d->next)
+        if (d->addr == addr) return d;
+    // NACK after the address byte
+    sim_counters.i2c_unanswered++;
+    sim_advance_ns(i2c_ns(i2c, 0));
+    return NULL;
+}
+
+static int i2c_done(const i2c_inst_t *i2c, sim_i2c_dev_t *d, int rc) {
+    uint64_t ns = i2c_ns(i2c, rc > 0 ? (size_t)rc : 0);
+    d->stats.transfers++;
+    d->stats.busy_ns += ns;
+    if (rc > 0)
+        d->stats.bytes += (uint64_t)rc;
+    else
+        d->stats.errors++;
+    sim_advance_ns(ns);
+    return rc;
+}
+
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len,
+                       bool nostop) {
+    sim_i2c_dev_t *d = i2c_find(i2c, addr);
+    if (!d) return PICO_ERROR_GENERIC;
+    return i2c_done(i2c, d, d->write ? d->write(d->ctx, src, len, nostop) : PICO_ERROR_GENERIC);
+}
+
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop) {
+    sim_i2c_dev_t *d = i2c_find(i2c, addr);
+    if (!d) return PICO_ERROR_GENERIC;
+    return i2c_done(i2c, d, d->read ? d->read(d->ctx, dst, len) : PICO_ERROR_GENERIC);
+}
+
+/* SPI */
+
+spi_inst_t spi0_inst = {.index = 0}, spi1_inst = {.index = 1};
+static sim_spi_dev_t *spi_devs[2];
+
+void sim_spi_attach(uint bus, sim_spi_dev_t *dev) { spi_devs[bus] = dev; }
+
+uint spi_init(spi_inst_t *spi, uint baudrate) { return spi_set_baudrate(spi, baudrate); }
+
+// The SDK's: the nearest rate at or below baudrate that clk_peri divides to
+uint spi_set_baudrate(spi_inst_t *spi, uint baudrate) {
+    uint64_t freq_in = SIM_CLK_PERI_HZ;
+    uint prescale, postdiv;
+    for (prescale = 2; prescale <= 254; prescale += 2)
+        if (freq_in < (prescale + 2) * 256 * (uint64_t)baudrate) break;
+    for (postdiv = 256; postdiv > 1; --postdiv)
+        if (freq_in / (prescale * (postdiv - 1)) > baudrate) break;
+    return spi->baudrate = (uint)(freq_in / (prescale * postdiv));
+}
+
+void spi_set_format(spi_inst_t *spi, uint data_bits, spi_cpol_t cpol, spi_cpha_t cpha,
+                    spi_order_t order) {}
+
+static uint8_t spi_byte(spi_inst_t *spi, uint8_t mosi) {
+    uint64_t ns = 8 * 1000000000ull / spi->baudrate;
+    sim_advance_ns(ns);
+    sim_spi_dev_t *d = spi_devs[spi->index];
+    if (!d) return 0xff;
+    d->stats.bytes++;
+    d->stats.busy_ns += ns;
+    return d->exchange(d->ctx, mosi);
+}
+
+static void spi_count(spi_inst_t *spi) {
+    if (spi_devs[spi->index]) spi_devs[spi->index]->stats.transfers++;
+}
+
+int spi_write_blocking(spi_inst_t *spi, const uint8_t *src, size_t len) {
+    spi_count(spi);
+    for (size_t i = 0; i < len; ++i) spi_byte(spi, src[i]);
+    return (int)len;
+}
+
+int spi_read_blocking(spi_inst_t *spi, uint8_t repeated_tx_data, uint8_t *dst, size_t len) {
+    spi_count(spi);
+    for (size_t i = 0; i < len; ++i) dst[i] = spi_byte(spi, repeated_tx_data);
+    return (int)len;
+}
+
+int spi_write_read_blocking(spi_inst_t *spi, const uint8_t *src, uint8_t *dst, size_t len) {
+    spi_count(spi);
+    for (size_t i = 0; i < len; ++i) dst[i] = spi_byte(spi, src[i]);
+    return (int)len;
+}
+
+/* DMA: a channel pair to and from an SPI data register runs the exchange;
+   any other channel copies memory. Transfers finish inside
+   dma_start_channel_mask(). */
+
+typedef struct {
+    bool claimed;
+    dma_channel_config config;
+    volatile void *write_addr;
+    const volatile void *read_addr;
+    uint count;
+    bool irq0, irq1;
+} sim_dma_channel_t;
+
+static sim_dma_channel_t channels[NUM_DMA_CHANNELS];
+static dma_hw_t dma;
+dma_hw_t *dma_hw = &dma;
+
+int dma_claim_unused_channel(bool required) {
+    for (uint ch = 0; ch < NUM_DMA_CHANNELS; ++ch)
+        if (!channels[ch].claimed) {
+            channels[ch].claimed = true;
+            return (int)ch;
+        }
+    if (required) {
+        fprintf(stderr, "pico_sim: no free DMA channel\n");
+        abort();
+    }
+    return -1;
+}
+
+void dma_channel_unclaim(uint channel) { channels[channel].claimed = false; }
+
+dma_channel_config dma_channel_get_default_config(uint channel) {
+    return (dma_channel_config){.read_increment = true,
+                                .write_increment = false,
+                                .size = DMA_SIZE_32,
+                                .dreq = 0x3f};
+}
+
+void dma_channel_set_irq0_enabled(uint channel, bool enabled) { channels[channel].irq0 = enabled; }
+void dma_channel_set_irq1_enabled(uint channel, bool enabled) { channels[channel].irq1 = enabled; }
+bool dma_channel_is_busy(uint channel) { return false; }
+
+void dma_channel_configure(uint channel, const dma_channel_config *config,
+                           volatile void *write_addr, const volatile void *read_addr,
+                           uint transfer_count, bool trigger) {
+    sim_dma_channel_t *c = &channels[channel];
+    c->config = *config;
+    c->write_addr = write_addr;
+    c->read_addr = read_addr;
+    c->count = transfer_count;
+    if (trigger) dma_start_channel_mask(1u << channel);
+}
+
+static spi_inst_t *dma_spi(const volatile void *addr) {
+    if (addr == &spi0_inst.hw.dr) return &spi0_inst;
+    if (addr == &spi1_inst.hw.dr) return &spi1_inst;
+    return NULL;
+}
+
+void dma_start_channel_mask(uint32_t chan_mask) {
+    uint32_t left = chan_mask;
+    // SPI: the TX channel paces the RX channel on the same data register
+    for (uint tx = 0; tx < NUM_DMA_CHANNELS; ++tx) {
+        if (!(left & (1u << tx))) continue;
+        sim_dma_channel_t *t = &channels[tx];
+        spi_inst_t *spi = dma_spi(t->write_addr);
+        if (!spi) continue;
+        sim_dma_channel_t *r = NULL;
+        for (uint rx = 0; rx < NUM_DMA_CHANNELS; ++rx)
+            if ((left & (1u << rx)) && dma_spi(channels[rx].read_addr) == spi) {
+                r = &channels[rx];
+                left &= ~(1u << rx);
+                break;
+            }
+        left &= ~(1u << tx);
+        const volatile uint8_t *src = t->read_addr;
+        volatile uint8_t *dst = r ? r->write_addr : NULL;
+        spi_count(spi);
+        for (uint i = 0; i < t->count; ++i) {
+            uint8_t in = spi_byte(spi, *src);
+            if (t->config.read_increment) ++src;
+            if (dst) {
+                *dst = in;
+                if (r->config.write_increment) ++dst;
+            }
+        }
+    }
+    for (uint ch = 0; ch < NUM_DMA_CHANNELS; ++ch) {
+        if (!(left & (1u << ch))) continue;
+        sim_dma_channel_t *c = &channels[ch];
+        size_t unit = 1u << c->config.size;
+        const volatile uint8_t *src = c->read_addr;
+        volatile uint8_t *dst = c->write_addr;
+        for (uint i = 0; i < c->count; ++i) {
+            memcpy((void *)dst, (const void *)src, unit);
+            if (c->config.read_increment) src += unit;
+            if (c->config.write_increment) dst += unit;
+        }
+    }
+    sim_counters.dma_transfers++;
+    // Completion interrupts, then the handlers' write-one-to-clear
+    uint32_t ints0 = 0, ints1 = 0;
+    for (uint ch = 0; ch < NUM_DMA_CHANNELS; ++ch) {
+        if (!(chan_mask & (1u << ch))) continue;
+        if (channels[ch].irq0) ints0 |= 1u << ch;
+        if (channels[ch].irq1) ints1 |= 1u << ch;
+    }
+    dma.intr |= chan_mask;
+    if (ints0) {
+        dma.ints0 |= ints0;
+        sim_irq_raise(DMA_IRQ_0);
+        dma.ints0 &= ~ints0;
+    }
+    if (ints1) {
+        dma.ints1 |= ints1;
+        sim_irq_raise(DMA_IRQ_1);
+        dma.ints1 &= ~ints1;
+    }
+    dma.intr &= ~chan_mask;
+}
+
+/* Statistics */
+
+void sim_bus_stats_reset() {
+    for (uint bus = 0; bus < 2; ++bus) {
+        for (sim_i2c_dev_t *d = i2c_devs[bus]; d; d = d->next)
+            memset(&d->stats, 0, sizeof d->stats);
+        if (spi_devs[bus]) memset(&spi_devs[bus]->stats, 0, sizeof spi_devs[bus]->stats);
+    }
+}
+
+static void print_dev(FILE *out, const char *bus, const char *name, const sim_bus_stats_t *s) {
+    uint64_t total = since();
+    fprintf(out, "%-5s %-10s %8llu transfers %10llu bytes %9.1f ms busy (%4.1f%%)", bus, name,
+            (unsigned long long)s->transfers, (unsigned long long)s->bytes, s->busy_ns / 1e6,
+            total ? 100.0 * s->busy_ns / total : 0.0);
+    if (s->errors) fprintf(out, " %llu errors", (unsigned long long)s->errors);
+    fputc('\n', out);
+}
+
+void sim_print_buses(FILE *out) {
+    static const char *const i2c_names[] = {"i2c0", "i2c1"};
+    static const char *const spi_names[] = {"spi0", "spi1"};
+    for (uint bus = 0; bus < 2; ++bus)
+        for (const sim_i2c_dev_t *d = i2c_devs[bus]; d; d = d->next)
+            print_dev(out, i2c_names[bus], d->name, &d->stats);
+    for (uint bus = 0; bus < 2; ++bus)
+        if (spi_devs[bus]) print_dev(out, spi_names[bus], spi_devs[bus]->name, &spi_devs[bus]->stats);
+}
+
+/* [] END OF FILE */
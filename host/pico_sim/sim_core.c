@@ -0,0 +1,461 @@
+/* sim_core.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// The virtual clock and the parts of the SDK that are not buses: time,
+// GPIO, interrupts, locks, core 1, flash, RTC, stdio and TinyUSB.
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+//
+#include "hardware/flash.h"
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/rtc.h"
+#include "hardware/structs/scb.h"
+#include "pico/flash.h"
+#include "pico/multicore.h"
+#include "pico/stdio_usb.h"
+#include "pico/stdlib.h"
+#include "tusb.h"
+//
+#include "sim_internal.h"
+
+// The W25Q16JV's typical times, as host/flash/nor_sim.h
+#define SIM_FLASH_ERASE_US 45000
+#define SIM_FLASH_PROGRAM_US 400
+// Where the firmware image would end: flash_log_pico_dev() keeps out of it
+#define SIM_BINARY_SIZE (384 * 1024)
+#define SIM_MAX_EVENTS 64
+
+#define SIM_STR_(x) #x
+#define SIM_STR(x) SIM_STR_(x)
+
+sim_stats_t sim_counters;
+uint64_t sim_stats_since_ns;
+
+static uint64_t now_ns;
+
+typedef struct {
+    uint64_t at_ns;
+    sim_event_fn_t fn;
+    void *arg;
+} sim_event_t;
+static sim_event_t events[SIM_MAX_EVENTS];
+static unsigned n_events;
+static bool in_event;
+
+static jmp_buf run_jmp;
+static bool running;
+static uint64_t end_ns;
+
+/* Clock and events */
+
+uint64_t sim_now_ns() { return now_ns; }
+
+void sim_advance_ns(uint64_t ns) {
+    uint64_t target = now_ns + ns;
+    // An event that takes time (a handler that waits) does not run others
+    while (!in_event && n_events && events[0].at_ns <= target) {
+        sim_event_t ev = events[0];
+        memmove(&events[0], &events[1], --n_events * sizeof events[0]);
+        if (ev.at_ns > now_ns) now_ns = ev.at_ns;
+        in_event = true;
+        ev.fn(ev.arg);
+        in_event = false;
+    }
+    if (target > now_ns) now_ns = target;
+}
+
+bool sim_at(uint64_t at_us, sim_event_fn_t fn, void *arg) {
+    if (n_events == SIM_MAX_EVENTS) return false;
+    uint64_t at_ns = at_us * 1000;
+    unsigned i = n_events;
+    while (i && events[i - 1].at_ns > at_ns) --i;
+    memmove(&events[i + 1], &events[i], (n_events - i) * sizeof events[0]);
+    events[i] = (sim_event_t){at_ns, fn, arg};
+    n_events++;
+    return true;
+}
+
+bool sim_run(int (*entry)(void), uint64_t end_us) {
+    end_ns = end_us * 1000;
+    running = true;
+    if (setjmp(run_jmp)) {
+        running = false;
+        return true;
+    }
+    entry();
+    running = false;
+    return false;
+}
+
+const sim_stats_t *sim_stats() { return &sim_counters; }
+
+void sim_stats_reset() {
+    memset(&sim_counters, 0, sizeof sim_counters);
+    sim_stats_since_ns = now_ns;
+    sim_bus_stats_reset();
+}
+
+/* pico/time.h */
+
+uint64_t time_us_64() {
+    sim_counters.time_reads++;
+    sim_advance_ns(SIM_TIME_READ_NS);
+    return now_ns / 1000;
+}
+uint32_t time_us_32() { return (uint32_t)time_us_64(); }
+absolute_time_t get_absolute_time() { return time_us_64(); }
+absolute_time_t make_timeout_time_us(uint64_t us) { return time_us_64() + us; }
+absolute_time_t make_timeout_time_ms(uint32_t ms) { return time_us_64() + 1000ull * ms; }
+bool time_reached(absolute_time_t t) { return time_us_64() >= t; }
+
+void busy_wait_us(uint64_t us) {
+    sim_counters.sleep_ns += us * 1000;
+    sim_advance_ns(us * 1000);
+}
+void busy_wait_us_32(uint32_t us) { busy_wait_us(us); }
+void busy_wait_ms(uint32_t ms) { busy_wait_us(1000ull * ms); }
+void sleep_us(uint64_t us) { busy_wait_us(us); }
+void sleep_ms(uint32_t ms) { busy_wait_us(1000ull * ms); }
+
+/* hardware/irq.h */
+
+#define SIM_SHARED_HANDLERS 4
+
+static irq_handler_t handlers[NUM_IRQS][SIM_SHARED_HANDLERS];
+static bool irq_enabled[NUM_IRQS];
+
+void irq_set_enabled(uint num, bool enabled) { irq_enabled[num] = enabled; }
+bool irq_is_enabled(uint num) { return irq_enabled[num]; }
+void irq_set_priority(uint num, uint8_t hardware_priority) {}
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler) {
+    memset(handlers[num], 0, sizeof handlers[num]);
+    handlers[num][0] = handler;
+}
+
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority) {
+    for (unsigned i = 0; i < SIM_SHARED_HANDLERS; ++i)
+        if (!handlers[num][i]) {
+            handlers[num][i] = handler;
+            return;
+        }
+    fprintf(stderr, "pico_sim: too many handlers for IRQ %u\n", num);
+    abort();
+}
+
+void irq_remove_handler(uint num, irq_handler_t handler) {
+    for (unsigned i = 0; i < SIM_SHARED_HANDLERS; ++i)
+        if (handlers[num][i] == handler) handlers[num][i] = NULL;
+}
+
+void sim_irq_raise(uint num) {
+    if (!irq_enabled[num]) return;
+    for (unsigned i = 0; i < SIM_SHARED_HANDLERS; ++i)
+        if (handlers[num][i]) {
+            sim_counters.irqs++;
+            handlers[num][i]();
+        }
+}
+
+/* hardware/gpio.h */
+
+typedef struct {
+    bool out;        // Direction
+    bool level;      // Output level
+    bool driven;     // Input driven by sim_gpio_input()
+    bool in_level;
+    bool pull_up, pull_down;
+    uint32_t irq_events;  // Enabled
+    uint32_t pending;
+    irq_handler_t raw;
+} sim_gpio_t;
+
+static sim_gpio_t pins[NUM_BANK0_GPIOS];
+static gpio_irq_callback_t gpio_callback;
+
+void gpio_init(uint gpio) {
+    pins[gpio].out = false;
+    pins[gpio].level = false;
+}
+void gpio_set_function(uint gpio, enum gpio_function fn) {}
+void gpio_set_dir(uint gpio, bool out) { pins[gpio].out = out; }
+void gpio_put(uint gpio, bool value) { pins[gpio].level = value; }
+void gpio_set_pulls(uint gpio, bool up, bool down) {
+    pins[gpio].pull_up = up;
+    pins[gpio].pull_down = down;
+}
+void gpio_set_drive_strength(uint gpio, enum gpio_drive_strength drive) {}
+void gpio_set_slew_rate(uint gpio, enum gpio_slew_rate slew) {}
+
+bool gpio_get(uint gpio) { return sim_gpio_level(gpio); }
+
+bool sim_gpio_level(uint gpio) {
+    const sim_gpio_t *p = &pins[gpio];
+    if (p->out) return p->level;
+    if (p->driven) return p->in_level;
+    return p->pull_up;  // Floating reads low without a pull up
+}
+
+void gpio_set_irq_enabled(uint gpio, uint32_t events, bool enabled) {
+    if (enabled)
+        pins[gpio].irq_events |= events;
+    else
+        pins[gpio].irq_events &= ~events;
+}
+
+void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t events, bool enabled,
+                                        gpio_irq_callback_t callback) {
+    gpio_set_irq_enabled(gpio, events, enabled);
+    if (callback) gpio_callback = callback;
+    if (enabled) irq_set_enabled(IO_IRQ_BANK0, true);
+}
+
+void gpio_add_raw_irq_handler(uint gpio, irq_handler_t handler) { pins[gpio].raw = handler; }
+uint32_t gpio_get_irq_event_mask(uint gpio) { return pins[gpio].pending; }
+void gpio_acknowledge_irq(uint gpio, uint32_t events) { pins[gpio].pending &= ~events; }
+
+void sim_gpio_input(uint gpio, bool level) {
+    sim_gpio_t *p = &pins[gpio];
+    bool was = sim_gpio_level(gpio);
+    p->driven = true;
+    p->in_level = level;
+    if (p->out || was == level) return;
+    uint32_t event = (level ? GPIO_IRQ_EDGE_RISE : GPIO_IRQ_EDGE_FALL) & p->irq_events;
+    if (!event || !irq_enabled[IO_IRQ_BANK0]) return;
+    p->pending |= event;
+    sim_counters.irqs++;
+    if (p->raw) {
+        p->raw();
+    } else if (gpio_callback) {
+        uint32_t events = p->pending;
+        p->pending = 0;
+        gpio_callback(gpio, events);
+    }
+}
+
+/* pico/mutex.h, pico/sem.h */
+
+void mutex_init(mutex_t *mtx) {
+    mtx->owner = -1;
+    mtx->init = true;
+}
+
+void mutex_enter_blocking(mutex_t *mtx) {
+    if (mtx->owner >= 0) {
+        // The one thread would wait for itself: a deadlock on the device too
+        fprintf(stderr, "pico_sim: mutex %p entered twice\n", (void *)mtx);
+        abort();
+    }
+    mtx->owner = 0;
+    mtx->depth++;
+}
+
+bool mutex_try_enter(mutex_t *mtx, uint32_t *owner_out) {
+    if (mtx->owner >= 0) {
+        if (owner_out) *owner_out = (uint32_t)mtx->owner;
+        return false;
+    }
+    mutex_enter_blocking(mtx);
+    return true;
+}
+
+void mutex_exit(mutex_t *mtx) { mtx->owner = -1; }
+
+void sem_init(semaphore_t *sem, int16_t initial_permits, int16_t max_permits) {
+    sem->permits = initial_permits;
+    sem->max_permits = max_permits;
+}
+int sem_available(semaphore_t *sem) { return sem->permits; }
+void sem_reset(semaphore_t *sem, int16_t permits) { sem->permits = permits; }
+
+bool sem_release(semaphore_t *sem) {
+    if (sem->permits >= sem->max_permits) return false;
+    sem->permits++;
+    return true;
+}
+
+bool sem_acquire_timeout_ms(semaphore_t *sem, uint32_t timeout_ms) {
+    if (sem->permits <= 0) {
+        // Only an event can release it now
+        sim_advance_ns(1000000ull * timeout_ms);
+        if (sem->permits <= 0) {
+            sim_counters.sem_timeouts++;
+            return false;
+        }
+    }
+    sem->permits--;
+    return true;
+}
+
+void sem_acquire_blocking(semaphore_t *sem) {
+    if (!sem_acquire_timeout_ms(sem, UINT32_MAX)) {
+        fprintf(stderr, "pico_sim: semaphore %p never released\n", (void *)sem);
+        abort();
+    }
+}
+
+/* pico/multicore.h */
+
+void multicore_reset_core1() {}
+void multicore_launch_core1(void (*entry)(void)) { entry(); }
+
+/* hardware/flash.h, pico/flash.h */
+
+uint8_t sim_flash[PICO_FLASH_SIZE_BYTES];
+__asm__(".globl __flash_binary_end\n"
+        ".set __flash_binary_end, sim_flash + " SIM_STR(SIM_BINARY_SIZE) "\n");
+
+static void __attribute__((constructor)) erase_flash() { memset(sim_flash, 0xff, sizeof sim_flash); }
+
+void flash_range_erase(uint32_t flash_offs, size_t count) {
+    if (flash_offs % FLASH_SECTOR_SIZE || count % FLASH_SECTOR_SIZE ||
+        flash_offs + count > sizeof sim_flash) {
+        fprintf(stderr, "pico_sim: bad flash erase %lx+%lx\n", (unsigned long)flash_offs,
+                (unsigned long)count);
+        abort();
+    }
+    memset(sim_flash + flash_offs, 0xff, count);
+    sim_counters.flash_erases += count / FLASH_SECTOR_SIZE;
+    sim_advance_ns(count / FLASH_SECTOR_SIZE * SIM_FLASH_ERASE_US * 1000ull);
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count) {
+    if (flash_offs % FLASH_PAGE_SIZE || count % FLASH_PAGE_SIZE ||
+        flash_offs + count > sizeof sim_flash) {
+        fprintf(stderr, "pico_sim: bad flash program %lx+%lx\n", (unsigned long)flash_offs,
+                (unsigned long)count);
+        abort();
+    }
+    // NOR: bits only go from 1 to 0
+    for (size_t i = 0; i < count; ++i) sim_flash[flash_offs + i] &= data[i];
+    sim_counters.flash_programs += count / FLASH_PAGE_SIZE;
+    sim_advance_ns(count / FLASH_PAGE_SIZE * SIM_FLASH_PROGRAM_US * 1000ull);
+}
+
+int flash_safe_execute(void (*func)(void *), void *param, uint32_t enter_exit_timeout_ms) {
+    func(param);
+    return PICO_OK;
+}
+bool flash_safe_execute_core_init() { return true; }
+bool flash_safe_execute_core_deinit() { return true; }
+
+/* hardware/rtc.h */
+
+static bool rtc_on;
+static time_t rtc_base;  // Seconds since the epoch at rtc_base_ns
+static uint64_t rtc_base_ns;
+
+// rtc_init() resets the RTC on the device; here it keeps a date set with
+// sim_rtc_set(), which stands for one set before the boot
+void rtc_init() {}
+
+bool rtc_set_datetime(const datetime_t *t) {
+    struct tm tm = {.tm_sec = t->sec,
+                    .tm_min = t->min,
+                    .tm_hour = t->hour,
+                    .tm_mday = t->day,
+                    .tm_mon = t->month - 1,
+                    .tm_year = t->year - 1900};
+    rtc_base = timegm(&tm);
+    rtc_base_ns = now_ns;
+    rtc_on = true;
+    return true;
+}
+
+bool rtc_get_datetime(datetime_t *t) {
+    if (!rtc_on) return false;
+    time_t now = rtc_base + (time_t)((now_ns - rtc_base_ns) / 1000000000u);
+    struct tm tm;
+    gmtime_r(&now, &tm);
+    *t = (datetime_t){.year = (int16_t)(tm.tm_year + 1900),
+                      .month = (int8_t)(tm.tm_mon + 1),
+                      .day = (int8_t)tm.tm_mday,
+                      .dotw = (int8_t)tm.tm_wday,
+                      .hour = (int8_t)tm.tm_hour,
+                      .min = (int8_t)tm.tm_min,
+                      .sec = (int8_t)tm.tm_sec};
+    return true;
+}
+
+bool rtc_running() { return rtc_on; }
+
+void sim_rtc_set(const datetime_t *t) { rtc_set_datetime(t); }
+
+/* pico/stdlib.h, pico/stdio_usb.h */
+
+typedef struct serial_chunk {
+    uint64_t at_ns;
+    char *text;
+    size_t pos;
+    struct serial_chunk *next;
+} serial_chunk_t;
+static serial_chunk_t *serial_queue;
+
+void sim_serial_input(uint64_t at_us, const char *text) {
+    serial_chunk_t *c = calloc(1, sizeof *c);
+    c->at_ns = at_us * 1000;
+    c->text = strdup(text);
+    serial_chunk_t **p = &serial_queue;
+    while (*p && (*p)->at_ns <= c->at_ns) p = &(*p)->next;
+    c->next = *p;
+    *p = c;
+}
+
+bool stdio_init_all() { return true; }
+void stdio_flush() { fflush(stdout); }
+
+int getchar_timeout_us(uint32_t timeout_us) {
+    serial_chunk_t *c = serial_queue;
+    if (c && c->at_ns > now_ns && c->at_ns - now_ns <= 1000ull * timeout_us)
+        sim_advance_ns(c->at_ns - now_ns);
+    else if (!c || c->at_ns > now_ns) {
+        sim_advance_ns(1000ull * timeout_us);
+        return PICO_ERROR_TIMEOUT;
+    }
+    int ch = (unsigned char)c->text[c->pos++];
+    if (!c->text[c->pos]) {
+        serial_queue = c->next;
+        free(c->text);
+        free(c);
+    }
+    sim_counters.serial_in++;
+    return ch;
+}
+
+static void usb_out_chars(const char *buf, int len) { sim_counters.usb_out_bytes += len; }
+stdio_driver_t stdio_usb = {usb_out_chars};
+
+/* tusb.h */
+
+bool tusb_init() { return true; }
+bool tud_mounted() { return false; }
+
+void tud_task() {
+    sim_counters.tud_task_calls++;
+    sim_advance_ns(SIM_TUD_TASK_NS);
+    if (running && now_ns >= end_ns) longjmp(run_jmp, 1);
+}
+
+bool tud_msc_set_sense(uint8_t lun, uint8_t sense_key, uint8_t add_sense_code,
+                       uint8_t add_sense_qualifier) {
+    return true;
+}
+
+/* hardware/structs/scb.h: a write to AIRCR would reset the core */
+
+static armv6m_scb_hw_t scb;
+armv6m_scb_hw_t *scb_hw = &scb;
+
+/* [] END OF FILE */
@@ -0,0 +1,139 @@
+/* sim_devices.h
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Models of the data collector's devices for the host simulation
+// (pico_sim.h): the GY-33's TCS34725 colour sensor and the SSD1306 display on
+// I2C, and an SD card on SPI.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+//
+#include "pico_sim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// TCS34725: registers behind the command byte (bit 7 set; reads go on to the
+// following registers), ID 0x44. With PON and AEN set, a new reading is
+// ready every integration time ((256 - ATIME) x 2.4 ms). The scene in front
+// of the sensor changes colour every SIM_TCS34725_SCENE_MS; counts scale with
+// the integration time and the gain and carry a little noise from a fixed
+// sequence, so runs repeat exactly.
+#define SIM_TCS34725_ADDR 0x29
+#define SIM_TCS34725_SCENE_MS 3000
+
+typedef struct sim_tcs34725 {
+    sim_i2c_dev_t dev;
+    uint8_t reg[32];
+    uint8_t ptr;          // Register the next access goes to
+    uint64_t enabled_ns;  // When integration started; 0: not running
+    uint32_t cycles;      // Readings made
+    uint32_t noise;       // Noise generator state
+} sim_tcs34725_t;
+
+void sim_tcs34725_init(sim_tcs34725_t *s, uint bus);
+
+// SSD1306, 128 x 64: a control byte (0x80 or 0x00: commands, 0x40: data)
+// then its bytes. Keeps the display RAM in the horizontal and vertical
+// addressing modes with the column and page windows; counts data writes
+// that reach the last byte of the window as frames.
+#define SIM_SSD1306_W 128
+#define SIM_SSD1306_PAGES 8
+
+typedef struct sim_ssd1306 {
+    sim_i2c_dev_t dev;
+    uint8_t ram[SIM_SSD1306_PAGES][SIM_SSD1306_W];
+    bool on;
+    uint8_t mode;  // 0: horizontal, 1: vertical, 2: page
+    uint8_t col_start, col_end, page_start, page_end;
+    uint8_t col, page;
+    uint8_t cmd[3];  // A command and its arguments, as they arrive
+    uint8_t cmd_len;
+    uint32_t frames;
+    uint32_t commands;
+} sim_ssd1306_t;
+
+void sim_ssd1306_init(sim_ssd1306_t *d, uint bus, uint8_t addr);
+// The screen as text, a character per 2 x 4 pixels
+void sim_ssd1306_print(const sim_ssd1306_t *d, FILE *out);
+
+// SD card (SDHC) in SPI mode on a RAM image. Answers the commands the
+// driver (lib/FatFs_SPI/sd_driver/sd_card.c) sends: CMD0, 8, 9, 10, 12, 13,
+// 16, 17, 18, 24, 25, 55, 58, 59 and ACMD23, 41. Checks command CRCs (CMD0
+// and CMD8 always, the rest after CMD59) and data CRCs. Takes
+// SIM_SD_INIT_MS to leave the idle state after the first ACMD41, sends a
+// data token SIM_SD_READ_US after a read command (SIM_SD_NEXT_READ_US
+// between the blocks of CMD18) and is busy SIM_SD_PROGRAM_US after each block
+// written; every SIM_SD_STALL_EVERY blocks written it stalls for
+// SIM_SD_STALL_MS instead, as a card does when it cleans up.
+// Powered up, it is in SD mode until a CMD0 with chip select low.
+#define SIM_SD_INIT_MS 50
+#define SIM_SD_READ_US 300
+#define SIM_SD_NEXT_READ_US 60
+#define SIM_SD_PROGRAM_US 350
+#define SIM_SD_STALL_EVERY 512
+#define SIM_SD_STALL_MS 40
+
+typedef struct sim_sd_stats {
+    uint32_t cmds[64];   // Per command index
+    uint32_t acmds[64];
+    uint64_t blocks_read;
+    uint64_t blocks_written;
+    uint32_t crc_errors;  // Command and data CRCs that did not match
+    uint32_t stalls;
+    uint64_t program_ns;  // Busy after writes
+} sim_sd_stats_t;
+
+typedef struct sim_sd {
+    sim_spi_dev_t dev;
+    uint cs_gpio;
+    uint8_t *data;
+    uint32_t sectors;
+    // Protocol state
+    bool spi_mode;  // false: powered up in SD mode, only CMD0 is heard
+    bool idle;
+    bool app_cmd;  // Last command was CMD55
+    bool crc_on;
+    uint64_t init_done_ns;  // 0: ACMD41 not seen yet
+    uint8_t cmd[6];
+    uint8_t cmd_len;
+    uint8_t out[600];  // Bytes queued for MISO
+    uint16_t out_head, out_len;
+    uint64_t busy_until_ns;
+    int read_left;  // Blocks still to send: -1 until CMD12
+    uint32_t read_lba;
+    uint64_t read_ready_ns;
+    enum { SIM_SD_WRITE_NONE, SIM_SD_WRITE_SINGLE, SIM_SD_WRITE_MULTI } write_mode;
+    uint32_t write_lba;
+    int rx_len;  // Data block bytes received (with the CRC); -1: no block
+    uint8_t rx[514];
+    uint32_t write_count;  // For the stalls
+    sim_sd_stats_t stats;
+} sim_sd_t;
+
+// sectors of 512 bytes, a multiple of 1024 (the CSD counts 512 KiB units)
+bool sim_sd_init(sim_sd_t *sd, uint bus, uint cs_gpio, uint32_t sectors);
+// Back to SD mode, as after a power cycle (the image is kept)
+void sim_sd_power_cycle(sim_sd_t *sd);
+// Prints the commands and blocks since the last sim_sd_stats_reset()
+void sim_sd_print(const sim_sd_t *sd, FILE *out);
+void sim_sd_stats_reset(sim_sd_t *sd);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,24 @@
+/* sim_internal.h
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Shared between the parts of the simulation (sim_core.c, sim_bus.c)
+
+#pragma once
+
+#include "pico_sim.h"
+
+extern sim_stats_t sim_counters;
+extern uint64_t sim_stats_since_ns;  // Clock at the last sim_stats_reset()
+
+void sim_bus_stats_reset(void);
+
+/* [] END OF FILE */
@@ -0,0 +1,328 @@
+/* sim_sdcard.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+#include <stdlib.h>
+#include <string.h>
+//
+#include "crc.h"
+//
+#include "sim_devices.h"
+
+#define BLOCK 512
+#define R1_IDLE 0x01
+#define R1_ILLEGAL 0x04
+#define R1_CRC 0x08
+#define R1_ADDRESS 0x20
+#define R1_PARAMETER 0x40
+#define DATA_ACCEPTED 0x05
+#define DATA_CRC_ERROR 0x0B
+#define DATA_WRITE_ERROR 0x0D
+#define R1B_BUSY_NS 20000ull  // After CMD12 and the end of a multiple block write
+
+static void push(sim_sd_t *sd, uint8_t b) {
+    if (sd->out_head + sd->out_len == sizeof sd->out) {
+        memmove(sd->out, sd->out + sd->out_head, sd->out_len);
+        sd->out_head = 0;
+    }
+    sd->out[sd->out_head + sd->out_len++] = b;
+}
+
+static void clear_out(sim_sd_t *sd) { sd->out_head = sd->out_len = 0; }
+
+// A data token, the block and its CRC
+static void push_block(sim_sd_t *sd, const uint8_t *data, size_t len) {
+    push(sd, 0xFE);
+    for (size_t i = 0; i < len; ++i) push(sd, data[i]);
+    unsigned short crc = crc16((const char *)data, (int)len);
+    push(sd, crc >> 8);
+    push(sd, crc & 0xFF);
+}
+
+static void csd(const sim_sd_t *sd, uint8_t out[16]) {
+    uint32_t c_size = sd->sectors / 1024 - 1;  // C_SIZE: csd[69:48]
+    const uint8_t v2[16] = {0x40, 0x0E, 0x00, 0x32, 0x5B, 0x59, 0x00, (c_size >> 16) & 0x3F,
+                            (uint8_t)(c_size >> 8), (uint8_t)c_size, 0x7F, 0x80, 0x0A, 0x40, 0x00};
+    memcpy(out, v2, 16);
+    out[15] = (uint8_t)(crc7((const char *)out, 15) << 1) | 1;
+}
+
+static void cid(uint8_t out[16]) {
+    // Manufacturer, OEM, "PSIM1", revision, serial, date
+    const uint8_t id[16] = {0x03, 'S', 'D', 'P', 'S', 'I', 'M', '1', 0x10,
+                            0x12, 0x34, 0x56, 0x78, 0x01, 0x9A};
+    memcpy(out, id, 16);
+    out[15] = (uint8_t)(crc7((const char *)out, 15) << 1) | 1;
+}
+
+static void reset(sim_sd_t *sd) {
+    sd->idle = true;
+    sd->app_cmd = false;
+    sd->crc_on = false;
+    sd->init_done_ns = 0;
+    sd->read_left = 0;
+    sd->write_mode = SIM_SD_WRITE_NONE;
+    sd->rx_len = -1;
+    sd->busy_until_ns = 0;
+}
+
+// Commands a card answers in the idle state
+static bool idle_ok(uint8_t idx, bool acmd) {
+    return acmd ? idx == 41 : idx == 0 || idx == 8 || idx == 55 || idx == 58 || idx == 59;
+}
+
+static void command(sim_sd_t *sd) {
+    const uint8_t *c = sd->cmd;
+    uint8_t idx = c[0] & 0x3F;
+    uint32_t arg = (uint32_t)c[1] << 24 | (uint32_t)c[2] << 16 | (uint32_t)c[3] << 8 | c[4];
+    bool crc_ok = c[5] == ((uint8_t)(crc7((const char *)c, 5) << 1) | 1);
+    uint64_t now = sim_now_ns();
+
+    if (!sd->spi_mode) {
+        // SD mode: a CMD0 with chip select low switches to SPI mode
+        if (idx != 0 || !crc_ok) return;
+        sd->spi_mode = true;
+    }
+    clear_out(sd);
+    push(sd, 0xFF);  // NCR
+    if ((idx == 0 || idx == 8 || sd->crc_on) && !crc_ok) {
+        sd->stats.crc_errors++;
+        sd->app_cmd = false;
+        push(sd, R1_CRC | (sd->idle ? R1_IDLE : 0));
+        return;
+    }
+    bool acmd = sd->app_cmd;
+    sd->app_cmd = false;
+    if (acmd)
+        sd->stats.acmds[idx]++;
+    else
+        sd->stats.cmds[idx]++;
+    uint8_t r1 = sd->idle ? R1_IDLE : 0;
+    if (sd->idle && !idle_ok(idx, acmd)) {
+        push(sd, r1 | R1_ILLEGAL);
+        return;
+    }
+    if (acmd) {
+        switch (idx) {
+            case 41:
+                if (!sd->init_done_ns) sd->init_done_ns = now + SIM_SD_INIT_MS * 1000000ull;
+                if (now >= sd->init_done_ns) sd->idle = false;
+                push(sd, sd->idle ? R1_IDLE : 0);
+                return;
+            case 23:
+                push(sd, r1);
+                return;
+            default:
+                push(sd, r1 | R1_ILLEGAL);
+                return;
+        }
+    }
+    switch (idx) {
+        case 0:
+            reset(sd);
+            push(sd, R1_IDLE);
+            break;
+        case 8:
+            push(sd, r1);
+            push(sd, 0x00);
+            push(sd, 0x00);
+            push(sd, (arg >> 8) & 0x0F);
+            push(sd, arg & 0xFF);
+            break;
+        case 9: {
+            uint8_t reg[16];
+            csd(sd, reg);
+            push(sd, r1);
+            push(sd, 0xFF);
+            push_block(sd, reg, sizeof reg);
+            break;
+        }
+        case 10: {
+            uint8_t reg[16];
+            cid(reg);
+            push(sd, r1);
+            push(sd, 0xFF);
+            push_block(sd, reg, sizeof reg);
+            break;
+        }
+        case 12:
+            sd->read_left = 0;
+            push(sd, 0xFF);  // Stuff byte
+            push(sd, r1);
+            sd->busy_until_ns = now + R1B_BUSY_NS;
+            break;
+        case 13:
+            push(sd, r1);
+            push(sd, 0x00);
+            break;
+        case 16:
+            push(sd, arg == BLOCK ? r1 : r1 | R1_PARAMETER);
+            break;
+        case 17:
+        case 18:
+            if (arg >= sd->sectors) {
+                push(sd, r1 | R1_ADDRESS);
+                break;
+            }
+            push(sd, r1);
+            sd->read_lba = arg;
+            sd->read_left = idx == 17 ? 1 : -1;
+            sd->read_ready_ns = now + SIM_SD_READ_US * 1000ull;
+            break;
+        case 24:
+        case 25:
+            if (arg >= sd->sectors) {
+                push(sd, r1 | R1_ADDRESS);
+                break;
+            }
+            push(sd, r1);
+            sd->write_lba = arg;
+            sd->write_mode = idx == 24 ? SIM_SD_WRITE_SINGLE : SIM_SD_WRITE_MULTI;
+            break;
+        case 55:
+            sd->app_cmd = true;
+            push(sd, r1);
+            break;
+        case 58: {
+            uint32_t ocr = 0x00FF8000 | (sd->idle ? 0 : 0xC0000000);  // Powered up, CCS
+            push(sd, r1);
+            for (int shift = 24; shift >= 0; shift -= 8) push(sd, (ocr >> shift) & 0xFF);
+            break;
+        }
+        case 59:
+            sd->crc_on = arg & 1;
+            push(sd, r1);
+            break;
+        default:
+            push(sd, r1 | R1_ILLEGAL);
+    }
+}
+
+static void block_written(sim_sd_t *sd) {
+    uint64_t now = sim_now_ns();
+    unsigned short crc = (unsigned short)(sd->rx[BLOCK] << 8 | sd->rx[BLOCK + 1]);
+    sd->rx_len = -1;
+    if (sd->write_mode == SIM_SD_WRITE_SINGLE) sd->write_mode = SIM_SD_WRITE_NONE;
+    if (sd->crc_on && crc != crc16((const char *)sd->rx, BLOCK)) {
+        sd->stats.crc_errors++;
+        push(sd, DATA_CRC_ERROR);
+        return;
+    }
+    if (sd->write_lba >= sd->sectors) {
+        push(sd, DATA_WRITE_ERROR);
+        return;
+    }
+    memcpy(sd->data + (size_t)sd->write_lba++ * BLOCK, sd->rx, BLOCK);
+    sd->stats.blocks_written++;
+    push(sd, DATA_ACCEPTED);
+    uint64_t busy = SIM_SD_PROGRAM_US * 1000ull;
+    if (++sd->write_count % SIM_SD_STALL_EVERY == 0) {
+        busy = SIM_SD_STALL_MS * 1000000ull;
+        sd->stats.stalls++;
+    }
+    sd->stats.program_ns += busy;
+    sd->busy_until_ns = now + busy;
+}
+
+static uint8_t sd_exchange(void *ctx, uint8_t mosi) {
+    sim_sd_t *sd = ctx;
+    uint64_t now = sim_now_ns();
+    if (sim_gpio_level(sd->cs_gpio)) {
+        // Deselected: the card lets go of MISO and drops what it was saying
+        clear_out(sd);
+        sd->cmd_len = 0;
+        return 0xFF;
+    }
+
+    uint8_t miso = 0xFF;
+    if (sd->out_len) {
+        miso = sd->out[sd->out_head++];
+        if (!--sd->out_len) {
+            sd->out_head = 0;
+            if (sd->read_left && sd->read_ready_ns < now + SIM_SD_NEXT_READ_US * 1000ull)
+                sd->read_ready_ns = now + SIM_SD_NEXT_READ_US * 1000ull;
+        }
+    } else if (now < sd->busy_until_ns) {
+        miso = 0x00;
+    } else if (sd->read_left && !sd->cmd_len && now >= sd->read_ready_ns) {
+        if (sd->read_lba < sd->sectors) {
+            push_block(sd, sd->data + (size_t)sd->read_lba++ * BLOCK, BLOCK);
+            sd->stats.blocks_read++;
+        } else {
+            push(sd, 0x08);  // Data error token: out of range
+            sd->read_left = 1;
+        }
+        if (sd->read_left > 0) sd->read_left--;
+        miso = sd->out[sd->out_head++];
+        sd->out_len--;
+    }
+
+    if (sd->rx_len >= 0) {
+        sd->rx[sd->rx_len++] = mosi;
+        if (sd->rx_len == (int)sizeof sd->rx) block_written(sd);
+    } else if (sd->write_mode != SIM_SD_WRITE_NONE && !sd->cmd_len &&
+               (mosi == 0xFE || mosi == 0xFC || mosi == 0xFD)) {
+        if (mosi == (sd->write_mode == SIM_SD_WRITE_SINGLE ? 0xFE : 0xFC)) {
+            sd->rx_len = 0;
+        } else if (mosi == 0xFD && sd->write_mode == SIM_SD_WRITE_MULTI) {
+            sd->write_mode = SIM_SD_WRITE_NONE;
+            if (sd->busy_until_ns < now + R1B_BUSY_NS) sd->busy_until_ns = now + R1B_BUSY_NS;
+        }
+    } else if (sd->cmd_len) {
+        sd->cmd[sd->cmd_len++] = mosi;
+        if (sd->cmd_len == sizeof sd->cmd) {
+            sd->cmd_len = 0;
+            command(sd);
+        }
+    } else if ((mosi & 0xC0) == 0x40) {
+        sd->cmd[0] = mosi;
+        sd->cmd_len = 1;
+    }
+    return miso;
+}
+
+bool sim_sd_init(sim_sd_t *sd, uint bus, uint cs_gpio, uint32_t sectors) {
+    if (!sectors || sectors % 1024) return false;
+    memset(sd, 0, sizeof *sd);
+    sd->data = calloc(sectors, BLOCK);
+    if (!sd->data) return false;
+    sd->sectors = sectors;
+    sd->cs_gpio = cs_gpio;
+    reset(sd);
+    sd->dev = (sim_spi_dev_t){.name = "sdcard", .exchange = sd_exchange, .ctx = sd};
+    sim_spi_attach(bus, &sd->dev);
+    return true;
+}
+
+void sim_sd_power_cycle(sim_sd_t *sd) {
+    reset(sd);
+    sd->spi_mode = false;
+    sd->cmd_len = 0;
+    clear_out(sd);
+}
+
+void sim_sd_stats_reset(sim_sd_t *sd) { memset(&sd->stats, 0, sizeof sd->stats); }
+
+void sim_sd_print(const sim_sd_t *sd, FILE *out) {
+    const sim_sd_stats_t *s = &sd->stats;
+    fputs("sdcard commands:", out);
+    for (unsigned i = 0; i < 64; ++i)
+        if (s->cmds[i]) fprintf(out, " CMD%u=%lu", i, (unsigned long)s->cmds[i]);
+    for (unsigned i = 0; i < 64; ++i)
+        if (s->acmds[i]) fprintf(out, " ACMD%u=%lu", i, (unsigned long)s->acmds[i]);
+    fprintf(out,
+            "\nsdcard blocks: %llu read, %llu written; %lu stalls, %.1f ms programming; "
+            "%lu CRC errors\n",
+            (unsigned long long)s->blocks_read, (unsigned long long)s->blocks_written,
+            (unsigned long)s->stalls, s->program_ns / 1e6, (unsigned long)s->crc_errors);
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,138 @@
+/* sim_ssd1306.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+#include <string.h>
+//
+#include "sim_devices.h"
+
+// Bytes of arguments after each command that has any
+static uint8_t args_of(uint8_t cmd) {
+    switch (cmd) {
+        case 0x21:  // Column address
+        case 0x22:  // Page address
+            return 2;
+        case 0x20:  // Addressing mode
+        case 0x81:  // Contrast
+        case 0x8D:  // Charge pump
+        case 0xA8:  // Multiplex ratio
+        case 0xD3:  // Display offset
+        case 0xD5:  // Clock divide
+        case 0xD9:  // Precharge
+        case 0xDA:  // COM pins
+        case 0xDB:  // VCOMH deselect
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static void command(sim_ssd1306_t *d) {
+    const uint8_t *c = d->cmd;
+    d->commands++;
+    switch (c[0]) {
+        case 0x20:
+            d->mode = c[1] & 3;
+            break;
+        case 0x21:
+            d->col_start = d->col = c[1] & 0x7F;
+            d->col_end = c[2] & 0x7F;
+            break;
+        case 0x22:
+            d->page_start = d->page = c[1] & 7;
+            d->page_end = c[2] & 7;
+            break;
+        case 0xAE:
+        case 0xAF:
+            d->on = c[0] & 1;
+            break;
+    }
+}
+
+static void data(sim_ssd1306_t *d, uint8_t b) {
+    d->ram[d->page][d->col] = b;
+    bool last_col = d->col == d->col_end, last_page = d->page == d->page_end;
+    if (last_col && last_page) d->frames++;
+    switch (d->mode) {
+        case 0:  // Horizontal
+            d->col = last_col ? d->col_start : d->col + 1;
+            if (last_col) d->page = last_page ? d->page_start : d->page + 1;
+            break;
+        case 1:  // Vertical
+            d->page = last_page ? d->page_start : d->page + 1;
+            if (last_page) d->col = last_col ? d->col_start : d->col + 1;
+            break;
+        default:  // Page: the column wraps within the page
+            d->col = last_col ? d->col_start : d->col + 1;
+    }
+}
+
+static int ssd_write(void *ctx, const uint8_t *src, size_t len, bool nostop) {
+    sim_ssd1306_t *d = ctx;
+    size_t i = 0;
+    while (i < len) {
+        uint8_t control = src[i++];
+        bool co = control & 0x80;  // Continuation: one byte, then another control byte
+        if (control & 0x40) {
+            for (; i < len; ++i) {
+                data(d, src[i]);
+                if (co) {
+                    ++i;
+                    break;
+                }
+            }
+            continue;
+        }
+        for (; i < len; ++i) {
+            d->cmd[d->cmd_len++] = src[i];
+            if (d->cmd_len > args_of(d->cmd[0])) {
+                command(d);
+                d->cmd_len = 0;
+            }
+            if (co) {
+                ++i;
+                break;
+            }
+        }
+    }
+    return (int)len;
+}
+
+void sim_ssd1306_init(sim_ssd1306_t *d, uint bus, uint8_t addr) {
+    memset(d, 0, sizeof *d);
+    d->col_end = SIM_SSD1306_W - 1;
+    d->page_end = SIM_SSD1306_PAGES - 1;
+    d->mode = 2;  // The reset state
+    d->dev = (sim_i2c_dev_t){.name = "ssd1306", .addr = addr, .write = ssd_write, .ctx = d};
+    sim_i2c_attach(bus, &d->dev);
+}
+
+void sim_ssd1306_print(const sim_ssd1306_t *d, FILE *out) {
+    fputc('+', out);
+    for (unsigned x = 0; x < SIM_SSD1306_W / 2; ++x) fputc('-', out);
+    fputs("+\n", out);
+    for (unsigned y = 0; y < SIM_SSD1306_PAGES * 8; y += 4) {
+        fputc('|', out);
+        for (unsigned x = 0; x < SIM_SSD1306_W; x += 2) {
+            unsigned lit = 0;
+            for (unsigned dy = 0; dy < 4; ++dy)
+                for (unsigned dx = 0; dx < 2; ++dx)
+                    lit += (d->ram[(y + dy) / 8][x + dx] >> ((y + dy) % 8)) & 1;
+            fputc(!d->on ? ' ' : lit >= 4 ? '#' : lit >= 2 ? '+' : lit ? '.' : ' ', out);
+        }
+        fputs("|\n", out);
+    }
+    fputc('+', out);
+    for (unsigned x = 0; x < SIM_SSD1306_W / 2; ++x) fputc('-', out);
+    fputs("+\n", out);
+}
+
+/* [] END OF FILE */
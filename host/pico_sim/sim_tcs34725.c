@@ -0,0 +1,111 @@
+/* sim_tcs34725.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+#include <string.h>
+//
+#include "sim_devices.h"
+
+#define REG_ENABLE 0x00
+#define REG_ATIME 0x01
+#define REG_CONTROL 0x0F
+#define REG_ID 0x12
+#define REG_STATUS 0x13
+#define REG_CDATAL 0x14
+
+#define ENABLE_PON 0x01
+#define ENABLE_AEN 0x02
+#define STATUS_AVALID 0x01
+#define CYCLE_NS 2400000ull
+
+// Counts per integration cycle at gain 1x: clear, red, green, blue
+static const uint16_t scenes[][4] = {
+    {36, 24, 6, 5},    // Red
+    {30, 7, 17, 6},    // Green
+    {28, 5, 8, 15},    // Blue
+    {60, 26, 24, 8},   // Yellow
+    {90, 30, 31, 29},  // White
+    {1, 0, 0, 0},      // Dark
+};
+static const uint8_t gains[] = {1, 4, 16, 60};
+
+static uint32_t integration_cycles(const sim_tcs34725_t *s) { return 256u - s->reg[REG_ATIME]; }
+
+static bool running(const sim_tcs34725_t *s) {
+    return (s->reg[REG_ENABLE] & (ENABLE_PON | ENABLE_AEN)) == (ENABLE_PON | ENABLE_AEN);
+}
+
+// Latches the channels the way the device does: the last full integration
+static void update(sim_tcs34725_t *s) {
+    if (!running(s)) return;
+    uint64_t period = integration_cycles(s) * CYCLE_NS;
+    uint32_t done = (uint32_t)((sim_now_ns() - s->enabled_ns) / period);
+    if (done == s->cycles) return;
+    s->cycles = done;
+    s->reg[REG_STATUS] |= STATUS_AVALID;
+    const uint16_t *scene =
+        scenes[sim_now_ns() / (SIM_TCS34725_SCENE_MS * 1000000ull) % count_of(scenes)];
+    uint32_t atime = integration_cycles(s);
+    uint32_t max = atime >= 64 ? 65535 : 1024 * atime;
+    for (unsigned ch = 0; ch < 4; ++ch) {
+        s->noise = s->noise * 1664525u + 1013904223u;
+        // Within 1/32 either way
+        uint32_t v = scene[ch] * atime * gains[s->reg[REG_CONTROL] & 3];
+        v += (uint32_t)(((uint64_t)v * ((s->noise >> 24) & 0x0F)) >> 8);
+        v -= v >> 5;
+        if (v > max) v = max;
+        s->reg[REG_CDATAL + 2 * ch] = (uint8_t)v;
+        s->reg[REG_CDATAL + 2 * ch + 1] = (uint8_t)(v >> 8);
+    }
+}
+
+static int tcs_write(void *ctx, const uint8_t *src, size_t len, bool nostop) {
+    sim_tcs34725_t *s = ctx;
+    if (!len || !(src[0] & 0x80)) return PICO_ERROR_GENERIC;  // Not a command
+    s->ptr = src[0] & 0x1F;
+    for (size_t i = 1; i < len; ++i) {
+        uint8_t reg = s->ptr;
+        s->ptr = (s->ptr + 1) & 0x1F;
+        if (reg == REG_ID || reg == REG_STATUS || reg >= REG_CDATAL) continue;  // Read only
+        bool was = running(s);
+        s->reg[reg] = src[i];
+        if (!was && running(s)) {
+            s->enabled_ns = sim_now_ns();
+            s->cycles = 0;
+        }
+    }
+    return (int)len;
+}
+
+static int tcs_read(void *ctx, uint8_t *dst, size_t len) {
+    sim_tcs34725_t *s = ctx;
+    update(s);
+    for (size_t i = 0; i < len; ++i) {
+        dst[i] = s->reg[s->ptr];
+        s->ptr = (s->ptr + 1) & 0x1F;
+    }
+    return (int)len;
+}
+
+void sim_tcs34725_init(sim_tcs34725_t *s, uint bus) {
+    memset(s, 0, sizeof *s);
+    s->reg[REG_ATIME] = 0xFF;
+    s->reg[REG_ID] = 0x44;
+    s->noise = 0x12345678u;
+    s->dev = (sim_i2c_dev_t){.name = "tcs34725",
+                             .addr = SIM_TCS34725_ADDR,
+                             .write = tcs_write,
+                             .read = tcs_read,
+                             .ctx = s};
+    sim_i2c_attach(bus, &s->dev);
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,196 @@
+// collector_sim: the whole data collector (SPI_DataCollector.c and every
+// library it links) on the host, against the Pico simulation in
+// host/pico_sim: a TCS34725 on i2c0, the SSD1306 on i2c1 and an SD card on
+// spi0, all on a virtual clock (pico_sim.h).
+//
+// The card image is formatted through the firmware's own driver stack
+// (f_mkfs), then the firmware boots and is driven as a user would: button B
+// mounts the card, "start" on the serial terminal starts a capture that
+// runs for the given virtual seconds, then "etapas", "metrics", "stop" and
+// "unmount". The firmware's output goes to stdout (-q drops it). On stderr:
+// the virtual and the host time, each bus device's traffic and share of the
+// time, the SD commands and blocks, the final screen.
+//
+// Afterwards the card is mounted again and the last session is read back
+// with log_reader.c: the CSV header, one record per sample numbered from 1,
+// about ten per second, closed cleanly. Exits 1 if any check fails.
+//
+//   collector_sim [-q] [seconds]
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "ff.h"
+//
+#include "diskio.h"
+#include "hw_config.h"
+#include "log_reader.h"
+#include "pico_sim.h"
+#include "session.h"
+#include "sim_devices.h"
+
+extern "C" int collector_main(void);
+
+// The sampling profiler looks for return addresses in Thumb code; there is
+// none here (prof.c on the host)
+extern "C" bool prof_host_is_return(uint32_t) { return false; }
+
+namespace {
+
+const uint BUTTON_B = 6;
+const uint SD_CS = 17;
+const uint32_t SD_SECTORS = 64 * 2048;  // 64 MiB
+const uint64_t T_BUTTON_US = 2500000;  // After the boot wait
+const uint64_t T_START_US = 3000000;  // After the mount
+const char HEADER[] = "Amostra,Clear,Red,Green,Blue,cor\n";
+
+sim_tcs34725_t sensor;
+sim_ssd1306_t display;
+sim_sd_t card;
+int failures;
+
+void check(bool ok, const char *what) {
+    if (!ok) {
+        std::fprintf(stderr, "FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+void button(void *arg) { sim_gpio_input(BUTTON_B, arg != nullptr); }
+
+// FAT32 (on 64 MiB, 512 byte clusters), written through glue.c and the SPI
+// driver
+bool format() {
+    sd_card_t *pSD = sd_get_by_num(0);
+    static BYTE work[64 * FF_MAX_SS];  // Multiple block writes
+    MKFS_PARM opt = {FM_FAT32, 0, 0, 0, 512};
+    FRESULT fr = f_mkfs(pSD->pcName, &opt, work, sizeof work);
+    if (FR_OK != fr) {
+        std::fprintf(stderr, "f_mkfs: %d\n", fr);
+        return false;
+    }
+    // As the firmware's unmount does: the next mount starts from a cold card
+    pSD->m_Status |= STA_NOINIT;
+    sim_sd_power_cycle(&card);
+    return true;
+}
+
+// Reads the last session back and checks it against what was captured
+void verify(unsigned seconds) {
+    sd_card_t *pSD = sd_get_by_num(0);
+    FRESULT fr = f_mount(&pSD->fatfs, pSD->pcName, 1);
+    check(FR_OK == fr, "mount after the run");
+    if (FR_OK != fr) return;
+    uint32_t count = 0, next = 0;
+    session_info_t info = {};
+    check(FR_OK == session_count(pSD, &count, &next) && count, "a session was written");
+    if (!count || FR_OK != session_get(pSD, count - 1, &info)) return;
+    check(SESSION_CLOSED == info.closed, "session closed");
+    char path[64];
+    session_path(pSD, &info, path, sizeof path);
+
+    static log_reader_t r;
+    fr = log_reader_open(&r, path);
+    check(FR_OK == fr, "session opens with log_reader");
+    if (FR_OK != fr) return;
+    std::string text;
+    char buf[512];
+    UINT br;
+    do {
+        if (FR_OK != log_reader_read(&r, buf, sizeof buf, &br)) break;
+        text.append(buf, br);
+    } while (br == sizeof buf);
+    log_reader_close(&r);
+    f_unmount(pSD->pcName);
+
+    check(0 == text.compare(0, sizeof HEADER - 1, HEADER), "CSV header");
+    unsigned samples = 0;
+    bool in_order = true;
+    for (size_t pos = sizeof HEADER - 1; pos < text.size();) {
+        size_t end = text.find('\n', pos);
+        if (end == std::string::npos) {
+            in_order = false;
+            break;
+        }
+        if (std::strtoul(text.c_str() + pos, nullptr, 10) != samples + 1) in_order = false;
+        samples++;
+        pos = end + 1;
+    }
+    check(in_order, "samples numbered 1, 2, 3... one per line");
+    // 10 Hz; the first and the last interval may be cut
+    check(samples + 2 >= seconds * 10 && samples <= seconds * 10 + 2, "about 10 samples a second");
+    std::fprintf(stderr, "session %s: %u samples, %lu records, %lu bytes\n", path, samples,
+                 (unsigned long)info.records, (unsigned long)info.size);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    int arg = 1;
+    bool quiet = arg < argc && 0 == std::strcmp(argv[arg], "-q");
+    if (quiet) arg++;
+    unsigned seconds = arg < argc ? (unsigned)std::strtoul(argv[arg], nullptr, 10) : 10;
+    if (!seconds) seconds = 1;
+
+    datetime_t t = {2024, 6, 1, 6, 12, 0, 0};
+    sim_rtc_set(&t);
+    sim_tcs34725_init(&sensor, 0);
+    sim_ssd1306_init(&display, 1, 0x3C);
+    if (!sim_sd_init(&card, 0, SD_CS, SD_SECTORS)) {
+        std::fprintf(stderr, "no memory for the card image\n");
+        return 1;
+    }
+    if (!format()) return 1;
+    sim_stats_reset();
+    sim_sd_stats_reset(&card);
+
+    uint64_t boot_us = sim_now_ns() / 1000;
+    uint64_t start_us = boot_us + T_START_US, stop_us = start_us + seconds * 1000000ull;
+    sim_gpio_input(BUTTON_B, true);  // Pulled up
+    sim_at(boot_us + T_BUTTON_US, button, nullptr);
+    sim_at(boot_us + T_BUTTON_US + 100000, button, &card);
+    sim_serial_input(start_us, "start\n");
+    sim_serial_input(stop_us, "etapas\n");
+    sim_serial_input(stop_us + 100000, "metrics\n");
+    sim_serial_input(stop_us + 200000, "stop\n");
+    sim_serial_input(stop_us + 500000, "unmount\n");
+
+    if (quiet && !std::freopen("/dev/null", "w", stdout)) return 1;
+    auto wall0 = std::chrono::steady_clock::now();
+    bool stopped = sim_run(collector_main, stop_us + 1000000);
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall0).count();
+    std::fflush(stdout);
+    check(stopped, "firmware still running at the end");
+
+    double virt = (sim_now_ns() / 1000 - boot_us) / 1e6;
+    std::fprintf(stderr, "%.2f s virtual in %.2f s host (%.0fx)\n", virt, wall,
+                 wall > 0 ? virt / wall : 0.0);
+    sim_print_buses(stderr);
+    sim_sd_print(&card, stderr);
+    const sim_stats_t *s = sim_stats();
+    std::fprintf(stderr,
+                 "sleeping %.1f ms, %llu tud_task, %llu clock reads, %llu irqs, %llu DMA, "
+                 "%llu flash erases, %llu flash pages, %llu semaphore timeouts\n",
+                 s->sleep_ns / 1e6, (unsigned long long)s->tud_task_calls,
+                 (unsigned long long)s->time_reads, (unsigned long long)s->irqs,
+                 (unsigned long long)s->dma_transfers, (unsigned long long)s->flash_erases,
+                 (unsigned long long)s->flash_programs, (unsigned long long)s->sem_timeouts);
+    std::fprintf(stderr, "display: %lu frames, %lu commands\n", (unsigned long)display.frames,
+                 (unsigned long)display.commands);
+    sim_ssd1306_print(&display, stderr);
+    check(!card.stats.crc_errors, "no CRC errors on the card");
+    check(!s->sem_timeouts, "no SPI transfer timed out");
+    check(!s->i2c_unanswered, "every I2C transfer found its device");
+
+    verify(seconds);
+    if (failures) {
+        std::fprintf(stderr, "collector_sim: %d checks failed\n", failures);
+        return 1;
+    }
+    std::fprintf(stderr, "collector_sim: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,84 @@
+// dlog_decode: turns the hex lines of the deferred log (lib/FatFs_SPI/include/
+// dlog.h, "dlog bin" on the serial terminal) back into text.
+//
+//   dlog_decode spi_data_collector.dlog capture.txt
+//   dlog_decode -t spi_data_collector.dlog < /dev/ttyACM0
+//
+// The dictionary is the dlog_fmt section of the firmware, written next to
+// the .elf by the build. Lines that are not DLOG_LINE_TAG lines are copied
+// as they are. -t prefixes each message with the device time (s) and the
+// gap since the previous one (ms).
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "dlog.h"
+
+int main(int argc, char **argv) {
+    bool times = false;
+    int argi = 1;
+    if (argi < argc && !std::strcmp(argv[argi], "-t")) {
+        times = true;
+        ++argi;
+    }
+    if (argi >= argc || argc - argi > 2) {
+        std::fprintf(stderr, "usage: %s [-t] firmware.dlog [capture.txt]\n", argv[0]);
+        return 2;
+    }
+    FILE *f = std::fopen(argv[argi], "rb");
+    if (!f) {
+        std::perror(argv[argi]);
+        return 1;
+    }
+    std::vector<char> dict;
+    char chunk[4096];
+    for (size_t n; (n = std::fread(chunk, 1, sizeof chunk, f)) > 0;)
+        dict.insert(dict.end(), chunk, chunk + n);
+    std::fclose(f);
+    if (dict.empty() || dict.back()) dict.push_back(0);  // The last format ends there
+
+    FILE *in = stdin;
+    if (argi + 1 < argc && !(in = std::fopen(argv[argi + 1], "r"))) {
+        std::perror(argv[argi + 1]);
+        return 1;
+    }
+    std::string line;
+    bool have_prev = false;
+    uint32_t prev_us = 0, decoded = 0, unknown = 0;
+    for (int c; (c = std::fgetc(in)) != EOF;) {
+        if ('\n' != c) {
+            line += char(c);
+            continue;
+        }
+        while (!line.empty() && '\r' == line.back()) line.pop_back();
+        dlog_rec_t rec;
+        if (!dlog_parse_line(line.c_str(), &rec)) {
+            std::printf("%s\n", line.c_str());
+        } else if (rec.id >= dict.size() - 1) {
+            std::printf("[dlog] unknown format id %u: wrong dictionary?\n", rec.id);
+            ++unknown;
+        } else {
+            char text[512];
+            dlog_format(text, sizeof text, &dict[rec.id], &rec);
+            if (times) {
+                // Timestamps are 32 bit microseconds: differences survive wrap around
+                std::printf("%12.6f %+9.3f  ", rec.t_us / 1e6,
+                            have_prev ? int32_t(rec.t_us - prev_us) / 1000.0 : 0.0);
+                prev_us = rec.t_us;
+                have_prev = true;
+            }
+            std::fputs(text, stdout);
+            size_t n = std::strlen(text);
+            if (!n || '\n' != text[n - 1]) std::putchar('\n');
+            ++decoded;
+        }
+        std::fflush(stdout);
+        line.clear();
+    }
+    if (in != stdin) std::fclose(in);
+    std::fprintf(stderr, "%u messages decoded, %u with an unknown id\n", decoded, unknown);
+    return 0;
+}
@@ -0,0 +1,199 @@
+// dlog_test: the deferred log (lib/FatFs_SPI/src/dlog.c) on the host.
+//
+// Checks the formatting of each argument kind against snprintf, strings
+// copied at the call (the caller's buffer may change), long strings cut so
+// that the numbers after them are kept, the hex line round trip through a
+// dictionary taken from this program's dlog_fmt section (as dlog_decode
+// uses the firmware's), and several writer threads against one drain: every
+// record arrives once, in order per writer, or is counted as dropped.
+//
+//   dlog_test [records per writer]
+
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dlog.h"
+
+extern "C" uint32_t sd_stats_host_now_us(void) { return 1234; }
+
+extern "C" const char __start_dlog_fmt[] __attribute__((weak));
+extern "C" const char __stop_dlog_fmt[] __attribute__((weak));
+
+namespace {
+
+int failures;
+
+void check(bool ok, const std::string &what) {
+    if (!ok) {
+        std::fprintf(stderr, "FAIL: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+std::string take_text() {
+    dlog_rec_t rec;
+    if (!dlog_take(&rec)) return "(nothing)";
+    char text[256];
+    dlog_format(text, sizeof text, dlog_fmt_of(&rec), &rec);
+    return text;
+}
+
+std::string expected(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+std::string expected(const char *fmt, ...) {
+    char text[256];
+    va_list ap;
+    va_start(ap, fmt);
+    std::vsnprintf(text, sizeof text, fmt, ap);
+    va_end(ap);
+    return text;
+}
+
+// Logs and formats back, compared with snprintf
+#define CHECK_FORMAT(fmt, ...)                                                  \
+    do {                                                                        \
+        DLOG_PRINTF(fmt, ##__VA_ARGS__);                                        \
+        std::string got = take_text(), want = expected(fmt, ##__VA_ARGS__);     \
+        check(got == want, std::string(fmt) + ": \"" + got + "\" != \"" + want + "\""); \
+    } while (0)
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    unsigned per_writer = argc > 1 ? (unsigned)std::strtoul(argv[1], nullptr, 0) : 5000;
+    dlog_init();
+
+    // Formatting
+    int neg = -42;
+    unsigned big = 4000000000u;
+    int64_t wide = -1234567890123ll;
+    uint64_t uwide = 0xfedcba9876543210ull;
+    uint16_t half = 65535;
+    char ch = 'x';
+    CHECK_FORMAT("plain text\n");
+    CHECK_FORMAT("%d %i %u %x %X %o", neg, neg, big, big, big, 8u);
+    CHECK_FORMAT("%5d|%-5d|%05d|%+d|% d", 42, 42, 42, 42, 42);
+    CHECK_FORMAT("%lld %llu %llx", (long long)wide, (unsigned long long)uwide,
+                 (unsigned long long)uwide);
+    CHECK_FORMAT("%hu %c %%", half, ch);
+    CHECK_FORMAT("%s=%d", "name", 7);
+    CHECK_FORMAT("[%-8s|%8s|%.3s]", "ab", "cd", "abcdef");
+    CHECK_FORMAT("%*d|%-*d|%.*s", 6, 3, 4, 5, 2, "xyz");
+    CHECK_FORMAT("%u %u %u %u %u %u", 1u, 2u, 3u, 4u, 5u, 6u);
+    CHECK_FORMAT("%#x %#o", 255u, 8u);
+
+    // Strings are copied when logged
+    {
+        char buf[16];
+        std::strcpy(buf, "before");
+        DLOG_PRINTF("temp %s", buf);
+        std::strcpy(buf, "after");
+        check(take_text() == "temp before", "string copied at the call");
+    }
+
+    // A long string is cut, the numbers after it kept
+    {
+        std::string path(100, 'p');
+        DLOG_PRINTF("%s:%d %s (%d)", path.c_str(), 123, "tail", 9);
+        std::string got = take_text();
+        check(got.size() < 60 && got.find(":123 tail (9)") != std::string::npos,
+              "long string cut, later arguments kept: " + got);
+    }
+
+    // Hex lines through a dictionary made of the format section
+    {
+        const char *start = __start_dlog_fmt, *stop = __stop_dlog_fmt;
+        check(start && stop > start, "format section present");
+        std::vector<char> dict(start, stop);
+        DLOG_PRINTF("GY33 -> C:%u R:%u G:%u B:%u cor:%s\n", 100, 20, 30, 40, "Vermelho");
+        dlog_rec_t rec, back;
+        check(dlog_take(&rec), "record taken");
+        char line[DLOG_LINE_MAX];
+        dlog_hex_line(&rec, line, sizeof line);
+        check(dlog_parse_line(line, &back) && !std::memcmp((char *)&rec + 4, (char *)&back + 4,
+                                                           DLOG_LINE_BYTES),
+              "hex line round trip");
+        char text[256];
+        dlog_format(text, sizeof text, &dict[back.id], &back);
+        check(!std::strcmp(text, "GY33 -> C:100 R:20 G:30 B:40 cor:Vermelho\n"),
+              std::string("decoded with the dictionary: ") + text);
+        check(1234 == back.t_us, "time stamp");
+        check(!dlog_parse_line("dlog:12zz", &back) && !dlog_parse_line("other", &back),
+              "not a hex line");
+    }
+
+    // Full ring: dropped and counted
+    {
+        dlog_stats_t before, after;
+        dlog_get_stats(&before);
+        for (unsigned i = 0; i < DLOG_DEPTH + 10; ++i) DLOG_PRINTF("fill %u", i);
+        dlog_get_stats(&after);
+        check(after.dropped - before.dropped == 10, "drops counted when full");
+        check(after.peak == DLOG_DEPTH, "peak");
+        bool in_order = true;
+        for (unsigned i = 0; i < DLOG_DEPTH; ++i)
+            in_order &= take_text() == "fill " + std::to_string(i);
+        check(in_order, "the first records kept, in order");
+        check(take_text() == "(nothing)", "ring empty");
+    }
+
+    // Writers on several threads, one drain
+    {
+        const unsigned writers = 4;
+        dlog_stats_t before, after;
+        dlog_get_stats(&before);
+        std::atomic<unsigned> running(writers);
+        std::vector<std::thread> threads;
+        for (unsigned w = 0; w < writers; ++w)
+            threads.emplace_back([w, per_writer, &running] {
+                for (unsigned i = 0; i < per_writer; ++i) {
+                    DLOG_PRINTF("%u %u %s", w, i, "pad");
+                    std::this_thread::yield();
+                }
+                --running;
+            });
+        std::vector<long> last(writers, -1);
+        uint64_t received = 0;
+        bool ordered = true, well_formed = true;
+        for (;;) {
+            bool done = 0 == running.load();
+            dlog_rec_t rec;
+            bool any = false;
+            while (dlog_take(&rec)) {
+                any = true;
+                char text[64];
+                dlog_format(text, sizeof text, dlog_fmt_of(&rec), &rec);
+                unsigned w, i;
+                char pad[8];
+                if (3 != std::sscanf(text, "%u %u %7s", &w, &i, pad) || w >= writers ||
+                    std::strcmp(pad, "pad")) {
+                    well_formed = false;
+                    continue;
+                }
+                ordered &= (long)i > last[w];
+                last[w] = i;
+                ++received;
+            }
+            if (done && !any) break;
+        }
+        for (auto &t : threads) t.join();
+        dlog_get_stats(&after);
+        uint64_t dropped = after.dropped - before.dropped;
+        check(well_formed, "records intact");
+        check(ordered, "in order per writer");
+        check(received + dropped == uint64_t(writers) * per_writer, "every record received or dropped");
+        check(received > 0, "records received");
+        std::printf("dlog: %u writers, %llu records received, %llu dropped, peak %lu\n", writers,
+                    (unsigned long long)received, (unsigned long long)dropped,
+                    (unsigned long)after.peak);
+    }
+
+    if (failures) return 1;
+    std::printf("dlog: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,211 @@
+// export_bench: file export in frames (export.c) on the RAM disk.
+//
+// A file is exported into memory with export_file(), whose DATA frames are
+// streamed by f_forward() from the file's sector buffer, and with the same
+// framing built on f_read() into a frame buffer, the obvious way to write it.
+// Reports host throughput, disk calls and wire overhead for both.
+//
+// The stream is then decoded with export_rx_feed() and checked against the
+// file: whole, from an unaligned offset, for a range, with debug text mixed
+// in, and with a damaged frame followed by a resume from the first byte
+// missing, as export_recv does it.
+//
+//   export_bench [megabytes] [seed]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "crc.h"
+}
+#include "export.h"
+#include "ff.h"
+#include "ramdisk.h"
+
+extern "C" void my_printf(const char *, ...) {}
+extern "C" void my_assert_func(const char *file, int line, const char *func, const char *pred) {
+    std::fprintf(stderr, "assertion \"%s\" failed: %s:%d %s\n", pred, file, line, func);
+    std::abort();
+}
+
+namespace {
+
+const char *const PATH = "0042.log";
+
+std::vector<uint8_t> wire;  // What went out over the "USB" link
+
+void to_wire(const void *data, size_t len) {
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    wire.insert(wire.end(), p, p + len);
+}
+
+int fail(const char *what) {
+    std::fprintf(stderr, "FAIL: %s\n", what);
+    return 1;
+}
+
+double secs_since(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// The same frames as export_file(), through f_read() and a frame buffer
+FRESULT export_copy(const char *path, export_out_t out) {
+    static FIL fil;
+    static uint8_t buf[EXPORT_FRAME];
+    FRESULT fr = f_open(&fil, path, FA_READ);
+    if (FR_OK != fr) return fr;
+    auto frame = [&](uint8_t type, uint32_t offset, uint32_t arg, const void *payload,
+                     uint16_t len) {
+        export_hdr_t h = {EXPORT_MAGIC, type, 0, len, offset, arg, 0, 0};
+        h.crc = crc16(reinterpret_cast<const char *>(&h), offsetof(export_hdr_t, crc));
+        out(&h, sizeof h);
+        uint16_t crc = 0;
+        update_crc16(&crc, static_cast<const char *>(payload), len);
+        if (len) out(payload, len);
+        out(&crc, sizeof crc);
+    };
+    uint32_t size = (uint32_t)f_size(&fil), pos = 0;
+    frame(EXPORT_BEGIN, 0, size, path, (uint16_t)std::strlen(path));
+    while (FR_OK == fr && pos < size) {
+        UINT br = 0;
+        fr = f_read(&fil, buf, sizeof buf, &br);
+        if (FR_OK != fr || !br) break;
+        frame(EXPORT_DATA, pos, 0, buf, (uint16_t)br);
+        pos += br;
+    }
+    frame(EXPORT_END, pos, fr, nullptr, 0);
+    f_close(&fil);
+    return fr;
+}
+
+// Receiver state, as in export_recv
+struct rx_file_t {
+    std::vector<uint8_t> data;
+    uint32_t next;
+    bool begun, ended, broken;
+};
+
+void on_frame(void *arg, const export_hdr_t *h, const uint8_t *payload, bool ok) {
+    rx_file_t *r = static_cast<rx_file_t *>(arg);
+    if (EXPORT_BEGIN == h->type && ok) {
+        r->begun = true;
+        r->data.resize(h->arg);
+    } else if (EXPORT_DATA == h->type && r->begun && !r->broken) {
+        if (!ok || h->offset != r->next || h->offset + h->len > r->data.size()) {
+            r->broken = true;
+            return;
+        }
+        std::memcpy(r->data.data() + h->offset, payload, h->len);
+        r->next += h->len;
+    } else if (EXPORT_END == h->type && ok) {
+        r->ended = true;
+    }
+}
+
+// Decodes the wire into r, from r->next on
+export_rx_t decode(rx_file_t *r) {
+    export_rx_t rx;
+    export_rx_init(&rx);
+    r->begun = r->ended = r->broken = false;
+    // In USB packet sized pieces, so frames straddle calls
+    for (size_t i = 0; i < wire.size(); i += 64)
+        export_rx_feed(&rx, wire.data() + i, std::min<size_t>(64, wire.size() - i), on_frame, r);
+    return rx;
+}
+
+bool same(const rx_file_t &r, const std::vector<uint8_t> &file, uint32_t from, uint32_t to) {
+    return r.data.size() == file.size() &&
+           !std::memcmp(r.data.data() + from, file.data() + from, to - from);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    const size_t mb = argc > 1 ? std::atoi(argv[1]) : 16;
+    const uint32_t seed = argc > 2 ? std::atoi(argv[2]) : 1;
+
+    if (!ramdisk_create(0, 128 * 2048)) return 1;
+    std::vector<uint8_t> work(FF_MAX_SS * 16);
+    MKFS_PARM opt = {FM_FAT32, 1, 0, 0, 0};
+    static FATFS fs;
+    if (FR_OK != f_mkfs("", &opt, work.data(), work.size()) || FR_OK != f_mount(&fs, "", 1))
+        return 1;
+
+    // A file of an odd size, so the last frame is short
+    std::vector<uint8_t> file((mb << 20) + 1234);
+    std::mt19937 rng(seed);
+    for (uint8_t &b : file) b = (uint8_t)rng();
+    {
+        static FIL fil;
+        UINT bw = 0;
+        if (FR_OK != f_open(&fil, PATH, FA_CREATE_ALWAYS | FA_WRITE) ||
+            FR_OK != f_write(&fil, file.data(), (UINT)file.size(), &bw) || bw != file.size() ||
+            FR_OK != f_close(&fil))
+            return fail("write the file");
+    }
+    wire.reserve(file.size() + file.size() / 64);
+
+    std::printf("%zu MB file, %u byte frames     MB/s  disk reads  sectors  wire/file\n", mb,
+                EXPORT_FRAME);
+    for (int forward = 1; forward >= 0; --forward) {
+        wire.clear();
+        ramdisk_reset_stats(0);
+        auto t0 = std::chrono::steady_clock::now();
+        FRESULT fr = forward ? export_file(PATH, 0, 0, to_wire, nullptr)
+                             : export_copy(PATH, to_wire);
+        double s = secs_since(t0);
+        if (FR_OK != fr) return fail("export");
+        ramdisk_stats_t *st = ramdisk_stats(0);
+        std::printf("%-32s %8.1f %11llu %8llu %10.4f\n",
+                    forward ? "f_forward (export_file)" : "f_read + frame buffer",
+                    file.size() / s / 1e6, (unsigned long long)st->reads,
+                    (unsigned long long)st->sectors_read, (double)wire.size() / file.size());
+        rx_file_t r = {};
+        export_rx_t rx = decode(&r);
+        if (!r.ended || r.broken || r.next != file.size() || !same(r, file, 0, r.next) ||
+            rx.skipped || rx.bad)
+            return fail("decode the whole file");
+    }
+
+    // From an unaligned offset, and a range
+    {
+        uint32_t from = 1000, len = 3 * EXPORT_FRAME + 77;
+        wire.clear();
+        if (FR_OK != export_file(PATH, from, len, to_wire, nullptr)) return fail("export range");
+        rx_file_t r = {};
+        r.next = from;
+        decode(&r);
+        if (!r.ended || r.broken || r.next != from + len || !same(r, file, from, from + len))
+            return fail("decode a range");
+    }
+
+    // Debug output between frames, and a damaged frame with a resume
+    {
+        wire.clear();
+        if (FR_OK != export_file(PATH, 0, 0, to_wire, nullptr)) return fail("export");
+        const char text[] = "[debug] something printed\r\n";
+        wire.insert(wire.begin() + wire.size() / 3, text, text + sizeof text - 1);
+        wire[wire.size() / 2] ^= 0x5A;
+        rx_file_t r = {};
+        export_rx_t rx = decode(&r);
+        if (!r.ended || !r.broken || r.next >= file.size()) return fail("damage not noticed");
+        uint32_t resumed = r.next;
+        wire.clear();
+        if (FR_OK != export_file(PATH, r.next, 0, to_wire, nullptr)) return fail("resume");
+        decode(&r);
+        if (!r.ended || r.broken || r.next != file.size() || !same(r, file, 0, r.next))
+            return fail("decode after resume");
+        std::printf("\ndamaged frame: %u bytes skipped, %u bad frames, resumed at %u, "
+                    "file complete\n",
+                    rx.skipped, rx.bad, resumed);
+    }
+    std::printf("range, unaligned offset, debug text: decoded file matches\n");
+    return 0;
+}
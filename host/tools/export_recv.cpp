@@ -0,0 +1,195 @@
+// export_recv: receives a file exported by the device over USB serial
+// (lib/FatFs_SPI/include/export.h).
+//
+//   export_recv [-o offset] [-n bytes] /dev/ttyACM0 0:/20251019/0042.log 0042.log
+//   export_recv -f capture.bin 0042.log
+//
+// Sends "export <path> <offset> <bytes>" and writes the DATA frames at their
+// offsets in the output file. If the output file exists, the transfer
+// resumes at its size unless -o is given. A frame that fails its CRC, goes
+// missing or does not arrive in time ends the pass; the command is sent
+// again from the first byte not received, up to MAX_PASSES times. Reports
+// the sustained rate of the data frames.
+//
+// With -f, a stream captured to a file (e.g. cat /dev/ttyACM0 > capture.bin)
+// is decoded instead, with no resume.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/select.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "export.h"
+
+namespace {
+
+const int MAX_PASSES = 8;
+const int IDLE_TIMEOUT_MS = 3000;
+
+struct transfer_t {
+    FILE *out;
+    uint32_t next;       // First byte not received
+    uint32_t file_size;  // From BEGIN
+    bool begun, ended, broken;
+    uint32_t end_fr;
+    uint64_t bytes;      // Good DATA bytes
+};
+
+void on_frame(void *arg, const export_hdr_t *h, const uint8_t *payload, bool ok) {
+    transfer_t *t = static_cast<transfer_t *>(arg);
+    switch (h->type) {
+        case EXPORT_BEGIN:
+            if (!ok) break;
+            t->begun = true;
+            t->file_size = h->arg;
+            std::fprintf(stderr, "%.*s: %u bytes, from %u\n", (int)h->len,
+                         reinterpret_cast<const char *>(payload), h->arg, h->offset);
+            break;
+        case EXPORT_DATA:
+            if (!t->begun || t->broken) break;
+            if (!ok || h->offset != t->next) {
+                t->broken = true;  // Everything after this is sent again
+                break;
+            }
+            std::fseek(t->out, h->offset, SEEK_SET);
+            std::fwrite(payload, 1, h->len, t->out);
+            t->next += h->len;
+            t->bytes += h->len;
+            break;
+        case EXPORT_END:
+            if (!ok || !t->begun) break;
+            t->ended = true;
+            t->end_fr = h->arg;
+            break;
+    }
+}
+
+int open_serial(const char *dev) {
+    int fd = open(dev, O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        std::perror(dev);
+        return -1;
+    }
+    termios tio;
+    if (0 == tcgetattr(fd, &tio)) {
+        cfmakeraw(&tio);
+        cfsetspeed(&tio, B115200);  // Ignored by USB CDC
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    tcflush(fd, TCIOFLUSH);
+    return fd;
+}
+
+// One export command: reads until END or the line goes quiet
+void pass(int fd, const char *path, uint32_t last, transfer_t *t) {
+    char cmd[256];
+    uint32_t len = last ? last - t->next : 0;
+    int n = std::snprintf(cmd, sizeof cmd, "export %s %u %u\n", path, t->next, len);
+    if (write(fd, cmd, n) != n) return;
+    t->begun = t->ended = t->broken = false;
+    static export_rx_t rx;
+    export_rx_init(&rx);
+    uint8_t buf[4096];
+    while (!t->ended) {
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(fd, &fds);
+        timeval tv = {IDLE_TIMEOUT_MS / 1000, IDLE_TIMEOUT_MS % 1000 * 1000};
+        if (select(fd + 1, &fds, nullptr, nullptr, &tv) <= 0) {
+            std::fprintf(stderr, "no data for %d ms\n", IDLE_TIMEOUT_MS);
+            return;
+        }
+        ssize_t got = read(fd, buf, sizeof buf);
+        if (got <= 0) return;
+        export_rx_feed(&rx, buf, got, on_frame, t);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    long offset = -1, bytes = 0;
+    const char *capture = nullptr;
+    int arg = 1;
+    for (; arg + 1 < argc && '-' == argv[arg][0]; arg += 2) {
+        if (!std::strcmp(argv[arg], "-o")) offset = std::strtol(argv[arg + 1], nullptr, 0);
+        else if (!std::strcmp(argv[arg], "-n")) bytes = std::strtol(argv[arg + 1], nullptr, 0);
+        else if (!std::strcmp(argv[arg], "-f")) capture = argv[arg + 1];
+        else break;
+    }
+    if (argc - arg != (capture ? 1 : 3)) {
+        std::fprintf(stderr,
+                     "usage: %s [-o offset] [-n bytes] /dev/ttyACM0 device-path out\n"
+                     "       %s -f capture.bin out\n",
+                     argv[0], argv[0]);
+        return 2;
+    }
+    const char *out_path = argv[argc - 1];
+
+    transfer_t t = {};
+    if (offset < 0) {
+        // Resume after what an earlier run received
+        FILE *f = std::fopen(out_path, "rb");
+        offset = 0;
+        if (f && 0 == std::fseek(f, 0, SEEK_END)) offset = std::ftell(f);
+        if (f) std::fclose(f);
+    }
+    t.out = std::fopen(out_path, offset ? "r+b" : "wb");
+    if (!t.out) {
+        std::perror(out_path);
+        return 1;
+    }
+    t.next = (uint32_t)offset;
+
+    if (capture) {
+        FILE *in = std::fopen(capture, "rb");
+        if (!in) {
+            std::perror(capture);
+            return 1;
+        }
+        static export_rx_t rx;
+        export_rx_init(&rx);
+        uint8_t buf[4096];
+        size_t got;
+        while ((got = std::fread(buf, 1, sizeof buf, in)) > 0)
+            export_rx_feed(&rx, buf, got, on_frame, &t);
+        std::fclose(in);
+        std::fclose(t.out);
+        std::fprintf(stderr, "%llu bytes, up to %u; %u bytes skipped, %u damaged frames%s\n",
+                     (unsigned long long)t.bytes, t.next, rx.skipped, rx.bad,
+                     t.ended && !t.broken ? "" : "; incomplete");
+        return t.ended && !t.broken && !t.end_fr ? 0 : 1;
+    }
+
+    int fd = open_serial(argv[arg]);
+    if (fd < 0) return 1;
+    const char *path = argv[arg + 1];
+    uint32_t last = bytes ? t.next + (uint32_t)bytes : 0;  // 0: the end of the file
+    auto t0 = std::chrono::steady_clock::now();
+    int passes = 0;
+    bool done = false;
+    while (!done && passes++ < MAX_PASSES) {
+        pass(fd, path, last, &t);
+        if (t.ended && t.end_fr) {
+            std::fprintf(stderr, "device error: FRESULT %u\n", t.end_fr);
+            break;
+        }
+        uint32_t want = last ? last : t.file_size;
+        done = t.begun && t.next >= want;
+        if (!done) std::fprintf(stderr, "pass %d stopped at %u, resuming\n", passes, t.next);
+    }
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    close(fd);
+    std::fclose(t.out);
+    std::fprintf(stderr, "%llu bytes in %.2f s, %.1f KB/s, %d pass%s%s\n",
+                 (unsigned long long)t.bytes, s, t.bytes / s / 1024, passes,
+                 passes > 1 ? "es" : "", done ? "" : "; incomplete");
+    return done ? 0 : 1;
+}
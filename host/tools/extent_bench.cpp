@@ -0,0 +1,157 @@
+// extent_bench: sustained write rate of the FatFs path against a raw extent.
+//
+// The same CSV records are written to the RAM disk in four ways:
+//   fatfs      - f_write() and an f_sync() per flush, as a plain FatFs logger
+//   crash_log  - the crash-consistent log file of a session (crash_log_start())
+//   extent/N   - a preallocated contiguous extent written straight to its
+//                sectors (crash_log_start_extent()), full blocks collected N at
+//                a time into one multi-block write
+// each with a flush every 10 records (10 Hz, one per second, as on the device)
+// and every 1000 (streaming as fast as the card takes it).
+//
+// The RAM disk counts disk_read()/disk_write() calls and sectors; those are
+// turned into card time with a simple model of the SD card on SPI at the
+// driver's fastest setting (25 MHz asked, 20.8 MHz actual). Every command
+// pays its overhead and a program busy time; a multi-block write (CMD25) pays
+// them once plus a little per extra block. The figures are an estimate to
+// compare the paths with each other, not a measurement of a given card.
+//
+//   extent_bench [records]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "crash_log.h"
+#include "ff.h"
+#include "ramdisk.h"
+
+extern "C" void my_printf(const char *, ...) {}
+
+namespace {
+
+// Card model, microseconds
+const double XFER_US = (RAMDISK_SECTOR_SIZE + 3) * 8 / 20.8;  // Token, data, CRC
+const double CMD_US = 60;          // Command, response, CMD13 status
+const double WRITE_BUSY_US = 250;  // Programming after a write command
+const double EXTRA_BLOCK_US = 20;  // Each further block of a CMD25
+const double READ_ACCESS_US = 100; // Wait for the data token
+
+const char *const COLORS[] = {"Vermelho", "Verde", "Azul", "Amarelo", "Branco", "Preto"};
+
+std::string record(uint32_t n) {
+    char line[64];
+    int len = std::snprintf(line, sizeof line, "%u,%u,%u,%u,%u,%s\n", n, n * 7 % 1024,
+                            n * 13 % 256, n * 17 % 256, n * 19 % 256, COLORS[n % 6]);
+    return std::string(line, len);
+}
+
+double card_us(const ramdisk_stats_t *s) {
+    return s->writes * (CMD_US + WRITE_BUSY_US) +
+           (s->sectors_written - s->writes) * EXTRA_BLOCK_US + s->sectors_written * XFER_US +
+           s->reads * (CMD_US + READ_ACCESS_US) + s->sectors_read * XFER_US;
+}
+
+void check(FRESULT fr, const char *what) {
+    if (FR_OK != fr) {
+        std::fprintf(stderr, "%s failed: %d\n", what, fr);
+        std::exit(1);
+    }
+}
+
+enum path_mode_t { PLAIN, CRASH_LOG, EXTENT };
+
+struct result_t {
+    ramdisk_stats_t io;
+    uint64_t bytes;
+    double host_ns;  // Per record
+};
+
+result_t run(path_mode_t mode, uint32_t burst, uint32_t records, uint32_t flush_every,
+             const std::vector<uint8_t> &pristine) {
+    static FATFS fs;
+    static FIL fil;
+    static crash_log_t cl;
+    static crash_log_blk_t burst_buf[64];
+    std::copy(pristine.begin(), pristine.end(), ramdisk_data(0));
+    check(f_mount(&fs, "", 1), "f_mount");
+    ramdisk_reset_stats(0);
+
+    result_t r = {};
+    auto t0 = std::chrono::steady_clock::now();
+    check(f_open(&fil, "data.log", FA_CREATE_NEW | FA_WRITE), "f_open");
+    if (CRASH_LOG == mode) check(crash_log_start(&cl, &fil), "crash_log_start");
+    if (EXTENT == mode)
+        check(crash_log_start_extent(&cl, &fil, 32 << 20, burst_buf, burst),
+              "crash_log_start_extent");
+    for (uint32_t n = 1; n <= records; ++n) {
+        std::string line = record(n);
+        r.bytes += line.size();
+        if (PLAIN == mode) {
+            UINT bw;
+            check(f_write(&fil, line.data(), line.size(), &bw), "f_write");
+        } else {
+            check(crash_log_write(&cl, line.data(), line.size()), "crash_log_write");
+        }
+        if (0 == n % flush_every)
+            check(PLAIN == mode ? f_sync(&fil) : crash_log_flush(&cl), "flush");
+    }
+    if (PLAIN != mode) check(crash_log_finish(&cl), "crash_log_finish");
+    check(f_close(&fil), "f_close");
+    r.host_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0)
+                    .count() / records;
+    r.io = *ramdisk_stats(0);
+
+    // What the host (or log_dump) sees: a file of whole blocks, nothing past the data
+    FILINFO fno;
+    check(f_stat("data.log", &fno), "f_stat");
+    if (PLAIN != mode && fno.fsize != (FSIZE_t)crash_log_blocks(&cl) * CRASH_LOG_BLOCK_SIZE) {
+        std::fprintf(stderr, "file size %llu does not match the log\n",
+                     (unsigned long long)fno.fsize);
+        std::exit(1);
+    }
+    f_mount(nullptr, "", 0);
+    return r;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    const uint32_t records = argc > 1 ? std::atoi(argv[1]) : 200000;
+
+    const uint64_t sectors = 128 * 2048;
+    if (!ramdisk_create(0, sectors)) return 1;
+    std::vector<uint8_t> work(FF_MAX_SS * 16);
+    MKFS_PARM opt = {FM_ANY, 1, 0, 0, 0};
+    check(f_mkfs("", &opt, work.data(), work.size()), "f_mkfs");
+    std::vector<uint8_t> pristine(ramdisk_data(0),
+                                  ramdisk_data(0) + sectors * RAMDISK_SECTOR_SIZE);
+
+    struct {
+        const char *name;
+        path_mode_t mode;
+        uint32_t burst;
+    } paths[] = {{"fatfs", PLAIN, 0},         {"crash_log", CRASH_LOG, 0},
+                 {"extent/1", EXTENT, 1},     {"extent/8", EXTENT, 8},
+                 {"extent/32", EXTENT, 32}};
+    std::printf("%u records; card time from the SPI model (see source)\n", records);
+    for (uint32_t flush_every : {10u, 1000u}) {
+        std::printf("\nflush every %u records\n", flush_every);
+        std::printf("%-10s %8s %9s %7s %9s %10s %9s %8s\n", "path", "writes", "sectors",
+                    "reads", "sectors", "card s", "KB/s", "host ns");
+        for (auto &p : paths) {
+            result_t r = run(p.mode, p.burst, records, flush_every, pristine);
+            double s = card_us(&r.io) / 1e6;
+            std::printf("%-10s %8llu %9llu %7llu %9llu %10.2f %9.1f %8.0f\n", p.name,
+                        (unsigned long long)r.io.writes,
+                        (unsigned long long)r.io.sectors_written,
+                        (unsigned long long)r.io.reads, (unsigned long long)r.io.sectors_read,
+                        s, r.bytes / s / 1024, r.host_ns);
+        }
+    }
+    return 0;
+}
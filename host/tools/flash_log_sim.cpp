@@ -0,0 +1,207 @@
+// flash_log_sim: the flash fallback log (flash_log.c) on a simulated NOR chip.
+//
+// Phase 1, wear and erase scheduling: records arrive at 10 per second into
+// a 1.5 MiB log while the "card" comes and goes; when it is there the log is
+// drained to it and committed. Some outages outlast the log. Checks that the
+// card receives every record in order except those counted as dropped, that
+// no program landed on non-erased flash, that flash_log_maintain() (called once
+// per record, as from the idle loop) left no erase to flash_log_put(), and
+// that every sector was erased the same number of times, give or take one.
+//
+// Phase 2, power cuts: the same traffic with a cut at a random flash
+// operation, a torn erase or program, then a remount. Checks that every
+// record flushed before a cut reaches the card, intact, and that the only
+// records seen twice are resends.
+//
+// Times are the chip's (nor_sim.h), not the host's.
+//
+//   flash_log_sim [records] [seed]
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "flash_log.h"
+#include "nor_sim.h"
+
+namespace {
+
+const uint32_t REGION = 1536 * 1024;
+
+// Records of 10 to 60 bytes, rebuilt from their number for checking
+std::string record(uint32_t n) {
+    std::string s = std::to_string(n) + ",";
+    s.append(n % 51, 'a' + n % 26);
+    return s + "\n";
+}
+
+int fail(const char *what) {
+    std::fprintf(stderr, "FAIL: %s\n", what);
+    return 1;
+}
+
+// The card: what was drained since the last commit is lost with the power
+struct sink_t {
+    std::vector<uint32_t> committed;
+    size_t synced = 0;
+    bool bad = false;
+};
+
+int write_rec(void *ctx, const void *rec, size_t len) {
+    sink_t *s = static_cast<sink_t *>(ctx);
+    std::string r(static_cast<const char *>(rec), len);
+    uint32_t n = std::strtoul(r.c_str(), nullptr, 10);
+    if (r != record(n)) s->bad = true;
+    s->committed.push_back(n);
+    return 0;
+}
+
+// Drains everything and commits: the card's sync, then the flash marks
+int drain(flash_log_t *fl, sink_t &s) {
+    int rc = flash_log_drain(fl, write_rec, &s);
+    if (rc) return rc;
+    s.synced = s.committed.size();
+    return flash_log_commit(fl);
+}
+
+uint32_t spread(const nor_sim_t &nor, uint32_t *lo) {
+    uint32_t sectors = nor.size / FLASH_LOG_SECTOR_SIZE;
+    uint32_t *b = nor.erase_counts, *e = b + sectors;
+    *lo = *std::min_element(b, e);
+    return *std::max_element(b, e);
+}
+
+int wear_phase(uint32_t records, uint32_t seed) {
+    nor_sim_t nor;
+    if (!nor_sim_init(&nor, REGION, seed)) return fail("nor_sim_init");
+    flash_log_dev_t dev;
+    nor_sim_dev(&nor, &dev);
+    static flash_log_t fl;
+    if (flash_log_mount(&fl, &dev)) return fail("mount");
+    std::mt19937 rng(seed);
+
+    sink_t sink;
+    bool online = true;
+    uint32_t next_change = 3000, outages = 0;
+    uint64_t put_us = 0, put_max_us = 0, maintain_us = 0;
+    for (uint32_t n = 1; n <= records; ++n) {
+        if (n >= next_change) {
+            online = !online;
+            if (!online) outages++;
+            // Outages from minutes to a few hours; one in four overflows the log
+            next_change = n + (online ? 600 + rng() % 30000
+                                      : rng() % 4 ? 600 + rng() % 20000 : 70000 + rng() % 40000);
+        }
+        uint64_t t0 = nor.now_us;
+        std::string r = record(n);
+        flash_log_put(&fl, r.data(), r.size());
+        uint64_t dt = nor.now_us - t0;
+        put_us += dt;
+        put_max_us = std::max(put_max_us, dt);
+        if (online && 0 == n % 10 && drain(&fl, sink)) return fail("drain");
+        t0 = nor.now_us;
+        if (flash_log_maintain(&fl) < 0) return fail("maintain");
+        maintain_us += nor.now_us - t0;
+    }
+    if (drain(&fl, sink)) return fail("final drain");
+
+    const flash_log_stats_t *st = flash_log_stats(&fl);
+    uint32_t last = 0, missing = 0;
+    for (uint32_t n : sink.committed) {
+        if (n <= last) return fail("out of order");
+        missing += n - last - 1;
+        last = n;
+    }
+    missing += records - last;
+    uint32_t lo, hi = spread(nor, &lo);
+    std::printf("wear: %u records, %u outages; %u dropped, %u missing\n", records, outages,
+                st->dropped, missing);
+    std::printf("  %llu erases (%u inline), %llu programs; erase count per sector %u..%u\n",
+                (unsigned long long)nor.erases, st->inline_erases,
+                (unsigned long long)nor.programs, lo, hi);
+    std::printf("  put: %.1f us average, %llu us worst; maintain: %.1f s in total\n",
+                double(put_us) / records, (unsigned long long)put_max_us, maintain_us / 1e6);
+    int rc = 0;
+    if (sink.bad) rc = fail("corrupt record");
+    else if (missing != st->dropped) rc = fail("missing records not accounted for as dropped");
+    else if (nor.violations) rc = fail("program over non-erased flash");
+    else if (st->inline_erases) rc = fail("erase in the put path");
+    else if (hi - lo > 1) rc = fail("uneven wear");
+    else if (!st->dropped || hi < 2) rc = fail("log never filled or wrapped");
+    nor_sim_free(&nor);
+    return rc;
+}
+
+int cut_phase(uint32_t cuts, uint32_t seed) {
+    nor_sim_t nor;
+    if (!nor_sim_init(&nor, 64 * FLASH_LOG_SECTOR_SIZE, seed)) return fail("nor_sim_init");
+    flash_log_dev_t dev;
+    nor_sim_dev(&nor, &dev);
+    static flash_log_t fl;
+    std::mt19937 rng(seed);
+
+    sink_t sink;
+    std::vector<uint8_t> accepted(1), must(1);
+    uint32_t n = 0, unacked_from = 1, torn = 0, resent = 0;
+    for (uint32_t c = 0; c <= cuts; ++c) {
+        nor_sim_power_on(&nor);
+        if (flash_log_mount(&fl, &dev)) return fail("mount");
+        torn += flash_log_stats(&fl)->torn;
+        if (c == cuts) break;
+        nor_sim_cut_after(&nor, rng() % 400);
+        while (!nor.off) {
+            ++n;
+            std::string r = record(n);
+            accepted.push_back(flash_log_put(&fl, r.data(), r.size()));
+            must.push_back(0);
+            if (0 == n % 7 && 0 == flash_log_flush(&fl)) {
+                for (uint32_t i = unacked_from; i <= n; ++i) must[i] = accepted[i];
+                unacked_from = n + 1;
+            }
+            if (0 == n % 23) drain(&fl, sink);
+            flash_log_maintain(&fl);
+        }
+        // The card loses what it had not synced
+        sink.committed.resize(sink.synced);
+        unacked_from = n + 1;
+    }
+    if (drain(&fl, sink)) return fail("final drain");
+
+    std::vector<uint8_t> seen(n + 1);
+    uint32_t last = 0, lost = 0;
+    for (uint32_t v : sink.committed) {
+        if (!v || v > n || !accepted[v]) return fail("unknown record");
+        if (v <= last) {
+            if (!seen[v]) return fail("out of order");
+            resent++;
+        }
+        seen[v] = 1;
+        last = std::max(last, v);
+    }
+    for (uint32_t v = 1; v <= n; ++v) {
+        if (must[v] && !seen[v]) return fail("flushed record lost");
+        lost += accepted[v] && !seen[v];
+    }
+    std::printf("cuts: %u power cuts over %u records; %u torn found at mount, "
+                "%u unflushed lost, %u resent\n",
+                cuts, n, torn, lost, resent);
+    int rc = 0;
+    if (sink.bad) rc = fail("corrupt record");
+    else if (nor.violations) rc = fail("program over non-erased flash");
+    nor_sim_free(&nor);
+    return rc;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    const uint32_t records = argc > 1 ? std::atoi(argv[1]) : 300000;
+    const uint32_t seed = argc > 2 ? std::atoi(argv[2]) : 1;
+    if (wear_phase(records, seed) || cut_phase(records / 1000, seed)) return 1;
+    std::printf("OK\n");
+    return 0;
+}
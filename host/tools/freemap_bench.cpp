@@ -0,0 +1,132 @@
+// freemap_bench: f_write latency tail while growing a file on a fragmented,
+// nearly full FAT32 volume.
+//
+// The volume is filled with small files, then every few files one is deleted
+// to leave scattered single holes. A log file is then appended 512 bytes at a
+// time (one sample block) until the volume is full. For every f_write the
+// number of sectors FatFs had to read is recorded: on a card each one costs a
+// CMD17 round trip, so it is the part of the latency that the free cluster map
+// removes. Build both freemap_bench and freemap_bench_nofreemap and compare.
+//
+//   freemap_bench [image_MiB] [fill_percent] [hole_every]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "ff.h"
+#include "ramdisk.h"
+
+namespace {
+
+void check(FRESULT fr, const char *what) {
+    if (FR_OK != fr) {
+        std::fprintf(stderr, "%s failed: %d\n", what, fr);
+        std::exit(1);
+    }
+}
+
+template <typename T>
+T percentile(std::vector<T> v, double p) {
+    if (v.empty()) return T{};
+    std::sort(v.begin(), v.end());
+    size_t ix = std::min(v.size() - 1, static_cast<size_t>(p / 100.0 * v.size()));
+    return v[ix];
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    const unsigned mib = argc > 1 ? std::atoi(argv[1]) : 64;
+    const unsigned fill_percent = argc > 2 ? std::atoi(argv[2]) : 97;
+    const unsigned hole_every = argc > 3 ? std::atoi(argv[3]) : 512;
+
+    if (!ramdisk_create(0, static_cast<uint64_t>(mib) * 2048)) return 1;
+    FATFS fs;
+    std::vector<uint8_t> work(FF_MAX_SS * 64);
+    MKFS_PARM opt = {FM_FAT32, 1, 0, 0, 512};  // 512-byte clusters: many FAT entries
+    check(f_mkfs("", &opt, work.data(), work.size()), "f_mkfs");
+    check(f_mount(&fs, "", 1), "f_mount");
+    check(f_mkdir("fill"), "f_mkdir");
+
+    // Fill with 1..8 cluster files
+    std::mt19937 rng(12345);
+    std::vector<uint8_t> chunk(8 * 512, 0xA5);
+    const DWORD total = fs.n_fatent - 2;
+    unsigned nfiles = 0;
+    for (;;) {
+        DWORD nfree;
+        FATFS *pfs;
+        check(f_getfree("", &nfree, &pfs), "f_getfree");
+        if ((uint64_t)(total - nfree) * 100 >= (uint64_t)total * fill_percent) break;
+        char name[32];
+        std::snprintf(name, sizeof name, "fill/%06u.dat", nfiles++);
+        FIL fil;
+        check(f_open(&fil, name, FA_WRITE | FA_CREATE_ALWAYS), "f_open");
+        UINT bw;
+        check(f_write(&fil, chunk.data(), 512 * (1 + rng() % 8), &bw), "f_write");
+        check(f_close(&fil), "f_close");
+    }
+    // Punch scattered holes
+    for (unsigned i = 0; i < nfiles; i += hole_every) {
+        char name[32];
+        std::snprintf(name, sizeof name, "fill/%06u.dat", i);
+        check(f_unlink(name), "f_unlink");
+    }
+    // Fresh mount, as after boot: allocation starts from the FSINFO hint
+    check(f_mount(nullptr, "", 0), "f_unmount");
+    check(f_mount(&fs, "", 1), "f_mount");
+
+    ramdisk_reset_stats(0);
+    auto t0 = std::chrono::steady_clock::now();
+#if FF_USE_FREEMAP
+    check(f_freemap(""), "f_freemap");
+#endif
+    double build_ms = std::chrono::duration<double, std::milli>(
+                          std::chrono::steady_clock::now() - t0).count();
+    uint64_t build_reads = ramdisk_stats(0)->sectors_read;
+
+    FIL log;
+    check(f_open(&log, "log.bin", FA_WRITE | FA_CREATE_ALWAYS), "f_open log");
+    std::vector<uint8_t> block(512, 0x5A);
+    std::vector<uint64_t> reads;
+    std::vector<double> us;
+    for (;;) {
+        ramdisk_reset_stats(0);
+        auto t = std::chrono::steady_clock::now();
+        UINT bw = 0;
+        FRESULT fr = f_write(&log, block.data(), block.size(), &bw);
+        us.push_back(std::chrono::duration<double, std::micro>(
+                         std::chrono::steady_clock::now() - t).count());
+        reads.push_back(ramdisk_stats(0)->sectors_read);
+        if (FR_OK != fr || bw < block.size()) break;
+    }
+    f_close(&log);
+
+    uint64_t sum = 0;
+    for (auto r : reads) sum += r;
+#if FF_USE_FREEMAP
+    std::printf("free cluster map: on (%d bytes, %u clusters/bit)\n", FF_FREEMAP_SIZE,
+                1u << fs.fm_shift);
+#else
+    std::printf("free cluster map: off\n");
+#endif
+    std::printf("volume: %u MiB, %lu clusters, %u fill files, hole every %u\n", mib,
+                (unsigned long)total, nfiles, hole_every);
+    std::printf("map build at mount: %.2f ms, %llu sectors read\n", build_ms,
+                (unsigned long long)build_reads);
+    std::printf("f_write calls: %zu, FAT sectors read: total %llu\n", reads.size(),
+                (unsigned long long)sum);
+    std::printf("sectors read per f_write: p50 %llu  p99 %llu  p99.9 %llu  max %llu\n",
+                (unsigned long long)percentile(reads, 50), (unsigned long long)percentile(reads, 99),
+                (unsigned long long)percentile(reads, 99.9),
+                (unsigned long long)*std::max_element(reads.begin(), reads.end()));
+    std::printf("host us per f_write:       p50 %.2f  p99 %.2f  p99.9 %.2f  max %.2f\n",
+                percentile(us, 50), percentile(us, 99), percentile(us, 99.9),
+                *std::max_element(us.begin(), us.end()));
+    return 0;
+}
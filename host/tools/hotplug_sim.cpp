@@ -0,0 +1,219 @@
+// hotplug_sim: card removal during capture, on the RAM disk.
+//
+// Replays a capture at 10 samples per second into crash-consistent logs
+// (crash_log.c) the way the application does: each sample goes through the
+// spill buffer (spill.c), which is drained to the open log while the card is
+// there and committed at every successful flush; hotplug.c probes the
+// emulated card. The card is pulled out and put back at random times, some
+// outages long enough to fill the spill buffer. A failed write or a probe
+// that misses the card rewinds the spill buffer; when the card comes back
+// the volume is remounted, a new log is opened and the backlog drained.
+//
+// At the end every log is recovered and read back, and the tool checks that:
+//   - every sample appears, in order, except exactly those counted as dropped;
+//   - any repeated sample is a rewrite of one not yet flushed at the loss.
+// Exits non-zero on the first violation.
+//
+//   hotplug_sim [samples] [seed]
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "crash_log.h"
+#include "ff.h"
+#include "hotplug.h"
+#include "ramdisk.h"
+#include "spill.h"
+
+extern "C" void my_printf(const char *, ...) {}
+
+namespace {
+
+const uint32_t SAMPLE_US = 100000;
+const uint32_t FLUSH_EVERY = 10;  // Samples between flushes
+const uint32_t POLL_MS = 500;
+
+struct card_t {
+    bool inserted = true;
+};
+
+bool probe(void *ctx) { return static_cast<card_t *>(ctx)->inserted; }
+
+struct sink_t {
+    FATFS fs;
+    FIL fil;
+    crash_log_t cl;
+    bool online = false;
+    uint32_t files = 0;
+};
+
+int write_rec(void *ctx, const void *rec, size_t len) {
+    sink_t *s = static_cast<sink_t *>(ctx);
+    return crash_log_write(&s->cl, rec, static_cast<UINT>(len));
+}
+
+FRESULT open_log(sink_t &s) {
+    f_mount(nullptr, "", 0);  // Drops the state of the lost volume
+    FRESULT fr = f_mount(&s.fs, "", 1);
+    if (FR_OK != fr) return fr;
+    char path[16];
+    std::snprintf(path, sizeof path, "%04u.log", s.files);
+    fr = f_open(&s.fil, path, FA_CREATE_ALWAYS | FA_WRITE);
+    if (FR_OK != fr) return fr;
+    s.files++;
+    return crash_log_start(&s.cl, &s.fil);
+}
+
+std::string sample(uint32_t n) { return std::to_string(n) + ",123,45,67,89,Verde\n"; }
+
+int fail(const char *what) {
+    std::fprintf(stderr, "FAIL: %s\n", what);
+    return 1;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    const uint32_t samples = argc > 1 ? std::atoi(argv[1]) : 20000;
+    std::mt19937 rng(argc > 2 ? std::atoi(argv[2]) : 1);
+
+    if (!ramdisk_create(0, 32 * 2048)) return 1;
+    std::vector<uint8_t> work(FF_MAX_SS * 16);
+    MKFS_PARM opt = {FM_ANY, 1, 0, 0, 0};
+    if (FR_OK != f_mkfs("", &opt, work.data(), work.size())) return 1;
+
+    // About 3 minutes of samples fit
+    static uint8_t spill_buf[48 * 1024];
+    spill_t sp;
+    spill_init(&sp, spill_buf, sizeof spill_buf);
+    card_t card;
+    hotplug_t hp;
+    hotplug_init(&hp, probe, &card, POLL_MS, HOTPLUG_SETTLE_MS, true);
+    static sink_t sink;
+    if (FR_OK != open_log(sink)) return fail("first open");
+    sink.online = true;
+
+    auto lost = [&]() {
+        sink.online = false;
+        spill_rewind(&sp);
+        hotplug_lost(&hp);
+    };
+    auto flush = [&]() {
+        if (FR_OK == crash_log_flush(&sink.cl))
+            spill_commit(&sp);
+        else
+            lost();
+    };
+
+    uint64_t next_change = 30000000;  // First removal after 30 s
+    uint32_t outages = 0, reconnects = 0, max_backlog = 0;
+    for (uint32_t n = 1; n <= samples; ++n) {
+        uint64_t now = (uint64_t)n * SAMPLE_US;
+        if (now >= next_change) {
+            card.inserted = !card.inserted;
+            ramdisk_set_present(0, card.inserted);
+            if (!card.inserted) {
+                outages++;
+                // Mostly short outages; one in four outlasts the spill buffer
+                next_change = now + (rng() % 4 ? 1 + rng() % 60 : 200 + rng() % 200) * 1000000ull;
+            } else {
+                next_change = now + (10 + rng() % 120) * 1000000ull;
+            }
+        }
+        std::string s = sample(n);
+        spill_put(&sp, s.data(), s.size());
+        if (sink.online) {
+            if (spill_drain(&sp, write_rec, &sink))
+                lost();
+            else if (0 == n % FLUSH_EVERY)
+                flush();
+        }
+        if (spill_pending(&sp) > max_backlog) max_backlog = spill_pending(&sp);
+
+        switch (hotplug_poll(&hp, now)) {
+            case HOTPLUG_REMOVED:
+                if (sink.online) lost();
+                break;
+            case HOTPLUG_INSERTED:
+                // Remount, new log, and the backlog at full speed
+                if (FR_OK != open_log(sink) || spill_drain(&sp, write_rec, &sink)) {
+                    lost();
+                    break;
+                }
+                sink.online = true;
+                reconnects++;
+                flush();
+                break;
+            default:
+                break;
+        }
+    }
+    if (!sink.online) {
+        card.inserted = true;
+        ramdisk_set_present(0, true);
+        if (FR_OK != open_log(sink) || spill_drain(&sp, write_rec, &sink))
+            return fail("final reconnect");
+    }
+    if (FR_OK != crash_log_finish(&sink.cl) || FR_OK != f_close(&sink.fil)) return fail("finish");
+    spill_commit(&sp);
+
+    // Read back every log, recovering the abandoned ones
+    std::vector<uint32_t> seen;
+    for (uint32_t f = 0; f < sink.files; ++f) {
+        char path[16];
+        std::snprintf(path, sizeof path, "%04u.log", f);
+        FIL fil;
+        if (FR_OK != f_open(&fil, path, FA_OPEN_EXISTING | FA_READ | FA_WRITE))
+            return fail("log missing");
+        crash_log_recovery_t rec;
+        if (FR_OK != crash_log_recover(&fil, &rec)) return fail("recover");
+        std::string text;
+        crash_log_blk_t blk;
+        f_lseek(&fil, 0);
+        for (uint32_t b = 0; b < rec.blocks; ++b) {
+            UINT br;
+            if (FR_OK != f_read(&fil, &blk, sizeof blk, &br) || br != sizeof blk)
+                return fail("read");
+            text.append(reinterpret_cast<char *>(blk.payload), blk.hdr.len);
+        }
+        f_close(&fil);
+        size_t pos = 0, nl;
+        while (std::string::npos != (nl = text.find('\n', pos))) {
+            uint32_t v = std::strtoul(text.c_str() + pos, nullptr, 10);
+            if (text.compare(pos, nl + 1 - pos, sample(v))) return fail("corrupt sample");
+            seen.push_back(v);
+            pos = nl + 1;
+        }
+    }
+
+    // In order, apart from rewrites of unflushed samples after a loss; at most
+    // FLUSH_EVERY - 1 samples plus one drain can be unflushed at once
+    std::vector<uint8_t> present(samples + 1);
+    uint32_t last = 0, dups = 0;
+    for (uint32_t v : seen) {
+        if (!v || v > samples) return fail("unknown sample");
+        if (v <= last) {
+            if (!present[v] || last - v > max_backlog + FLUSH_EVERY) return fail("out of order");
+            dups++;
+        }
+        present[v] = 1;
+        if (v > last) last = v;
+    }
+    uint32_t missing = 0;
+    for (uint32_t v = 1; v <= samples; ++v) missing += !present[v];
+    const spill_stats_t *st = spill_stats(&sp);
+    std::printf("%u samples, %u outages, %u reconnects, %u log files\n", samples, outages,
+                reconnects, sink.files);
+    std::printf("spill: peak %u bytes, %u drained, %u rewritten, %u dropped; "
+                "%u missing, %u duplicates; %u probes\n",
+                st->peak, st->drained, st->rewound, st->dropped, missing, dups, hp.probes);
+    if (missing != st->dropped) return fail("missing samples not accounted for as dropped");
+    if (!outages || !reconnects) return fail("no outage exercised");
+    std::printf("OK\n");
+    return 0;
+}
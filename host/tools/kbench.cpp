@@ -0,0 +1,139 @@
+// kbench: the firmware's CPU kernels (lib/kbench.c) on the host, the same
+// code and the same output as the "kbench" command on the device.
+//
+// Prints one CSV line per kernel (kbench.h): operations per measurement and
+// the fastest and the median time per operation, in ns here and in cycles on
+// the device. With -b, the run is compared with a baseline: a saved run of
+// this tool or a serial capture of the device's command (other lines in the
+// file are ignored). -c compares two saved files without measuring. Kernels
+// are matched by name and unit on the fastest time; the exit status is 1 if
+// any got slower by more than the threshold (10% by default), or if a kernel
+// could not be measured.
+//
+//   kbench [-t percent] [-b baseline.txt] [kernel...]
+//   kbench [-t percent] -c old.txt new.txt
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "kbench.h"
+}
+#include "pico_sim.h"
+
+namespace {
+
+struct entry {
+    double min;
+    std::string unit;
+};
+using run_t = std::map<std::string, entry>;
+
+// The "kbench," lines of a file; false if it cannot be read
+bool load(const char *path, run_t *run) {
+    std::ifstream in(path);
+    if (!in) {
+        std::fprintf(stderr, "%s: cannot open\n", path);
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        while (!line.empty() && (line.back() == '\r' || line.back() == '\n')) line.pop_back();
+        if (line.compare(0, 7, "kbench,")) continue;
+        std::vector<std::string> f;
+        std::stringstream ss(line);
+        for (std::string s; std::getline(ss, s, ',');) f.push_back(s);
+        if (f.size() != 6 || f[1] == "kernel") continue;
+        (*run)[f[1]] = {std::strtod(f[3].c_str(), nullptr), f[5]};
+    }
+    return true;
+}
+
+// One line per kernel in both runs; returns the number of regressions
+int compare(const run_t &old_run, const run_t &new_run, double threshold) {
+    int regressions = 0;
+    for (const auto &n : new_run) {
+        auto o = old_run.find(n.first);
+        if (o == old_run.end() || o->second.unit != n.second.unit || o->second.min <= 0) continue;
+        double change = 100.0 * (n.second.min / o->second.min - 1);
+        bool slower = change > threshold;
+        regressions += slower;
+        std::printf("%-20s %10.2f -> %10.2f %-6s %+6.1f%%%s\n", n.first.c_str(), o->second.min,
+                    n.second.min, n.second.unit.c_str(), change, slower ? "  REGRESSION" : "");
+    }
+    return regressions;
+}
+
+int usage() {
+    std::fprintf(stderr,
+                 "usage: kbench [-t percent] [-b baseline.txt] [kernel...]\n"
+                 "       kbench [-t percent] -c old.txt new.txt\n");
+    return 2;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    double threshold = 10;
+    const char *baseline = nullptr;
+    bool compare_only = false;
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; ++arg) {
+        if (!std::strcmp(argv[arg], "-t") && arg + 1 < argc)
+            threshold = std::atof(argv[++arg]);
+        else if (!std::strcmp(argv[arg], "-b") && arg + 1 < argc)
+            baseline = argv[++arg];
+        else if (!std::strcmp(argv[arg], "-c"))
+            compare_only = true;
+        else
+            return usage();
+    }
+
+    if (compare_only) {
+        if (argc - arg != 2) return usage();
+        run_t old_run, new_run;
+        if (!load(argv[arg], &old_run) || !load(argv[arg + 1], &new_run)) return 2;
+        return compare(old_run, new_run, threshold) ? 1 : 0;
+    }
+
+    std::vector<const kbench_kernel_t *> kernels;
+    for (; arg < argc; ++arg) {
+        const kbench_kernel_t *k = kbench_buscar(argv[arg]);
+        if (!k) {
+            std::fprintf(stderr, "unknown kernel: %s\n", argv[arg]);
+            return 2;
+        }
+        kernels.push_back(k);
+    }
+    if (kernels.empty())
+        for (unsigned i = 0; i < kbench_num_kernels; ++i) kernels.push_back(&kbench_kernels[i]);
+    run_t old_run;
+    if (baseline && !load(baseline, &old_run)) return 2;
+
+    // get_fattime() reads the RTC, set at boot on the device
+    datetime_t t = {2024, 6, 1, 6, 12, 0, 0};
+    sim_rtc_set(&t);
+
+    int failures = 0;
+    run_t new_run;
+    kbench_imprimir_cabecalho();
+    for (const kbench_kernel_t *k : kernels) {
+        kbench_result_t r;
+        if (!kbench_medir(k, &r) || !r.min_x100 || r.min_x100 > r.med_x100) {
+            std::fprintf(stderr, "FAIL: %s could not be measured\n", k->nome);
+            failures++;
+            continue;
+        }
+        kbench_imprimir(k, &r);
+        new_run[k->nome] = {r.min_x100 / 100.0, kbench_unidade()};
+    }
+    std::fflush(stdout);
+    if (baseline && compare(old_run, new_run, threshold)) failures++;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,180 @@
+// log_dump: extracts the records of a crash-consistent log file
+// (lib/FatFs_SPI/include/crash_log.h), e.g. a session file, to plain text.
+//
+//   log_dump [-from T] [-to T] 0042.log [out.csv]
+//
+// Blocks are read in order and checked (file id, block number, CRC); output
+// stops at the first block that does not belong to the log, which is where a
+// reset cut it if the file was not recovered on the device.
+//
+// -from and -to limit the output to a time range, T counted from the start
+// of the log in seconds, or with a suffix m or h (-from 40m -to 45m). The
+// range is block-aligned: output starts with the first record of the block
+// that was being written at -from and ends with the last record started
+// before a block begun after -to. If the log has a sparse time index next to
+// it (0042.tix, log_index.h), a binary search of it gives the block to start
+// reading from; otherwise every block before the range is read.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+extern "C" {
+#include "crc.h"
+}
+#include "crash_log.h"
+#include "log_index.h"
+
+namespace {
+
+bool blk_valid(crash_log_blk_t blk, uint32_t id, uint32_t seq) {
+    if (CRASH_LOG_MAGIC != blk.hdr.magic || id != blk.hdr.id || seq != blk.hdr.seq ||
+        blk.hdr.len > CRASH_LOG_PAYLOAD)
+        return false;
+    uint16_t crc = blk.hdr.crc;
+    blk.hdr.crc = 0;
+    uint16_t calc = 0;
+    update_crc16(&calc, reinterpret_cast<const char *>(&blk.hdr), sizeof blk.hdr);
+    update_crc16(&calc, reinterpret_cast<const char *>(blk.payload), blk.hdr.len);
+    return crc == calc;
+}
+
+bool parse_time(const char *s, uint32_t *t) {
+    char *end;
+    unsigned long v = std::strtoul(s, &end, 10);
+    if (end == s) return false;
+    if ('m' == *end) v *= 60, ++end;
+    else if ('h' == *end) v *= 3600, ++end;
+    *t = (uint32_t)v;
+    return !*end;
+}
+
+// Block to start reading from for time t: the last index entry at or before
+// it, binary searched in the file. 0 without a usable index.
+uint32_t index_start(const std::string &log_path, uint32_t id, uint32_t t, uint32_t *probes) {
+    std::string path = log_path;
+    size_t dot = path.rfind('.');
+    if (std::string::npos == dot || std::string::npos != path.find('/', dot)) dot = path.size();
+    path = path.substr(0, dot) + "." LOG_INDEX_EXT;
+    FILE *f = std::fopen(path.c_str(), "rb");
+    if (!f) return 0;
+    log_index_hdr_t hdr;
+    uint32_t start = 0;
+    if (1 == std::fread(&hdr, sizeof hdr, 1, f) && LOG_INDEX_MAGIC == hdr.magic && id == hdr.id) {
+        std::fseek(f, 0, SEEK_END);
+        long entries = (std::ftell(f) - (long)sizeof hdr) / (long)sizeof(log_index_entry_t);
+        long lo = 0, hi = entries;  // [0, lo) at or before t, [hi, entries) after it or torn
+        while (lo < hi) {
+            long mid = lo + (hi - lo) / 2;
+            log_index_entry_t e;
+            std::fseek(f, (long)sizeof hdr + mid * (long)sizeof e, SEEK_SET);
+            ++*probes;
+            bool ok = 1 == std::fread(&e, sizeof e, 1, f) &&
+                      e.check == (id ^ e.block ^ e.record ^ e.time);
+            if (ok && e.time <= t) {
+                lo = mid + 1;
+                start = e.block;
+            } else {
+                hi = mid;
+            }
+        }
+    }
+    std::fclose(f);
+    return start;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    uint32_t from = 0, to = UINT32_MAX;
+    bool ranged = false;
+    int arg = 1;
+    for (; arg + 1 < argc && '-' == argv[arg][0]; arg += 2) {
+        bool ok = !std::strcmp(argv[arg], "-from")  ? parse_time(argv[arg + 1], &from)
+                  : !std::strcmp(argv[arg], "-to") ? parse_time(argv[arg + 1], &to)
+                                                   : false;
+        if (!ok) break;
+        ranged = true;
+    }
+    if (arg >= argc || '-' == argv[arg][0]) {
+        std::fprintf(stderr, "usage: %s [-from T] [-to T] file.log [out]\n", argv[0]);
+        return 2;
+    }
+    const char *in_path = argv[arg];
+    const char *out_path = arg + 1 < argc ? argv[arg + 1] : nullptr;
+    FILE *in = std::fopen(in_path, "rb");
+    if (!in) {
+        std::perror(in_path);
+        return 1;
+    }
+    FILE *out = out_path ? std::fopen(out_path, "wb") : stdout;
+    if (!out) {
+        std::perror(out_path);
+        return 1;
+    }
+    crash_log_blk_t blk;
+    uint32_t id = 0, seq = 0, records = 0, read = 0, probes = 0;
+    uint64_t bytes = 0;
+    if (ranged && 1 == std::fread(&blk, sizeof blk, 1, in) && blk_valid(blk, blk.hdr.id, 0)) {
+        // Times in the headers are absolute
+        id = blk.hdr.id;
+        uint32_t t0 = blk.hdr.time;
+        from = t0 + from;
+        to = UINT32_MAX - t0 < to ? UINT32_MAX : t0 + to;
+        seq = index_start(in_path, id, from, &probes);
+        std::fseek(in, (long)seq * (long)sizeof blk, SEEK_SET);
+    } else {
+        std::rewind(in);
+    }
+    // Ranged: before the range (the last block begun by -from waits in
+    // `held`, as the range starts with its first record), in it, or past it
+    enum { BEFORE, IN, PAST } state = ranged ? BEFORE : IN;
+    crash_log_blk_t held;
+    bool holding = false;
+    auto emit_held = [&] {
+        if (!holding || CRASH_LOG_NO_REC == held.hdr.first_rec) return;
+        uint16_t first = held.hdr.first_rec;
+        std::fwrite(held.payload + first, 1, held.hdr.len - first, out);
+        bytes += held.hdr.len - first;
+        records = held.hdr.records;
+    };
+    while (PAST != state && 1 == std::fread(&blk, sizeof blk, 1, in)) {
+        if (!ranged && !seq) id = blk.hdr.id;
+        if (!blk_valid(blk, id, seq)) break;
+        ++read;
+        ++seq;
+        if (BEFORE == state) {
+            if (blk.hdr.time <= from) {
+                held = blk;
+                holding = true;
+                continue;
+            }
+            state = IN;
+            emit_held();
+        }
+        uint16_t len = blk.hdr.len;
+        if (blk.hdr.time > to) {
+            // Begun after the range: only the end of the record running into it
+            state = PAST;
+            len = CRASH_LOG_NO_REC == blk.hdr.first_rec ? len : blk.hdr.first_rec;
+        } else {
+            records = blk.hdr.records;
+        }
+        std::fwrite(blk.payload, 1, len, out);
+        bytes += len;
+    }
+    if (BEFORE == state) emit_held();  // The range starts in the last block
+    bool tail = PAST != state && !std::feof(in);
+    std::fclose(in);
+    if (out != stdout) std::fclose(out);
+    if (ranged)
+        std::fprintf(stderr, "%u blocks read%s, up to record %u, %llu bytes%s\n", read,
+                     probes ? " after an index search" : "", records,
+                     (unsigned long long)bytes, tail ? "; stopped at an invalid block" : "");
+    else
+        std::fprintf(stderr, "%u blocks, %u records, %llu bytes%s\n", seq, records,
+                     (unsigned long long)bytes, tail ? "; stopped at an invalid block" : "");
+    return read ? 0 : 1;
+}
@@ -0,0 +1,269 @@
+// log_seek_bench: random access into a large session file (log_reader.c).
+//
+// A session of CSV records at 10 Hz, with pauses of up to half an hour now
+// and then, is written with crash_log.c and its sparse time index
+// (log_index.c) onto a RAM disk formatted with 1 KiB clusters, into the
+// holes left between other files, so that the log is long and in fragments
+// (more of them than on a card, where clusters are 32 KiB and the index
+// takes a new one every 64 MiB of log, not every 2 MiB).
+// It is then opened with log_reader_open() and sought to random record
+// indices and times:
+//   chain   - the cluster link map dropped, each f_lseek() follows the FAT
+//   mapped  - the link map (FF_USE_FASTSEEK) built on open, or loaded from
+//             the map file saved by an earlier open
+//   indexed - mapped, and a time seek narrowed by the time index
+// Every seek is checked against the record it lands on. Reports sectors read
+// per seek (FAT, index and data) and host time. The index is also rebuilt
+// from the block headers (log_index_build()) and compared with the one
+// written while logging.
+//
+//   log_seek_bench [megabytes] [seeks] [seed]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "crash_log.h"
+#include "ff.h"
+#include "log_index.h"
+#include "log_reader.h"
+#include "ramdisk.h"
+
+extern "C" void my_printf(const char *, ...) {}
+
+// Virtual wall clock for the block headers: the session runs at 10 Hz no
+// matter how fast the host writes it
+static time_t now_s = 1700000000;
+extern "C" time_t time(time_t *t) {
+    if (t) *t = now_s;
+    return now_s;
+}
+
+namespace {
+
+const uint32_t HZ = 10;
+const uint32_t PAUSE_EVERY = 20000;  // Records between pauses
+const char *const COLORS[] = {"Vermelho", "Verde", "Azul", "Amarelo", "Branco", "Preto"};
+
+void check(FRESULT fr, const char *what) {
+    if (FR_OK != fr) {
+        std::fprintf(stderr, "%s failed: %d\n", what, fr);
+        std::exit(1);
+    }
+}
+
+int fail(const char *what, uint32_t arg) {
+    std::fprintf(stderr, "FAIL: %s %u\n", what, arg);
+    return 1;
+}
+
+// Record n (1-based) was written at times[n - 1], at offs[n - 1] in the
+// stream of payload bytes: blocks hold CRASH_LOG_PAYLOAD bytes of it each
+std::vector<uint32_t> times;
+std::vector<uint64_t> offs;
+
+// Start time of block b: that of the record that filled the one before
+uint32_t block_time(uint64_t b) {
+    if (!b) return times[0];
+    auto it = std::upper_bound(offs.begin(), offs.end(), b * CRASH_LOG_PAYLOAD - 1);
+    return times[it - offs.begin() - 1];
+}
+
+// Record log_reader_seek_time(t) should land on: the first one starting in
+// the last block begun by t
+uint32_t expect_time(uint32_t t) {
+    uint64_t lo = 0, hi = offs.back() / CRASH_LOG_PAYLOAD + 1;  // block_time(lo) <= t
+    while (hi - lo > 1) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        (block_time(mid) <= t ? lo : hi) = mid;
+    }
+    auto it = std::lower_bound(offs.begin(), offs.end(), lo * CRASH_LOG_PAYLOAD);
+    return (uint32_t)(it - offs.begin()) + 1;
+}
+
+std::string record(uint32_t n) {
+    char line[64];
+    int len = std::snprintf(line, sizeof line, "%u,%u,%u,%u,%u,%s\n", n, n * 7 % 1024,
+                            n * 13 % 256, n * 17 % 256, n * 19 % 256, COLORS[n % 6]);
+    return std::string(line, len);
+}
+
+// Fills the volume with pad files and deletes every other one
+void fragment_volume(uint32_t pads, UINT pad_bytes) {
+    static FIL fil;
+    std::vector<uint8_t> zero(pad_bytes);
+    char name[16];
+    uint32_t n = 0;
+    while (n < pads) {
+        std::snprintf(name, sizeof name, "pad%u", n++);
+        check(f_open(&fil, name, FA_CREATE_ALWAYS | FA_WRITE), "f_open pad");
+        UINT bw;
+        FRESULT fr = f_write(&fil, zero.data(), pad_bytes, &bw);
+        check(f_close(&fil), "f_close pad");
+        if (FR_OK != fr || bw < pad_bytes) break;  // Volume full
+    }
+    for (uint32_t i = 0; i < n; i += 2) {
+        std::snprintf(name, sizeof name, "pad%u", i);
+        check(f_unlink(name), "f_unlink pad");
+    }
+}
+
+uint32_t write_session(const char *path, uint64_t bytes, time_t t0, uint32_t seed) {
+    static FIL fil;
+    static crash_log_t cl;
+    static log_index_t ix;
+    std::mt19937 rng(seed);
+    now_s = t0;
+    check(f_open(&fil, path, FA_CREATE_NEW | FA_WRITE), "f_open");
+    check(crash_log_start(&cl, &fil), "crash_log_start");
+    check(log_index_open(&ix, path, cl.id, LOG_INDEX_EVERY), "log_index_open");
+    uint64_t n_bytes = 0;
+    uint32_t n = 0;
+    time_t paused = 0;
+    while (n_bytes < bytes) {
+        ++n;
+        if (0 == n % PAUSE_EVERY) paused += rng() % 1800;
+        now_s = t0 + paused + (n - 1) / HZ;
+        times.push_back((uint32_t)now_s);
+        offs.push_back(n_bytes);
+        std::string line = record(n);
+        check(crash_log_write(&cl, line.data(), line.size()), "crash_log_write");
+        check(log_index_note(&ix, &cl), "log_index_note");
+        n_bytes += line.size();
+        if (0 == n % HZ) check(crash_log_flush(&cl), "crash_log_flush");
+    }
+    check(log_index_close(&ix), "log_index_close");
+    check(crash_log_finish(&cl), "crash_log_finish");
+    check(f_close(&fil), "f_close");
+    return n;
+}
+
+std::vector<uint8_t> slurp(const char *path) {
+    static FIL fil;
+    check(f_open(&fil, path, FA_READ), "f_open");
+    std::vector<uint8_t> data(f_size(&fil));
+    UINT br;
+    check(f_read(&fil, data.data(), data.size(), &br), "f_read");
+    check(f_close(&fil), "f_close");
+    return data;
+}
+
+// Fragments of the file: runs of consecutive clusters
+uint32_t fragments(const log_reader_t *r) {
+    return r->fast ? (r->clmt[0] - 1) / 2 : 0;
+}
+
+// Record number at the read position
+uint32_t read_n(log_reader_t *r) {
+    char buf[16] = {};
+    UINT br;
+    check(log_reader_read(r, buf, sizeof buf - 1, &br), "log_reader_read");
+    return (uint32_t)std::strtoul(buf, nullptr, 10);
+}
+
+struct result_t {
+    double sectors;  // Per seek
+    double us;
+};
+
+int seeks(log_reader_t *r, uint32_t records, uint32_t count, uint32_t seed, bool by_time,
+          result_t *res) {
+    std::mt19937 rng(seed);
+    ramdisk_reset_stats(0);
+    double us = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (by_time) {
+            uint32_t t = times.front() + rng() % (times.back() - times.front() + 1);
+            auto s = std::chrono::steady_clock::now();
+            check(log_reader_seek_time(r, t), "log_reader_seek_time");
+            uint32_t n = read_n(r);
+            us += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - s)
+                      .count();
+            if (n != expect_time(t)) return fail("seek to time", t);
+        } else {
+            uint32_t index = rng() % records;
+            auto s = std::chrono::steady_clock::now();
+            check(log_reader_seek_record(r, index), "log_reader_seek_record");
+            uint32_t n = read_n(r);
+            us += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - s)
+                      .count();
+            if (n != index + 1) return fail("seek to record", index);
+        }
+    }
+    res->sectors = (double)ramdisk_stats(0)->sectors_read / count;
+    res->us = us / count;
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    const uint64_t mb = argc > 1 ? std::atoi(argv[1]) : 24;
+    const uint32_t count = argc > 2 ? std::atoi(argv[2]) : 2000;
+    const uint32_t seed = argc > 3 ? std::atoi(argv[3]) : 1;
+    const time_t t0 = 1700000000;
+
+    // 128 MiB of 1 KiB clusters: FAT32, 128 clusters per FAT sector
+    if (!ramdisk_create(0, 256 * 1024)) return 1;
+    std::vector<uint8_t> work(FF_MAX_SS * 16);
+    MKFS_PARM opt = {FM_FAT32, 1, 0, 0, 2 * RAMDISK_SECTOR_SIZE};
+    check(f_mkfs("", &opt, work.data(), work.size()), "f_mkfs");
+    static FATFS fs;
+    check(f_mount(&fs, "", 1), "f_mount");
+    fragment_volume(64, 4 << 20);  // Up to full: about 15 holes of 4 MiB
+
+    const char *path = "0001.log";
+    uint32_t records = write_session(path, mb << 20, t0, seed);
+
+    // The index written while logging matches one built from the headers
+    std::vector<uint8_t> written = slurp("0001.tix");
+    check(log_index_build(path, LOG_INDEX_EVERY), "log_index_build");
+    if (slurp("0001.tix") != written) return fail("rebuilt index differs", 0);
+    std::printf("index 0001.tix: %zu entries, %zu bytes, same when rebuilt from the log\n",
+                (written.size() - sizeof(log_index_hdr_t)) / sizeof(log_index_entry_t),
+                written.size());
+
+    static log_reader_t r;
+    // Built on the first open, loaded from 0001.map on the next
+    for (int open = 0; open < 2; ++open) {
+        ramdisk_reset_stats(0);
+        check(log_reader_open(&r, path), "log_reader_open");
+        uint64_t open_sectors = ramdisk_stats(0)->sectors_read;
+        if (r.records != records) return fail("records", r.records);
+        if (!r.fast || r.map_loaded != (1 == open)) return fail("link map, open", open);
+        if (read_n(&r) != 1) return fail("first record", 0);
+        std::printf("open %s: %u records in %u blocks, %u fragments, map %s, %llu sectors read\n",
+                    path, r.records, r.blocks, fragments(&r),
+                    r.map_loaded ? "loaded" : "built", (unsigned long long)open_sectors);
+        if (0 == open) check(log_reader_close(&r), "log_reader_close");
+    }
+
+    if (!r.indexed) return fail("index not opened", 0);
+
+    std::printf("\n%u random seeks        sectors/seek   us/seek\n", count);
+    for (bool by_time : {false, true}) {
+        result_t indexed, mapped, chain;
+        if (seeks(&r, records, count, seed, by_time, &indexed)) return 1;
+        r.indexed = false;
+        int rc = seeks(&r, records, count, seed, by_time, &mapped);
+        DWORD *cltbl = r.fil.cltbl;
+        r.fil.cltbl = nullptr;
+        if (!rc) rc = seeks(&r, records, count, seed, by_time, &chain);
+        r.fil.cltbl = cltbl;
+        r.indexed = true;
+        if (rc) return 1;
+        const char *what = by_time ? "to a time  " : "to a record";
+        std::printf("%s  chain   %12.1f %9.2f\n", what, chain.sectors, chain.us);
+        std::printf("%s  mapped  %12.1f %9.2f\n", what, mapped.sectors, mapped.us);
+        if (by_time)  // Record seeks do not use the index
+            std::printf("%s  indexed %12.1f %9.2f\n", what, indexed.sectors, indexed.us);
+    }
+    check(log_reader_close(&r), "log_reader_close");
+    return 0;
+}
@@ -0,0 +1,286 @@
+// msc_sim: the USB mass storage layer (lib/FatFs_SPI/src/msc_disk.c) on the
+// RAM disk, driven the way TinyUSB drives its callbacks.
+//
+// Every SCSI READ(10)/WRITE(10) is cut into pieces of at most EP_BUF bytes
+// (CFG_TUD_MSC_EP_BUFSIZE in tusb_config.h), each passed to
+// msc_disk_read10()/msc_disk_write10(); a write ends with msc_disk_flush(),
+// as tud_msc_write10_complete_cb() does.
+//
+// Check: random commands (sequential runs, random places, 1 to 240 blocks,
+// now and then a SYNCHRONIZE CACHE, an eject and reload, a failed card
+// write) against a model of the disk. Every read must return the model's
+// data; every failed write must reach the host, in the command itself or as
+// a deferred error on the next one; after msc_disk_detach() the image must
+// equal the model. Nothing may be read or written while not attached.
+//
+// Rate: sequential reads and writes, and random 4 KiB reads, per SCSI
+// request size, with one card command per callback (as a plain mapping of
+// the callbacks onto the card would do) and with read-ahead and write
+// coalescing. The RAM disk counts the card commands and blocks; as in
+// extent_bench, those are turned into card time with a model of the SD card
+// on SPI, to which the full-speed USB transfer time is added. The figures
+// compare the two mappings; they are not a measurement of a given card.
+//
+//   msc_sim [-f card.img] [commands] [seed]
+//
+// With -f the rate is measured on a copy of a card image (dd of a real card)
+// loaded into RAM; the file is not written.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "ff.h"
+#include "msc_disk.h"
+#include "ramdisk.h"
+
+namespace {
+
+const uint32_t EP_BUF = 4096;        // CFG_TUD_MSC_EP_BUFSIZE
+const uint32_t MAX_CMD_BLOCKS = 240; // Largest request from Linux usb-storage
+const uint64_t CARD_SECTORS = 64 * 1024 * 1024 / MSC_DISK_BLOCK;
+
+// Card model, microseconds (extent_bench)
+const double XFER_US = (RAMDISK_SECTOR_SIZE + 3) * 8 / 20.8;  // Token, data, CRC
+const double CMD_US = 60;           // Command, response, CMD13 status
+const double WRITE_BUSY_US = 250;   // Programming after a write command
+const double EXTRA_BLOCK_US = 20;   // Each further block of a CMD25
+const double READ_ACCESS_US = 100;  // Wait for the data token
+// USB full speed: bulk data at ~1.1 MB/s, CBW and CSW per command
+const double USB_US_PER_BYTE = 1 / 1.1;
+const double USB_CMD_US = 250;
+
+double card_us(const ramdisk_stats_t *s) {
+    return s->writes * (CMD_US + WRITE_BUSY_US) +
+           (s->sectors_written - s->writes) * EXTRA_BLOCK_US + s->sectors_written * XFER_US +
+           s->reads * (CMD_US + READ_ACCESS_US) + s->sectors_read * XFER_US;
+}
+
+// One SCSI command, split as TinyUSB does. Returns false if any piece failed.
+bool scsi_read(msc_disk_t *d, uint32_t lba, uint32_t blocks, uint8_t *buf) {
+    uint32_t total = blocks * MSC_DISK_BLOCK;
+    for (uint32_t done = 0; done < total;) {
+        uint32_t n = total - done < EP_BUF ? total - done : EP_BUF;
+        int32_t got = msc_disk_read10(d, lba + done / MSC_DISK_BLOCK, done % MSC_DISK_BLOCK,
+                                      buf + done, n);
+        if (got <= 0) return false;
+        done += got;
+    }
+    return true;
+}
+
+bool scsi_write(msc_disk_t *d, uint32_t lba, uint32_t blocks, const uint8_t *buf) {
+    uint32_t total = blocks * MSC_DISK_BLOCK;
+    bool ok = true;
+    for (uint32_t done = 0; done < total;) {
+        uint32_t n = total - done < EP_BUF ? total - done : EP_BUF;
+        int32_t got = msc_disk_write10(d, lba + done / MSC_DISK_BLOCK, done % MSC_DISK_BLOCK,
+                                       buf + done, n);
+        if (got <= 0) {
+            ok = false;  // TinyUSB fails the command and skips the rest
+            break;
+        }
+        done += got;
+    }
+    msc_disk_flush(d);  // tud_msc_write10_complete_cb()
+    return ok;
+}
+
+// Card writes fail while armed, one in `every`
+struct faults_t {
+    std::mt19937 rng;
+    uint32_t every = 0;
+    uint32_t failed = 0;
+};
+
+bool write_hook(uint8_t, uint64_t, const uint8_t *, void *ctx) {
+    faults_t *f = static_cast<faults_t *>(ctx);
+    if (!f->every || f->rng() % f->every) return true;
+    f->failed++;
+    return false;
+}
+
+int fail(const char *what, uint32_t cmd) {
+    std::fprintf(stderr, "FAIL: %s (command %u)\n", what, cmd);
+    return 1;
+}
+
+int check(uint32_t commands, uint32_t seed) {
+    if (!ramdisk_create(0, CARD_SECTORS)) return fail("RAM disk", 0);
+    std::mt19937 rng(seed);
+    faults_t faults;
+    faults.rng.seed(seed * 7 + 1);
+    ramdisk_set_write_hook(0, write_hook, &faults);
+
+    // Model: contents, and whether they are known (not after a failed write)
+    std::vector<uint8_t> model(CARD_SECTORS * MSC_DISK_BLOCK, 0);
+    std::vector<bool> known(CARD_SECTORS, true);
+    std::vector<uint8_t> buf(MAX_CMD_BLOCKS * MSC_DISK_BLOCK);
+
+    static msc_disk_t d;
+    msc_disk_init(&d, 0, 0, 0);
+    uint8_t probe[MSC_DISK_BLOCK];
+    if (msc_disk_read10(&d, 0, 0, probe, sizeof probe) >= 0) return fail("read while off", 0);
+    if (RES_OK != msc_disk_attach(&d)) return fail("attach", 0);
+
+    uint32_t next = 0;  // End of the last command, for sequential runs
+    bool pending_error = false;
+    uint32_t reads = 0, writes = 0, failed_cmds = 0, deferred = 0;
+    for (uint32_t c = 0; c < commands; ++c) {
+        uint32_t roll = rng() % 100;
+        if (roll < 2) {
+            if (RES_OK != msc_disk_sync(&d)) return fail("sync", c);
+            continue;
+        }
+        if (roll < 3) {
+            // Eject and load again: nothing reaches the card meanwhile
+            msc_disk_start_stop(&d, false, true);
+            if (msc_disk_read10(&d, 0, 0, probe, sizeof probe) >= 0)
+                return fail("read while ejected", c);
+            if (!msc_disk_start_stop(&d, true, true)) return fail("load", c);
+            continue;
+        }
+        faults.every = roll < 10 ? 20 : 0;
+        uint32_t blocks = 1 + rng() % (rng() % 4 ? 16 : MAX_CMD_BLOCKS);
+        uint32_t lba = rng() % 2 ? next : rng() % (uint32_t)CARD_SECTORS;
+        if (lba + blocks > CARD_SECTORS) lba = (uint32_t)CARD_SECTORS - blocks;
+        next = lba + blocks;
+        uint32_t before = faults.failed;
+        // A write buffer that failed after the last command's status
+        bool expect_deferred = pending_error;
+        pending_error = false;
+        if (rng() % 2) {
+            ++writes;
+            for (uint32_t i = 0; i < blocks * MSC_DISK_BLOCK; ++i) buf[i] = (uint8_t)rng();
+            bool ok = scsi_write(&d, lba, blocks, buf.data());
+            bool card_failed = faults.failed != before;
+            if (expect_deferred) {
+                if (ok || card_failed) return fail("deferred write error not reported", c);
+                ++deferred;
+            } else if (card_failed) {
+                for (uint32_t b = 0; b < blocks; ++b) known[lba + b] = false;
+                if (ok) pending_error = true;  // Failed in the final flush
+                else ++failed_cmds;
+            } else {
+                if (!ok) return fail("write failed with no card error", c);
+                std::memcpy(&model[(size_t)lba * MSC_DISK_BLOCK], buf.data(),
+                            (size_t)blocks * MSC_DISK_BLOCK);
+                for (uint32_t b = 0; b < blocks; ++b) known[lba + b] = true;
+            }
+        } else {
+            ++reads;
+            bool ok = scsi_read(&d, lba, blocks, buf.data());
+            if (expect_deferred) {
+                if (ok) return fail("deferred write error not reported", c);
+                ++deferred;
+                continue;
+            }
+            if (!ok) return fail("read failed", c);
+            for (uint32_t b = 0; b < blocks; ++b)
+                if (known[lba + b] &&
+                    std::memcmp(&buf[(size_t)b * MSC_DISK_BLOCK],
+                                &model[(size_t)(lba + b) * MSC_DISK_BLOCK], MSC_DISK_BLOCK))
+                    return fail("read returned wrong data", c);
+        }
+    }
+    faults.every = 0;
+    msc_disk_take_write_error(&d);
+    if (RES_OK != msc_disk_detach(&d)) return fail("detach", commands);
+    if (msc_disk_write10(&d, 0, 0, probe, sizeof probe) >= 0)
+        return fail("write after detach", commands);
+    const uint8_t *img = ramdisk_data(0);
+    for (uint64_t b = 0; b < CARD_SECTORS; ++b)
+        if (known[b] && std::memcmp(img + b * MSC_DISK_BLOCK, &model[b * MSC_DISK_BLOCK],
+                                    MSC_DISK_BLOCK))
+            return fail("image differs from the model", commands);
+    const msc_disk_stats_t *s = msc_disk_stats(&d);
+    std::printf("check: %u commands (%u reads, %u writes), %u card write failures: "
+                "%u failed commands, %u deferred errors; %u read hits, %u card reads, "
+                "%u card writes\n",
+                commands, reads, writes, faults.failed, failed_cmds, deferred, s->hits,
+                s->reads, s->writes);
+    ramdisk_set_write_hook(0, nullptr, nullptr);
+    return 0;
+}
+
+struct rate_t {
+    double total;     // MB/s with the USB transfer
+    double card;      // MB/s of the card alone
+    double per_mb;    // Card commands per MB
+};
+
+// Card and USB time of a run of commands
+rate_t rate(uint64_t bytes, uint32_t commands) {
+    const ramdisk_stats_t *s = ramdisk_stats(0);
+    double card = card_us(s);
+    double usb = bytes * USB_US_PER_BYTE + commands * USB_CMD_US;
+    return {bytes / (card + usb), bytes / card, (s->reads + s->writes) * 1048576.0 / bytes};
+}
+
+void bench(uint64_t sectors) {
+    const uint32_t sizes[] = {1, 8, 32, 128, MAX_CMD_BLOCKS};  // Blocks per request
+    const uint64_t span = sectors < 32768 ? sectors : 32768;   // 16 MiB per run
+    std::vector<uint8_t> buf(MAX_CMD_BLOCKS * MSC_DISK_BLOCK, 0x5A);
+    static msc_disk_t d;
+    std::printf("\nMB/s, card on SPI (model) + USB full speed; %u byte endpoint buffer\n",
+                EP_BUF);
+    std::printf("%-9s %-9s %9s %9s %9s   %10s %10s   %9s %9s\n", "request", "mapping",
+                "seq read", "seq write", "rand 4K", "card read", "card write", "cmds/MB r",
+                "cmds/MB w");
+    for (uint32_t blocks : sizes) {
+        for (int coalesce = 0; coalesce < 2; ++coalesce) {
+            // Without: one card command per callback
+            msc_disk_init(&d, 0, coalesce ? 0 : 1, coalesce ? 0 : 1);
+            msc_disk_attach(&d);
+            uint32_t n = (uint32_t)(span / blocks);
+
+            ramdisk_reset_stats(0);
+            for (uint32_t i = 0; i < n; ++i) scsi_read(&d, i * blocks, blocks, buf.data());
+            rate_t rd = rate((uint64_t)n * blocks * MSC_DISK_BLOCK, n);
+
+            ramdisk_reset_stats(0);
+            for (uint32_t i = 0; i < n; ++i) scsi_write(&d, i * blocks, blocks, buf.data());
+            rate_t wr = rate((uint64_t)n * blocks * MSC_DISK_BLOCK, n);
+
+            std::mt19937 rng(1);
+            ramdisk_reset_stats(0);
+            const uint32_t rand_n = 2000;
+            for (uint32_t i = 0; i < rand_n; ++i)
+                scsi_read(&d, (uint32_t)(rng() % (sectors / 8)) * 8, 8, buf.data());
+            rate_t rr = rate((uint64_t)rand_n * 4096, rand_n);
+            msc_disk_detach(&d);
+
+            char req[16];
+            std::snprintf(req, sizeof req, "%u B", blocks * MSC_DISK_BLOCK);
+            std::printf("%-9s %-9s %9.3f %9.3f %9.3f   %10.3f %10.3f   %9.0f %9.0f\n",
+                        coalesce ? "" : req, coalesce ? "coalesce" : "per cb", rd.total,
+                        wr.total, rr.total, rd.card, wr.card, rd.per_mb, wr.per_mb);
+        }
+    }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    const char *image = nullptr;
+    int arg = 1;
+    if (arg + 1 < argc && !std::strcmp(argv[arg], "-f")) {
+        image = argv[arg + 1];
+        arg += 2;
+    }
+    uint32_t commands = arg < argc ? std::atoi(argv[arg]) : 20000;
+    uint32_t seed = arg + 1 < argc ? std::atoi(argv[arg + 1]) : 1;
+
+    if (check(commands, seed)) return 1;
+
+    if (image && !ramdisk_load(0, image)) {
+        std::fprintf(stderr, "%s: not a card image\n", image);
+        return 1;
+    }
+    bench(ramdisk_sectors(0));
+    ramdisk_destroy(0);
+    return 0;
+}
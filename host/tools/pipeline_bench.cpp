@@ -0,0 +1,130 @@
+// pipeline_bench: the capture pipeline end to end, into each storage sink.
+//
+// Every sample is formatted as the application does it, goes through the
+// spill buffer (spill.c) and is drained into a sink_t (sink.h); the sink is
+// flushed every 10 samples and the spill buffer committed, as after a sync
+// on the device. The sinks are:
+//   mem   - RAM buffer: the cost of the pipeline itself
+//   file  - crash-consistent log file, FatFs on the RAM disk
+//   raw   - the same blocks written straight to the sectors of a second RAM disk
+//   flash - the internal flash log on the simulated NOR chip
+// Host time measures CPU cost per sample; the disk and flash counters are
+// the I/O the device would do (sectors written, pages programmed, and the
+// chip's virtual busy time).
+//
+//   pipeline_bench [samples]
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "ff.h"
+#include "nor_sim.h"
+#include "ramdisk.h"
+#include "sink.h"
+#include "spill.h"
+
+extern "C" void my_printf(const char *, ...) {}
+
+namespace {
+
+const uint32_t FLUSH_EVERY = 10;
+const char *const COLORS[] = {"Vermelho", "Verde", "Azul", "Amarelo", "Branco", "Preto"};
+
+void check(FRESULT fr, const char *what) {
+    if (FR_OK != fr) {
+        std::fprintf(stderr, "%s failed: %d\n", what, fr);
+        std::exit(1);
+    }
+}
+
+// Runs the pipeline into sk; returns host nanoseconds per sample
+double run(sink_t *sk, uint32_t samples) {
+    static uint8_t spill_buf[16 * 1024];
+    spill_t sp;
+    spill_init(&sp, spill_buf, sizeof spill_buf);
+    check(sink_open(sk), "sink_open");
+    auto t0 = std::chrono::steady_clock::now();
+    char line[100];
+    for (uint32_t n = 1; n <= samples; ++n) {
+        unsigned c = n * 7 % 1024, r = n * 13 % 256, g = n * 17 % 256, b = n * 19 % 256;
+        int len = std::snprintf(line, sizeof line, "%u,%u,%u,%u,%u,%s\n", n, c, r, g, b,
+                                COLORS[n % 6]);
+        spill_put(&sp, line, len);
+        check((FRESULT)spill_drain(&sp, sink_write, sk), "drain");
+        if (0 == n % FLUSH_EVERY) {
+            check(sink_flush(sk), "sink_flush");
+            spill_commit(&sp);
+        }
+    }
+    check(sink_close(sk), "sink_close");
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0)
+               .count() / samples;
+}
+
+void report(const sink_t *sk, double ns, const char *io) {
+    std::printf("%-6s %8.0f ns/sample %10.2f MB/s  %s\n", sink_name(sk), ns,
+                sk->stats.bytes / (ns * sk->stats.records / 1e3), io);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    const uint32_t samples = argc > 1 ? std::atoi(argv[1]) : 200000;
+    char io[160];
+
+    // RAM
+    static uint8_t mem_buf[1 << 20];
+    sink_mem_t mem;
+    sink_t sk;
+    sink_mem_init(&sk, &mem, mem_buf, sizeof mem_buf, true);
+    double ns = run(&sk, samples);
+    std::snprintf(io, sizeof io, "%llu bytes, buffer wrapped %u times",
+                  (unsigned long long)sk.stats.bytes, mem.wraps);
+    report(&sk, ns, io);
+
+    // File on the RAM disk
+    if (!ramdisk_create(0, 64 * 2048)) return 1;
+    std::vector<uint8_t> work(FF_MAX_SS * 16);
+    MKFS_PARM opt = {FM_ANY, 1, 0, 0, 0};
+    check(f_mkfs("", &opt, work.data(), work.size()), "f_mkfs");
+    static FATFS fs;
+    check(f_mount(&fs, "", 1), "f_mount");
+    static sink_file_t file;
+    sink_file_init(&sk, &file, "bench.log");
+    ramdisk_reset_stats(0);
+    ns = run(&sk, samples);
+    const ramdisk_stats_t *ds = ramdisk_stats(0);
+    std::snprintf(io, sizeof io, "%llu sectors written, %llu read",
+                  (unsigned long long)ds->sectors_written, (unsigned long long)ds->sectors_read);
+    report(&sk, ns, io);
+
+    // Raw sectors: a second RAM disk with no file system
+    if (!ramdisk_create(1, 64 * 2048)) return 1;
+    static sink_raw_t raw;
+    sink_raw_init(&sk, &raw, 1, 0, (uint32_t)ramdisk_sectors(1));
+    ds = ramdisk_stats(1);
+    ns = run(&sk, samples);
+    std::snprintf(io, sizeof io, "%llu sectors written, %llu read",
+                  (unsigned long long)ds->sectors_written, (unsigned long long)ds->sectors_read);
+    report(&sk, ns, io);
+
+    // Internal flash
+    nor_sim_t nor;
+    if (!nor_sim_init(&nor, 1536 * 1024, 1)) return 1;
+    flash_log_dev_t dev;
+    nor_sim_dev(&nor, &dev);
+    static flash_log_t fl;
+    if (flash_log_mount(&fl, &dev)) return 1;
+    sink_flash_init(&sk, &fl);
+    uint32_t fit = samples < 30000 ? samples : 30000;  // About what the region holds
+    ns = run(&sk, fit);
+    std::snprintf(io, sizeof io, "%llu programs, %llu erases, %.2f s of flash time",
+                  (unsigned long long)nor.programs, (unsigned long long)nor.erases,
+                  nor.now_us / 1e6);
+    report(&sk, ns, io);
+    nor_sim_free(&nor);
+    return 0;
+}
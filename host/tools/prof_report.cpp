@@ -0,0 +1,206 @@
+// prof_report: turns the sampling profiler's dump (lib/FatFs_SPI/include/
+// prof.h, "prof dump" on the serial terminal) into a profile per function,
+// with the symbols of the firmware's .elf.
+//
+//   prof_report spi_data_collector.elf capture.txt
+//   prof_report -f perfil.folded -n 30 spi_data_collector.elf < capture.txt
+//
+// Prints, most samples first, the share of samples taken in each function
+// (self) and with the function anywhere on the stack (total). -f also writes
+// folded stacks ("outer;...;inner count" per line) for flamegraph.pl,
+// inferno or speedscope. -n limits the table to that many functions.
+//
+// The stack of a sample is the function holding pc, the one holding lr when
+// it differs (lr is the return address in a leaf; elsewhere it is a stale
+// address in the same function, after its last call) and the return
+// addresses found on the stack, innermost first. Those are a scan, not an
+// unwind: a stale return address left in a local can add a caller that is
+// no longer there. Addresses without a symbol show as [rom] (boot ROM: the
+// floating point and memory routines), [ram] or in hex.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "prof.h"
+
+namespace {
+
+struct symbol {
+    uint32_t addr;
+    uint32_t size;
+    std::string name;
+};
+
+uint32_t get32(const std::vector<uint8_t> &b, size_t off) {
+    return off + 4 > b.size() ? 0
+                              : b[off] | b[off + 1] << 8 | b[off + 2] << 16 | uint32_t(b[off + 3]) << 24;
+}
+uint16_t get16(const std::vector<uint8_t> &b, size_t off) {
+    return off + 2 > b.size() ? 0 : uint16_t(b[off] | b[off + 1] << 8);
+}
+
+// The functions of a 32 bit little endian ELF, sorted by address
+bool load_symbols(const char *path, std::vector<symbol> &syms) {
+    FILE *f = std::fopen(path, "rb");
+    if (!f) {
+        std::perror(path);
+        return false;
+    }
+    std::vector<uint8_t> elf;
+    uint8_t chunk[65536];
+    for (size_t n; (n = std::fread(chunk, 1, sizeof chunk, f)) > 0;) elf.insert(elf.end(), chunk, chunk + n);
+    std::fclose(f);
+    if (elf.size() < 52 || std::memcmp(elf.data(), "\x7f" "ELF", 4) || 1 != elf[4] || 1 != elf[5]) {
+        std::fprintf(stderr, "%s: not a 32 bit little endian ELF file\n", path);
+        return false;
+    }
+    uint32_t shoff = get32(elf, 32);
+    unsigned shentsize = get16(elf, 46), shnum = get16(elf, 48);
+    for (unsigned i = 0; i < shnum; ++i) {
+        size_t sh = shoff + size_t(i) * shentsize;
+        if (2 != get32(elf, sh + 4)) continue;  // SHT_SYMTAB
+        uint32_t off = get32(elf, sh + 16), size = get32(elf, sh + 20), link = get32(elf, sh + 24);
+        size_t strsh = shoff + size_t(link) * shentsize;
+        uint32_t stroff = get32(elf, strsh + 16), strsize = get32(elf, strsh + 20);
+        for (uint32_t s = off; s + 16 <= off + size && s + 16 <= elf.size(); s += 16) {
+            uint32_t name = get32(elf, s), value = get32(elf, s + 4), sz = get32(elf, s + 8);
+            if (2 != (elf[s + 12] & 0xf) || !sz || name >= strsize) continue;  // STT_FUNC
+            size_t p = size_t(stroff) + name;
+            if (p >= elf.size()) continue;
+            const char *str = reinterpret_cast<const char *>(&elf[p]);
+            syms.push_back({value & ~1u, sz, std::string(str, strnlen(str, elf.size() - p))});
+        }
+    }
+    std::sort(syms.begin(), syms.end(), [](const symbol &a, const symbol &b) { return a.addr < b.addr; });
+    if (syms.empty()) {
+        std::fprintf(stderr, "%s: no function symbols (stripped?)\n", path);
+        return false;
+    }
+    return true;
+}
+
+std::string name_of(const std::vector<symbol> &syms, uint32_t addr) {
+    addr &= ~1u;
+    auto it = std::upper_bound(syms.begin(), syms.end(), addr,
+                               [](uint32_t a, const symbol &s) { return a < s.addr; });
+    if (it != syms.begin() && addr - (it - 1)->addr < (it - 1)->size) return (it - 1)->name;
+    if (addr < 0x4000) return "[rom]";
+    if (addr >= 0x20000000 && addr < 0x20042000) return "[ram]";
+    char hex[16];
+    std::snprintf(hex, sizeof hex, "0x%08x", unsigned(addr));
+    return hex;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    const char *folded_path = nullptr;
+    unsigned top = 0;
+    int argi = 1;
+    for (; argi + 1 < argc && '-' == argv[argi][0]; argi += 2) {
+        if (!std::strcmp(argv[argi], "-f"))
+            folded_path = argv[argi + 1];
+        else if (!std::strcmp(argv[argi], "-n"))
+            top = unsigned(std::strtoul(argv[argi + 1], nullptr, 0));
+        else
+            break;
+    }
+    if (argi >= argc || argc - argi > 2 || '-' == argv[argi][0]) {
+        std::fprintf(stderr, "usage: %s [-f out.folded] [-n functions] firmware.elf [capture.txt]\n",
+                     argv[0]);
+        return 2;
+    }
+    std::vector<symbol> syms;
+    if (!load_symbols(argv[argi], syms)) return 1;
+    FILE *in = stdin;
+    if (argi + 1 < argc && !(in = std::fopen(argv[argi + 1], "r"))) {
+        std::perror(argv[argi + 1]);
+        return 1;
+    }
+
+    const size_t tag_len = std::strlen(PROF_LINE_TAG);
+    std::map<std::string, uint64_t> self, total, folded;
+    uint64_t samples = 0;
+    unsigned hz = 0, dropped = 0, missed = 0, dumps = 0;
+    char line[256];
+    while (std::fgets(line, sizeof line, in)) {
+        const char *p = std::strstr(line, PROF_LINE_TAG);
+        if (!p) continue;
+        p += tag_len;
+        if (' ' == *p) {
+            // Header of a dump: counts so far on the device, so the last one wins
+            unsigned version, h, s, d, m, n;
+            if (6 == std::sscanf(p, "%u %u %u %u %u %u", &version, &h, &s, &d, &m, &n) &&
+                PROF_FORMAT_VERSION == version) {
+                hz = h, dropped = d, missed = m;
+                ++dumps;
+                self.clear(), total.clear(), folded.clear();
+                samples = 0;
+            }
+            continue;
+        }
+        unsigned long count, pc, lr, ret[PROF_DEPTH];
+        if (7 != std::sscanf(p, "%lx %lx %lx %lx %lx %lx %lx", &count, &pc, &lr, &ret[0], &ret[1],
+                             &ret[2], &ret[3]))
+            continue;
+        // Innermost first, a function once in a row (recursion and the stale lr)
+        std::vector<std::string> stack{name_of(syms, pc)};
+        auto push = [&](uint32_t a) {
+            std::string n = name_of(syms, a);
+            if (n != stack.back()) stack.push_back(n);
+        };
+        if (lr & 1) push(lr);
+        for (unsigned d = 0; d < PROF_DEPTH && ret[d]; ++d) push(ret[d]);
+        samples += count;
+        self[stack[0]] += count;
+        std::vector<std::string> seen;
+        std::string key;
+        for (size_t i = stack.size(); i--;) {
+            if (std::find(seen.begin(), seen.end(), stack[i]) == seen.end()) {
+                seen.push_back(stack[i]);
+                total[stack[i]] += count;
+            }
+            key += stack[i];
+            if (i) key += ';';
+        }
+        folded[key] += count;
+    }
+    if (in != stdin) std::fclose(in);
+    if (!dumps || !samples) {
+        std::fprintf(stderr, "no " PROF_LINE_TAG " dump with samples in the input\n");
+        return 1;
+    }
+
+    std::printf("%llu samples at %u Hz (%.1f s of run time), %u dropped (table full), %u missed\n",
+                (unsigned long long)samples, hz, hz ? double(samples) / hz : 0.0, dropped, missed);
+    std::printf("%7s %8s %7s %8s  %s\n", "self%", "self", "total%", "total", "function");
+    std::vector<std::pair<std::string, uint64_t>> rows(total.begin(), total.end());
+    std::sort(rows.begin(), rows.end(), [&](const auto &a, const auto &b) {
+        uint64_t sa = self.count(a.first) ? self[a.first] : 0;
+        uint64_t sb = self.count(b.first) ? self[b.first] : 0;
+        return sa != sb ? sa > sb : a.second > b.second;
+    });
+    unsigned shown = 0;
+    for (const auto &r : rows) {
+        if (top && shown++ == top) break;
+        uint64_t s = self.count(r.first) ? self[r.first] : 0;
+        std::printf("%6.2f%% %8llu %6.2f%% %8llu  %s\n", 100.0 * s / samples, (unsigned long long)s,
+                    100.0 * r.second / samples, (unsigned long long)r.second, r.first.c_str());
+    }
+
+    if (folded_path) {
+        FILE *out = std::fopen(folded_path, "w");
+        if (!out) {
+            std::perror(folded_path);
+            return 1;
+        }
+        for (const auto &kv : folded) std::fprintf(out, "%s %llu\n", kv.first.c_str(), (unsigned long long)kv.second);
+        std::fclose(out);
+    }
+    return 0;
+}
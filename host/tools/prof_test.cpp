@@ -0,0 +1,169 @@
+// prof_test: the sampling profiler's table (lib/FatFs_SPI/src/prof.c) fed
+// with made up stacks.
+//
+// Checks which stack words are taken as return addresses (odd, in flash,
+// after a call, lr only once, at most PROF_DEPTH and PROF_SCAN_WORDS), that
+// equal stacks share an entry, that a full table counts samples as dropped
+// and that the dump lines carry it all, whole or printed in steps.
+//
+//   prof_test
+
+#include <cstdio>
+#include <cstring>
+#include <set>
+#include <string>
+
+#include "prof.h"
+
+namespace {
+
+int failures;
+
+void check(bool ok, const std::string &what) {
+    if (!ok) {
+        std::fprintf(stderr, "FAIL: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+// What prof_print() prints, or the steps of per_step entries if nonzero;
+// *steps is set to the number of steps
+std::string dump(unsigned per_step, unsigned *steps) {
+    std::FILE *tmp = std::tmpfile();
+    std::FILE *saved = stdout;
+    stdout = tmp;
+    *steps = 0;
+    if (!per_step) {
+        prof_print();
+    } else {
+        prof_print_begin();
+        while (++*steps, !prof_print_step(per_step)) {}
+    }
+    stdout = saved;
+    std::rewind(tmp);
+    std::string text;
+    for (int c; (c = std::fgetc(tmp)) != EOF;) text += (char)c;
+    std::fclose(tmp);
+    return text;
+}
+
+// Addresses a call returns to, as the Thumb code would say on the device
+std::set<uint32_t> call_sites = {0x10000101, 0x10000201, 0x10000301, 0x10000401,
+                                 0x10000501, 0x10000601};
+
+const prof_entry_t *find(uint32_t pc) {
+    const prof_entry_t *t = prof_table();
+    for (unsigned i = 0; i < PROF_SLOTS; ++i)
+        if (t[i].count && t[i].pc == pc) return &t[i];
+    return nullptr;
+}
+
+template <size_t N>
+void sample(uint32_t pc, uint32_t lr, const uint32_t (&stack)[N]) {
+    prof_sample(pc, lr, stack, stack + N);
+}
+
+}  // namespace
+
+extern "C" bool prof_host_is_return(uint32_t ret) { return call_sites.count(ret); }
+
+int main() {
+    check(!prof_start(5) && !prof_start(20000) && prof_start(1000), "rate limits");
+
+    // Saved registers, a return address to the leaf's caller (== lr), locals
+    // that look like code addresses but are not, and two callers further up
+    const uint32_t stack[] = {0x20001000, 0x10000101, 0x10000100, 0x10000103, 0x30000001,
+                              0x0000ffff, 0x10000201, 0x10000101, 0x10000301};
+    sample(0x10000050, 0x10000101, stack);
+    const prof_entry_t *e = find(0x10000050);
+    check(e && 1 == e->count, "sample kept");
+    check(e && 0x10000201 == e->ret[0] && 0x10000101 == e->ret[1] && 0x10000301 == e->ret[2] &&
+              0 == e->ret[3],
+          "return addresses: lr skipped once, even, out of flash and non call sites ignored");
+
+    for (int i = 0; i < 9; ++i) sample(0x10000050, 0x10000101, stack);
+    check(e && 10 == e->count, "equal stacks share an entry");
+
+    // Depth and scan limits
+    const uint32_t deep[] = {0x10000201, 0x10000301, 0x10000401, 0x10000501, 0x10000601};
+    sample(0x10000060, 0, deep);
+    e = find(0x10000060);
+    check(e && 0x10000201 == e->ret[0] && 0x10000501 == e->ret[3], "PROF_DEPTH return addresses");
+    uint32_t far[PROF_SCAN_WORDS + 1] = {};
+    far[PROF_SCAN_WORDS] = 0x10000201;
+    sample(0x10000070, 0, far);
+    e = find(0x10000070);
+    check(e && 0 == e->ret[0], "scan stops after PROF_SCAN_WORDS");
+
+    // An empty stack range (the frame at the top of the stack)
+    prof_sample(0x10000080, 0, stack, stack);
+    check(find(0x10000080), "no stack to scan");
+
+    prof_stats_t s;
+    prof_get_stats(&s);
+    check(13 == s.samples && 0 == s.dropped && 1000 == s.hz, "stats");
+
+    // Fill the table: different pcs until some have nowhere to go
+    for (uint32_t i = 0; i < 2 * PROF_SLOTS; ++i) sample(0x10010000 + 2 * i, 0, deep);
+    prof_get_stats(&s);
+    check(s.dropped > 0 && s.samples + s.dropped == 13 + 2 * PROF_SLOTS, "full table drops");
+    check(s.samples - 13 >= PROF_SLOTS * 3 / 4, "table mostly used before dropping");
+
+    // The dump, read back as prof_report does
+    std::FILE *tmp = std::tmpfile();
+    std::FILE *saved = stdout;
+    stdout = tmp;
+    prof_print();
+    stdout = saved;
+    std::rewind(tmp);
+    char line[256];
+    unsigned version = 0, hz = 0, samples = 0, dropped = 0, missed = 0, entries = 0, lines = 0;
+    unsigned long total = 0;
+    check(std::fgets(line, sizeof line, tmp) &&
+              6 == std::sscanf(line, PROF_LINE_TAG " %u %u %u %u %u %u", &version, &hz, &samples,
+                               &dropped, &missed, &entries),
+          "dump header");
+    check(PROF_FORMAT_VERSION == version && 1000 == hz && s.samples == samples &&
+              s.dropped == dropped && 0 == missed,
+          "header values");
+    while (std::fgets(line, sizeof line, tmp)) {
+        unsigned long count, pc, lr, r[PROF_DEPTH];
+        if (7 == std::sscanf(line, PROF_LINE_TAG "%lx %lx %lx %lx %lx %lx %lx", &count, &pc, &lr,
+                             &r[0], &r[1], &r[2], &r[3])) {
+            total += count;
+            ++lines;
+        }
+    }
+    std::fclose(tmp);
+    check(lines == entries && total == samples, "a line per entry, counts add up");
+
+    // In steps, as the shell prints it: the same lines, sampling paused
+    // until the last step
+    unsigned steps;
+    std::string whole = dump(0, &steps);
+    check(dump(100, &steps) == whole && steps > entries / 100, "dump in steps");
+    std::FILE *sink = std::tmpfile();
+    stdout = sink;
+    prof_print_begin();
+    prof_print_step(10);
+    sample(0x10000050, 0, deep);
+    prof_get_stats(&s);
+    check(1 == s.missed, "no sample taken while a dump is in progress");
+    while (!prof_print_step(10)) {}
+    stdout = saved;
+    std::fclose(sink);
+    sample(0x10000050, 0, deep);
+    prof_get_stats(&s);
+    check(1 == s.missed, "sampling again after the dump");
+
+    prof_reset();
+    prof_get_stats(&s);
+    check(!find(0x10000050) && !s.samples && !s.dropped && 1000 == s.hz, "reset keeps the rate");
+    prof_stop();
+    prof_get_stats(&s);
+    check(!s.hz, "stopped");
+
+    if (failures) return 1;
+    std::printf("prof: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,133 @@
+// ring_dump: rebuilds the time-ordered stream from a ring log file
+// (lib/FatFs_SPI/include/ring_log.h) copied off the card.
+//
+//   ring_dump ring.log [out.csv]
+//
+// Blocks are collected from every slot, checked (ring id, slot, CRC) and
+// sorted by sequence number. The payload is written out in that order,
+// starting at the first whole record. Where blocks are missing (torn write,
+// bad sector) the partial record is dropped and output resumes at the next
+// record boundary. A summary goes to stderr.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+extern "C" {
+#include "crc.h"
+}
+#include "ring_log.h"
+
+namespace {
+
+uint16_t blk_crc(ring_log_blk_t blk) {
+    blk.hdr.crc = 0;
+    uint16_t crc = 0;
+    update_crc16(&crc, reinterpret_cast<const char *>(&blk.hdr), sizeof blk.hdr);
+    update_crc16(&crc, reinterpret_cast<const char *>(blk.payload), blk.hdr.len);
+    return crc;
+}
+
+uint32_t checksum(const uint32_t *p, size_t size) {  // util.h: calculate_checksum
+    uint32_t sum = 0;
+    for (size_t i = 0; i < size / sizeof(uint32_t) - 1; i++) sum ^= p[i];
+    return sum;
+}
+
+void print_time(const char *label, uint32_t t, uint64_t uptime_us) {
+    char buf[32] = "RTC not set";
+    if (t) {
+        time_t tt = t;
+        std::strftime(buf, sizeof buf, "%Y-%m-%d %H:%M:%S", std::gmtime(&tt));
+    }
+    std::fprintf(stderr, "%s %s (uptime %.3f s)\n", label, buf, uptime_us / 1e6);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s ring.log [out]\n", argv[0]);
+        return 2;
+    }
+    FILE *in = std::fopen(argv[1], "rb");
+    if (!in) {
+        std::perror(argv[1]);
+        return 1;
+    }
+    FILE *out = argc > 2 ? std::fopen(argv[2], "wb") : stdout;
+    if (!out) {
+        std::perror(argv[2]);
+        return 1;
+    }
+
+    ring_log_blk_t blk;
+    ring_log_super_t sb;
+    if (1 != std::fread(&blk, sizeof blk, 1, in)) {
+        std::fprintf(stderr, "%s: too short\n", argv[1]);
+        return 1;
+    }
+    std::memcpy(&sb, &blk, sizeof sb);
+    if (RING_LOG_SUPER_MAGIC != sb.magic || RING_LOG_VERSION != sb.version ||
+        RING_LOG_BLOCK_SIZE != sb.block_size ||
+        sb.checksum != checksum(reinterpret_cast<uint32_t *>(&sb), sizeof sb)) {
+        std::fprintf(stderr, "%s: not a ring log (bad superblock)\n", argv[1]);
+        return 1;
+    }
+
+    std::vector<ring_log_blk_t> blocks;
+    uint32_t bad = 0;
+    for (uint32_t slot = 0; slot < sb.nslots; ++slot) {
+        if (1 != std::fread(&blk, sizeof blk, 1, in)) {
+            std::fprintf(stderr, "warning: file ends at slot %u of %u\n", slot, sb.nslots);
+            break;
+        }
+        const ring_log_blk_hdr_t &h = blk.hdr;
+        if (RING_LOG_BLOCK_MAGIC != h.magic || sb.id != h.id) continue;  // Never written
+        if (h.seq % sb.nslots != slot || h.len > RING_LOG_PAYLOAD || h.crc != blk_crc(blk)) {
+            ++bad;
+            continue;
+        }
+        blocks.push_back(blk);
+    }
+    std::fclose(in);
+    std::sort(blocks.begin(), blocks.end(),
+              [](const ring_log_blk_t &a, const ring_log_blk_t &b) { return a.hdr.seq < b.hdr.seq; });
+
+    uint64_t bytes = 0;
+    uint32_t gaps = 0;
+    bool in_rec = false;  // Output is aligned to a record boundary
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        const ring_log_blk_hdr_t &h = blocks[i].hdr;
+        bool contiguous = i && blocks[i - 1].hdr.seq + 1 == h.seq &&
+                          RING_LOG_PAYLOAD == blocks[i - 1].hdr.len;
+        if (i && blocks[i - 1].hdr.seq + 1 != h.seq) ++gaps;
+        uint16_t from = 0;
+        if (!contiguous || !in_rec) {
+            if (RING_LOG_NO_REC == h.first_rec) {
+                in_rec = false;
+                continue;
+            }
+            from = h.first_rec;
+        }
+        std::fwrite(blocks[i].payload + from, 1, h.len - from, out);
+        bytes += h.len - from;
+        in_rec = true;
+    }
+    if (out != stdout) std::fclose(out);
+
+    std::fprintf(stderr, "ring: %u slots (%.1f MiB), id %08x\n", sb.nslots,
+                 (sb.nslots + 1) * 512.0 / (1 << 20), sb.id);
+    std::fprintf(stderr, "blocks: %zu valid, %u bad, %u gaps; %llu bytes out\n", blocks.size(),
+                 bad, gaps, (unsigned long long)bytes);
+    if (!blocks.empty()) {
+        std::fprintf(stderr, "seq %u .. %u (%u laps)\n", blocks.front().hdr.seq,
+                     blocks.back().hdr.seq, blocks.back().hdr.seq / sb.nslots);
+        print_time("oldest:", blocks.front().hdr.time, blocks.front().hdr.uptime_us);
+        print_time("newest:", blocks.back().hdr.time, blocks.back().hdr.uptime_us);
+    }
+    return 0;
+}
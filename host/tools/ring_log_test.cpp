@@ -0,0 +1,143 @@
+// ring_log_test: where ring_log_open() resumes (lib/FatFs_SPI/src/ring_log.c)
+// on the RAM disk.
+//
+// A ring of 8 slots is reopened empty, before the first wrap, after a wrap,
+// and after a wrap with slot 0 damaged, as a torn rewrite of the first block
+// of a lap leaves it: once while slot 0 is still the head and once with
+// later blocks of its lap written. Each time the next sequence number must
+// be past every valid block, and after more records are appended, the
+// blocks sorted by sequence number (as ring_dump does) must end with them.
+//
+//   ring_log_test
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "crc.h"
+}
+#include "ff.h"
+#include "ramdisk.h"
+#include "ring_log.h"
+
+extern "C" void my_printf(const char *, ...) {}
+
+namespace {
+
+const uint32_t SLOTS = 8;
+const char *const PATH = "ring.log";
+const unsigned REC_LEN = 60;  // 8 records a block
+
+FATFS fs;
+ring_log_t rl;
+unsigned next_rec;
+int failures;
+
+void check(bool ok, const std::string &what) {
+    if (!ok) {
+        std::fprintf(stderr, "FAIL: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+bool open_ring() { return FR_OK == ring_log_open(&rl, PATH, (1 + SLOTS) * RING_LOG_BLOCK_SIZE); }
+
+void write_recs(unsigned n) {
+    for (unsigned i = 0; i < n; ++i) {
+        char rec[REC_LEN];
+        std::memset(rec, ' ', sizeof rec);
+        std::snprintf(rec, sizeof rec, "%u", next_rec++);
+        ring_log_write(&rl, rec, sizeof rec);
+    }
+    ring_log_close(&rl);
+}
+
+uint8_t *slot_data(uint32_t slot) {
+    return ramdisk_data(0) + (rl.lba + 1 + slot) * RAMDISK_SECTOR_SIZE;
+}
+
+// Sequence numbers of the valid blocks, highest first
+std::vector<uint32_t> valid_seqs() {
+    std::vector<uint32_t> seqs;
+    for (uint32_t slot = 0; slot < SLOTS; ++slot) {
+        ring_log_blk_t blk;
+        std::memcpy(&blk, slot_data(slot), sizeof blk);
+        uint16_t crc = blk.hdr.crc, sum = 0;
+        blk.hdr.crc = 0;
+        update_crc16(&sum, reinterpret_cast<const char *>(&blk.hdr), sizeof blk.hdr);
+        if (blk.hdr.len <= RING_LOG_PAYLOAD)
+            update_crc16(&sum, reinterpret_cast<const char *>(blk.payload), blk.hdr.len);
+        if (RING_LOG_BLOCK_MAGIC == blk.hdr.magic && rl.id == blk.hdr.id &&
+            slot == blk.hdr.seq % SLOTS && blk.hdr.len <= RING_LOG_PAYLOAD && crc == sum)
+            seqs.push_back(blk.hdr.seq);
+    }
+    std::sort(seqs.rbegin(), seqs.rend());
+    return seqs;
+}
+
+// The record number at the start of the last record in the newest block
+unsigned newest_rec() {
+    std::vector<uint32_t> seqs = valid_seqs();
+    if (seqs.empty()) return ~0u;
+    const ring_log_blk_t *blk =
+        reinterpret_cast<const ring_log_blk_t *>(slot_data(seqs[0] % SLOTS));
+    unsigned off = blk->hdr.first_rec;
+    if (RING_LOG_NO_REC == off) return ~0u;
+    while (off + 2 * REC_LEN <= blk->hdr.len) off += REC_LEN;
+    return (unsigned)std::strtoul(reinterpret_cast<const char *>(blk->payload) + off, nullptr, 10);
+}
+
+// Reopens, expecting to resume at seq, then appends a block and a half
+void reopen(uint32_t seq, const std::string &what) {
+    check(open_ring(), what + ": reopen");
+    std::vector<uint32_t> seqs = valid_seqs();
+    check(rl.seq == seq, what + ": resumes at seq " + std::to_string(seq) + ", got " +
+                             std::to_string(rl.seq));
+    check(seqs.empty() || rl.seq > seqs[0], what + ": past every valid block");
+    write_recs(12);
+    check(newest_rec() == next_rec - 1, what + ": newest block holds the last record");
+}
+
+void damage_slot0() { slot_data(0)[sizeof(ring_log_blk_hdr_t) + 5] ^= 0xFF; }
+
+}  // namespace
+
+int main() {
+    if (!ramdisk_create(0, 4 * 2048)) return 1;
+    std::vector<uint8_t> work(FF_MAX_SS * 16);
+    MKFS_PARM opt = {FM_ANY, 1, 0, 0, 0};
+    if (FR_OK != f_mkfs("", &opt, work.data(), work.size())) return 1;
+    if (FR_OK != f_mount(&fs, "", 1)) return 1;
+
+    check(open_ring() && 0 == rl.seq && SLOTS == rl.nslots, "new ring starts at seq 0");
+    ring_log_close(&rl);
+    reopen(0, "empty ring");             // Blocks 0 and 1 (partial)
+    reopen(2, "before the first wrap");  // 2 and 3
+    reopen(4, "before the first wrap");  // 4 and 5
+    reopen(6, "before the first wrap");  // 6 and 7
+    reopen(8, "after a wrap");           // 8 (slot 0) and 9
+
+    // Blocks 10 to 15 and 16, partial, back in slot 0: torn there, the
+    // other slots hold 9 to 15
+    check(open_ring(), "reopen");
+    write_recs(6 * 8 + 4);
+    check(16 == rl.seq, "head back in slot 0");
+    damage_slot0();
+    reopen(16, "slot 0 torn while the head");  // 16 and 17
+
+    // Slot 0 damaged with a later block of its lap written (17 in slot 1)
+    damage_slot0();
+    reopen(18, "slot 0 damaged behind the head");
+
+    f_mount(nullptr, "", 0);
+    if (failures) {
+        std::fprintf(stderr, "ring_log_test: %d checks failed\n", failures);
+        return 1;
+    }
+    std::fprintf(stderr, "ring_log_test: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,262 @@
+// sd_trace_decode: turns an SD trace (lib/FatFs_SPI/sd_driver/sd_trace.h) into
+// a timeline.
+//
+//   sd_trace_decode sdtrace.bin          file written by sd_trace_save()
+//   sd_trace_decode serial.txt           capture with sd_trace_print() lines
+//   sd_trace_decode -s 5000 sdtrace.bin  flag events of 5 ms or more
+//
+// One line per event: time since the first record, gap since the end of the
+// previous event, duration, and the decoded command/response. Errors are
+// marked with 'E' and slow events with '!'. A summary per event type follows.
+
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "sd_trace.h"
+
+namespace {
+
+const char *cmd_name(unsigned cmd, bool acmd) {
+    if (acmd) {
+        switch (cmd) {
+            case 6: return "SET_BUS_WIDTH";
+            case 13: return "SD_STATUS";
+            case 22: return "SEND_NUM_WR_BLOCKS";
+            case 23: return "SET_WR_BLK_ERASE_COUNT";
+            case 41: return "SD_SEND_OP_COND";
+            case 42: return "SET_CLR_CARD_DETECT";
+            case 51: return "SEND_SCR";
+        }
+        return "?";
+    }
+    switch (cmd) {
+        case 0: return "GO_IDLE_STATE";
+        case 1: return "SEND_OP_COND";
+        case 6: return "SWITCH_FUNC";
+        case 8: return "SEND_IF_COND";
+        case 9: return "SEND_CSD";
+        case 10: return "SEND_CID";
+        case 12: return "STOP_TRANSMISSION";
+        case 13: return "SEND_STATUS";
+        case 16: return "SET_BLOCKLEN";
+        case 17: return "READ_SINGLE_BLOCK";
+        case 18: return "READ_MULTIPLE_BLOCK";
+        case 24: return "WRITE_BLOCK";
+        case 25: return "WRITE_MULTIPLE_BLOCK";
+        case 27: return "PROGRAM_CSD";
+        case 32: return "ERASE_WR_BLK_START_ADDR";
+        case 33: return "ERASE_WR_BLK_END_ADDR";
+        case 38: return "ERASE";
+        case 55: return "APP_CMD";
+        case 56: return "GEN_CMD";
+        case 58: return "READ_OCR";
+        case 59: return "CRC_ON_OFF";
+    }
+    return "?";
+}
+
+// Status codes of sd_card.h
+const char *status_name(int16_t st) {
+    switch (st) {
+        case 0: return "ok";
+        case -5001: return "WOULD_BLOCK";
+        case -5002: return "UNSUPPORTED";
+        case -5003: return "PARAMETER";
+        case -5004: return "NO_INIT";
+        case -5005: return "NO_DEVICE";
+        case -5006: return "WRITE_PROTECTED";
+        case -5007: return "UNUSABLE";
+        case -5008: return "NO_RESPONSE";
+        case -5009: return "CRC";
+        case -5010: return "ERASE";
+        case -5011: return "WRITE";
+    }
+    return "?";
+}
+
+// R1 flags, idle first; 0xFF means no response
+std::string r1_str(uint8_t r1) {
+    if (0xFF == r1) return " no-response";
+    static const char *const bits[] = {"idle",     "erase-reset", "illegal", "crc",
+                                       "erase-seq", "address",    "param"};
+    std::string s;
+    for (unsigned b = 0; b < 7; ++b)
+        if (r1 & 1u << b) s += std::string(" ") + bits[b];
+    return s;
+}
+
+// Returns true if the event is an error
+bool describe(const sd_trace_rec_t &r, char *buf, size_t len) {
+    switch (r.event) {
+        case SD_TRACE_CMD: {
+            bool acmd = r.cmd & SD_TRACE_ACMD;
+            unsigned cmd = r.cmd & ~SD_TRACE_ACMD;
+            // Commands with a longer response keep its low 16 bits, not R1
+            bool r1 = !(!acmd && (8 == cmd || 58 == cmd || 13 == cmd));
+            std::string flags = r1 ? r1_str(static_cast<uint8_t>(r.resp)) : "";
+            std::snprintf(buf, len, "%s%u %-22s arg=0x%08" PRIx32 " resp=0x%04x%s",
+                          acmd ? "ACMD" : "CMD", cmd, cmd_name(cmd, acmd), r.arg, r.resp,
+                          flags.c_str());
+            if (r1) return r.resp & 0xFE;  // Anything but idle
+            return 13 == cmd && r.resp;
+        }
+        case SD_TRACE_READ:
+        case SD_TRACE_WRITE: {
+            int16_t st = static_cast<int16_t>(r.resp);
+            std::snprintf(buf, len, "%-5s block %" PRIu32 " x%u%s %s",
+                          SD_TRACE_READ == r.event ? "read" : "write", r.arg, r.cmd,
+                          0xFF == r.cmd ? "+" : "", status_name(st));
+            return st;
+        }
+        case SD_TRACE_BUSY_TMO:
+            std::snprintf(buf, len, "busy timeout (%" PRIu32 " ms)", r.arg);
+            return true;
+        case SD_TRACE_TOKEN_TMO:
+            std::snprintf(buf, len, "start token 0x%02x timeout", r.cmd);
+            return true;
+        case SD_TRACE_INIT:
+            std::snprintf(buf, len, "init drive %u: DSTATUS 0x%02x", r.cmd, r.resp);
+            return r.resp & 0x01;  // STA_NOINIT
+        case SD_TRACE_FREQ:
+            std::snprintf(buf, len, "SPI %s clock %" PRIu32 " Hz", r.cmd ? "high" : "low", r.arg);
+            return false;
+        case SD_TRACE_MARK:
+            std::snprintf(buf, len, "mark %u 0x%08" PRIx32, r.cmd, r.arg);
+            return false;
+    }
+    std::snprintf(buf, len, "unknown event %u", r.event);
+    return true;
+}
+
+const char *event_name(uint8_t ev) {
+    switch (ev) {
+        case SD_TRACE_CMD: return "cmd";
+        case SD_TRACE_READ: return "read";
+        case SD_TRACE_WRITE: return "write";
+        case SD_TRACE_BUSY_TMO: return "busy-tmo";
+        case SD_TRACE_TOKEN_TMO: return "token-tmo";
+        case SD_TRACE_INIT: return "init";
+        case SD_TRACE_FREQ: return "freq";
+        case SD_TRACE_MARK: return "mark";
+    }
+    return "?";
+}
+
+bool load_binary(FILE *in, std::vector<sd_trace_rec_t> &recs, uint32_t &dropped) {
+    sd_trace_file_hdr_t hdr;
+    if (1 != std::fread(&hdr, sizeof hdr, 1, in) || SD_TRACE_FILE_MAGIC != hdr.magic)
+        return false;
+    if (SD_TRACE_FILE_VERSION != hdr.version || sizeof(sd_trace_rec_t) != hdr.rec_size) {
+        std::fprintf(stderr, "unsupported trace version %u / record size %u\n", hdr.version,
+                     hdr.rec_size);
+        std::exit(1);
+    }
+    recs.resize(hdr.count);
+    size_t n = std::fread(recs.data(), sizeof(sd_trace_rec_t), hdr.count, in);
+    if (n != hdr.count)
+        std::fprintf(stderr, "truncated: %zu of %" PRIu32 " records\n", n, hdr.count);
+    recs.resize(n);
+    dropped = hdr.dropped;
+    return true;
+}
+
+// Text capture: the first "sdtr: <version> <count> <dropped>" line starts a
+// dump; the records are the tagged lines of 32 hex digits after it. If the
+// capture holds several dumps, the last one wins.
+void load_text(FILE *in, std::vector<sd_trace_rec_t> &recs, uint32_t &dropped) {
+    char line[512];
+    const size_t tag = std::strlen(SD_TRACE_LINE_TAG);
+    while (std::fgets(line, sizeof line, in)) {
+        const char *p = std::strstr(line, SD_TRACE_LINE_TAG);
+        if (!p) continue;
+        p += tag;
+        if (' ' == *p) {
+            unsigned version = 0;
+            unsigned long count = 0, drop = 0;
+            if (3 == std::sscanf(p, "%u %lu %lu", &version, &count, &drop)) {
+                recs.clear();
+                dropped = drop;
+            }
+            continue;
+        }
+        sd_trace_rec_t r;
+        uint8_t *b = reinterpret_cast<uint8_t *>(&r);
+        size_t i = 0;
+        for (; i < sizeof r; ++i) {
+            unsigned v;
+            if (1 != std::sscanf(p + 2 * i, "%2x", &v)) break;
+            b[i] = static_cast<uint8_t>(v);
+        }
+        if (sizeof r == i) recs.push_back(r);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    uint32_t slow_us = 10000;
+    int argi = 1;
+    if (argi + 1 < argc && !std::strcmp(argv[argi], "-s")) {
+        slow_us = std::strtoul(argv[argi + 1], nullptr, 0);
+        argi += 2;
+    }
+    if (argi >= argc) {
+        std::fprintf(stderr, "usage: %s [-s slow_us] sdtrace.bin|capture.txt\n", argv[0]);
+        return 2;
+    }
+    FILE *in = std::fopen(argv[argi], "rb");
+    if (!in) {
+        std::perror(argv[argi]);
+        return 1;
+    }
+    std::vector<sd_trace_rec_t> recs;
+    uint32_t dropped = 0;
+    if (!load_binary(in, recs, dropped)) {
+        std::rewind(in);
+        load_text(in, recs, dropped);
+    }
+    std::fclose(in);
+    if (recs.empty()) {
+        std::fprintf(stderr, "%s: no trace records\n", argv[argi]);
+        return 1;
+    }
+
+    struct summary {
+        uint32_t n = 0, errors = 0, slow = 0, max_us = 0;
+        uint64_t sum_us = 0;
+    };
+    std::map<uint8_t, summary> sums;
+    std::printf("%" PRIu32 " records (%" PRIu32 " older ones overwritten)\n", uint32_t(recs.size()),
+                dropped);
+    std::printf("%12s %10s %9s\n", "t (ms)", "gap (us)", "dur (us)");
+    const uint32_t t_first = recs.front().t_us;
+    uint32_t prev_end = t_first;
+    char what[160];
+    for (const sd_trace_rec_t &r : recs) {
+        bool err = describe(r, what, sizeof what);
+        bool slow = r.dur_us >= slow_us;
+        // Timestamps are 32 bit microseconds: differences survive wrap around
+        int32_t gap = static_cast<int32_t>(r.t_us - prev_end);
+        std::printf("%12.3f %10" PRId32 " %9" PRIu32 " %c%c %s\n", (r.t_us - t_first) / 1000.0, gap,
+                    r.dur_us, err ? 'E' : ' ', slow ? '!' : ' ', what);
+        prev_end = r.t_us + r.dur_us;
+        summary &s = sums[r.event];
+        s.n++;
+        s.errors += err;
+        s.slow += slow;
+        s.sum_us += r.dur_us;
+        if (r.dur_us > s.max_us) s.max_us = r.dur_us;
+    }
+    std::printf("\n%-10s %7s %7s %7s %10s %10s\n", "event", "count", "errors", "slow", "mean (us)",
+                "max (us)");
+    for (const auto &[ev, s] : sums)
+        std::printf("%-10s %7" PRIu32 " %7" PRIu32 " %7" PRIu32 " %10" PRIu64 " %10" PRIu32 "\n",
+                    event_name(ev), s.n, s.errors, s.slow, s.sum_us / s.n, s.max_us);
+    return 0;
+}
@@ -0,0 +1,190 @@
+// shell_test: the command shell (lib/FatFs_SPI/src/shell.c) fed from a
+// string, with the output captured.
+//
+// Checks word splitting and quotes, command lookup and word counts, number
+// parsing, line endings, backspace, overlong lines, the input budget (no
+// more characters taken per poll than allowed, one line per poll) and jobs
+// (one step per poll, input held back until the job ends).
+//
+//   shell_test
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "shell.h"
+
+namespace {
+
+std::string input;
+size_t input_pos;
+size_t taken;  // Characters read by the shell
+std::string output;
+std::vector<std::string> calls;  // Commands run, with their words
+int steps_left;
+int failures;
+
+int get_char() {
+    if (input_pos == input.size()) return -1;
+    ++taken;
+    return (unsigned char)input[input_pos++];
+}
+
+int print(const char *fmt, ...) {
+    char buf[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = std::vsnprintf(buf, sizeof buf, fmt, ap);
+    va_end(ap);
+    output += buf;
+    return n;
+}
+
+int record(int argc, char **argv) {
+    std::string s;
+    for (int i = 0; i < argc; ++i) s += std::string(i ? "|" : "") + argv[i];
+    calls.push_back(s);
+    return 0;
+}
+
+int fails(int argc, char **argv) {
+    record(argc, argv);
+    return 1;
+}
+
+bool step() {
+    calls.push_back("step");
+    return 0 == --steps_left;
+}
+
+shell_t *the_shell;
+
+int start_job(int argc, char **argv) {
+    record(argc, argv);
+    steps_left = 3;
+    shell_job(the_shell, step);
+    return 0;
+}
+
+const shell_cmd_t cmds[] = {
+    {"start", nullptr, "starts", 0, 0, record},
+    {"rate", "<ms>", "sets the rate", 1, 1, record},
+    {"ls", "[dir]", "lists", 0, 1, record},
+    {"cp", "<from> <to>", "copies", 2, 2, record},
+    {"bad", nullptr, "fails", 0, 0, fails},
+    {"bench", nullptr, "runs a job", 0, 0, start_job},
+};
+
+void check(bool ok, const char *what) {
+    if (!ok) {
+        std::fprintf(stderr, "FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+void reset(shell_t *sh, const std::string &in) {
+    shell_init(sh, cmds, sizeof cmds / sizeof cmds[0], get_char, print);
+    the_shell = sh;
+    input = in;
+    input_pos = taken = 0;
+    output.clear();
+    calls.clear();
+}
+
+// Polls until the input is used up and no job is left
+void run(shell_t *sh, unsigned budget) {
+    for (int i = 0; i < 10000 && (input_pos < input.size() || shell_busy(sh)); ++i)
+        shell_poll(sh, budget);
+}
+
+}  // namespace
+
+int main() {
+    static shell_t sh;
+
+    // Splitting
+    {
+        char line[] = "  cp \"a b.txt\"\tc\"d e\"f  ";
+        char *argv[8];
+        int argc = shell_split(line, argv, 8);
+        check(3 == argc && !std::strcmp(argv[0], "cp") && !std::strcmp(argv[1], "a b.txt") &&
+                  !std::strcmp(argv[2], "cd ef"),
+              "split with quotes");
+        char unclosed[] = "ls \"a b";
+        check(-1 == shell_split(unclosed, argv, 8), "unclosed quote");
+        char many[] = "a b c d";
+        check(-1 == shell_split(many, argv, 3), "too many words");
+        char empty[] = "  \t ";
+        check(0 == shell_split(empty, argv, 8), "empty line");
+    }
+
+    // Numbers
+    {
+        uint32_t v = 0;
+        check(shell_parse_u32("250", 1, 1000, &v) && 250 == v, "decimal");
+        check(shell_parse_u32("0x10", 0, 100, &v) && 16 == v, "hex");
+        check(!shell_parse_u32("1001", 1, 1000, &v), "above max");
+        check(!shell_parse_u32("0", 1, 1000, &v), "below min");
+        check(!shell_parse_u32("12ms", 1, 1000, &v), "trailing text");
+        check(!shell_parse_u32("-5", 0, 1000, &v), "negative");
+        check(!shell_parse_u32("", 0, 1000, &v), "empty");
+        check(!shell_parse_u32("99999999999", 0, UINT32_MAX, &v), "overflow");
+    }
+
+    // Lookup, word counts, line endings, backspace
+    reset(&sh, "start\r\nrate 100\rls\nls a b\ncp x\nnope\nbad\nrx\x7f" "ax\bte 5\n\n\r\n");
+    run(&sh, 64);
+    check(calls == std::vector<std::string>({"start", "rate|100", "ls", "bad", "rate|5"}),
+          "commands run");
+    check(std::string::npos != output.find("usage: ls [dir]"), "usage for too many words");
+    check(std::string::npos != output.find("usage: cp <from> <to>"), "usage for too few words");
+    check(std::string::npos != output.find("unknown command nope"), "unknown command");
+    check(4 == sh.stats.errors, "errors counted");
+    check(8 == sh.stats.lines, "lines counted");
+
+    // help
+    reset(&sh, "help\n");
+    run(&sh, 64);
+    check(std::string::npos != output.find("rate <ms>: sets the rate") &&
+              std::string::npos != output.find("start: starts"),
+          "help");
+
+    // Overlong line: dropped whole, the next one runs
+    reset(&sh, std::string(SHELL_LINE_MAX + 20, 'x') + "\nstart\n");
+    run(&sh, 1000);
+    check(calls == std::vector<std::string>({"start"}) && 1 == sh.stats.overflow,
+          "overlong line dropped");
+
+    // Budget: never more than asked per poll, one line per poll
+    reset(&sh, "rate 1\nrate 2\nrate 3\n");
+    shell_poll(&sh, 4);
+    check(4 == taken && calls.empty(), "no line complete within the budget");
+    for (int i = 0; i < 10; ++i) {
+        size_t before = taken;
+        shell_poll(&sh, 4);
+        check(taken - before <= 4, "budget respected");
+    }
+    check(calls.size() == 3, "all lines run");
+    reset(&sh, "start\nstart\n");
+    shell_poll(&sh, 64);
+    check(calls.size() == 1, "one line per poll");
+
+    // Jobs: one step per poll, input waits
+    reset(&sh, "bench\nstart\n");
+    shell_poll(&sh, 64);
+    check(calls == std::vector<std::string>({"bench"}) && shell_busy(&sh), "job started");
+    size_t held = taken;
+    shell_poll(&sh, 64);
+    shell_poll(&sh, 64);
+    check(taken == held && calls.size() == 3, "one step per poll, no input read");
+    shell_poll(&sh, 64);
+    check(!shell_busy(&sh) && calls.size() == 4, "job done after its last step");
+    shell_poll(&sh, 64);
+    check(calls.back() == "start", "input read after the job");
+
+    if (failures) return 1;
+    std::printf("shell: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,12 @@
+// Part of stage_timer_test: the macros with STAGE_TIMER=0 must compile and
+// expand to nothing.
+
+#define STAGE_TIMER 0
+#include "stage_timer.h"
+
+int stage_timer_off_scope(void) {
+    STAGE_SCOPE(0);
+    stage_timer_add(0, 5);
+    stage_timer_print(-1);
+    return 42;
+}
@@ -0,0 +1,88 @@
+// stage_timer_test: the stage timers (lib/FatFs_SPI/src/stage_timer.c) on a
+// clock driven by the test.
+//
+// Checks that a scope is closed on every way out of its block, min/mean/max,
+// the buckets and percentiles, wrap around of the clock, the display lines
+// and, built a second time with STAGE_TIMER=0 (stage_timer_off.c), that the
+// macros still compile and leave nothing behind.
+//
+//   stage_timer_test
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "stage_timer.h"
+
+namespace {
+
+uint32_t now_us;
+int failures;
+
+void check(bool ok, const std::string &what) {
+    if (!ok) {
+        std::fprintf(stderr, "FAIL: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+enum { SENSOR, SYNC, TOTAL, N };
+const char *const names[N] = {"sens", "sync", "total"};
+
+// Advances the clock by us inside a SENSOR scope, leaving early if asked
+int timed(uint32_t us, bool early) {
+    STAGE_SCOPE(SENSOR);
+    now_us += us;
+    if (early) return 1;
+    return 0;
+}
+
+}  // namespace
+
+extern "C" uint32_t sd_stats_host_now_us(void) { return now_us; }
+extern "C" int stage_timer_off_scope(void);
+
+int main() {
+    stage_timer_init(names, N);
+
+    timed(100, false);
+    timed(300, true);
+    timed(1, false);
+    const stage_timer_stats_t &s = stage_timer_stats[SENSOR];
+    check(3 == s.count, "every scope closed, early return included");
+    check(1 == s.min && 300 == s.max && 401 == s.sum, "min, max, sum");
+    check(1 == s.bucket[0] && 1 == s.bucket[6] && 1 == s.bucket[8], "log2 buckets");
+    check(128 == stage_timer_percentile(SENSOR, 50) && 300 == stage_timer_percentile(SENSOR, 99),
+          "percentiles bounded by max");
+
+    // Nested scopes and the clock wrapping around
+    now_us = 0xffffff00u;
+    {
+        STAGE_SCOPE(TOTAL);
+        {
+            STAGE_SCOPE(SYNC);
+            now_us += 0x200;
+        }
+        now_us += 0x100;
+    }
+    check(0x200 == stage_timer_stats[SYNC].max, "wrap around");
+    check(0x300 == stage_timer_stats[TOTAL].max, "outer scope includes the inner one");
+
+    char lines[4][24];
+    unsigned n = stage_timer_lines(lines, 4, 16);
+    check(3 == n, "a line per stage that ran");
+    check(!std::strcmp(lines[0], "sens   133   300"), std::string("display line: ") + lines[0]);
+    for (unsigned i = 0; i < n; ++i) check(std::strlen(lines[i]) <= 16, "display width");
+
+    stage_timer_print(TOTAL);
+    stage_timer_reset();
+    check(!stage_timer_stats[SENSOR].count && !stage_timer_lines(lines, 4, 16), "reset");
+
+    // Compiled out: no storage, the block runs as is
+    check(42 == stage_timer_off_scope(), "STAGE_TIMER=0 build");
+    check(!stage_timer_stats[SENSOR].count, "STAGE_TIMER=0 records nothing");
+
+    if (failures) return 1;
+    std::printf("stage_timer: all checks passed\n");
+    return 0;
+}
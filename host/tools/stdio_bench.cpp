@@ -0,0 +1,228 @@
+// stdio_bench: byte and line I/O through ff_stdio (ff_stdio.c) on the RAM disk.
+//
+// A CSV file like the application's is written with ff_fputc() and read back
+// with ff_fgets() and ff_fgetc(), unbuffered (FF_IONBF: one f_read()/f_write()
+// per byte, lines included) and with stream buffers of several sizes.
+// Reports host throughput and the disk calls made.
+//
+// Before that, a random mix of reads, writes, seeks and flushes on a buffered
+// and an unbuffered stream is checked against a model of the file, so the
+// buffering is also shown not to change what is read or written.
+//
+//   stdio_bench [megabytes] [seed]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "ff_stdio.h"
+#include "ramdisk.h"
+
+extern "C" void my_printf(const char *, ...) {}
+extern "C" void my_assert_func(const char *file, int line, const char *func, const char *pred) {
+    std::fprintf(stderr, "assertion \"%s\" failed: %s:%d %s\n", pred, file, line, func);
+    std::abort();
+}
+
+namespace {
+
+int fail(const char *what) {
+    std::fprintf(stderr, "FAIL: %s\n", what);
+    return 1;
+}
+
+FF_FILE *open_buffered(const char *path, const char *mode, size_t bufsize) {
+    FF_FILE *f = ff_fopen(path, mode);
+    if (f && ff_setvbuf(f, nullptr, bufsize ? FF_IOFBF : FF_IONBF, bufsize)) {
+        ff_fclose(f);
+        return nullptr;
+    }
+    return f;
+}
+
+// Random operations on "r+" streams against a std::string; returns 0 if all agree
+int check(uint32_t seed, size_t bufsize) {
+    std::mt19937 rng(seed);
+    std::string model;
+    FF_FILE *f = open_buffered("check.bin", "w+", bufsize);
+    if (!f) return fail("open");
+    size_t pos = 0;
+    char buf[2048];
+    for (int op = 0; op < 20000; ++op) {
+        switch (rng() % 8) {
+            case 0: {  // fputc
+                char c = 'a' + rng() % 26;
+                if (ff_fputc(c, f) != c) return fail("fputc");
+                if (pos == model.size()) model += c; else model[pos] = c;
+                ++pos;
+                break;
+            }
+            case 1: {  // fwrite, small or larger than the buffer
+                size_t n = rng() % 2 ? rng() % 40 : rng() % sizeof buf;
+                for (size_t i = 0; i < n; ++i) buf[i] = 'A' + rng() % 26;
+                if (ff_fwrite(buf, 1, n, f) != n) return fail("fwrite");
+                if (pos + n > model.size()) model.resize(pos + n);
+                model.replace(pos, n, buf, n);
+                pos += n;
+                break;
+            }
+            case 2: {  // fgetc
+                int c = ff_fgetc(f);
+                int want = pos < model.size() ? (uint8_t)model[pos] : FF_EOF;
+                if (c != want) return fail("fgetc");
+                if (FF_EOF != c) ++pos;
+                break;
+            }
+            case 3: {  // fread
+                size_t n = rng() % 2 ? rng() % 40 : rng() % sizeof buf;
+                size_t want = pos < model.size() ? std::min(n, model.size() - pos) : 0;
+                if (ff_fread(buf, 1, n, f) != want || model.compare(pos, want, buf, want))
+                    return fail("fread");
+                pos += want;
+                break;
+            }
+            case 4: {  // fgets
+                size_t n = 1 + rng() % 100;
+                if (rng() % 4 == 0 && pos < model.size()) {
+                    // Plant a newline to stop at
+                    size_t at = pos + rng() % std::min<size_t>(model.size() - pos, 60);
+                    model[at] = '\n';
+                    long here = ff_ftell(f);
+                    if (ff_fseek(f, (int)at, FF_SEEK_SET) || ff_fputc('\n', f) != '\n' ||
+                        ff_fseek(f, (int)here, FF_SEEK_SET))
+                        return fail("plant newline");
+                }
+                char *p = ff_fgets(buf, n, f);
+                std::string want = model.substr(pos, n - 1);
+                size_t nl = want.find('\n');
+                if (std::string::npos != nl) want.resize(nl + 1);
+                if (want.empty() ? p != nullptr : (!p || want != p)) return fail("fgets");
+                pos += want.size();
+                break;
+            }
+            case 5: {  // fseek in any of the three ways
+                long to = model.empty() ? 0 : rng() % (model.size() + 1);
+                int whence = rng() % 3;
+                int ofs = FF_SEEK_SET == whence ? (int)to
+                        : FF_SEEK_CUR == whence ? (int)(to - (long)pos)
+                                                : (int)(to - (long)model.size());
+                if (ff_fseek(f, ofs, whence)) return fail("fseek");
+                pos = to;
+                break;
+            }
+            case 6:
+                if ((size_t)ff_ftell(f) != pos) return fail("ftell");
+                if ((size_t)ff_filelength(f) != model.size()) return fail("filelength");
+                if (!ff_feof(f) != (pos < model.size())) return fail("feof");
+                break;
+            case 7:
+                if (rng() % 8 == 0 && ff_fflush(f)) return fail("fflush");
+                break;
+        }
+    }
+    if (ff_fclose(f)) return fail("close");
+    // What reached the volume
+    f = ff_fopen("check.bin", "r");
+    if (!f) return fail("reopen");
+    std::string disk(model.size() + 1, 0);
+    size_t n = ff_fread(&disk[0], 1, disk.size(), f);
+    ff_fclose(f);
+    disk.resize(n);
+    if (disk != model) return fail("file contents");
+    return 0;
+}
+
+struct timing_t {
+    double mb_s;
+    uint64_t calls;  // disk_read() or disk_write() calls
+};
+
+double secs_since(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+timing_t write_csv(size_t bufsize, size_t bytes) {
+    ramdisk_reset_stats(0);
+    FF_FILE *f = open_buffered("data.csv", "w", bufsize);
+    auto t0 = std::chrono::steady_clock::now();
+    char line[64];
+    size_t n = 0;
+    for (uint32_t i = 1; n < bytes; ++i) {
+        int len = std::snprintf(line, sizeof line, "%u,%u,%u,%u,%u,Vermelho\n", i, i * 7 % 1024,
+                                i * 13 % 256, i * 17 % 256, i * 19 % 256);
+        for (int k = 0; k < len; ++k) ff_fputc(line[k], f);
+        n += len;
+    }
+    ff_fclose(f);
+    return {n / secs_since(t0) / 1e6, ramdisk_stats(0)->writes};
+}
+
+timing_t read_lines(size_t bufsize, size_t *lines) {
+    ramdisk_reset_stats(0);
+    FF_FILE *f = open_buffered("data.csv", "r", bufsize);
+    auto t0 = std::chrono::steady_clock::now();
+    char line[128];
+    size_t n = 0;
+    *lines = 0;
+    while (ff_fgets(line, sizeof line, f)) {
+        n += std::strlen(line);
+        ++*lines;
+    }
+    ff_fclose(f);
+    return {n / secs_since(t0) / 1e6, ramdisk_stats(0)->reads};
+}
+
+timing_t read_bytes(size_t bufsize) {
+    ramdisk_reset_stats(0);
+    FF_FILE *f = open_buffered("data.csv", "r", bufsize);
+    auto t0 = std::chrono::steady_clock::now();
+    size_t n = 0;
+    while (FF_EOF != ff_fgetc(f)) ++n;
+    ff_fclose(f);
+    return {n / secs_since(t0) / 1e6, ramdisk_stats(0)->reads};
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    const size_t mb = argc > 1 ? std::atoi(argv[1]) : 8;
+    const uint32_t seed = argc > 2 ? std::atoi(argv[2]) : 1;
+
+    if (!ramdisk_create(0, 64 * 2048)) return 1;
+    std::vector<uint8_t> work(FF_MAX_SS * 16);
+    MKFS_PARM opt = {FM_ANY, 1, 0, 0, 0};
+    static FATFS fs;
+    if (FR_OK != f_mkfs("", &opt, work.data(), work.size()) || FR_OK != f_mount(&fs, "", 1))
+        return 1;
+
+    for (size_t bufsize : {0, 1, 7, 512, 4096})
+        if (check(seed + bufsize, bufsize)) {
+            std::fprintf(stderr, "with a %zu byte buffer\n", bufsize);
+            return 1;
+        }
+    std::printf("random operations: buffered and unbuffered streams agree with the model\n\n");
+
+    std::printf("%zu MB CSV file                     MB/s  disk calls\n", mb);
+    for (size_t bufsize : {0, 512, 4096, 32768}) {
+        char name[sizeof "18446744073709551615 byte buffer"];  // The largest size_t
+        if (bufsize) std::snprintf(name, sizeof name, "%zu byte buffer", bufsize);
+        else std::snprintf(name, sizeof name, "unbuffered");
+        timing_t w = write_csv(bufsize, mb << 20);
+        size_t lines;
+        timing_t l = read_lines(bufsize, &lines);
+        timing_t c = read_bytes(bufsize);
+        std::printf("%-18s ff_fputc        %8.1f %10llu\n", name, w.mb_s,
+                    (unsigned long long)w.calls);
+        std::printf("%-18s ff_fgets        %8.1f %10llu  (%zu lines)\n", "", l.mb_s,
+                    (unsigned long long)l.calls, lines);
+        std::printf("%-18s ff_fgetc        %8.1f %10llu\n", "", c.mb_s,
+                    (unsigned long long)c.calls);
+    }
+    return 0;
+}
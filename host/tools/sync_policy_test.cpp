@@ -0,0 +1,98 @@
+// sync_policy_test: the adaptive sync interval (lib/FatFs_SPI/src/sync_policy.c)
+// fed with sync times chosen by the test.
+//
+// Checks the interval at start, when a write makes a sync due, the interval
+// following the measured sync cost and bounded by the minimum and the risk
+// budget, a stall raising the estimate at once and backing off (up to 8x),
+// the back-off relaxing step by step with fast syncs again, the oldest
+// unsynced data reported, and the configuration clamps.
+//
+//   sync_policy_test
+
+#include <cstdio>
+#include <string>
+
+#include "sync_policy.h"
+
+namespace {
+
+int failures;
+
+void check(bool ok, const std::string &what) {
+    if (!ok) {
+        std::fprintf(stderr, "FAIL: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+// Risk 2 s, at least 100 ms apart, 5% of the time syncing
+const sync_policy_cfg_t CFG = {2000, 100, 50};
+
+uint64_t now_us;
+
+void sync(sync_policy_t *sp, uint32_t us) {
+    sync_policy_synced(sp, now_us, now_us + us);
+    now_us += us;
+}
+
+}  // namespace
+
+int main() {
+    sync_policy_t sp;
+    sync_policy_init(&sp, &CFG);
+    const sync_policy_metrics_t *m = sync_policy_metrics(&sp);
+    check(100 == m->interval_ms, "no sync timed yet: the minimum interval");
+
+    // Due one interval after the oldest unsynced write, not after the latest
+    now_us = 1000000;
+    check(!sync_policy_wrote(&sp, now_us), "first write");
+    check(!sync_policy_wrote(&sp, now_us + 99999), "before the interval");
+    check(sync_policy_wrote(&sp, now_us + 100000), "due after the interval");
+    now_us += 150000;
+    sync(&sp, 20000);
+    check(170 == m->max_risk_ms, "oldest unsynced data: write to end of sync");
+    check(1 == m->syncs && 20000 == m->avg_us, "first sync sets the estimate");
+    check(400 == m->interval_ms, "20 ms at 5%: every 400 ms");
+    check(!sync_policy_wrote(&sp, now_us), "synced data is not pending");
+
+    // Faster syncs pull the estimate down slowly (1/8 per sync)
+    sync(&sp, 12000);
+    check(19000 == m->avg_us && 380 == m->interval_ms, "one 12 ms sync");
+    for (int i = 0; i < 60; ++i) sync(&sp, 1000);
+    check(m->avg_us < 2000 && 100 == m->interval_ms, "cheap syncs: back to the minimum");
+    check(0 == m->stalls, "no stall so far");
+
+    // A stall is believed at once and doubles the interval multiplier
+    uint32_t avg = m->avg_us;
+    sync(&sp, 30000);
+    check(1 == m->stalls && m->avg_us == (avg + 30000) / 2, "stall: half way to it at once");
+    check(m->interval_ms == m->avg_us / 50 * 2, "stall: interval doubled");
+    check(30000 == m->max_us && 30000 == m->last_us, "slowest and last sync");
+
+    // More stalls: the multiplier stops at 8, the risk budget bounds all
+    for (int i = 0; i < 6; ++i) sync(&sp, 4 * m->avg_us + 1000);
+    check(7 == m->stalls && 8 == sp.backoff, "back-off stops at 8x");
+    check(2000 == m->interval_ms, "interval capped by the risk budget");
+
+    // Normal syncs relax the back-off one step each
+    uint32_t stall_avg = m->avg_us;
+    sync(&sp, stall_avg);
+    check(4 == sp.backoff, "8x -> 4x");
+    sync(&sp, stall_avg);
+    sync(&sp, stall_avg);
+    check(1 == sp.backoff, "back to 1x after three normal syncs");
+
+    // Configuration clamps
+    sync_policy_cfg_t bad = {50, 500, 0};
+    sync_policy_init(&sp, &bad);
+    check(50 == sp.cfg.min_interval_ms && 50 == m->interval_ms, "minimum above the risk budget");
+    sync(&sp, 1000000);
+    check(50 == m->interval_ms, "no cost budget: the risk budget");
+
+    if (failures) {
+        std::fprintf(stderr, "sync_policy_test: %d checks failed\n", failures);
+        return 1;
+    }
+    std::fprintf(stderr, "sync_policy_test: all checks passed\n");
+    return 0;
+}
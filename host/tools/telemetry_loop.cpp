@@ -0,0 +1,209 @@
+// telemetry_loop: telemetry_recv against a simulated device over a pty.
+//
+// A pseudo-terminal stands in for the USB CDC port: telemetry_recv is started
+// on its slave side and this program plays the device on the master side,
+// waiting for "telemetry on" and sending samples through telemetry.c as fast
+// as the pty takes them. Some frames are dropped, some damaged and some text
+// lines printed between frames, as debug output would be. The session file
+// written by telemetry_recv is then read back block by block (crash_log.h)
+// and its records compared with the samples that were delivered intact.
+//
+//   telemetry_loop path/to/telemetry_recv [samples] [seed]
+
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+extern "C" {
+#include "crc.h"
+}
+#include "crash_log.h"
+#include "gy33_cores.h"
+#include "telemetry.h"
+
+extern "C" void my_printf(const char *, ...) {}
+extern "C" void my_assert_func(const char *file, int line, const char *func, const char *pred) {
+    std::fprintf(stderr, "assertion \"%s\" failed: %s:%d %s\n", pred, file, line, func);
+    std::abort();
+}
+
+namespace {
+
+const char *const OUT = "telemetry_loop.log";
+
+struct sample_t {
+    uint16_t c, r, g, b;
+    uint8_t color;
+};
+
+int master = -1;
+std::vector<bool> expect;  // By sample number: in a frame sent intact
+bool dry_run = false;      // Only decide the fate of each frame
+std::mt19937 fate;
+
+void write_all(const void *data, size_t len) {
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    while (len) {
+        ssize_t n = write(master, p, len);
+        if (n <= 0) {
+            std::perror("write");
+            std::exit(1);
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+// The "USB" link: loses 1 frame in 60, damages 1 in 80, and prints a line
+// before 1 in 40
+void link_out(const void *data, size_t len) {
+    uint32_t roll = fate() % 240;
+    bool lost = roll < 4, damaged = roll >= 4 && roll < 7, text = roll >= 7 && roll < 13;
+    if (dry_run) {
+        // Which samples the frame holds: decode it (without the delimiters)
+        static uint8_t frame[TELEMETRY_WIRE_MAX];
+        cobs_decode(static_cast<const uint8_t *>(data) + 1, len - 2, frame);
+        telemetry_hdr_t h;
+        std::memcpy(&h, frame, sizeof h);
+        for (uint32_t k = 0; k < h.count; ++k) expect[h.first + k] = !lost && !damaged;
+        return;
+    }
+    if (text) write_all("Amostras coletadas: 42 (sync 812 us)\n", 37);
+    if (lost) return;
+    if (damaged) {
+        std::vector<uint8_t> bad(static_cast<const uint8_t *>(data),
+                                 static_cast<const uint8_t *>(data) + len);
+        bad[len / 2] ^= 0x10;
+        if (!bad[len / 2]) bad[len / 2] = 0x33;  // Still one frame, with a bad CRC
+        write_all(bad.data(), len);
+        return;
+    }
+    write_all(data, len);
+}
+
+// Samples with sample number, time and channels derived from i
+sample_t make(uint32_t i) {
+    return {(uint16_t)(i * 7), (uint16_t)(i * 3), (uint16_t)(i * 5 + 1), (uint16_t)(i ^ 0x5A5A),
+            (uint8_t)(i % NUM_CORES)};
+}
+
+void send_all(uint32_t samples) {
+    static telemetry_t t;
+    telemetry_init(&t, link_out);
+    for (uint32_t i = 1; i <= samples; ++i) {
+        sample_t s = make(i);
+        // 10 Hz, with a pause now and then that closes a batch early
+        uint32_t t_ms = i * 100 + (i / 1000) * 5000;
+        telemetry_put(&t, i, t_ms, s.c, s.r, s.g, s.b, s.color);
+    }
+    telemetry_flush(&t);
+}
+
+bool wait_for(const char *text, int seconds) {
+    std::string seen;
+    auto end = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+    while (std::chrono::steady_clock::now() < end) {
+        char c;
+        ssize_t n = read(master, &c, 1);
+        if (1 == n) {
+            seen += c;
+            if (std::string::npos != seen.find(text)) return true;
+        } else {
+            usleep(1000);
+        }
+    }
+    return false;
+}
+
+int fail(const char *what) {
+    std::fprintf(stderr, "FAIL: %s\n", what);
+    return 1;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s telemetry_recv [samples] [seed]\n", argv[0]);
+        return 2;
+    }
+    const uint32_t samples = argc > 2 ? std::atoi(argv[2]) : 100000;
+    const uint32_t seed = argc > 3 ? std::atoi(argv[3]) : 1;
+
+    // Which frames arrive, and so how many samples telemetry_recv gets
+    expect.assign(samples + 1, false);
+    fate.seed(seed);
+    dry_run = true;
+    send_all(samples);
+    dry_run = false;
+    uint64_t want = 0;
+    for (bool e : expect) want += e;
+
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) || unlockpt(master)) return fail("pty");
+    const char *slave = ptsname(master);
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+    std::string count = std::to_string(want);
+    pid_t pid = fork();
+    if (!pid) {
+        execl(argv[1], argv[1], "-c", count.c_str(), slave, OUT, (char *)nullptr);
+        std::perror(argv[1]);
+        _exit(127);
+    }
+    if (!wait_for("telemetry on\n", 10)) {
+        kill(pid, SIGKILL);
+        return fail("no \"telemetry on\" from telemetry_recv");
+    }
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) & ~O_NONBLOCK);
+    fate.seed(seed);
+    auto t0 = std::chrono::steady_clock::now();
+    send_all(samples);
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+    bool off = wait_for("telemetry off\n", 30);
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    int status = 0;
+    if (!off) kill(pid, SIGTERM);
+    waitpid(pid, &status, 0);
+    close(master);
+    if (!off || !WIFEXITED(status) || WEXITSTATUS(status)) return fail("telemetry_recv");
+
+    // The session file: valid blocks, header line, then the delivered samples
+    FILE *f = std::fopen(OUT, "rb");
+    if (!f) return fail("no output file");
+    std::string text;
+    crash_log_blk_t blk;
+    uint32_t id = 0, seq = 0;
+    while (1 == std::fread(&blk, sizeof blk, 1, f)) {
+        if (!seq) id = blk.hdr.id;
+        if (!crash_log_valid(&blk, id, seq)) return fail("invalid block");
+        text.append(reinterpret_cast<const char *>(blk.payload), blk.hdr.len);
+        ++seq;
+    }
+    std::fclose(f);
+    std::remove(OUT);
+    std::string model = "Amostra,Clear,Red,Green,Blue,cor\n";
+    for (uint32_t i = 1; i <= samples; ++i) {
+        if (!expect[i]) continue;
+        sample_t x = make(i);
+        char line[64];
+        std::snprintf(line, sizeof line, "%u,%u,%u,%u,%u,%s\n", i, x.c, x.r, x.g, x.b,
+                      nomes_cores[x.color]);
+        model += line;
+    }
+    if (text != model) return fail("records differ from the samples delivered");
+    std::printf("%u samples, %llu delivered and logged in %u blocks, %.0f samples/s over the pty\n",
+                samples, (unsigned long long)want, seq, samples / s);
+    return 0;
+}
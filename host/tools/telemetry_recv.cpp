@@ -0,0 +1,220 @@
+// telemetry_recv: receives the binary sample stream of the device
+// (lib/FatFs_SPI/include/telemetry.h) and writes it as a session file.
+//
+//   telemetry_recv [-n] [-c samples] /dev/ttyACM0 0042.log
+//
+// Sends "telemetry on" (not with -n) and decodes frames as they arrive. Each
+// sample becomes the CSV line the device writes to the card, in the same
+// crash-consistent block format (crash_log.h), so log_dump reads the file;
+// the partial last block is rewritten after every read, as crash_log_flush()
+// does, so the file is complete whenever the tool stops. Samples missing
+// from the stream (lost or damaged frames) are reported as gaps and left out.
+//
+// Stops on Ctrl-C, after -c samples or when the line closes, then sends
+// "telemetry off" and reports frames, samples, gaps and the rate.
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <sys/select.h>
+#include <termios.h>
+#include <unistd.h>
+
+extern "C" {
+#include "crc.h"
+}
+#include "crash_log.h"
+#include "gy33_cores.h"
+#include "telemetry.h"
+
+namespace {
+
+volatile sig_atomic_t stop = 0;
+
+void on_signal(int) { stop = 1; }
+
+// Writes records in crash_log blocks, as crash_log_write() and
+// crash_log_flush() do on the card
+struct log_writer_t {
+    FILE *f;
+    crash_log_blk_t blk;
+
+    void start(uint32_t id, uint32_t time, uint32_t uptime) {
+        std::memset(&blk, 0, sizeof blk);
+        blk.hdr.magic = CRASH_LOG_MAGIC;
+        blk.hdr.id = id;
+        blk.hdr.time = time;
+        blk.hdr.uptime_ms = uptime;
+        blk.hdr.first_rec = CRASH_LOG_NO_REC;
+    }
+
+    void write_blk() {
+        blk.hdr.crc = 0;
+        uint16_t crc = 0;
+        update_crc16(&crc, reinterpret_cast<const char *>(&blk.hdr), sizeof blk.hdr);
+        update_crc16(&crc, reinterpret_cast<const char *>(blk.payload), blk.hdr.len);
+        blk.hdr.crc = crc;
+        std::fseek(f, (long)blk.hdr.seq * (long)sizeof blk, SEEK_SET);
+        std::fwrite(&blk, sizeof blk, 1, f);
+    }
+
+    // time and uptime: when the record was taken, for a block it starts
+    void record(const char *p, size_t len, uint32_t time, uint32_t uptime) {
+        crash_log_hdr_t *h = &blk.hdr;
+        if (CRASH_LOG_NO_REC == h->first_rec) h->first_rec = h->len;
+        h->records++;
+        while (len) {
+            size_t n = CRASH_LOG_PAYLOAD - h->len;
+            if (n > len) n = len;
+            std::memcpy(blk.payload + h->len, p, n);
+            h->len += n;
+            p += n;
+            len -= n;
+            if (CRASH_LOG_PAYLOAD == h->len) {
+                write_blk();
+                h->seq++;
+                h->time = time;
+                h->uptime_ms = uptime;
+                h->len = 0;
+                h->first_rec = CRASH_LOG_NO_REC;
+                std::memset(blk.payload, 0, sizeof blk.payload);
+            }
+        }
+    }
+
+    void flush() {
+        if (blk.hdr.len) write_blk();
+        std::fflush(f);
+    }
+};
+
+struct receiver_t {
+    log_writer_t log;
+    bool started;
+    uint32_t t0_ms;        // Device time of the first sample
+    time_t t0;             // Host time then
+    uint32_t next;         // Sample number expected
+    uint64_t samples, gaps, missing;
+};
+
+void on_frame(void *arg, const telemetry_hdr_t *h, const telemetry_sample_t *s) {
+    receiver_t *r = static_cast<receiver_t *>(arg);
+    if (!r->started) {
+        r->started = true;
+        r->t0_ms = h->t0_ms;
+        r->t0 = std::time(nullptr);
+        r->log.start((uint32_t)r->t0 ^ h->t0_ms << 12 ^ (uint32_t)getpid(), (uint32_t)r->t0,
+                     h->t0_ms);
+        static const char header[] = "Amostra,Clear,Red,Green,Blue,cor\n";
+        r->log.record(header, sizeof header - 1, (uint32_t)r->t0, h->t0_ms);
+        r->next = h->first;
+    }
+    if (h->first != r->next) {
+        if (r->gaps < 20)
+            std::fprintf(stderr, "gap: samples %u to %u missing\n", r->next, h->first - 1);
+        else if (20 == r->gaps)
+            std::fprintf(stderr, "more gaps, counted below\n");
+        r->gaps++;
+        r->missing += h->first - r->next;
+    }
+    for (unsigned i = 0; i < h->count; ++i) {
+        uint32_t t_ms = h->t0_ms + s[i].dt_ms;
+        char line[64];
+        int n = std::snprintf(line, sizeof line, "%u,%u,%u,%u,%u,%s\n", h->first + i, s[i].c,
+                              s[i].r, s[i].g, s[i].b,
+                              s[i].color < NUM_CORES ? nomes_cores[s[i].color] : "?");
+        r->log.record(line, n, (uint32_t)r->t0 + (t_ms - r->t0_ms) / 1000, t_ms);
+    }
+    r->samples += h->count;
+    r->next = h->first + h->count;
+}
+
+int open_serial(const char *dev) {
+    int fd = open(dev, O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        std::perror(dev);
+        return -1;
+    }
+    termios tio;
+    if (0 == tcgetattr(fd, &tio)) {
+        cfmakeraw(&tio);
+        cfsetspeed(&tio, B115200);  // Ignored by USB CDC
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    tcflush(fd, TCIOFLUSH);
+    return fd;
+}
+
+void send(int fd, const char *cmd) {
+    if (write(fd, cmd, std::strlen(cmd)) < 0) std::perror("write");
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    bool command = true;
+    uint64_t count = 0;
+    int arg = 1;
+    for (; arg < argc && '-' == argv[arg][0]; ++arg) {
+        if (!std::strcmp(argv[arg], "-n")) command = false;
+        else if (!std::strcmp(argv[arg], "-c") && arg + 1 < argc)
+            count = std::strtoull(argv[++arg], nullptr, 0);
+        else break;
+    }
+    if (argc - arg != 2) {
+        std::fprintf(stderr, "usage: %s [-n] [-c samples] /dev/ttyACM0 out.log\n", argv[0]);
+        return 2;
+    }
+    int fd = open_serial(argv[arg]);
+    if (fd < 0) return 1;
+    static receiver_t r;
+    r.log.f = std::fopen(argv[arg + 1], "w+b");
+    if (!r.log.f) {
+        std::perror(argv[arg + 1]);
+        return 1;
+    }
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+    if (command) send(fd, "telemetry on\n");
+
+    static telemetry_rx_t rx;
+    telemetry_rx_init(&rx);
+    uint64_t bytes = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    static uint8_t buf[16384];
+    while (!stop && (!count || r.samples < count)) {
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(fd, &fds);
+        timeval tv = {0, 200000};
+        int ready = select(fd + 1, &fds, nullptr, nullptr, &tv);
+        if (ready < 0 && EINTR == errno) continue;
+        if (ready < 0) break;
+        if (!ready) continue;
+        ssize_t got = read(fd, buf, sizeof buf);
+        if (got <= 0) break;  // Closed (EIO on a pty whose other side went away)
+        if (!bytes) t0 = std::chrono::steady_clock::now();
+        bytes += got;
+        telemetry_rx_feed(&rx, buf, got, on_frame, &r);
+        r.log.flush();
+    }
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    if (command) send(fd, "telemetry off\n");
+    close(fd);
+    r.log.flush();
+    std::fclose(r.log.f);
+    std::fprintf(stderr,
+                 "%llu samples in %u frames, %llu bytes in %.2f s (%.0f samples/s, %.1f KB/s)\n"
+                 "%llu gaps, %llu samples missing; %u frames lost, %u damaged or not frames\n",
+                 (unsigned long long)r.samples, rx.frames, (unsigned long long)bytes, s,
+                 s > 0 ? r.samples / s : 0.0, s > 0 ? bytes / s / 1024 : 0.0,
+                 (unsigned long long)r.gaps, (unsigned long long)r.missing, rx.lost, rx.bad);
+    return r.samples ? 0 : 1;
+}
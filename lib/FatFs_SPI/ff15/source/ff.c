@@ -1421,6 +1421,56 @@ static FRESULT fill_last_frag (
 
 
 
+#if FF_USE_FREEMAP && !FF_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Free cluster map - Initialize/Read/Write a group status               */
+/*-----------------------------------------------------------------------*/
+
+static void fmap_init (
+	FATFS* fs		/* Filesystem object */
+)
+{
+	BYTE sh = 0;
+
+
+	while (((fs->n_fatent - 1) >> sh) >= (DWORD)FF_FREEMAP_SIZE * 8) sh++;	/* Smallest group that lets the map cover the volume */
+	fs->fm_shift = sh;
+	memset(fs->fmap, 0xFF, FF_FREEMAP_SIZE);	/* All groups may have free clusters */
+}
+
+
+static int fmap_get (	/* 0:The group is fully allocated, 1:The group may have free clusters */
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst		/* Cluster# in the group */
+)
+{
+	DWORD g = clst >> fs->fm_shift;
+
+
+	return (fs->fmap[g / 8] >> (g % 8)) & 1;
+}
+
+
+static void fmap_put (
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst,		/* Cluster# in the group */
+	int val			/* 0:The group is fully allocated, 1:The group may have free clusters */
+)
+{
+	DWORD g = clst >> fs->fm_shift;
+
+
+	if (val) {
+		fs->fmap[g / 8] |= (BYTE)(1 << (g % 8));
+	} else {
+		fs->fmap[g / 8] &= (BYTE)~(1 << (g % 8));
+	}
+}
+
+#endif	/* FF_USE_FREEMAP && !FF_FS_READONLY */
+
+
+
 #if !FF_FS_READONLY
 /*-----------------------------------------------------------------------*/
 /* FAT handling - Remove a cluster chain                                 */
@@ -1459,6 +1509,9 @@ static FRESULT remove_chain (	/* FR_OK(0):succeeded, !=0:error */
 		if (!FF_FS_EXFAT || fs->fs_type != FS_EXFAT) {
 			res = put_fat(fs, clst, 0);		/* Mark the cluster 'free' on the FAT */
 			if (res != FR_OK) return res;
+#if FF_USE_FREEMAP
+			fmap_put(fs, clst, 1);			/* The group has a free cluster */
+#endif
 		}
 		if (fs->free_clst < fs->n_fatent - 2) {	/* Update FSINFO */
 			fs->free_clst++;
@@ -1527,6 +1580,9 @@ static DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:D
 )
 {
 	DWORD cs, ncl, scl;
+#if FF_USE_FREEMAP
+	DWORD gcl;
+#endif
 	FRESULT res;
 	FATFS *fs = obj->fs;
 
@@ -1585,16 +1641,33 @@ static DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:D
 		}
 		if (ncl == 0) {	/* The new cluster cannot be contiguous and find another fragment */
 			ncl = scl;	/* Start cluster */
+#if FF_USE_FREEMAP
+			gcl = 0;	/* Top of the group being scanned from its top (0:partial group) */
+#endif
 			for (;;) {
 				ncl++;							/* Next cluster */
 				if (ncl >= fs->n_fatent) {		/* Check wrap-around */
 					ncl = 2;
 					if (ncl > scl) return 0;	/* No free cluster found? */
 				}
+#if FF_USE_FREEMAP
+				if (!fmap_get(fs, ncl)) {		/* Skip the group without reading its FAT entries if it is fully allocated */
+					cs = ((ncl >> fs->fm_shift) + 1) << fs->fm_shift;	/* Top of the next group */
+					if (scl >= ncl && scl < cs) return 0;	/* No free cluster found? */
+					ncl = cs - 1;
+					continue;
+				}
+				if (ncl == 2 || (ncl & ((1UL << fs->fm_shift) - 1)) == 0) gcl = ncl;
+#endif
 				cs = get_fat(obj, ncl);			/* Get the cluster status */
 				if (cs == 0) break;				/* Found a free cluster? */
 				if (cs == 1 || cs == 0xFFFFFFFF) return cs;	/* Test for error */
 				if (ncl == scl) return 0;		/* No free cluster found? */
+#if FF_USE_FREEMAP
+				if (gcl != 0 && (((ncl + 1) & ((1UL << fs->fm_shift) - 1)) == 0 || ncl + 1 == fs->n_fatent)) {
+					fmap_put(fs, ncl, 0);		/* The whole group was found in use */
+				}
+#endif
 			}
 		}
 		res = put_fat(fs, ncl, 0xFFFFFFFF);		/* Mark the new cluster 'EOC' */
@@ -3587,6 +3660,9 @@ static FRESULT mount_volume (	/* FR_OK(0): successful, !=0: an error occurred */
 	}
 
 	fs->fs_type = (BYTE)fmt;/* FAT sub-type (the filesystem object gets valid) */
+#if FF_USE_FREEMAP && !FF_FS_READONLY
+	fmap_init(fs);			/* Free cluster map is unknown until it is learned or scanned */
+#endif
 	fs->id = ++Fsid;		/* Volume mount ID */
 #if FF_USE_LFN == 1
 	fs->lfnbuf = LfnBuf;	/* Static LFN working buffer */
@@ -4809,6 +4885,107 @@ FRESULT f_stat (
 
 
 #if !FF_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Count Number of Free Clusters by a Full FAT Scan                      */
+/*-----------------------------------------------------------------------*/
+
+static FRESULT scan_free (	/* FR_OK(0):succeeded, !=0:error */
+	FATFS* fs,		/* Filesystem object */
+	DWORD* nclst	/* Pointer to a variable to return number of free clusters */
+)
+{
+	FRESULT res = FR_OK;
+	DWORD nfree, clst, stat;
+	LBA_t sect;
+	UINT i;
+	FFOBJID obj;
+
+
+	nfree = 0;
+#if FF_USE_FREEMAP
+	if (fs->fs_type != FS_EXFAT) memset(fs->fmap, 0, FF_FREEMAP_SIZE);	/* Rebuild the free cluster map on the way */
+#endif
+	if (fs->fs_type == FS_FAT12) {	/* FAT12: Scan bit field FAT entries */
+		clst = 2; obj.fs = fs;
+		do {
+			stat = get_fat(&obj, clst);
+			if (stat == 0xFFFFFFFF) {
+				res = FR_DISK_ERR; break;
+			}
+			if (stat == 1) {
+				res = FR_INT_ERR; break;
+			}
+			if (stat == 0) {
+				nfree++;
+#if FF_USE_FREEMAP
+				fmap_put(fs, clst, 1);
+#endif
+			}
+		} while (++clst < fs->n_fatent);
+	} else {
+#if FF_FS_EXFAT
+		if (fs->fs_type == FS_EXFAT) {	/* exFAT: Scan allocation bitmap */
+			BYTE bm;
+			UINT b;
+
+			clst = fs->n_fatent - 2;	/* Number of clusters */
+			sect = fs->bitbase;			/* Bitmap sector */
+			i = 0;						/* Offset in the sector */
+			do {	/* Counts numbuer of bits with zero in the bitmap */
+				if (i == 0) {	/* New sector? */
+					res = move_window(fs, sect++);
+					if (res != FR_OK) break;
+				}
+				for (b = 8, bm = ~fs->win[i]; b && clst; b--, clst--) {
+					nfree += bm & 1;
+					bm >>= 1;
+				}
+				i = (i + 1) % SS(fs);
+			} while (clst);
+		} else
+#endif
+		{	/* FAT16/32: Scan WORD/DWORD FAT entries */
+			clst = fs->n_fatent;	/* Number of entries */
+			sect = fs->fatbase;		/* Top of the FAT */
+			i = 0;					/* Offset in the sector */
+			do {	/* Counts numbuer of entries with zero in the FAT */
+				if (i == 0) {	/* New sector? */
+					res = move_window(fs, sect++);
+					if (res != FR_OK) break;
+				}
+				if (fs->fs_type == FS_FAT16) {
+					stat = ld_word(fs->win + i);
+					i += 2;
+				} else {
+					stat = ld_dword(fs->win + i) & 0x0FFFFFFF;
+					i += 4;
+				}
+				if (stat == 0) {
+					nfree++;
+#if FF_USE_FREEMAP
+					fmap_put(fs, fs->n_fatent - clst, 1);
+#endif
+				}
+				i %= SS(fs);
+			} while (--clst);
+		}
+	}
+	if (res == FR_OK) {		/* Update parameters if succeeded */
+		*nclst = nfree;			/* Return the free clusters */
+		fs->free_clst = nfree;	/* Now free_clst is valid */
+		fs->fsi_flag |= 1;		/* FAT32: FSInfo is to be updated */
+	}
+#if FF_USE_FREEMAP
+	else if (fs->fs_type != FS_EXFAT) {
+		memset(fs->fmap, 0xFF, FF_FREEMAP_SIZE);	/* Back to 'unknown' */
+	}
+#endif
+	return res;
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Get Number of Free Clusters                                           */
 /*-----------------------------------------------------------------------*/
@@ -4821,10 +4998,6 @@ FRESULT f_getfree (
 {
 	FRESULT res;
 	FATFS *fs;
-	DWORD nfree, clst, stat;
-	LBA_t sect;
-	UINT i;
-	FFOBJID obj;
 
 
 	/* Get logical drive */
@@ -4836,66 +5009,7 @@ FRESULT f_getfree (
 			*nclst = fs->free_clst;
 		} else {
 			/* Scan FAT to obtain number of free clusters */
-			nfree = 0;
-			if (fs->fs_type == FS_FAT12) {	/* FAT12: Scan bit field FAT entries */
-				clst = 2; obj.fs = fs;
-				do {
-					stat = get_fat(&obj, clst);
-					if (stat == 0xFFFFFFFF) {
-						res = FR_DISK_ERR; break;
-					}
-					if (stat == 1) {
-						res = FR_INT_ERR; break;
-					}
-					if (stat == 0) nfree++;
-				} while (++clst < fs->n_fatent);
-			} else {
-#if FF_FS_EXFAT
-				if (fs->fs_type == FS_EXFAT) {	/* exFAT: Scan allocation bitmap */
-					BYTE bm;
-					UINT b;
-
-					clst = fs->n_fatent - 2;	/* Number of clusters */
-					sect = fs->bitbase;			/* Bitmap sector */
-					i = 0;						/* Offset in the sector */
-					do {	/* Counts numbuer of bits with zero in the bitmap */
-						if (i == 0) {	/* New sector? */
-							res = move_window(fs, sect++);
-							if (res != FR_OK) break;
-						}
-						for (b = 8, bm = ~fs->win[i]; b && clst; b--, clst--) {
-							nfree += bm & 1;
-							bm >>= 1;
-						}
-						i = (i + 1) % SS(fs);
-					} while (clst);
-				} else
-#endif
-				{	/* FAT16/32: Scan WORD/DWORD FAT entries */
-					clst = fs->n_fatent;	/* Number of entries */
-					sect = fs->fatbase;		/* Top of the FAT */
-					i = 0;					/* Offset in the sector */
-					do {	/* Counts numbuer of entries with zero in the FAT */
-						if (i == 0) {	/* New sector? */
-							res = move_window(fs, sect++);
-							if (res != FR_OK) break;
-						}
-						if (fs->fs_type == FS_FAT16) {
-							if (ld_word(fs->win + i) == 0) nfree++;
-							i += 2;
-						} else {
-							if ((ld_dword(fs->win + i) & 0x0FFFFFFF) == 0) nfree++;
-							i += 4;
-						}
-						i %= SS(fs);
-					} while (--clst);
-				}
-			}
-			if (res == FR_OK) {		/* Update parameters if succeeded */
-				*nclst = nfree;			/* Return the free clusters */
-				fs->free_clst = nfree;	/* Now free_clst is valid */
-				fs->fsi_flag |= 1;		/* FAT32: FSInfo is to be updated */
-			}
+			res = scan_free(fs, nclst);
 		}
 	}
 
@@ -4904,6 +5018,32 @@ FRESULT f_getfree (
 
 
 
+#if FF_USE_FREEMAP
+/*-----------------------------------------------------------------------*/
+/* Rebuild the Free Cluster Map                                          */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_freemap (
+	const TCHAR* path	/* Logical drive number */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD nfree;
+
+
+	/* Get logical drive */
+	res = mount_volume(&path, &fs, 0);
+	if (res == FR_OK) {
+		res = scan_free(fs, &nfree);	/* Also validates the free cluster count */
+	}
+
+	LEAVE_FF(fs, res);
+}
+#endif
+
+
+
 
 /*-----------------------------------------------------------------------*/
 /* Truncate File                                                         */
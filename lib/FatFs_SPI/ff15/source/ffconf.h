@@ -38,10 +38,25 @@
 /* This option switches fast seek function. (0:Disable or 1:Enable) */
 
 
-#define FF_USE_EXPAND	0
+#define FF_USE_EXPAND	1
 /* This option switches f_expand function. (0:Disable or 1:Enable) */
 
 
+#ifndef FF_USE_FREEMAP
+#define FF_USE_FREEMAP	1
+#endif
+#ifndef FF_FREEMAP_SIZE
+#define FF_FREEMAP_SIZE	512
+#endif
+/* FF_USE_FREEMAP switches the in-memory free cluster map and f_freemap() function.
+/  (0:Disable or 1:Enable) The map keeps one bit per group of clusters, cleared when
+/  the group is known to be fully allocated, so that the cluster allocator on the
+/  FAT12/16/32 volume skips full regions instead of reading their FAT sectors.
+/  FF_FREEMAP_SIZE is the size of the map in bytes per volume. The group size is
+/  the smallest power of 2 clusters that lets the map cover the volume. It does not
+/  apply to the exFAT volume, which already has an allocation bitmap. */
+
+
 #define FF_USE_CHMOD	0
 /* This option switches attribute manipulation functions, f_chmod() and f_utime().
 /  (0:Disable or 1:Enable) Also FF_FS_READONLY needs to be 0 to enable this option. */
@@ -52,7 +67,7 @@
 /  (0:Disable or 1:Enable) */
 
 
-#define FF_USE_FORWARD	0
+#define FF_USE_FORWARD	1
 /* This option switches f_forward() function. (0:Disable or 1:Enable) */
 
 
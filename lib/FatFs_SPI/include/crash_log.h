@@ -0,0 +1,153 @@
+/* crash_log.h
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+// Crash-consistent log file.
+//
+// With plain f_write()/f_sync(), everything written since the last f_sync()
+// is lost at a power cut: the new clusters are not linked in the FAT and the
+// directory entry still has the old size. Here the file is instead grown in
+// CRASH_LOG_RESERVE steps, each committed with one f_sync(), and data is
+// written in whole 512 byte blocks that land inside the already committed
+// size. A block write is then a single sector write, with no FAT, directory
+// or FSINFO traffic, and is durable as soon as it returns: crash_log_flush()
+// gives the same guarantee as f_sync() for the cost of one sector.
+//
+// Each block has a header (magic, file id, sequence number = block number,
+// record count, length, CRC16), so after a reset crash_log_recover() finds the
+// end of the valid data with a binary search over the reserved tail and trims
+// the file size to it: O(log n) sector reads, never a scan of the whole file.
+//
+// For the highest sustained rate the file can instead be allocated up front as
+// one contiguous extent (crash_log_start_extent()) and its blocks written with
+// disk_write() straight to the sectors, several full blocks per call (one
+// multi-block SD command). There is then no FatFs call at all until
+// crash_log_finish() gives back the unused tail; a reset in between leaves a
+// file crash_log_recover() trims like any other.
+//
+// The on-card structures are little-endian and shared with host/tools/log_dump.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+//
+#include "ff.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CRASH_LOG_BLOCK_SIZE 512
+#define CRASH_LOG_MAGIC 0x474F4C43  // "CLOG"
+#define CRASH_LOG_NO_REC 0xFFFF
+#ifndef CRASH_LOG_RESERVE
+#define CRASH_LOG_RESERVE (64 * 1024)  // Bytes committed ahead of the data
+#endif
+
+typedef struct crash_log_hdr {
+    uint32_t magic;
+    uint32_t id;         // Same in all blocks of a file; tells them from stale data
+    uint32_t seq;        // Block number in the file
+    uint32_t records;    // Records started in this and all previous blocks
+    uint32_t time;       // Seconds since the epoch when the block was started
+    uint32_t uptime_ms;  // Milliseconds since boot when the block was started
+    uint16_t len;        // Payload bytes in use
+    uint16_t first_rec;  // Offset of the first record starting here, or CRASH_LOG_NO_REC
+    uint16_t crc;        // CRC16 (crc.c) of the header with crc = 0, then payload[0, len)
+    uint16_t reserved;
+} crash_log_hdr_t;
+
+#define CRASH_LOG_PAYLOAD (CRASH_LOG_BLOCK_SIZE - sizeof(crash_log_hdr_t))
+
+typedef struct crash_log_blk {
+    crash_log_hdr_t hdr;
+    uint8_t payload[CRASH_LOG_PAYLOAD];
+} crash_log_blk_t;
+
+typedef struct crash_log {
+    FIL *fil;          // NULL for a raw extent outside any file
+    FSIZE_t reserved;  // Committed file size
+    BYTE pdrv;         // Raw extent: drive, first sector, length in blocks
+    LBA_t lba;
+    uint32_t blocks;   // 0: blocks go through f_write()
+    crash_log_blk_t *burst;  // Raw extent: full blocks waiting to be written together
+    uint32_t burst_max;
+    uint32_t burst_n;
+    uint32_t id;
+    bool dirty;        // blk has data not yet written
+    crash_log_blk_t blk __attribute__((aligned(4)));
+} crash_log_t;
+
+typedef struct crash_log_recovery {
+    uint32_t blocks;   // Valid blocks kept
+    uint32_t records;  // Records in them (the last one may be cut short)
+    FSIZE_t size;      // File size after recovery
+    bool trimmed;      // The file had a reserved or torn tail
+} crash_log_recovery_t;
+
+// Starts a log in fil, an empty file open for writing.
+FRESULT crash_log_start(crash_log_t *cl, FIL *fil);
+
+// Starts a log in blocks sectors of drive pdrv from lba, outside any file
+// system: no FatFs call until crash_log_finish(). The blocks have the same
+// format as in a file, so an extent later linked to a file reads as one.
+// With burst (burst_blocks blocks of RAM) full blocks are collected and
+// written burst_blocks at a time; burst may be NULL. Block 0 is written
+// at once, empty, so that stale data in the extent never passes for the log.
+FRESULT crash_log_start_raw(crash_log_t *cl, BYTE pdrv, LBA_t lba, uint32_t blocks,
+                            crash_log_blk_t *burst, uint32_t burst_blocks);
+
+// Starts a log in fil, an empty file open for writing, allocated now as one
+// contiguous extent of size bytes and written as a raw extent. FR_DENIED if
+// the volume has no contiguous free space that large.
+FRESULT crash_log_start_extent(crash_log_t *cl, FIL *fil, FSIZE_t size,
+                               crash_log_blk_t *burst, uint32_t burst_blocks);
+
+// Appends one record. Records may span blocks; full blocks are written at
+// once, or with a burst buffer when it fills. In a raw extent a record that
+// does not fit is refused with FR_DENIED and nothing is written.
+FRESULT crash_log_write(crash_log_t *cl, const void *data, UINT len);
+
+// Makes everything written so far durable: writes the partially filled block,
+// which is rewritten in place as it fills, after any blocks still in the
+// burst buffer.
+FRESULT crash_log_flush(crash_log_t *cl);
+
+// Flushes, trims the reserved tail (or the unused end of the extent) and
+// syncs. The caller closes the file. For a raw extent outside any file:
+// flushes and syncs the drive.
+FRESULT crash_log_finish(crash_log_t *cl);
+
+// Number of records written so far
+static inline uint32_t crash_log_records(const crash_log_t *cl) { return cl->blk.hdr.records; }
+
+// Blocks holding data so far
+static inline uint32_t crash_log_blocks(const crash_log_t *cl) {
+    return cl->blk.hdr.len ? cl->blk.hdr.seq + 1 : cl->blk.hdr.seq;
+}
+
+// Finds the end of the valid data in a log left open by a reset and trims the
+// file to it. fil must be open with FA_READ | FA_WRITE.
+FRESULT crash_log_recover(FIL *fil, crash_log_recovery_t *rec);
+
+// Whether blk is block seq of the log with the given id, intact
+bool crash_log_valid(crash_log_blk_t *blk, uint32_t id, uint32_t seq);
+
+// Counts the valid blocks at the start of fil, without changing it, and
+// leaves the last of them in *last: O(log n) sector reads.
+FRESULT crash_log_valid_blocks(FIL *fil, uint32_t *blocks, crash_log_blk_t *last);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,223 @@
+/* dlog.h
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Deferred logging.
+//
+// printf() on the sampling path formats in the caller and, over USB CDC,
+// waits for the host: a line can hold the loop for milliseconds.
+// DLOG_PRINTF(fmt, ...) instead stores the format's id and the raw
+// arguments in a fixed 64 byte record of a RAM ring, and returns.
+// dlog_drain(), called from the main loop when there is time, formats the
+// records (or prints them as hex for the host) in order.
+//
+// The format must be a string literal. It is placed in its own section,
+// "dlog_fmt", and its id is its offset in that section. The build extracts
+// the section into a dictionary file (objcopy, see the top CMakeLists.txt),
+// with which host/tools/dlog_decode turns the hex lines back into text, so
+// the device can also skip formatting altogether (DLOG_OUT_HEX).
+//
+// Arguments: integers of up to 64 bits and strings. Integers are stored as
+// 4 or 8 bytes according to their type (not the conversion), strings are
+// copied, so they may be temporary; those that do not fit in the record are
+// truncated. Conversions are those of printf for integers, %c, %s and %p;
+// there is no floating point. The format is checked by the compiler as for
+// printf.
+//
+// Writers may be tasks or interrupt handlers, on either core: a record is
+// reserved with a short critical section (IRQs off plus a hardware spin lock
+// on the device, whose cores have no atomic read-modify-write; a CAS on the
+// host), written outside it, then committed by storing its sequence number.
+// The drain is the only reader. When the ring is full, records are dropped
+// and counted; the drain reports how many.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+//
+#include "sd_stats.h"  // SD_STATS_NOW_US()
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef DLOG
+#define DLOG 1
+#endif
+
+// Number of records; must be a power of two
+#ifndef DLOG_DEPTH
+#define DLOG_DEPTH 128
+#endif
+
+#define DLOG_MAX_ARGS 6
+#define DLOG_DATA 52  // Argument bytes per record
+
+// Kind of each argument, 2 bits per argument in dlog_rec_t.kinds
+enum { DLOG_KIND_NONE = 0, DLOG_KIND_32, DLOG_KIND_64, DLOG_KIND_STR };
+
+typedef struct dlog_rec {
+    uint32_t seq;    // Ticket + 1 once written: the slot is committed
+    uint32_t t_us;   // SD_STATS_NOW_US() when logged
+    uint16_t id;     // Offset of the format in the dlog_fmt section
+    uint16_t kinds;  // Argument kinds, the first in the low bits
+    uint8_t data[DLOG_DATA];  // Integers little endian, strings NUL terminated
+} dlog_rec_t;
+
+typedef union dlog_arg {
+    uint64_t u;
+    const char *s;
+} dlog_arg_t;
+
+typedef enum {
+    DLOG_OUT_TEXT,  // Formatted on the device
+    DLOG_OUT_HEX    // DLOG_LINE_TAG lines, for host/tools/dlog_decode
+} dlog_output_t;
+
+// Prefix of the lines printed in DLOG_OUT_HEX: the record after `seq`, in hex
+#define DLOG_LINE_TAG "dlog:"
+#define DLOG_LINE_BYTES (sizeof(dlog_rec_t) - 4)
+#define DLOG_LINE_MAX (sizeof DLOG_LINE_TAG + 2 * DLOG_LINE_BYTES)  // With the NUL
+
+typedef struct dlog_stats {
+    uint32_t logged;   // Records written
+    uint32_t dropped;  // Records lost because the ring was full
+    uint32_t peak;     // Most records waiting for the drain
+} dlog_stats_t;
+
+// Formats rec as printf would with fmt and its arguments. Returns the
+// length, truncated to size - 1 as snprintf does. Builds on the host too:
+// the decoder uses it with the dictionary.
+int dlog_format(char *buf, size_t size, const char *fmt, const dlog_rec_t *rec);
+
+// Writes rec as a DLOG_LINE_TAG line (no newline); size >= DLOG_LINE_MAX
+void dlog_hex_line(const dlog_rec_t *rec, char *line, size_t size);
+// Reads a DLOG_LINE_TAG line into rec (seq is set to 0). Returns false if
+// the line is not one.
+bool dlog_parse_line(const char *line, dlog_rec_t *rec);
+
+#if DLOG
+
+void dlog_init(void);
+void dlog_write(const char *fmt, uint32_t kinds, const dlog_arg_t *args);
+
+// Moves the oldest committed record to rec; false if there is none yet.
+// dlog_drain() and dlog_take() are for a single consumer.
+bool dlog_take(dlog_rec_t *rec);
+// The format of a record taken from this program's ring
+const char *dlog_fmt_of(const dlog_rec_t *rec);
+
+// Prints up to max records, oldest first, and how many were dropped since
+// the last call; returns how many records were printed
+uint32_t dlog_drain(uint32_t max);
+void dlog_set_output(dlog_output_t out);
+dlog_output_t dlog_output(void);
+void dlog_get_stats(dlog_stats_t *stats);
+
+// The format check, never called
+static inline void __attribute__((format(__printf__, 1, 2))) dlog_check_(const char *fmt, ...) {
+    (void)fmt;
+}
+
+#ifndef __cplusplus
+static inline dlog_arg_t dlog_arg_u_(uint64_t u) {
+    dlog_arg_t a = {.u = u};
+    return a;
+}
+static inline dlog_arg_t dlog_arg_s_(const char *s) {
+    dlog_arg_t a = {.s = s};
+    return a;
+}
+#define DLOG_ARG_(x) \
+    _Generic((x), char *: dlog_arg_s_, const char *: dlog_arg_s_, default: dlog_arg_u_)(x)
+#define DLOG_KIND_(x)                                                  \
+    _Generic((x), char *: DLOG_KIND_STR, const char *: DLOG_KIND_STR,  \
+             default: (sizeof(x) > 4 ? DLOG_KIND_64 : DLOG_KIND_32))
+#endif
+
+#define DLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, n, ...) n
+#define DLOG_NARGS(...) DLOG_NARGS_(0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define DLOG_CAT_(a, b) a##b
+#define DLOG_XCAT_(a, b) DLOG_CAT_(a, b)
+#define DLOG_MAP_0(m)
+#define DLOG_MAP_1(m, a) m(a, 0)
+#define DLOG_MAP_2(m, a, b) m(a, 0) m(b, 1)
+#define DLOG_MAP_3(m, a, b, c) m(a, 0) m(b, 1) m(c, 2)
+#define DLOG_MAP_4(m, a, b, c, d) m(a, 0) m(b, 1) m(c, 2) m(d, 3)
+#define DLOG_MAP_5(m, a, b, c, d, e) m(a, 0) m(b, 1) m(c, 2) m(d, 3) m(e, 4)
+#define DLOG_MAP_6(m, a, b, c, d, e, f) m(a, 0) m(b, 1) m(c, 2) m(d, 3) m(e, 4) m(f, 5)
+#define DLOG_MAP(m, ...) DLOG_XCAT_(DLOG_MAP_, DLOG_NARGS(__VA_ARGS__))(m, ##__VA_ARGS__)
+#define DLOG_EACH_ARG_(x, i) DLOG_ARG_(x),
+#define DLOG_EACH_KIND_(x, i) | ((uint32_t)DLOG_KIND_(x) << (2 * (i)))
+
+// Logs fmt (a string literal) and up to DLOG_MAX_ARGS arguments
+#define DLOG_PRINTF(fmt, ...)                                                         \
+    do {                                                                              \
+        static const char dlog_fmt_[] __attribute__((section("dlog_fmt"))) = fmt;     \
+        if (0) dlog_check_(fmt, ##__VA_ARGS__);                                       \
+        const dlog_arg_t dlog_args_[DLOG_MAX_ARGS + 1] = {                            \
+            DLOG_MAP(DLOG_EACH_ARG_, ##__VA_ARGS__)};                                 \
+        dlog_write(dlog_fmt_, 0 DLOG_MAP(DLOG_EACH_KIND_, ##__VA_ARGS__), dlog_args_); \
+    } while (0)
+
+#else
+
+#include <stdio.h>
+
+static inline void dlog_init(void) {}
+static inline bool dlog_take(dlog_rec_t *rec) {
+    (void)rec;
+    return false;
+}
+static inline uint32_t dlog_drain(uint32_t max) {
+    (void)max;
+    return 0;
+}
+static inline void dlog_set_output(dlog_output_t out) { (void)out; }
+static inline dlog_output_t dlog_output(void) { return DLOG_OUT_TEXT; }
+static inline void dlog_get_stats(dlog_stats_t *stats) {
+    stats->logged = stats->dropped = stats->peak = 0;
+}
+#define DLOG_PRINTF(fmt, ...) printf(fmt, ##__VA_ARGS__)
+
+#endif
+
+#ifdef __cplusplus
+}
+
+#if DLOG
+// C++ (host tools and tests): the argument kinds by overloading
+#include <type_traits>
+inline dlog_arg_t DLOG_ARG_(const char *s) {
+    dlog_arg_t a;
+    a.s = s;
+    return a;
+}
+template <typename T, typename = typename std::enable_if<std::is_integral<T>::value ||
+                                                         std::is_enum<T>::value>::type>
+inline dlog_arg_t DLOG_ARG_(T v) {
+    dlog_arg_t a;
+    a.u = (uint64_t)v;
+    return a;
+}
+template <typename T>
+constexpr uint32_t DLOG_KIND_(T) {
+    return std::is_convertible<T, const char *>::value ? DLOG_KIND_STR
+           : sizeof(T) > 4                             ? DLOG_KIND_64
+                                                       : DLOG_KIND_32;
+}
+#endif
+
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,103 @@
+/* export.h
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// File export over a byte stream (USB CDC), in frames.
+//
+// export_file() sends a byte range of a file as
+//   BEGIN  offset of the range, file size in arg, the path as payload
+//   DATA   offset, up to EXPORT_FRAME bytes of the file
+//   ...
+//   END    offset reached, FRESULT in arg
+// Each frame is an export_hdr_t with its own CRC16, the payload and the
+// payload's CRC16 (crc.c). DATA payloads go through f_forward(): FatFs hands
+// the streaming function each sector straight from the file's sector buffer,
+// with no copy into a buffer of ours on the way to the output.
+//
+// Nothing is sent back while a transfer runs. A receiver that loses or
+// rejects a frame asks for a new export from the first offset it is missing
+// (resume); stray bytes between frames, e.g. debug output, are skipped by
+// looking for the next valid header.
+//
+// export_rx_feed() is the receiving side, for the host tool.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+//
+#include "ff.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EXPORT_MAGIC 0x3150584C  // "LXP1"
+#ifndef EXPORT_FRAME
+#define EXPORT_FRAME 2048  // DATA payload; a multiple of the sector size
+#endif
+#define EXPORT_FRAME_MAX 4096  // Largest payload a receiver accepts
+
+enum { EXPORT_BEGIN = 1, EXPORT_DATA = 2, EXPORT_END = 3 };
+
+typedef struct export_hdr {
+    uint32_t magic;
+    uint8_t type;
+    uint8_t reserved;
+    uint16_t len;     // Payload bytes
+    uint32_t offset;  // File offset: of the payload (DATA), start (BEGIN), end (END)
+    uint32_t arg;     // BEGIN: file size; END: FRESULT
+    uint16_t crc;     // CRC16 of the header up to here
+    uint16_t reserved2;
+} export_hdr_t;  // Then len bytes, then their CRC16
+
+// Takes a piece of a frame; for the device, e.g. the USB CDC driver
+typedef void (*export_out_t)(const void *data, size_t len);
+
+typedef struct export_stats {
+    uint64_t bytes;   // File bytes sent
+    uint32_t frames;  // DATA frames
+    uint32_t us;      // Time from BEGIN to END
+} export_stats_t;
+
+// Sends bytes [offset, offset + len) of the file at path (len 0: to the end
+// of the file) through out. One transfer at a time: the f_forward() callback
+// has no context. An error after BEGIN is also reported in END. st may be
+// NULL.
+FRESULT export_file(const TCHAR *path, uint32_t offset, uint32_t len, export_out_t out,
+                    export_stats_t *st);
+
+/* Receiver */
+
+typedef struct export_rx {
+    uint8_t buf[sizeof(export_hdr_t) + EXPORT_FRAME_MAX + 2];
+    size_t have;
+    uint32_t skipped;  // Bytes that were not part of a valid frame
+    uint32_t bad;      // Frames with a valid header and a damaged payload
+} export_rx_t;
+
+// Called for each frame; ok is false for a damaged payload
+typedef void (*export_rx_cb_t)(void *arg, const export_hdr_t *h, const uint8_t *payload,
+                               bool ok);
+
+void export_rx_init(export_rx_t *rx);
+
+// Parses the next len bytes of the stream, calling cb for every frame
+// completed by them.
+void export_rx_feed(export_rx_t *rx, const void *data, size_t len, export_rx_cb_t cb,
+                    void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* [] END OF FILE */
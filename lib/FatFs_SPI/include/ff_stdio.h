@@ -12,8 +12,21 @@ CONDITIONS OF ANY KIND, either express or implied. See the License for the
 specific language governing permissions and limitations under the License.
 */
 // For compatibility with FreeRTOS+FAT API
+//
+// Streams are buffered in user space, like C stdio: ff_fputc(), ff_fgetc(),
+// ff_fgets() and small ff_fread()/ff_fwrite() calls work in a buffer of
+// FF_STDIO_BUFSIZE bytes (allocated at the first access) and only go to
+// FatFs a buffer at a time. ff_setvbuf() sets another size, a caller's
+// buffer, line buffering or none. Seeking, ff_ftell(), switching between
+// reading and writing and ff_fclose() see the stream position, not FatFs'.
+// Written data reaches the card at ff_fflush() or ff_fclose().
+
+#pragma once
+
 #include <errno.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 //
@@ -21,10 +34,15 @@ specific language governing permissions and limitations under the License.
 //
 #include "my_debug.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #define BaseType_t int
-#define FF_FILE FIL
 
-#define ff_rewind f_rewind
+#ifndef FF_STDIO_BUFSIZE
+#define FF_STDIO_BUFSIZE 512  // Default stream buffer; 0: unbuffered
+#endif
 #define pvPortMalloc malloc
 #define vPortFree free
 #define ffconfigMAX_FILENAME 250
@@ -37,8 +55,22 @@ specific language governing permissions and limitations under the License.
 #define FF_SEEK_END 2
 #define pdFALSE 0
 #define pdTRUE 1
-#define ff_filelength f_size
-#define ff_feof f_eof
+
+// ff_setvbuf() modes, as setvbuf()'s
+#define FF_IOFBF 0  // Fully buffered
+#define FF_IOLBF 1  // Writes flushed at each newline
+#define FF_IONBF 2  // Unbuffered
+
+typedef struct FF_FILE {
+    FIL fil;
+    uint8_t *buf;
+    size_t size;  // Buffer size, 0 for an unbuffered stream
+    size_t pos;   // Next byte in buf
+    size_t len;   // Bytes read into buf; or 0 and pos bytes to write
+    uint8_t state;  // Buffer idle, holding read data or data to write
+    uint8_t mode;   // FF_IO*
+    bool own;       // buf was allocated here
+} FF_FILE;
 
 typedef struct FF_STAT {
     uint32_t st_size; /* Size of the object in number of bytes. */
@@ -75,3 +107,15 @@ FF_FILE *ff_truncate( const char * pcFileName, long lTruncateSize );
 int ff_seteof( FF_FILE *pxStream );
 int ff_rename( const char *pcOldName, const char *pcNewName, int bDeleteIfExists );
 char *ff_fgets(char *pcBuffer, size_t xCount, FF_FILE *pxStream);
+// As setvbuf(): before the first read or write. pcBuffer may be NULL to
+// have xSize bytes allocated. Returns 0, or -1 with errno set.
+int ff_setvbuf(FF_FILE *pxStream, char *pcBuffer, int iMode, size_t xSize);
+// Writes out the buffer and syncs the file. Returns 0, or FF_EOF.
+int ff_fflush(FF_FILE *pxStream);
+void ff_rewind(FF_FILE *pxStream);
+long ff_filelength(FF_FILE *pxStream);
+int ff_feof(FF_FILE *pxStream);
+
+#ifdef __cplusplus
+}
+#endif
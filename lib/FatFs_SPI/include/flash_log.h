@@ -0,0 +1,173 @@
+/* flash_log.h
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Log-structured record store in NOR flash.
+//
+// Fallback for when the SD card is missing or stalled: records are appended
+// to a region of whole 4 KiB sectors used as a circular log, and drained out
+// again, in order, once the card is usable.
+//
+// Every sector starts with a header: the erase count, programmed right after
+// the erase, then magic, sequence number and CRC16, programmed when the
+// sector is opened, and a bitmap of drained pages. Records follow, each with
+// its length and a CRC16, and never straddle a 256 byte page. Unwritten flash
+// reads as 0xFF, so a 0xFFFF length ends a page. Records are staged in RAM
+// and programmed a page at a time; a page may be programmed again as it
+// fills, since programming only clears bits.
+//
+// Sectors are opened in circular order, each with the next sequence number,
+// so each one is erased once per pass over the region and wear is even.
+// Erases take tens of milliseconds and are kept out of flash_log_put():
+// flash_log_maintain(), called when idle, erases free sectors ahead of the
+// head until FLASH_LOG_SPARE are ready; put only erases when none is.
+//
+// Delivery follows spill.h: flash_log_drain() hands records to a writer,
+// flash_log_commit() (once the writer's data is durable) clears their pages'
+// bits in the drained bitmap, flash_log_rewind() makes them pending again. A
+// page is the unit of commit in flash: after a reset, the records of a partly
+// committed page are sent again.
+//
+// flash_log_mount() rebuilds the state from the headers. A record torn by a
+// power cut fails its CRC and ends its page; a sector with a torn header or
+// erase is erased again before use.
+//
+// The flash is reached through flash_log_dev_t: flash_log_pico_dev() (device
+// only) maps it to the unused end of the Pico's QSPI flash; the host tools use
+// a simulated NOR chip.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FLASH_LOG_SECTOR_SIZE 4096
+#define FLASH_LOG_PAGE_SIZE 256
+#define FLASH_LOG_PAGES (FLASH_LOG_SECTOR_SIZE / FLASH_LOG_PAGE_SIZE)
+#define FLASH_LOG_MAGIC 0x474F4C46  // "FLOG"
+#define FLASH_LOG_SPARE 2           // Sectors kept erased ahead of the head
+#ifndef FLASH_LOG_SIZE
+#define FLASH_LOG_SIZE (1536 * 1024)  // Region size for flash_log_pico_dev()
+#endif
+
+typedef struct flash_log_sec_hdr {
+    uint32_t erases;   // Times this sector was erased
+    uint32_t magic;
+    uint32_t seq;      // Order in which sectors were opened
+    uint16_t crc;      // CRC16 (crc.c) of the fields above
+    uint16_t drained;  // Bit p cleared once page p was drained; not in the CRC
+} flash_log_sec_hdr_t;
+
+typedef struct flash_log_rec_hdr {
+    uint16_t len;  // 0xFFFF: no more records in this page
+    uint16_t crc;  // CRC16 of len, then the data
+} flash_log_rec_hdr_t;
+
+// Longest record: one in the first page of a sector, after the header
+#define FLASH_LOG_MAX_RECORD \
+    (FLASH_LOG_PAGE_SIZE - sizeof(flash_log_sec_hdr_t) - sizeof(flash_log_rec_hdr_t))
+
+typedef struct flash_log_dev {
+    // Erases the sector at offset (a multiple of FLASH_LOG_SECTOR_SIZE)
+    int (*erase)(void *ctx, uint32_t offset);
+    // Programs the page at offset (a multiple of FLASH_LOG_PAGE_SIZE)
+    int (*program)(void *ctx, uint32_t offset, const uint8_t *data);
+    void *ctx;
+    const uint8_t *base;  // Contents, memory mapped, for reading
+    uint32_t size;        // Multiple of FLASH_LOG_SECTOR_SIZE
+} flash_log_dev_t;
+
+typedef struct flash_log_stats {
+    uint32_t records;        // Accepted by flash_log_put()
+    uint32_t dropped;        // Rejected: the log was full or the flash failed
+    uint32_t drained;        // Handed out by flash_log_drain(), including resent ones
+    uint32_t programs;       // Page programs
+    uint32_t erases;         // Sector erases
+    uint32_t inline_erases;  // Of those, done inside flash_log_put()
+    uint32_t torn;           // Torn records or sectors found by flash_log_mount()
+} flash_log_stats_t;
+
+// A position in the log: sector index and byte offset in it
+typedef struct flash_log_pos {
+    uint32_t sec;
+    uint32_t off;
+} flash_log_pos_t;
+
+typedef struct flash_log {
+    flash_log_dev_t dev;
+    uint32_t sectors;
+    bool empty;                // No sector opened yet
+    uint32_t seq;              // Sequence number of the head sector
+    flash_log_pos_t head;      // Where the next record goes
+    flash_log_pos_t sent;      // Next record for flash_log_drain()
+    flash_log_pos_t done;      // Records before it are committed
+    uint32_t tail;             // Oldest sector with records not committed
+    uint32_t pending;          // Records from sent to head
+    uint32_t unsynced;         // Records from done to sent
+    uint32_t max_erases;       // Highest erase count seen
+    bool staged;               // page holds records not programmed yet
+    uint8_t page[FLASH_LOG_PAGE_SIZE] __attribute__((aligned(4)));
+    flash_log_stats_t stats;
+} flash_log_t;
+
+// Scans the sector headers and picks up where the log was left: records not
+// committed before a reset are pending again. Returns 0 or the device error.
+int flash_log_mount(flash_log_t *fl, const flash_log_dev_t *dev);
+
+// Appends a record (1 to FLASH_LOG_MAX_RECORD bytes) to the RAM page. Returns
+// false, and counts a drop, if the log is full or the flash fails.
+bool flash_log_put(flash_log_t *fl, const void *rec, size_t len);
+
+// Programs the staged page: the records put so far survive a reset.
+int flash_log_flush(flash_log_t *fl);
+
+// Same contract as spill_drain(): write(ctx, rec, len) returns 0 on success.
+typedef int (*flash_log_write_t)(void *ctx, const void *rec, size_t len);
+int flash_log_drain(flash_log_t *fl, flash_log_write_t write, void *ctx);
+
+// Everything drained so far is durable: marks it in flash.
+int flash_log_commit(flash_log_t *fl);
+
+// The writer lost what was drained since the last commit.
+void flash_log_rewind(flash_log_t *fl);
+
+// Idle work: erases at most one sector ahead of the head. Returns 1 if it
+// did (the call took an erase time), 0 if there was nothing to erase, or
+// the device's (negative) error code if the erase or the header failed.
+int flash_log_maintain(flash_log_t *fl);
+
+static inline uint32_t flash_log_pending(const flash_log_t *fl) {
+    return fl->pending + fl->unsynced;
+}
+static inline const flash_log_stats_t *flash_log_stats(const flash_log_t *fl) {
+    return &fl->stats;
+}
+
+#if PICO_ON_DEVICE
+// The last size bytes of the QSPI flash. Returns false if the program
+// image reaches into them. Erase and program run through
+// flash_safe_execute(), which fails with PICO_ERROR_NOT_PERMITTED unless
+// the other core has called flash_safe_execute_core_init() or is declared
+// safe at build time (PICO_FLASH_ASSUME_CORE1_SAFE): an idle core is not
+// enough on its own.
+bool flash_log_pico_dev(flash_log_dev_t *dev, uint32_t size);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,83 @@
+/* hotplug.h
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Card presence tracking.
+//
+// hotplug_poll() is called from the main loop and reports a card that went
+// away or came back. Presence is checked with a probe function:
+//   - on a card detect edge (hotplug_signal(), from the GPIO IRQ), once the
+//     contacts had settle_ms to stop bouncing;
+//   - every poll_ms when the socket has no card detect switch;
+//   - every poll_ms while the card is known to be missing.
+// A failed write is a stronger hint than any probe: hotplug_lost() marks the
+// card missing at once, and the next probe that finds it reports
+// HOTPLUG_INSERTED. Times are passed in by the caller (microseconds).
+//
+// hotplug_sd_init() (device only) probes an sd_card_t: the card detect GPIO
+// if use_card_detect is set, otherwise sd_test_com().
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum { HOTPLUG_NONE, HOTPLUG_REMOVED, HOTPLUG_INSERTED } hotplug_event_t;
+
+// Returns true if the card is there and answers
+typedef bool (*hotplug_probe_t)(void *ctx);
+
+typedef struct hotplug {
+    hotplug_probe_t probe;
+    void *ctx;
+    uint32_t poll_us;
+    uint32_t settle_us;
+    bool periodic;          // Probe every poll_us even while present
+    bool present;
+    volatile bool signaled; // Card detect edge not handled yet
+    bool settling;
+    uint64_t next_us;       // Next probe
+    uint32_t removals;
+    uint32_t insertions;
+    uint32_t probes;
+} hotplug_t;
+
+#define HOTPLUG_SETTLE_MS 100
+
+void hotplug_init(hotplug_t *hp, hotplug_probe_t probe, void *ctx, uint32_t poll_ms,
+                  uint32_t settle_ms, bool periodic);
+
+// Card detect edge: safe to call from an IRQ handler.
+static inline void hotplug_signal(hotplug_t *hp) { hp->signaled = true; }
+
+// I/O to the card failed: it is treated as missing from now on.
+void hotplug_lost(hotplug_t *hp);
+
+hotplug_event_t hotplug_poll(hotplug_t *hp, uint64_t now_us);
+
+static inline bool hotplug_present(const hotplug_t *hp) { return hp->present; }
+
+#if PICO_ON_DEVICE
+typedef struct sd_card_t sd_card_t;
+// Starts tracking pSD, assumed present. With use_card_detect, both edges of
+// the card detect GPIO call hotplug_signal() (one card per build).
+void hotplug_sd_init(hotplug_t *hp, sd_card_t *pSD, uint32_t poll_ms);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+/* [] END OF FILE */
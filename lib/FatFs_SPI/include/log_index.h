@@ -0,0 +1,105 @@
+/* log_index.h
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Sparse time index of a session file (crash_log.h).
+//
+// Next to NNNN.log, NNNN.tix holds a header and one entry every
+// LOG_INDEX_EVERY blocks: the block's start time, the number of records
+// started before it and its place in the log. Entries only grow, in both
+// time and record number, so a time or record range is found by a binary
+// search of this small file, in O(log n) sector reads, before the log itself
+// is touched.
+//
+// The index is written while logging, one entry per f_write() into the
+// file's sector buffer, and synced when a sector of entries is complete; it
+// is an accelerator only. Everything in it is also in the block headers, so
+// entries lost with a reset, or past the end of a trimmed log, are ignored
+// by readers, which fall back to searching the headers.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+//
+#include "ff.h"
+//
+#include "crash_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LOG_INDEX_EXT "tix"
+#define LOG_INDEX_MAGIC 0x58495443  // "CTIX"
+#ifndef LOG_INDEX_EVERY
+#define LOG_INDEX_EVERY 64  // Blocks per entry: 32 KiB of log, ~1100 samples
+#endif
+
+typedef struct log_index_hdr {
+    uint32_t magic;
+    uint32_t id;     // crash_log id of the log
+    uint32_t every;  // Blocks between entries
+    uint32_t reserved;
+} log_index_hdr_t;
+
+typedef struct log_index_entry {
+    uint32_t block;   // Block number; file offset block * CRASH_LOG_BLOCK_SIZE
+    uint32_t record;  // Records started before the block
+    uint32_t time;    // Start time of the block (crash_log_hdr_t.time)
+    uint32_t check;   // id ^ block ^ record ^ time: tells entries from torn data
+} log_index_entry_t;
+
+typedef struct log_index {
+    FIL fil;
+    bool open;
+    uint32_t id;
+    uint32_t every;
+    uint32_t next;     // Next block to index
+    uint32_t entries;  // Entries written
+} log_index_t;
+
+// Formats the path of a sidecar file: NNNN.log -> NNNN.<ext>
+void log_index_path(const TCHAR *log_path, const char *ext, char *buf, size_t len);
+
+// Creates the index of the log at log_path, whose blocks carry id
+// (crash_log_t.id), with an entry every `every` blocks.
+FRESULT log_index_open(log_index_t *ix, const TCHAR *log_path, uint32_t id, uint32_t every);
+
+// Call after each crash_log_write() to cl: adds an entry when a block due
+// one has been started. No-op if the index is not open.
+FRESULT log_index_note(log_index_t *ix, const crash_log_t *cl);
+
+FRESULT log_index_close(log_index_t *ix);
+
+// Writes the index of a complete log from its block headers: one block read
+// per entry. For logs written with no file system calls (extents).
+FRESULT log_index_build(const TCHAR *log_path, uint32_t every);
+
+// Opens the index of the log at log_path for lookups. FR_NO_FILE if there
+// is none or it belongs to another log (id).
+FRESULT log_index_open_read(FIL *fil, const TCHAR *log_path, uint32_t id, uint32_t *entries);
+
+// Binary search of an index opened with log_index_open_read(): the last
+// entry whose time (by_time) or record is <= key, and the one after it.
+// Entries past blocks (the valid end of the log) or damaged are treated as
+// absent. *found is false if the first entry is already past key; *next is
+// false if there is no entry after *lo.
+FRESULT log_index_lookup(FIL *fil, uint32_t id, uint32_t entries, uint32_t blocks, bool by_time,
+                         uint32_t key, log_index_entry_t *lo, bool *found, log_index_entry_t *hi,
+                         bool *next);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,105 @@
+/* log_reader.h
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Random access to a session file (crash_log.h), for playback and export.
+//
+// A plain f_lseek() deep into a large file follows the FAT chain one cluster
+// at a time. log_reader_open() instead gives the file FatFs' cluster link map
+// table (FF_USE_FASTSEEK), so that every seek is computed from the table with
+// no FAT reads. Building the table walks the chain once; it is then saved
+// next to the log (NNNN.map) and loaded by later opens, as long as the log's
+// first cluster and size still match.
+//
+// Block headers carry the running record count and the block's start time,
+// both growing with the block number, so a seek to a record or to a time is
+// an interpolation search over them: a block read or two at a steady sample
+// rate, O(log n) at worst. Pauses in the capture throw the interpolation
+// by time off, so if the log has a sparse time index (NNNN.tix, log_index.h)
+// a binary search of it first narrows a time seek to the blocks between two
+// entries. Record counts have no such gaps and are searched directly.
+// Records are taken to end with '\n', as the application's CSV lines, to
+// find one inside its block.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+//
+#include "ff.h"
+//
+#include "crash_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LOG_READER_MAP_EXT "map"
+#define LOG_READER_MAP_MAGIC 0x50414D4C  // "LMAP"
+#ifndef LOG_READER_CLMT
+#define LOG_READER_CLMT 64  // Table words: up to 31 fragments
+#endif
+#ifndef LOG_READER_TIX_CLMT
+#define LOG_READER_TIX_CLMT 32  // The same for the time index: up to 15 fragments
+#endif
+
+// Map file: this header, then the table's words
+typedef struct log_reader_map {
+    uint32_t magic;
+    uint32_t sclust;  // First cluster of the log
+    uint64_t size;    // Size of the log
+    uint32_t words;   // Table words that follow
+    uint16_t crc;     // CRC16 (crc.c) of this header with crc = 0, then the table
+    uint16_t reserved;
+} log_reader_map_t;
+
+typedef struct log_reader {
+    FIL fil;
+    DWORD clmt[LOG_READER_CLMT];
+    bool fast;        // Seeks use the table; false if the file has too many fragments
+    bool map_loaded;  // The table came from the map file
+    uint32_t id;
+    uint32_t blocks;   // Valid blocks
+    uint32_t records;  // Records in them
+    uint32_t time_first, time_last;  // Start times of the first and the last block
+    uint32_t seq;      // Read position: block and payload offset
+    uint32_t ofs;
+    uint32_t cached;   // Block in blk, or UINT32_MAX
+    uint32_t reads;    // Blocks read since open
+    crash_log_blk_t blk;
+    FIL tix;          // Sparse time index (log_index.h), if indexed
+    DWORD tix_clmt[LOG_READER_TIX_CLMT];
+    bool indexed;
+    uint32_t tix_entries;
+} log_reader_t;
+
+// Opens a session file for reading, positioned at the first record
+FRESULT log_reader_open(log_reader_t *r, const TCHAR *path);
+
+FRESULT log_reader_close(log_reader_t *r);
+
+// Moves to the start of record index (0 = first). Past the last record:
+// FR_INVALID_PARAMETER.
+FRESULT log_reader_seek_record(log_reader_t *r, uint32_t index);
+
+// Moves to the first record of the block that was being written at time
+// (seconds since the epoch, as in the block headers); before the first
+// block, to the first record.
+FRESULT log_reader_seek_time(log_reader_t *r, uint32_t time);
+
+// Reads payload bytes from the read position on; *br < len at the end.
+FRESULT log_reader_read(log_reader_t *r, void *buf, UINT len, UINT *br);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* [] END OF FILE */
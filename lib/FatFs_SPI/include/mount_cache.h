@@ -0,0 +1,79 @@
+/* mount_cache.h
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+// Mount accelerator.
+//
+// FatFs only knows the number of free clusters after a full FAT (or exFAT
+// allocation bitmap) scan, unless a valid FSINFO sector says otherwise. On
+// large cards that scan takes seconds and happens on the first f_getfree()
+// or, indirectly, on the first allocation. This module keeps the free cluster
+// count and the last allocated cluster hint in a small record on the volume
+// (MOUNT_CACHE_FILE). The record is written with a "clean" mark at unmount and
+// is re-marked dirty right after every mount, so an unclean shutdown is never
+// trusted.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+//
+#include "ff.h"
+#include "sd_card.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MOUNT_CACHE_FILE ".mntcache"
+
+// Where the free cluster count came from after mount_cache_mount()
+typedef enum {
+    MOUNT_CACHE_SRC_NONE = 0,  // Unknown: first allocation will scan the FAT
+    MOUNT_CACHE_SRC_FSINFO,    // FAT32 FSINFO sector, confirmed by the cache
+    MOUNT_CACHE_SRC_CACHE,     // Restored from MOUNT_CACHE_FILE
+    MOUNT_CACHE_SRC_SCAN       // Full scan done by f_getfree()
+} mount_cache_src_t;
+
+typedef struct {
+    uint32_t mount_us;    // f_mount(): boot sector, FSINFO
+    uint32_t restore_us;  // Reading and validating MOUNT_CACHE_FILE
+    uint32_t getfree_us;  // The FAT scan, if prewarm needed one
+    DWORD free_clst;      // Free clusters (0xFFFFFFFF if still unknown)
+    mount_cache_src_t source;
+} mount_cache_stats_t;
+
+// Mounts pSD's volume and restores the cached allocation information.
+// If prewarm and neither FSINFO nor the record gave the free count, also
+// scans the FAT (f_freemap(), or f_getfree() on exFAT) so that it happens now.
+FRESULT mount_cache_mount(sd_card_t *pSD, bool prewarm, mount_cache_stats_t *stats);
+
+// Writes the current allocation information with the clean mark.
+// Call with the volume still mounted, right before f_unmount().
+FRESULT mount_cache_save(sd_card_t *pSD);
+
+// Starts mount_cache_mount(pSD, true, ...) on core 1 so the card is ready by
+// the time the user asks for it. FatFs is not reentrant: core 0 must not touch
+// the volume until mount_cache_background_done() returns true.
+void mount_cache_start_background(sd_card_t *pSD);
+bool mount_cache_background_busy(void);
+// Returns true once the background mount has finished (and was not yet
+// claimed); *result gets its FRESULT. Subsequent calls return false.
+bool mount_cache_background_done(FRESULT *result);
+
+const mount_cache_stats_t *mount_cache_last_stats(void);
+const char *mount_cache_src_str(mount_cache_src_t src);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,150 @@
+/* msc_disk.h
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// The SD card as a USB mass storage device.
+//
+// TinyUSB splits every SCSI READ(10)/WRITE(10) into callbacks of at most
+// CFG_TUD_MSC_EP_BUFSIZE bytes. Mapped one to one onto the card, each would
+// cost a command (and, for writes, a program busy time) per few blocks. This
+// layer sits between the callbacks and the disk I/O of the drive (diskio.h,
+// so sd_card_t read_blocks/write_blocks on the device, the RAM disk on the
+// host) and turns them into multi-block transfers:
+//
+//   read-ahead     - a miss reads a window of blocks into a cache; the window
+//                    starts at the size asked and doubles while the reads
+//                    stay sequential, up to MSC_DISK_RA_BLOCKS
+//   write coalesce - contiguous writes collect in a buffer of up to
+//                    MSC_DISK_WB_BLOCKS blocks, written in one command when
+//                    full, when a write is not contiguous, before a read
+//                    that overlaps it and at the end of each SCSI command
+//                    (msc_disk_flush()). TinyUSB calls the latter after it
+//                    has sent the command's status, so the host is told a
+//                    write succeeded before its tail is on the card, as with
+//                    a disk's write cache: a failed flush is reported by
+//                    the next command (msc_disk_take_write_error()), and
+//                    SYNCHRONIZE CACHE or an eject waits for the card
+//
+// Ownership: between msc_disk_attach() and msc_disk_detach() the USB host
+// owns the card and FatFs must not have the volume mounted; outside, every
+// call fails as "medium not present". The host may eject the medium
+// (START STOP UNIT), which flushes and moves to MSC_DISK_EJECTED: still
+// owned by USB until the application calls msc_disk_detach().
+//
+// The SCSI-level calls take the TinyUSB callback arguments and return what
+// the callbacks return, so the device glue (msc_disk_usb_bind(), device
+// only) is thin and host/tools/msc_sim drives the same code against a RAM
+// disk, with TinyUSB's splitting, to check the data and measure the rate.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+//
+#include "ff.h"
+#include "diskio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MSC_DISK_BLOCK 512
+#ifndef MSC_DISK_RA_BLOCKS
+#define MSC_DISK_RA_BLOCKS 16  // Read-ahead cache, blocks
+#endif
+#ifndef MSC_DISK_WB_BLOCKS
+#define MSC_DISK_WB_BLOCKS 32  // Write buffer, blocks
+#endif
+
+typedef enum {
+    MSC_DISK_OFF = 0,   // FatFs side: no medium for USB
+    MSC_DISK_READY,     // Owned by the USB host
+    MSC_DISK_EJECTED    // Ejected by the host, waiting for msc_disk_detach()
+} msc_disk_state_t;
+
+typedef struct msc_disk_stats {
+    uint32_t read_calls;    // msc_disk_read10() calls
+    uint32_t write_calls;   // msc_disk_write10() calls
+    uint32_t reads;         // disk_read() commands
+    uint32_t writes;        // disk_write() commands
+    uint64_t blocks_read;   // Through disk_read(), read-ahead included
+    uint64_t blocks_written;
+    uint64_t bytes_in;      // Bytes the host wrote
+    uint64_t bytes_out;     // Bytes the host read
+    uint32_t hits;          // read10 calls served from the cache alone
+    uint32_t errors;        // Failed calls
+} msc_disk_stats_t;
+
+typedef struct msc_disk {
+    BYTE pdrv;
+    msc_disk_state_t state;
+    uint32_t sectors;
+    uint32_t ra_max;     // Read-ahead window and write buffer limits,
+    uint32_t wb_max;     // 1 to MSC_DISK_RA_BLOCKS / MSC_DISK_WB_BLOCKS
+    uint32_t ra_lba;     // Blocks held by the read cache
+    uint32_t ra_count;
+    uint32_t ra_window;  // Blocks the next miss reads
+    uint32_t ra_next;    // Block after the last one read: sequential if asked next
+    uint32_t wb_lba;     // Blocks held by the write buffer
+    uint32_t wb_count;
+    bool write_error;    // A flush at the end of a command failed: reported next
+    msc_disk_stats_t stats;
+    uint8_t ra_buf[MSC_DISK_RA_BLOCKS * MSC_DISK_BLOCK] __attribute__((aligned(4)));
+    uint8_t wb_buf[MSC_DISK_WB_BLOCKS * MSC_DISK_BLOCK] __attribute__((aligned(4)));
+} msc_disk_t;
+
+// ra_blocks/wb_blocks: 0 for the maximum; 1 turns read-ahead/coalescing off
+void msc_disk_init(msc_disk_t *d, BYTE pdrv, uint32_t ra_blocks, uint32_t wb_blocks);
+
+// Hands the drive to USB: initializes it if needed and reads its size.
+DRESULT msc_disk_attach(msc_disk_t *d);
+// Takes it back: writes what is buffered and syncs the card.
+DRESULT msc_disk_detach(msc_disk_t *d);
+
+static inline msc_disk_state_t msc_disk_state(const msc_disk_t *d) { return d->state; }
+static inline const msc_disk_stats_t *msc_disk_stats(const msc_disk_t *d) { return &d->stats; }
+
+// TEST UNIT READY
+static inline bool msc_disk_ready(const msc_disk_t *d) { return MSC_DISK_READY == d->state; }
+// READ CAPACITY: false when not ready
+bool msc_disk_capacity(const msc_disk_t *d, uint32_t *block_count, uint16_t *block_size);
+
+// READ(10) and WRITE(10) pieces, as tud_msc_read10_cb()/tud_msc_write10_cb():
+// bytes from offset into block lba. Return the bytes done, or -1 on error.
+// Writes must be whole blocks (offset 0, len a multiple of MSC_DISK_BLOCK),
+// which they are when the endpoint buffer is a multiple of the block size.
+int32_t msc_disk_read10(msc_disk_t *d, uint32_t lba, uint32_t offset, void *buf, uint32_t len);
+int32_t msc_disk_write10(msc_disk_t *d, uint32_t lba, uint32_t offset, const void *buf,
+                         uint32_t len);
+
+// End of a WRITE(10): writes the buffer out.
+DRESULT msc_disk_flush(msc_disk_t *d);
+// SYNCHRONIZE CACHE: flush, then CTRL_SYNC.
+DRESULT msc_disk_sync(msc_disk_t *d);
+// START STOP UNIT with LoEj: start false ejects. Returns false if it failed.
+bool msc_disk_start_stop(msc_disk_t *d, bool start, bool load_eject);
+// The flush at the end of a WRITE(10) runs once its status is decided: if
+// it failed, returns true once so that the next command reports it (a
+// deferred error, as from a disk with a write cache).
+bool msc_disk_take_write_error(msc_disk_t *d);
+
+#if PICO_ON_DEVICE
+// Routes the TinyUSB MSC callbacks (LUN 0) to d. Needs CFG_TUD_MSC in the
+// application's tusb_config.h; the callbacks run inside tud_task().
+void msc_disk_usb_bind(msc_disk_t *d);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+/* [] END OF FILE */
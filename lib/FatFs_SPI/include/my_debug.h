@@ -31,6 +31,11 @@ extern "C" {
 
 #ifdef NDEBUG           /* required by ANSI standard */
 # define DBG_PRINTF(fmt, args...) {} /* Don't do anything in release builds*/
+#elif PICO_ON_DEVICE
+/* Deferred: the driver prints from inside SD transfers, where waiting for
+   the USB host would stretch them; dlog_drain() prints later */
+# include "dlog.h"
+# define DBG_PRINTF(fmt, args...) DLOG_PRINTF(fmt, ##args)
 #else
 # define DBG_PRINTF my_printf
 #endif
@@ -0,0 +1,97 @@
+/* prof.h
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Sampling profiler.
+//
+// A hardware timer alarm interrupts core 0 at a set rate, at the highest
+// priority, so it also lands inside other interrupt handlers. Its handler
+// reads the interrupted PC and LR from the exception stack frame and scans
+// the words above the frame for return addresses: odd values in flash whose
+// preceding instruction is a BL or BLX. Without frame pointers this is a
+// guess (a stale return address left in a local can show up), but it is
+// cheap and good enough to see who called the hot spot. Each sample adds one
+// to the count of its (pc, lr, return addresses) key in a hash table, so
+// long runs cost no more memory than short ones; when the table is full the
+// sample is counted as dropped.
+//
+// prof_print() dumps the table as PROF_LINE_TAG lines; host/tools/prof_report
+// turns them, with the .elf, into a flat profile per function and folded
+// stacks for flame graph tools.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef PROF_SLOTS
+#define PROF_SLOTS 512  // Distinct stacks kept; a power of two
+#endif
+#define PROF_DEPTH 4         // Return addresses kept per sample, innermost first
+#define PROF_SCAN_WORDS 64   // Stack words looked at above the exception frame
+#define PROF_PROBES 8        // Hash table slots tried before dropping a sample
+
+// Addresses taken for code: the XIP flash window
+#ifndef PROF_CODE_START
+#define PROF_CODE_START 0x10000000u
+#define PROF_CODE_END 0x11000000u
+#endif
+
+#define PROF_LINE_TAG "prof:"
+#define PROF_FORMAT_VERSION 1
+
+typedef struct prof_entry {
+    uint32_t count;  // 0: free slot
+    uint32_t pc;
+    uint32_t lr;
+    uint32_t ret[PROF_DEPTH];  // 0 past the last one found
+} prof_entry_t;
+
+typedef struct prof_stats {
+    uint32_t hz;       // 0 when stopped
+    uint32_t samples;  // Kept in the table
+    uint32_t dropped;  // Table full
+    uint32_t missed;   // Taken while the table was being printed
+} prof_stats_t;
+
+// Adds a sample: the interrupted pc and lr, and the stack from sp up to
+// end (exclusive) to look for return addresses in. The timer handler calls
+// it; it builds on the host too, for the tests.
+void prof_sample(uint32_t pc, uint32_t lr, const uint32_t *sp, const uint32_t *end);
+
+// Starts sampling at hz (10 to 10000) on a free hardware alarm; false if
+// none is free or hz is out of range. Keeps what was already collected.
+bool prof_start(uint32_t hz);
+void prof_stop(void);
+void prof_reset(void);
+void prof_get_stats(prof_stats_t *stats);
+const prof_entry_t *prof_table(void);
+
+// Prints the header, "prof: version hz samples dropped missed entries", then
+// one line per stack: count, pc, lr and the return addresses, in hex.
+// Sampling is paused while printing.
+void prof_print(void);
+
+// prof_print() in pieces, for a polled loop: begin prints the header and
+// pauses sampling, each step prints up to max entries and returns true,
+// sampling again, once all are out.
+void prof_print_begin(void);
+bool prof_print_step(unsigned max);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,104 @@
+/* ring_log.h
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+// Circular log in a preallocated file.
+//
+// The file is allocated once, contiguously (f_expand), and from then on is
+// written sector by sector with disk_write(): no FAT, directory or FSINFO
+// update ever happens again, so the cost of a write is the same on the first
+// day and after years of wrap-arounds. The first sector holds a superblock;
+// every other sector is a self-describing block (ring id, sequence number,
+// timestamps, CRC) so that the time-ordered stream can be rebuilt from the
+// file alone (see host/tools/ring_dump.cpp). Block seq always lives in data
+// slot seq % nslots, which lets ring_log_open() find the head with a binary
+// search instead of reading the whole file (all of it only if slot 0, the
+// first block of every lap, is damaged).
+//
+// The on-card structures are little-endian and shared with the host tool.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+//
+#include "ff.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RING_LOG_BLOCK_SIZE 512
+#define RING_LOG_SUPER_MAGIC 0x53474E52  // "RNGS"
+#define RING_LOG_BLOCK_MAGIC 0x42474E52  // "RNGB"
+#define RING_LOG_VERSION 1
+#define RING_LOG_NO_REC 0xFFFF
+
+typedef struct ring_log_super {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t block_size;
+    uint32_t nslots;   // Data blocks following the superblock
+    uint32_t id;       // Tells this ring's blocks from stale data in the file
+    uint32_t created;  // Seconds since the epoch (0 if the RTC was not set)
+    uint32_t checksum;  // last, not included in checksum
+} ring_log_super_t;
+
+typedef struct ring_log_blk_hdr {
+    uint32_t magic;
+    uint32_t id;         // ring_log_super_t.id
+    uint32_t seq;        // Block sequence number; lives in data slot seq % nslots
+    uint32_t time;       // Seconds since the epoch when the block was started
+    uint64_t uptime_us;  // time_us_64() when the block was started
+    uint16_t len;        // Payload bytes in use
+    uint16_t first_rec;  // Offset of the first record starting here, or RING_LOG_NO_REC
+    uint16_t crc;        // CRC16 (crc.c) of the header with crc = 0, then payload[0, len)
+    uint16_t reserved;
+} ring_log_blk_hdr_t;
+
+#define RING_LOG_PAYLOAD (RING_LOG_BLOCK_SIZE - sizeof(ring_log_blk_hdr_t))
+
+typedef struct ring_log_blk {
+    ring_log_blk_hdr_t hdr;
+    uint8_t payload[RING_LOG_PAYLOAD];
+} ring_log_blk_t;
+
+typedef struct ring_log {
+    BYTE pdrv;
+    LBA_t lba;        // Superblock sector; data slot i is at lba + 1 + i
+    uint32_t nslots;
+    uint32_t id;
+    uint32_t seq;     // Block being filled
+    bool dirty;       // blk has data not yet written
+    uint32_t blocks_written;
+    ring_log_blk_t blk __attribute__((aligned(4)));
+} ring_log_t;
+
+// Opens the ring file at path, creating and preallocating it with size bytes
+// if it does not exist (an existing ring keeps its own size). Appending
+// resumes after the newest block found.
+FRESULT ring_log_open(ring_log_t *rl, const TCHAR *path, FSIZE_t size);
+
+// Appends one record. Records may span blocks; full blocks are written at once.
+FRESULT ring_log_write(ring_log_t *rl, const void *data, UINT len);
+
+// Writes the partially filled block. It is rewritten in place as it fills, so
+// this costs one sector write and never advances the ring.
+FRESULT ring_log_flush(ring_log_t *rl);
+
+// Flushes and asks the card to commit its caches (CTRL_SYNC).
+FRESULT ring_log_close(ring_log_t *rl);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,115 @@
+/* session.h
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+// Capture session files.
+//
+// Every capture goes to its own file, /YYYYMMDD/NNNN.<ext>, where NNNN is a
+// sequence number that never repeats on the volume. The file is a
+// crash-consistent log (crash_log.h). Instead of searching the
+// directories for a free name, the next number and a fixed-size record per
+// session (start time, sample count, size) are kept in a catalog file in the
+// root directory. Creating, finding and listing sessions reads the catalog
+// header and records by offset; no directory is scanned. Each file gets a
+// sparse time index, NNNN.tix (log_index.h), for range queries.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+//
+#include "ff.h"
+#include "sd_card.h"
+//
+#include "crash_log.h"
+#include "log_index.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SESSION_CATALOG_FILE "sessions.idx"
+#ifndef SESSION_FILE_EXT
+#define SESSION_FILE_EXT "log"
+#endif
+
+// Catalog record. Also written while the session is open (closed == 0), so a
+// session interrupted by a reset is still listed until session_recover()
+// completes it.
+typedef struct session_info {
+    uint32_t seq;      // NNNN in the file name
+    uint32_t date;     // YYYYMMDD, the directory name (0 if the RTC was not set)
+    uint32_t start;    // Start time, seconds since the epoch (0 if unknown)
+    uint32_t records;  // Records (crash_log_write() calls) in the file
+    uint32_t size;     // File size in bytes
+    uint32_t closed;   // SESSION_OPEN, SESSION_CLOSED or SESSION_RECOVERED
+    uint32_t checksum;  // last, not included in checksum
+} session_info_t;
+
+enum { SESSION_OPEN = 0, SESSION_CLOSED = 1, SESSION_RECOVERED = 2 };
+
+typedef struct session {
+    sd_card_t *pSD;
+    FIL fil;  // Open for writing between session_create() and session_close()
+    crash_log_t log;
+    log_index_t tix;  // NNNN.tix next to the file (log_index.h)
+    session_info_t info;
+    uint32_t index;  // Record number in the catalog
+    char path[32];   // e.g. "0:/20251019/0042.log"
+} session_t;
+
+// Creates the next session file and opens it for writing.
+FRESULT session_create(sd_card_t *pSD, session_t *s);
+
+// Like session_create(), but the file is allocated now as one contiguous
+// extent of size bytes and written straight to its sectors, with no FatFs
+// call until session_close() trims it (crash_log_start_extent()). burst, of
+// burst_blocks blocks, collects full blocks into multi-block writes and must
+// stay valid until the session is closed; it may be NULL. session_write()
+// returns FR_DENIED once the extent is full. The time index is written by
+// session_close(), from the block headers.
+FRESULT session_create_extent(sd_card_t *pSD, session_t *s, FSIZE_t size,
+                              crash_log_blk_t *burst, uint32_t burst_blocks);
+
+// Appends one record (e.g. a CSV line)
+FRESULT session_write(session_t *s, const void *data, UINT len);
+
+// Makes all records written so far durable (one sector write)
+FRESULT session_flush(session_t *s);
+
+// Closes the file and completes its catalog record.
+FRESULT session_close(session_t *s);
+
+// Completes the newest session if a reset left it open: trims the file to
+// its last valid block and fills in its catalog record. Returns FR_OK with
+// *recovered false if there was nothing to do. info and rec may be NULL.
+FRESULT session_recover(sd_card_t *pSD, bool *recovered, session_info_t *info,
+                        crash_log_recovery_t *rec);
+
+// Number of sessions in the catalog and the sequence number the next one
+// will get.
+FRESULT session_count(sd_card_t *pSD, uint32_t *count, uint32_t *next_seq);
+
+// Reads catalog record index (0 = oldest).
+FRESULT session_get(sd_card_t *pSD, uint32_t index, session_info_t *info);
+
+// Calls cb for every catalog record, oldest first, until it returns false.
+typedef bool (*session_list_cb_t)(const session_info_t *info, void *arg);
+FRESULT session_list(sd_card_t *pSD, session_list_cb_t cb, void *arg);
+
+// Formats the path of a session's file.
+void session_path(sd_card_t *pSD, const session_info_t *info, char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,110 @@
+/* shell.h
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Line command shell for a polled main loop.
+//
+// shell_poll() takes at most `budget` characters from a non-blocking input
+// function and runs at most one command per call, so a burst of input costs
+// the loop a bounded amount of time per iteration. A command that has more
+// to do than fits in one iteration (listing a directory, a benchmark) starts
+// a job with shell_job(); its step function is then called once per
+// shell_poll(), and no new line is read until it says it is done.
+//
+// Lines are split into words at spaces and tabs; double quotes keep spaces
+// in a word. The command is looked up in a table given by the caller, its
+// word count checked, and its function called with argc/argv as in main().
+// "help" lists the table. Nothing here touches the hardware: input and
+// output are the caller's functions, so the shell builds and is tested on
+// the host (host/tools/shell_test).
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef SHELL_LINE_MAX
+#define SHELL_LINE_MAX 96
+#endif
+#define SHELL_ARGS_MAX 8
+
+// Returns the next input character, or -1 if none is waiting
+typedef int (*shell_getc_t)(void);
+// printf-like output
+typedef int (*shell_printf_t)(const char *fmt, ...);
+
+// argv[0] is the command name. Returns 0, or nonzero after printing why not.
+typedef int (*shell_fn_t)(int argc, char **argv);
+// A step of a job; returns true when the job is done
+typedef bool (*shell_step_t)(void);
+
+typedef struct shell_cmd {
+    const char *name;
+    const char *args;  // For help, e.g. "<path> [offset]"
+    const char *help;
+    uint8_t min_args;  // Words after the name
+    uint8_t max_args;
+    shell_fn_t fn;
+} shell_cmd_t;
+
+typedef struct shell_stats {
+    uint32_t lines;     // Lines run, empty ones excluded
+    uint32_t errors;    // Unknown commands, bad word counts, failed commands
+    uint32_t overflow;  // Lines dropped for being too long
+    uint32_t steps;     // Job steps run
+} shell_stats_t;
+
+typedef struct shell {
+    const shell_cmd_t *cmds;
+    size_t ncmds;
+    shell_getc_t get_char;
+    shell_printf_t print;
+    char line[SHELL_LINE_MAX];
+    size_t len;
+    bool overflow;  // The line being read is too long: dropped at its end
+    char last;      // Previous character, to take "\r\n" as one end of line
+    shell_step_t job;
+    shell_stats_t stats;
+} shell_t;
+
+void shell_init(shell_t *sh, const shell_cmd_t *cmds, size_t ncmds, shell_getc_t get_char,
+                shell_printf_t print);
+
+// Runs a step of the current job, or reads up to budget characters and runs
+// the line they complete, if any. Returns true if anything was done.
+bool shell_poll(shell_t *sh, unsigned budget);
+
+// Runs one line (modified in place) as if it had been typed.
+// Returns the command's result; -1 for an empty or rejected line.
+int shell_exec(shell_t *sh, char *line);
+
+// From a command: calls step once per shell_poll() until it returns true
+void shell_job(shell_t *sh, shell_step_t step);
+
+static inline bool shell_busy(const shell_t *sh) { return sh->job != NULL; }
+
+// Splits line in place into at most max words; returns the count, or -1 if
+// there are more words or a quote is not closed.
+int shell_split(char *line, char **argv, int max);
+
+// Parses an unsigned number (decimal, or 0x hex) in [min, max]
+bool shell_parse_u32(const char *s, uint32_t min, uint32_t max, uint32_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,185 @@
+/* sink.h
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Storage sinks: where the capture pipeline puts its records.
+//
+// A sink_t pairs an implementation (sink_ops_t) with its state and is used
+// through sink_open(), sink_append() (a batch of records), sink_flush() (the
+// records appended so far become durable) and sink_close(). Every call
+// returns an FRESULT; FR_DENIED means the sink is full. Capability flags tell
+// the pipeline what it can rely on, e.g. whether flush survives a power cut
+// or whether the data is lost with the card.
+//
+// Implementations:
+//   sink_mem_init()     - RAM buffer, for tests and host benchmarks
+//   sink_file_init()    - crash-consistent log file (crash_log.h) at a path
+//   sink_raw_init()     - crash_log blocks written straight to a range of
+//                         sectors, with no file system calls
+//   sink_flash_init()   - the internal flash log (flash_log.h)
+//   sink_session_init() - a new session file per open (session.h), device only
+//   sink_extent_init()  - the same, but each file a preallocated extent
+//                         written like sink_raw (device only)
+//   sink_ring_init()    - the preallocated ring file (ring_log.h), device only
+//
+// sink_write() has the signature of spill_write_t and flash_log_write_t, so
+// those buffers drain straight into a sink.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+//
+#include "ff.h"
+//
+#include "crash_log.h"
+#include "flash_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    SINK_CAP_DURABLE = 1 << 0,  // After sink_flush() records survive a power cut
+    SINK_CAP_CARD = 1 << 1,     // Stored on the SD card: lost if it is removed
+    SINK_CAP_FILE = 1 << 2,     // Readable as a file on the card
+    SINK_CAP_BOUNDED = 1 << 3,  // Fixed capacity: fills up, or wraps
+    SINK_CAP_WRAPS = 1 << 4,    // When full, overwrites the oldest records
+    SINK_CAP_NO_FS = 1 << 5,    // No file system calls between open and close
+};
+
+// Blocks collected into one multi-block write by the raw sinks
+#ifndef SINK_BURST
+#define SINK_BURST 8
+#endif
+
+typedef struct sink_rec {
+    const void *data;
+    size_t len;
+} sink_rec_t;
+
+typedef struct sink_ops {
+    const char *name;
+    uint32_t caps;
+    FRESULT (*open)(void *ctx);
+    FRESULT (*append)(void *ctx, const sink_rec_t *recs, size_t n);
+    FRESULT (*flush)(void *ctx);
+    FRESULT (*close)(void *ctx);
+} sink_ops_t;
+
+typedef struct sink_stats {
+    uint32_t records;
+    uint32_t batches;  // sink_append() calls
+    uint32_t flushes;
+    uint32_t errors;
+    uint64_t bytes;
+} sink_stats_t;
+
+typedef struct sink {
+    const sink_ops_t *ops;
+    void *ctx;
+    bool open;
+    sink_stats_t stats;
+} sink_t;
+
+FRESULT sink_open(sink_t *sk);
+FRESULT sink_append(sink_t *sk, const sink_rec_t *recs, size_t n);
+FRESULT sink_flush(sink_t *sk);
+FRESULT sink_close(sink_t *sk);
+
+// One record; sk is a sink_t *. Returns an FRESULT.
+int sink_write(void *sk, const void *rec, size_t len);
+
+static inline bool sink_has(const sink_t *sk, uint32_t caps) {
+    return (sk->ops->caps & caps) == caps;
+}
+static inline const char *sink_name(const sink_t *sk) { return sk->ops->name; }
+
+/* RAM */
+
+typedef struct sink_mem {
+    uint8_t *buf;
+    size_t size;
+    size_t used;
+    bool wrap;  // Start over when full instead of failing
+    uint32_t wraps;
+} sink_mem_t;
+
+void sink_mem_init(sink_t *sk, sink_mem_t *m, void *buf, size_t size, bool wrap);
+
+/* Crash-consistent log file */
+
+typedef struct sink_file {
+    const TCHAR *path;
+    FIL fil;
+    crash_log_t log;
+} sink_file_t;
+
+void sink_file_init(sink_t *sk, sink_file_t *f, const TCHAR *path);
+
+/* Raw sectors */
+
+typedef struct sink_raw {
+    BYTE pdrv;
+    LBA_t lba;
+    uint32_t blocks;
+    crash_log_t log;
+    crash_log_blk_t burst[SINK_BURST];
+} sink_raw_t;
+
+void sink_raw_init(sink_t *sk, sink_raw_t *r, BYTE pdrv, LBA_t lba, uint32_t blocks);
+
+/* Internal flash; fl must be mounted */
+
+void sink_flash_init(sink_t *sk, flash_log_t *fl);
+
+#if PICO_ON_DEVICE
+
+#include "ring_log.h"
+#include "session.h"
+
+/* One session file per open */
+
+void sink_session_init(sink_t *sk, session_t *s, sd_card_t *pSD);
+
+/* One session file per open, each a preallocated extent of size bytes. When
+   one is full the session goes on in the next file: the only file system calls
+   between open and close. sink_open() fails with
+   FR_DENIED if the card has no contiguous free space that large. */
+
+typedef struct sink_extent {
+    session_t *s;
+    FSIZE_t size;
+    uint32_t files;  // Files used since sink_open()
+    crash_log_blk_t burst[SINK_BURST];
+} sink_extent_t;
+
+void sink_extent_init(sink_t *sk, sink_extent_t *e, session_t *s, sd_card_t *pSD,
+                      FSIZE_t size);
+
+/* Ring file */
+
+typedef struct sink_ring {
+    char path[32];
+    FSIZE_t size;
+    ring_log_t rl;
+} sink_ring_t;
+
+void sink_ring_init(sink_t *sk, sink_ring_t *r, const TCHAR *path, FSIZE_t size);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,82 @@
+/* spill.h
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Bounded spill buffer for records on their way to the card.
+//
+// A FIFO of variable length records in a caller supplied byte array, with
+// two read cursors:
+//   sent - records before it were handed to the card (spill_drain());
+//   tail - records before it are durable (spill_commit() after a sync).
+// Records between tail and sent were written but not synced yet, so they
+// would be lost with the card. spill_rewind() moves sent back to tail, and
+// the next drain writes them again (to a new file, after the card came
+// back): a record may then appear twice, never zero times. While the card is
+// missing, records pile up after sent; when the buffer is full new records
+// are dropped and counted.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct spill_stats {
+    uint32_t records;   // Accepted by spill_put()
+    uint32_t dropped;   // Rejected by spill_put(): buffer full
+    uint32_t drained;   // Written by spill_drain(), including rewritten ones
+    uint32_t rewound;   // Records sent again after spill_rewind()
+    uint32_t peak;      // Highest buffer use in bytes
+} spill_stats_t;
+
+typedef struct spill {
+    uint8_t *buf;
+    size_t size;
+    size_t tail, sent, head;  // Byte offsets, each < size
+    size_t used;              // Bytes from tail to head
+    size_t sent_bytes;        // Bytes from tail to sent
+    uint32_t pending;         // Records from sent to head
+    uint32_t unsynced;        // Records from tail to sent
+    spill_stats_t stats;
+} spill_t;
+
+// Longest record accepted (one length byte)
+#define SPILL_MAX_RECORD 255
+
+void spill_init(spill_t *sp, void *buf, size_t size);
+
+// Appends a record. Returns false (and counts a drop) if it does not fit.
+bool spill_put(spill_t *sp, const void *rec, size_t len);
+
+// Writes the records after sent, in order, with write(ctx, rec, len), which
+// returns 0 on success. Stops at the first failure and returns its result;
+// the failed record stays pending.
+typedef int (*spill_write_t)(void *ctx, const void *rec, size_t len);
+int spill_drain(spill_t *sp, spill_write_t write, void *ctx);
+
+// Everything drained so far is durable: releases its space.
+void spill_commit(spill_t *sp);
+
+// The card was lost: records drained since the last commit are pending again.
+void spill_rewind(spill_t *sp);
+
+static inline uint32_t spill_pending(const spill_t *sp) { return sp->pending; }
+static inline const spill_stats_t *spill_stats(const spill_t *sp) { return &sp->stats; }
+
+#ifdef __cplusplus
+}
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,143 @@
+/* stage_timer.h
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Time per stage of a processing pipeline.
+//
+// The application numbers its stages (0 to STAGE_TIMER_MAX - 1) and names
+// them in stage_timer_init(). STAGE_SCOPE(stage) at the top of a block times
+// the rest of the block (the end is run by the compiler's cleanup attribute,
+// so early returns are counted too); stage_timer_add() takes a duration
+// measured otherwise. Each stage keeps count, min, max, sum and a log2
+// histogram of its durations in static storage, as sd_stats.h does for the
+// card.
+//
+// Ticks are microseconds (SD_STATS_NOW_US()) by default. With
+// STAGE_TIMER_CYCLES=1 on the device they are CPU cycles from the core's
+// SysTick, which counts only 24 bits: stages longer than 2^24 cycles (134 ms
+// at 125 MHz) wrap. Updates are not atomic: time stages from one core.
+// Build with STAGE_TIMER=0 and the macros expand to nothing.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+//
+#include "sd_stats.h"  // SD_STATS_NOW_US()
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef STAGE_TIMER
+#define STAGE_TIMER 1
+#endif
+#ifndef STAGE_TIMER_CYCLES
+#define STAGE_TIMER_CYCLES 0
+#endif
+
+#define STAGE_TIMER_MAX 12
+// Bucket 0: < 2 ticks; bucket i: [2^i, 2^(i+1)); the last one is open ended
+#define STAGE_TIMER_N_BUCKETS 28
+
+typedef struct stage_timer_stats {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t bucket[STAGE_TIMER_N_BUCKETS];
+} stage_timer_stats_t;
+
+#if STAGE_TIMER
+
+#if STAGE_TIMER_CYCLES && PICO_ON_DEVICE
+#include "hardware/structs/systick.h"
+#define STAGE_TIMER_MASK 0xffffffu
+static inline uint32_t stage_timer_now(void) { return STAGE_TIMER_MASK - systick_hw->cvr; }
+#else
+#define STAGE_TIMER_MASK 0xffffffffu
+static inline uint32_t stage_timer_now(void) { return SD_STATS_NOW_US(); }
+#endif
+
+extern stage_timer_stats_t stage_timer_stats[STAGE_TIMER_MAX];
+
+// names: n short names (shown on a 128 pixel display: 5 characters or so)
+void stage_timer_init(const char *const *names, unsigned n);
+void stage_timer_reset(void);
+
+static inline void stage_timer_add(unsigned stage, uint32_t ticks) {
+    stage_timer_stats_t *s = &stage_timer_stats[stage];
+    unsigned b = ticks < 2 ? 0 : 31 - __builtin_clz(ticks);
+    if (b >= STAGE_TIMER_N_BUCKETS) b = STAGE_TIMER_N_BUCKETS - 1;
+    if (!s->count || ticks < s->min) s->min = ticks;
+    if (ticks > s->max) s->max = ticks;
+    s->count++;
+    s->sum += ticks;
+    s->bucket[b]++;
+}
+
+typedef struct stage_scope {
+    unsigned stage;
+    uint32_t t0;
+} stage_scope_t;
+
+static inline stage_scope_t stage_scope_begin(unsigned stage) {
+    stage_scope_t sc = {stage, stage_timer_now()};
+    return sc;
+}
+static inline void stage_scope_end(stage_scope_t *sc) {
+    stage_timer_add(sc->stage, (stage_timer_now() - sc->t0) & STAGE_TIMER_MASK);
+}
+
+#define STAGE_CAT_(a, b) a##b
+#define STAGE_XCAT_(a, b) STAGE_CAT_(a, b)
+#define STAGE_SCOPE(stage)                                                    \
+    stage_scope_t STAGE_XCAT_(stage_scope_, __LINE__)                         \
+        __attribute__((cleanup(stage_scope_end), unused)) = stage_scope_begin(stage)
+
+// Upper bound of the bucket holding the p-th percentile (p in 0..100), in ticks
+uint32_t stage_timer_percentile(unsigned stage, unsigned p);
+// Ticks per microsecond, to show the numbers in us
+uint32_t stage_timer_ticks_per_us(void);
+
+// Prints a line per stage that ran: count, min, mean, p50, p99, max (us), the
+// total and, if ref is a stage, the total as a share of ref's (e.g. ref
+// times the whole sample, the others its parts), then the buckets.
+void stage_timer_print(int ref);
+
+// Lines of at most `width` characters, "name mean max" (us), one per stage
+// that ran, for a display. Returns the number of lines written.
+unsigned stage_timer_lines(char lines[][24], unsigned max_lines, unsigned width);
+
+#else
+
+static inline void stage_timer_init(const char *const *names, unsigned n) {
+    (void)names;
+    (void)n;
+}
+static inline void stage_timer_reset(void) {}
+#define stage_timer_add(stage, ticks) ((void)0)
+#define STAGE_SCOPE(stage)
+static inline void stage_timer_print(int ref) { (void)ref; }
+static inline unsigned stage_timer_lines(char lines[][24], unsigned max_lines, unsigned width) {
+    (void)lines;
+    (void)max_lines;
+    (void)width;
+    return 0;
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,79 @@
+/* sync_policy.h
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+// Adaptive sync interval.
+//
+// Decides when buffered data should be made durable (f_sync(),
+// session_flush(), ring_log_flush(), ...) from two budgets instead of a fixed
+// sample count:
+//   - max_risk_ms: data may stay unsynced for at most this long;
+//   - max_cost_permille: syncing may take at most this share of wall time.
+// Each sync is timed. The interval is the smallest that keeps the measured
+// sync cost within its share, never more than the risk budget. A sync much
+// slower than usual (card garbage collection) raises the cost estimate at
+// once and doubles a back-off factor, so the controller syncs less often
+// while the card is busy and returns to its normal rate as syncs get fast
+// again. Times are passed in by the caller (microseconds, any epoch).
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct sync_policy_cfg {
+    uint32_t max_risk_ms;        // Upper bound on the age of unsynced data
+    uint32_t min_interval_ms;    // Lower bound on the interval
+    uint32_t max_cost_permille;  // Target share of time spent syncing
+} sync_policy_cfg_t;
+
+typedef struct sync_policy_metrics {
+    uint32_t syncs;
+    uint32_t stalls;        // Syncs slower than SYNC_POLICY_STALL_FACTOR * average
+    uint64_t total_us;      // Time spent syncing
+    uint32_t last_us;
+    uint32_t max_us;
+    uint32_t avg_us;        // Running estimate used by the controller
+    uint32_t interval_ms;   // Current sync interval
+    uint32_t max_risk_ms;   // Oldest unsynced data actually seen at a sync
+} sync_policy_metrics_t;
+
+typedef struct sync_policy {
+    sync_policy_cfg_t cfg;
+    sync_policy_metrics_t m;
+    uint8_t backoff;        // Interval multiplier after stalls (1, 2, 4, 8)
+    bool pending;           // Unsynced data
+    uint64_t oldest_us;     // When the oldest unsynced data was written
+} sync_policy_t;
+
+#define SYNC_POLICY_STALL_FACTOR 4
+
+void sync_policy_init(sync_policy_t *sp, const sync_policy_cfg_t *cfg);
+
+// Call after every write. Returns true if a sync is due now.
+bool sync_policy_wrote(sync_policy_t *sp, uint64_t now_us);
+
+// Call after every sync with its start and end times.
+void sync_policy_synced(sync_policy_t *sp, uint64_t start_us, uint64_t end_us);
+
+static inline const sync_policy_metrics_t *sync_policy_metrics(const sync_policy_t *sp) {
+    return &sp->m;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+/* [] END OF FILE */
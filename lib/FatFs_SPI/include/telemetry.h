@@ -0,0 +1,123 @@
+/* telemetry.h
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Binary sample stream over a byte link (USB CDC).
+//
+// Samples are collected in batches of up to TELEMETRY_BATCH and sent as one
+// frame: a telemetry_hdr_t (frame sequence number, number of the first
+// sample, its time), the samples as telemetry_sample_t (time relative to the
+// first, the four channels, a color code) and a CRC16 (crc.c). A batch goes
+// out when it is full, when a sample is more than TELEMETRY_MAX_AGE_MS older
+// than the first one, or on telemetry_flush(). Sample numbers in a frame are
+// consecutive; a sample that does not follow the batch starts a new one.
+//
+// Frames are COBS encoded (no zero bytes inside) with a zero byte before and
+// after each one, so a receiver finds frame boundaries with no state, and
+// text printed between frames ends up as a frame of its own that fails the
+// CRC. Gaps show as jumps in the sequence and sample numbers.
+//
+// telemetry_rx_feed() is the receiving side, for the host tool.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TELEMETRY_MAGIC 0x54  // 'T': type of a batch frame
+#ifndef TELEMETRY_BATCH
+#define TELEMETRY_BATCH 16
+#endif
+#ifndef TELEMETRY_MAX_AGE_MS
+#define TELEMETRY_MAX_AGE_MS 1000
+#endif
+
+typedef struct telemetry_hdr {
+    uint8_t type;    // TELEMETRY_MAGIC
+    uint8_t count;   // Samples in the frame, 1 to TELEMETRY_BATCH
+    uint16_t reserved;
+    uint32_t seq;    // Frame number since telemetry_init()
+    uint32_t first;  // Number of the first sample
+    uint32_t t0_ms;  // Its time, milliseconds since boot
+} telemetry_hdr_t;
+
+typedef struct telemetry_sample {
+    uint16_t dt_ms;  // Time after t0_ms
+    uint16_t c, r, g, b;
+    uint8_t color;   // Application defined code
+    uint8_t reserved;
+} telemetry_sample_t;
+
+// Largest frame before and after encoding (one COBS code byte per 254)
+#define TELEMETRY_FRAME_MAX \
+    (sizeof(telemetry_hdr_t) + TELEMETRY_BATCH * sizeof(telemetry_sample_t) + 2)
+#define TELEMETRY_WIRE_MAX (TELEMETRY_FRAME_MAX + TELEMETRY_FRAME_MAX / 254 + 1 + 2)
+
+// Takes an encoded frame, delimiters included
+typedef void (*telemetry_out_t)(const void *data, size_t len);
+
+typedef struct telemetry {
+    telemetry_out_t out;
+    telemetry_hdr_t hdr;  // Of the batch being collected
+    telemetry_sample_t samples[TELEMETRY_BATCH];
+    uint32_t frames;      // Sent
+    uint64_t bytes;       // Sent, after encoding
+} telemetry_t;
+
+void telemetry_init(telemetry_t *t, telemetry_out_t out);
+
+// Adds sample number n, taken at t_ms; sends the batch when it is due.
+void telemetry_put(telemetry_t *t, uint32_t n, uint32_t t_ms, uint16_t c, uint16_t r,
+                   uint16_t g, uint16_t b, uint8_t color);
+
+// Sends the samples collected so far, if any
+void telemetry_flush(telemetry_t *t);
+
+// COBS: encodes len bytes (out needs len + len / 254 + 1) or decodes them
+// (out needs len). Both return the bytes written; decode returns 0 if the
+// input is not valid COBS.
+size_t cobs_encode(const uint8_t *in, size_t len, uint8_t *out);
+size_t cobs_decode(const uint8_t *in, size_t len, uint8_t *out);
+
+/* Receiver */
+
+typedef struct telemetry_rx {
+    uint8_t buf[TELEMETRY_WIRE_MAX];
+    size_t have;
+    bool overflow;     // The frame being collected is too long: dropped
+    uint32_t frames;   // Valid frames
+    uint32_t bad;      // Non-empty frames that failed decoding or the CRC
+    uint32_t lost;     // Frames missing from the sequence
+    uint32_t next_seq;
+    bool synced;       // A valid frame was seen: next_seq is meaningful
+} telemetry_rx_t;
+
+// Called for each valid frame
+typedef void (*telemetry_rx_cb_t)(void *arg, const telemetry_hdr_t *h,
+                                  const telemetry_sample_t *samples);
+
+void telemetry_rx_init(telemetry_rx_t *rx);
+
+// Parses the next len bytes of the stream, calling cb for every valid frame
+// completed by them.
+void telemetry_rx_feed(telemetry_rx_t *rx, const void *data, size_t len, telemetry_rx_cb_t cb,
+                       void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* [] END OF FILE */
@@ -170,6 +170,8 @@ specific language governing permissions and limitations under the License.
 #include "sd_spi.h"
 //
 #include "sd_card.h"
+#include "sd_stats.h"
+#include "sd_trace.h"
 //
 #include "ff.h" /* Obtains integer types */
 //
@@ -179,6 +181,8 @@ specific language governing permissions and limitations under the License.
 #define SD_CRC_ENABLED 1
 #endif
 
+#include "util.h"  // calculate_checksum (also the warm start record)
+
 #if SD_CRC_ENABLED
 #include "crc.h"
 static bool crc_on = true;
@@ -346,8 +350,23 @@ static uint8_t sd_cmd_spi(sd_card_t *pSD, cmdSupported cmd, uint32_t arg) {
     return response;
 }
 
+#if SD_STATS
+// Operation being timed; NULL outside sd_read_blocks()/sd_write_blocks()
+static sd_stats_acc_t *stats_acc;
+#define STATS_START() uint32_t stats_t0 = SD_STATS_NOW_US()
+#define STATS_ADD(phase)                                                     \
+    do {                                                                     \
+        if (stats_acc) stats_acc->us[phase] += SD_STATS_NOW_US() - stats_t0; \
+    } while (0)
+#else
+#define STATS_START()
+#define STATS_ADD(phase) do {} while (0)
+#endif
+
 static bool sd_wait_ready(sd_card_t *pSD, int timeout) {
     char resp;
+    uint32_t t0 = SD_STATS_NOW_US();
+    STATS_START();
 
     // Keep sending dummy clocks with DI held high until the card releases the
     // DO line
@@ -357,7 +376,11 @@ static bool sd_wait_ready(sd_card_t *pSD, int timeout) {
     } while (resp == 0x00 &&
              0 < absolute_time_diff_us(get_absolute_time(), timeout_time));
 
-    if (resp == 0x00) DBG_PRINTF("%s failed\r\n", __FUNCTION__);
+    if (resp == 0x00) {
+        sd_trace(SD_TRACE_BUSY_TMO, 0, timeout, 0, t0);
+        DBG_PRINTF("%s failed\r\n", __FUNCTION__);
+    }
+    STATS_ADD(SD_STATS_BUSY);
 
     // Return success/failure
     return (resp > 0x00);
@@ -450,10 +473,8 @@ static const char *cmd2str(const cmdSupported cmd) {
 #define SD_COMMAND_RETRIES 3 /*!< Times SPI cmd is retried when there is no response */
 #define SD_COMMAND_TIMEOUT 2000 /*!< Timeout in ms for response */
 
-static int sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
-                  bool isAcmd, uint32_t *resp) {
-    TRACE_PRINTF("%s(%s(0x%08lx)): ", __FUNCTION__, cmd2str(cmd), arg);
-
+static int in_sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
+                     bool isAcmd, uint32_t *resp) {
     int32_t status = SD_BLOCK_DEVICE_ERROR_NONE;
     uint32_t response;
 
@@ -611,6 +632,26 @@ static int sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
     return status;
 }
 
+// Command phase: the time in in_sd_cmd() minus its waits for the card.
+// Every command also goes to the trace ring with its response.
+static int sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
+                  bool isAcmd, uint32_t *resp) {
+    uint32_t t0 = SD_STATS_NOW_US();
+#if SD_STATS
+    uint32_t busy0 = stats_acc ? stats_acc->us[SD_STATS_BUSY] : 0;
+#endif
+    uint32_t response = R1_NO_RESPONSE;
+    int status = in_sd_cmd(pSD, cmd, arg, isAcmd, &response);
+#if SD_STATS
+    if (stats_acc)
+        stats_acc->us[SD_STATS_CMD] += SD_STATS_NOW_US() - t0 -
+                                       (stats_acc->us[SD_STATS_BUSY] - busy0);
+#endif
+    sd_trace(SD_TRACE_CMD, cmd | (isAcmd ? SD_TRACE_ACMD : 0), arg, response, t0);
+    if (resp) *resp = response;
+    return status;
+}
+
 /* Return non-zero if the SD-card is present. */
 bool sd_card_detect(sd_card_t *pSD) {
     TRACE_PRINTF("> %s\r\n", __FUNCTION__);
@@ -753,6 +794,8 @@ static uint64_t sd_sectors_nolock(sd_card_t *pSD) {
     return blocks;
 }
 uint64_t sd_sectors(sd_card_t *pSD) {
+    // Read from the CSD at init
+    if (!(pSD->m_Status & STA_NOINIT) && pSD->sectors) return pSD->sectors;
     sd_acquire(pSD);
     uint64_t sectors = sd_sectors_nolock(pSD);
     sd_release(pSD);
@@ -761,15 +804,18 @@ uint64_t sd_sectors(sd_card_t *pSD) {
 
 // SPI function to wait till chip is ready and sends start token
 static bool sd_wait_token(sd_card_t *pSD, uint8_t token) {
-    TRACE_PRINTF("%s(0x%02hhx)\r\n", __FUNCTION__, token);
-
     const uint32_t timeout = SD_COMMAND_TIMEOUT;  // Wait for start token
+    uint32_t t0 = SD_STATS_NOW_US();
+    STATS_START();
     absolute_time_t timeout_time = make_timeout_time_ms(timeout);
     do {
         if (token == sd_spi_write(pSD, SPI_FILL_CHAR)) {
+            STATS_ADD(SD_STATS_BUSY);
             return true;
         }
     } while (0 < absolute_time_diff_us(get_absolute_time(), timeout_time));
+    STATS_ADD(SD_STATS_BUSY);
+    sd_trace(SD_TRACE_TOKEN_TMO, token, 0, 0, t0);
     DBG_PRINTF("sd_wait_token: timeout\r\n");
     return false;
 }
@@ -819,12 +865,14 @@ static int sd_read_block(sd_card_t *pSD, uint8_t *buffer, uint32_t length) {
     }
     // read data
     // bool spi_transfer(const uint8_t *tx, uint8_t *rx, size_t length)
+    STATS_START();
     if (!sd_spi_transfer(pSD, NULL, buffer, length)) {
         return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
     }
     // Read the CRC16 checksum for the data block
     crc = (sd_spi_write(pSD, SPI_FILL_CHAR) << 8);
     crc |= sd_spi_write(pSD, SPI_FILL_CHAR);
+    STATS_ADD(SD_STATS_XFER);
 
 #if SD_CRC_ENABLED
     if (crc_on) {
@@ -891,9 +939,19 @@ static int in_sd_read_blocks(sd_card_t *pSD, uint8_t *buffer,
 int sd_read_blocks(sd_card_t *pSD, uint8_t *buffer, uint64_t ulSectorNumber,
                    uint32_t ulSectorCount) {
     sd_acquire(pSD);
-    TRACE_PRINTF("sd_read_blocks(0x%p, 0x%llx, 0x%lx)\r\n", buffer,
-                 ulSectorNumber, ulSectorCount);
+    uint32_t t0 = SD_STATS_NOW_US();
+#if SD_STATS
+    sd_stats_acc_t acc = {.start_us = t0};
+    stats_acc = &acc;
+#endif
     int status = in_sd_read_blocks(pSD, buffer, ulSectorNumber, ulSectorCount);
+    sd_trace(SD_TRACE_READ, ulSectorCount > 0xFF ? 0xFF : ulSectorCount,
+             (uint32_t)ulSectorNumber, status, t0);
+#if SD_STATS
+    stats_acc = NULL;
+    acc.us[SD_STATS_TOTAL] = SD_STATS_NOW_US() - acc.start_us;
+    sd_stats_record(SD_STATS_READ, ulSectorCount, &acc, status);
+#endif
     sd_release(pSD);
     return status;
 }
@@ -904,6 +962,7 @@ static uint8_t sd_write_block(sd_card_t *pSD, const uint8_t *buffer,
     uint8_t response = 0xFF;
 
     // indicate start of block
+    STATS_START();
     sd_spi_write(pSD, token);
 
     // write the data
@@ -923,6 +982,7 @@ static uint8_t sd_write_block(sd_card_t *pSD, const uint8_t *buffer,
 
     // check the response token
     response = sd_spi_write(pSD, SPI_FILL_CHAR);
+    STATS_ADD(SD_STATS_XFER);
 
     // Wait for last block to be written
     if (false == sd_wait_ready(pSD, SD_COMMAND_TIMEOUT)) {
@@ -1017,9 +1077,19 @@ static int in_sd_write_blocks(sd_card_t *pSD, const uint8_t *buffer,
 int sd_write_blocks(sd_card_t *pSD, const uint8_t *buffer,
                     uint64_t ulSectorNumber, uint32_t blockCnt) {
     sd_acquire(pSD);
-    TRACE_PRINTF("sd_write_blocks(0x%p, 0x%llx, 0x%lx)\r\n", buffer,
-                 ulSectorNumber, blockCnt);
+    uint32_t t0 = SD_STATS_NOW_US();
+#if SD_STATS
+    sd_stats_acc_t acc = {.start_us = t0};
+    stats_acc = &acc;
+#endif
     int status = in_sd_write_blocks(pSD, buffer, ulSectorNumber, blockCnt);
+    sd_trace(SD_TRACE_WRITE, blockCnt > 0xFF ? 0xFF : blockCnt,
+             (uint32_t)ulSectorNumber, status, t0);
+#if SD_STATS
+    stats_acc = NULL;
+    acc.us[SD_STATS_TOTAL] = SD_STATS_NOW_US() - acc.start_us;
+    sd_stats_record(SD_STATS_WRITE, blockCnt, &acc, status);
+#endif
     sd_release(pSD);
     return status;
 }
@@ -1128,6 +1198,105 @@ static int sd_init_medium(sd_card_t *pSD) {
 
     return status;
 }
+
+/* Warm initialization
+
+A card that stays powered while the MCU soft resets (watchdog, debugger) or
+while the volume is unmounted and mounted again is still in SPI mode and in
+the transfer state, so the CMD0/CMD8/ACMD41 negotiation at 400 kHz and the
+CSD read can be skipped. What a cold init learned is kept in RAM that the
+runtime does not clear at reset; a warm init checks it with a single CMD10
+at full speed. A power cycled card is in SD mode or idle and does not answer
+it with R1 = 0, and another card answers with another CID: both fall back to
+the cold path. */
+
+#define SD_WARM_MAGIC 0x4D524157  // "WARM"
+#ifndef SD_WARM_CARDS
+#define SD_WARM_CARDS 2  // Cards remembered, by sd_get_by_num() index
+#endif
+
+typedef struct sd_warm {
+    uint32_t magic;
+    int32_t card_type;
+    uint64_t sectors;
+    uint32_t baud_rate;  // Configured rate the card was last run at
+    uint8_t cid[16];
+    uint32_t checksum;  // last, not included in checksum
+} sd_warm_t;
+
+// Not zeroed at reset; garbage after a power on, which the checksum rejects
+static sd_warm_t __uninitialized_ram(warm_cache)[SD_WARM_CARDS];
+
+static sd_warm_t *warm_slot(sd_card_t *pSD) {
+    for (size_t i = 0; i < sd_get_num() && i < SD_WARM_CARDS; ++i)
+        if (sd_get_by_num(i) == pSD) return &warm_cache[i];
+    return NULL;
+}
+
+static int sd_read_cid(sd_card_t *pSD, uint8_t cid[16]) {
+    uint32_t response;
+    int status = sd_cmd(pSD, CMD10_SEND_CID, 0x0, false, &response);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status) return status;
+    if (response) return SD_BLOCK_DEVICE_ERROR_NO_INIT;  // Idle: was reset
+    return sd_read_bytes(pSD, cid, 16);
+}
+
+static bool sd_init_warm(sd_card_t *pSD) {
+    sd_warm_t *w = warm_slot(pSD);
+    if (!w || SD_WARM_MAGIC != w->magic ||
+        w->checksum != calculate_checksum((uint32_t *)w, sizeof *w) ||
+        w->baud_rate != pSD->spi->baud_rate)
+        return false;
+    sd_spi_go_high_frequency(pSD);
+    uint8_t cid[16];
+    if (sd_read_cid(pSD, cid) || memcmp(cid, w->cid, sizeof cid)) {
+        DBG_PRINTF("%s: card changed or was reset\r\n", __FUNCTION__);
+        w->magic = 0;
+        return false;
+    }
+    pSD->card_type = w->card_type;
+    pSD->sectors = w->sectors;
+    return true;
+}
+
+static void sd_warm_save(sd_card_t *pSD) {
+    sd_warm_t *w = warm_slot(pSD);
+    if (!w) return;
+    w->magic = 0;
+    if (sd_read_cid(pSD, w->cid)) return;
+    w->card_type = pSD->card_type;
+    w->sectors = pSD->sectors;
+    w->baud_rate = pSD->spi->baud_rate;
+    w->magic = SD_WARM_MAGIC;
+    w->checksum = calculate_checksum((uint32_t *)w, sizeof *w);
+}
+
+static bool sd_init_cold(sd_card_t *pSD) {
+    // Initialize the member variables
+    pSD->card_type = SDCARD_NONE;
+
+    int err = sd_init_medium(pSD);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != err) {
+        DBG_PRINTF("Failed to initialize card\r\n");
+        return false;
+    }
+    DBG_PRINTF("SD card initialized\r\n");
+    pSD->sectors = sd_sectors_nolock(pSD);
+    if (0 == pSD->sectors) {
+        // CMD9 failed
+        return false;
+    }
+    // Set block length to 512 (CMD16)
+    if (sd_cmd(pSD, CMD16_SET_BLOCKLEN, _block_size, false, 0) != 0) {
+        DBG_PRINTF("Set %" PRIu32 "-byte block timed out\r\n", _block_size);
+        return false;
+    }
+    // Set SCK for data transfer
+    sd_spi_go_high_frequency(pSD);
+    sd_warm_save(pSD);
+    return true;
+}
+
 static int sd_init(sd_card_t *pSD);
 static bool sd_test_com(sd_card_t *pSD);
 
@@ -1197,35 +1366,16 @@ static int sd_init(sd_card_t *pSD) {
         sd_unlock(pSD);
         return pSD->m_Status;
     }
-    // Initialize the member variables
-    pSD->card_type = SDCARD_NONE;
-
     sd_spi_acquire(pSD);
 
-    int err = sd_init_medium(pSD);
-    if (SD_BLOCK_DEVICE_ERROR_NONE != err) {
-        DBG_PRINTF("Failed to initialize card\r\n");
+    uint32_t t0 = SD_STATS_NOW_US();
+    pSD->warm_init = sd_init_warm(pSD);
+    if (!pSD->warm_init && !sd_init_cold(pSD)) {
         sd_spi_release(pSD);
         sd_unlock(pSD);
         return pSD->m_Status;
     }
-    DBG_PRINTF("SD card initialized\r\n");
-    pSD->sectors = sd_sectors_nolock(pSD);
-    if (0 == pSD->sectors) {
-        // CMD9 failed
-        sd_spi_release(pSD);
-        sd_unlock(pSD);
-        return pSD->m_Status;
-    }
-    // Set block length to 512 (CMD16)
-    if (sd_cmd(pSD, CMD16_SET_BLOCKLEN, _block_size, false, 0) != 0) {
-        DBG_PRINTF("Set %" PRIu32 "-byte block timed out\r\n", _block_size);
-        sd_spi_release(pSD);
-        sd_unlock(pSD);
-        return pSD->m_Status;
-    }
-    // Set SCK for data transfer
-    sd_spi_go_high_frequency(pSD);
+    pSD->init_us = SD_STATS_NOW_US() - t0;
 
     // The card is now initialized
     pSD->m_Status &= ~STA_NOINIT;
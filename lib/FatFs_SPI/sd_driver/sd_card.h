@@ -54,6 +54,8 @@ struct sd_card_t {
     mutex_t mutex;
     FATFS fatfs;
     bool mounted;
+    bool warm_init;    // Last init reused the cached card parameters
+    uint32_t init_us;  // Duration of the last successful init
 
     int (*init)(sd_card_t *sd_card_p);
     int (*write_blocks)(sd_card_t *sd_card_p, const uint8_t *buffer,
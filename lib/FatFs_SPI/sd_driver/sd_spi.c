@@ -23,6 +23,7 @@ specific language governing permissions and limitations under the License.
 #include "sd_card.h"
 #include "sd_spi.h"
 #include "spi.h"
+#include "sd_trace.h"
 
 #define TRACE_PRINTF(fmt, args...)
 /* #define TRACE_PRINTF printf  // task_printf */
@@ -31,12 +32,14 @@ specific language governing permissions and limitations under the License.
 #pragma GCC diagnostic ignored "-Wunused-variable"
 
 void sd_spi_go_high_frequency(sd_card_t *pSD) {
+    uint32_t t0 = SD_STATS_NOW_US();
     uint actual = spi_set_baudrate(pSD->spi->hw_inst, pSD->spi->baud_rate);
-    TRACE_PRINTF("%s: Actual frequency: %lu\n", __FUNCTION__, (long)actual);
+    sd_trace(SD_TRACE_FREQ, 1, actual, 0, t0);
 }
 void sd_spi_go_low_frequency(sd_card_t *pSD) {
+    uint32_t t0 = SD_STATS_NOW_US();
     uint actual = spi_set_baudrate(pSD->spi->hw_inst, 400 * 1000); // Actual frequency: 398089
-    TRACE_PRINTF("%s: Actual frequency: %lu\n", __FUNCTION__, (long)actual);
+    sd_trace(SD_TRACE_FREQ, 0, actual, 0, t0);
 }
 
 #pragma GCC diagnostic pop
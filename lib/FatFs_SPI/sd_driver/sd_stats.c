@@ -0,0 +1,86 @@
+/* sd_stats.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+#include <stdio.h>
+#include <string.h>
+//
+#include "sd_stats.h"
+
+sd_stats_t sd_stats;
+
+static unsigned size_class(uint32_t blocks) {
+    unsigned c = 0;
+    while (blocks > 1 && c < SD_STATS_N_SIZES - 1) {
+        blocks >>= 1;
+        ++c;
+    }
+    return c;
+}
+
+static unsigned bucket(uint32_t us) {
+    if (us < 2) return 0;
+    unsigned b = 31 - __builtin_clz(us);
+    return b < SD_STATS_N_BUCKETS ? b : SD_STATS_N_BUCKETS - 1;
+}
+
+void sd_stats_record(sd_stats_op_t op, uint32_t blocks, const sd_stats_acc_t *acc,
+                     int status) {
+    if (status) sd_stats.errors[op]++;
+    sd_stats_hist_t *h = sd_stats.h[op][size_class(blocks)];
+    for (unsigned p = 0; p < SD_STATS_N_PHASES; ++p) {
+        uint32_t us = acc->us[p];
+        h[p].count++;
+        h[p].sum_us += us;
+        if (us > h[p].max_us) h[p].max_us = us;
+        h[p].bucket[bucket(us)]++;
+    }
+}
+
+void sd_stats_reset() { memset(&sd_stats, 0, sizeof sd_stats); }
+
+uint32_t sd_stats_percentile(const sd_stats_hist_t *h, unsigned p) {
+    if (!h->count) return 0;
+    uint64_t want = ((uint64_t)h->count * p + 99) / 100;
+    if (!want) want = 1;
+    uint64_t seen = 0;
+    for (unsigned b = 0; b < SD_STATS_N_BUCKETS; ++b) {
+        seen += h->bucket[b];
+        if (seen >= want) return b == SD_STATS_N_BUCKETS - 1 ? h->max_us : 2u << b;
+    }
+    return h->max_us;
+}
+
+void sd_stats_print() {
+    static const char *const ops[] = {"read", "write"};
+    static const char *const sizes[] = {"1", "2-3", "4-7", "8-15", "16+"};
+    static const char *const phases[] = {"cmd", "xfer", "busy", "total"};
+    printf("SD latency (us): op blocks phase: n mean p50 p99 max | log2 buckets\n");
+    for (unsigned o = 0; o < SD_STATS_N_OPS; ++o) {
+        for (unsigned s = 0; s < SD_STATS_N_SIZES; ++s) {
+            for (unsigned p = 0; p < SD_STATS_N_PHASES; ++p) {
+                const sd_stats_hist_t *h = &sd_stats.h[o][s][p];
+                if (!h->count) continue;
+                printf("%-5s %-4s %-5s: %lu %lu %lu %lu %lu |", ops[o], sizes[s], phases[p],
+                       (unsigned long)h->count, (unsigned long)(h->sum_us / h->count),
+                       (unsigned long)sd_stats_percentile(h, 50),
+                       (unsigned long)sd_stats_percentile(h, 99), (unsigned long)h->max_us);
+                unsigned last = SD_STATS_N_BUCKETS;
+                while (last && !h->bucket[last - 1]) --last;
+                for (unsigned b = 0; b < last; ++b) printf(" %lu", (unsigned long)h->bucket[b]);
+                printf("\n");
+            }
+        }
+        if (sd_stats.errors[o]) printf("%s errors: %lu\n", ops[o], (unsigned long)sd_stats.errors[o]);
+    }
+}
+
+/* [] END OF FILE */
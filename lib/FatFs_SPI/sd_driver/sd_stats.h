@@ -0,0 +1,105 @@
+/* sd_stats.h
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+// SD card operation latency histograms.
+//
+// sd_card.c splits every sd_read_blocks()/sd_write_blocks() into phases:
+//   CMD  - sending commands and getting their responses;
+//   XFER - moving data blocks over SPI;
+//   BUSY - waiting for the card: start token before read data, busy (DO low)
+//          after written data and before the next command;
+//   TOTAL- the whole operation.
+// Each phase is added into a log2 histogram of microseconds, per operation
+// type and per block count class. The tables are static and only ever
+// incremented by the task doing the I/O (under the card mutex), so they can
+// be read from anywhere without a lock; a count may be one behind.
+//
+// The time source is SD_STATS_NOW_US(): time_us_32() on the device. Other
+// builds (host emulator) define it or provide sd_stats_host_now_us().
+// Build with SD_STATS=0 to compile the instrumentation out.
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef SD_STATS
+#define SD_STATS 1
+#endif
+
+#ifndef SD_STATS_NOW_US
+#if PICO_ON_DEVICE
+#include "hardware/timer.h"
+#define SD_STATS_NOW_US() time_us_32()
+#else
+uint32_t sd_stats_host_now_us(void);
+#define SD_STATS_NOW_US() sd_stats_host_now_us()
+#endif
+#endif
+
+typedef enum { SD_STATS_READ, SD_STATS_WRITE, SD_STATS_N_OPS } sd_stats_op_t;
+typedef enum {
+    SD_STATS_CMD,
+    SD_STATS_XFER,
+    SD_STATS_BUSY,
+    SD_STATS_TOTAL,
+    SD_STATS_N_PHASES
+} sd_stats_phase_t;
+
+// Block count classes: 1, 2-3, 4-7, 8-15, 16 and more
+#define SD_STATS_N_SIZES 5
+// Bucket 0: < 2 us; bucket i: [2^i, 2^(i+1)) us; the last one is open ended
+#define SD_STATS_N_BUCKETS 24
+
+typedef struct sd_stats_hist {
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t sum_us;
+    uint32_t bucket[SD_STATS_N_BUCKETS];
+} sd_stats_hist_t;
+
+typedef struct sd_stats {
+    sd_stats_hist_t h[SD_STATS_N_OPS][SD_STATS_N_SIZES][SD_STATS_N_PHASES];
+    uint32_t errors[SD_STATS_N_OPS];
+} sd_stats_t;
+
+// Time spent in each phase by the operation in progress
+typedef struct sd_stats_acc {
+    uint32_t start_us;
+    uint32_t us[SD_STATS_N_PHASES];
+} sd_stats_acc_t;
+
+extern sd_stats_t sd_stats;
+
+void sd_stats_record(sd_stats_op_t op, uint32_t blocks, const sd_stats_acc_t *acc,
+                     int status);
+
+// Clears all histograms. Safe to call while I/O is running: a concurrent
+// update may survive the reset.
+void sd_stats_reset(void);
+
+// Prints every non-empty histogram with printf(): count, mean, approximate
+// p50/p99 (bucket upper bounds), max, and the bucket counts.
+void sd_stats_print(void);
+
+// Upper bound in microseconds of the bucket holding the p-th percentile
+// (p in 0..100), 0 if the histogram is empty.
+uint32_t sd_stats_percentile(const sd_stats_hist_t *h, unsigned p);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* [] END OF FILE */
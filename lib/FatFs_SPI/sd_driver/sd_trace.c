@@ -0,0 +1,123 @@
+/* sd_trace.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+#include <stdio.h>
+#include <string.h>
+//
+#include "sd_trace.h"
+
+#if SD_TRACE
+
+_Static_assert(sizeof(sd_trace_rec_t) == 16, "sd_trace_rec_t layout");
+_Static_assert(!(SD_TRACE_DEPTH & (SD_TRACE_DEPTH - 1)),
+               "SD_TRACE_DEPTH must be a power of two");
+
+sd_trace_rec_t sd_trace_ring[SD_TRACE_DEPTH];
+volatile uint32_t sd_trace_head;
+volatile bool sd_trace_paused;
+
+// Snapshot used by the dumpers, so that the ring can keep running
+static sd_trace_rec_t snap[SD_TRACE_DEPTH];
+
+uint32_t sd_trace_snapshot(sd_trace_rec_t *buf, uint32_t max, uint32_t *dropped) {
+    uint32_t end = sd_trace_head;
+    __asm volatile("" ::: "memory");
+    uint32_t n = end < SD_TRACE_DEPTH ? end : SD_TRACE_DEPTH;
+    if (n > max) n = max;
+    uint32_t begin = end - n;
+    for (uint32_t i = 0; i < n; ++i)
+        buf[i] = sd_trace_ring[(begin + i) & (SD_TRACE_DEPTH - 1)];
+    __asm volatile("" ::: "memory");
+    // The writer may be filling slot `now` (head not yet advanced), which
+    // holds record now - SD_TRACE_DEPTH: anything at or before that is suspect.
+    uint32_t now = sd_trace_head;
+    uint32_t skip = 0;
+    if (now - begin >= SD_TRACE_DEPTH) {
+        skip = now - begin - SD_TRACE_DEPTH + 1;
+        if (skip > n) skip = n;
+        memmove(buf, buf + skip, (n - skip) * sizeof *buf);
+        n -= skip;
+    }
+    if (dropped) *dropped = begin + skip;
+    return n;
+}
+
+// Where sd_trace_print_step() is in the snapshot
+static uint32_t print_n, print_next;
+
+void sd_trace_print_begin() {
+    sd_trace_paused = true;
+    uint32_t dropped;
+    print_n = sd_trace_snapshot(snap, SD_TRACE_DEPTH, &dropped);
+    print_next = 0;
+    sd_trace_paused = false;
+    printf(SD_TRACE_LINE_TAG " %u %lu %lu\n", SD_TRACE_FILE_VERSION, (unsigned long)print_n,
+           (unsigned long)dropped);
+}
+
+bool sd_trace_print_step(uint32_t max) {
+    static const char hex[] = "0123456789abcdef";
+    char line[sizeof SD_TRACE_LINE_TAG + 2 * sizeof(sd_trace_rec_t) + 1];
+    for (; max && print_next < print_n; --max, ++print_next) {
+        const uint8_t *p = (const uint8_t *)&snap[print_next];
+        char *c = line + sizeof SD_TRACE_LINE_TAG - 1;
+        memcpy(line, SD_TRACE_LINE_TAG, sizeof SD_TRACE_LINE_TAG - 1);
+        for (unsigned j = 0; j < sizeof(sd_trace_rec_t); ++j) {
+            *c++ = hex[p[j] >> 4];
+            *c++ = hex[p[j] & 0xF];
+        }
+        *c++ = '\n';
+        *c = '\0';
+        printf("%s", line);  // One write per record
+    }
+    return print_next >= print_n;
+}
+
+void sd_trace_print() {
+    sd_trace_print_begin();
+    sd_trace_print_step(SD_TRACE_DEPTH);
+}
+
+FRESULT sd_trace_save(const char *path) {
+    sd_trace_paused = true;
+    sd_trace_file_hdr_t hdr = {
+        .magic = SD_TRACE_FILE_MAGIC,
+        .version = SD_TRACE_FILE_VERSION,
+        .rec_size = sizeof(sd_trace_rec_t),
+    };
+    hdr.count = sd_trace_snapshot(snap, SD_TRACE_DEPTH, &hdr.dropped);
+    FIL fil;
+    FRESULT fr = f_open(&fil, path, FA_CREATE_ALWAYS | FA_WRITE);
+    if (FR_OK == fr) {
+        UINT bw;
+        UINT len = hdr.count * sizeof(sd_trace_rec_t);
+        fr = f_write(&fil, &hdr, sizeof hdr, &bw);
+        if (FR_OK == fr && sizeof hdr != bw) fr = FR_DENIED;
+        if (FR_OK == fr) fr = f_write(&fil, snap, len, &bw);
+        if (FR_OK == fr && len != bw) fr = FR_DENIED;
+        FRESULT fr2 = f_close(&fil);
+        if (FR_OK == fr) fr = fr2;
+    }
+    sd_trace_paused = false;
+    return fr;
+}
+
+void sd_trace_reset() {
+    sd_trace_paused = true;
+    memset(sd_trace_ring, 0, sizeof sd_trace_ring);
+    sd_trace_head = 0;
+    sd_trace_paused = false;
+}
+
+#endif
+
+/* [] END OF FILE */
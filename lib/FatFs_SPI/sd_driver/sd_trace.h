@@ -0,0 +1,154 @@
+/* sd_trace.h
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Binary SD trace ring.
+//
+// The driver logs every SD command, block transfer, wait timeout and SPI
+// clock change as a fixed 16 byte record into a RAM ring of SD_TRACE_DEPTH
+// entries. Logging a record is a handful of stores, so it stays enabled in
+// normal builds; when the card misbehaves the last SD_TRACE_DEPTH events are
+// still there to be dumped over stdio (sd_trace_print) or to a file
+// (sd_trace_save), and turned into a timeline on the host by
+// host/tools/sd_trace_decode.
+//
+// Records are written by the task doing the I/O (under the card mutex).
+// Readers take a snapshot and drop any record that was overwritten while it
+// was being copied. Build with SD_TRACE=0 to compile the tracing out.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+//
+#include "ff.h"        // FRESULT
+#include "sd_stats.h"  // SD_STATS_NOW_US()
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef SD_TRACE
+#define SD_TRACE 1
+#endif
+
+// Number of records kept; must be a power of two
+#ifndef SD_TRACE_DEPTH
+#define SD_TRACE_DEPTH 256
+#endif
+
+typedef enum {
+    SD_TRACE_CMD = 1,    // cmd: index (| 0x40 for ACMD), arg, resp: R1 or status
+    SD_TRACE_READ,       // arg: first block, cmd: block count (saturated), resp: status
+    SD_TRACE_WRITE,      // ditto
+    SD_TRACE_BUSY_TMO,   // sd_wait_ready() gave up: dur is the wait
+    SD_TRACE_TOKEN_TMO,  // sd_wait_token() gave up: cmd is the expected token
+    SD_TRACE_INIT,       // disk_initialize(): resp is the resulting DSTATUS
+    SD_TRACE_FREQ,       // SPI clock change: arg is the actual baud rate
+    SD_TRACE_MARK,       // Application marker: cmd and arg are free
+} sd_trace_event_t;
+
+// Flag in sd_trace_rec_t.cmd for application specific commands
+#define SD_TRACE_ACMD 0x40
+
+typedef struct sd_trace_rec {
+    uint32_t t_us;    // SD_STATS_NOW_US() at the start of the event
+    uint32_t dur_us;  // How long it took
+    uint32_t arg;
+    uint16_t resp;    // Low 16 bits of the response or of the status code
+    uint8_t event;    // sd_trace_event_t
+    uint8_t cmd;
+} sd_trace_rec_t;
+
+// Header of sd_trace_save() files, followed by `count` records, oldest first.
+// All fields are little endian.
+#define SD_TRACE_FILE_MAGIC 0x52544453  // "SDTR"
+#define SD_TRACE_FILE_VERSION 1
+typedef struct sd_trace_file_hdr {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t rec_size;
+    uint32_t count;
+    uint32_t dropped;  // Records logged before the oldest one, now overwritten
+} sd_trace_file_hdr_t;
+
+// Prefix of the lines written by sd_trace_print()
+#define SD_TRACE_LINE_TAG "sdtr:"
+
+#if SD_TRACE
+
+extern sd_trace_rec_t sd_trace_ring[SD_TRACE_DEPTH];
+extern volatile uint32_t sd_trace_head;  // Records ever logged
+extern volatile bool sd_trace_paused;
+
+static inline void sd_trace(sd_trace_event_t event, uint8_t cmd, uint32_t arg,
+                            uint32_t resp, uint32_t t0_us) {
+    if (sd_trace_paused) return;
+    uint32_t now = SD_STATS_NOW_US();
+    uint32_t head = sd_trace_head;
+    sd_trace_rec_t *r = &sd_trace_ring[head & (SD_TRACE_DEPTH - 1)];
+    r->t_us = t0_us;
+    r->dur_us = now - t0_us;
+    r->arg = arg;
+    r->resp = (uint16_t)resp;
+    r->event = (uint8_t)event;
+    r->cmd = cmd;
+    __asm volatile("" ::: "memory");
+    sd_trace_head = head + 1;
+}
+
+// Copies up to max records, oldest first, into buf. Returns the number copied
+// and, in *dropped, how many records were logged before the first one copied.
+uint32_t sd_trace_snapshot(sd_trace_rec_t *buf, uint32_t max, uint32_t *dropped);
+
+// Prints the ring as SD_TRACE_LINE_TAG lines: a header line and one line of
+// hex per record.
+void sd_trace_print(void);
+
+// sd_trace_print() in pieces, for a polled loop: begin takes the snapshot
+// and prints the header line, each step prints up to max records and
+// returns true once all are out. Shares the snapshot with sd_trace_save().
+void sd_trace_print_begin(void);
+bool sd_trace_print_step(uint32_t max);
+
+// Stops logging, e.g. to keep the events of a failure from being
+// overwritten; the next print, save or reset starts it again.
+static inline void sd_trace_freeze(void) { sd_trace_paused = true; }
+
+// Writes the ring to a file (FatFs path) in the sd_trace_file_hdr_t format.
+// The SD traffic caused by the save itself is not traced.
+FRESULT sd_trace_save(const char *path);
+
+void sd_trace_reset(void);
+
+#else
+
+#define sd_trace(event, cmd, arg, resp, t0_us) ((void)(t0_us))
+static inline void sd_trace_print(void) {}
+static inline void sd_trace_print_begin(void) {}
+static inline bool sd_trace_print_step(uint32_t max) {
+    (void)max;
+    return true;
+}
+static inline void sd_trace_freeze(void) {}
+static inline FRESULT sd_trace_save(const char *path) {
+    (void)path;
+    return FR_NOT_ENABLED;
+}
+static inline void sd_trace_reset(void) {}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+/* [] END OF FILE */
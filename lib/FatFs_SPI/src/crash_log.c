@@ -0,0 +1,285 @@
+/* crash_log.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+//
+#if PICO_ON_DEVICE
+#include "pico/time.h"
+#endif
+//
+#include "ff.h"
+#include "diskio.h"
+//
+#include "crc.h"
+#include "my_debug.h"
+//
+#include "crash_log.h"
+
+#define TRACE_PRINTF(fmt, args...)
+//#define TRACE_PRINTF printf
+
+static_assert(sizeof(crash_log_blk_t) == CRASH_LOG_BLOCK_SIZE, "");
+static_assert(CRASH_LOG_RESERVE % CRASH_LOG_BLOCK_SIZE == 0, "");
+
+static uint32_t uptime_ms() {
+#if PICO_ON_DEVICE
+    return to_ms_since_boot(get_absolute_time());
+#else
+    return (uint32_t)((uint64_t)clock() * 1000 / CLOCKS_PER_SEC);
+#endif
+}
+
+static uint16_t blk_crc(crash_log_blk_t *blk) {
+    uint16_t saved = blk->hdr.crc;
+    blk->hdr.crc = 0;
+    uint16_t crc = 0;
+    update_crc16(&crc, (const char *)&blk->hdr, sizeof blk->hdr);
+    update_crc16(&crc, (const char *)blk->payload, blk->hdr.len);
+    blk->hdr.crc = saved;
+    return crc;
+}
+
+bool crash_log_valid(crash_log_blk_t *blk, uint32_t id, uint32_t seq) {
+    crash_log_hdr_t *h = &blk->hdr;
+    return CRASH_LOG_MAGIC == h->magic && id == h->id && seq == h->seq &&
+           h->len <= CRASH_LOG_PAYLOAD && h->crc == blk_crc(blk);
+}
+
+static FRESULT read_blk(FIL *fil, uint32_t seq, crash_log_blk_t *blk) {
+    FRESULT fr = f_lseek(fil, (FSIZE_t)seq * CRASH_LOG_BLOCK_SIZE);
+    if (FR_OK != fr) return fr;
+    UINT br = 0;
+    fr = f_read(fil, blk, sizeof *blk, &br);
+    if (FR_OK == fr && sizeof *blk != br) fr = FR_INT_ERR;
+    return fr;
+}
+
+static void next_block(crash_log_t *cl) {
+    crash_log_hdr_t *h = &cl->blk.hdr;
+    h->seq++;
+    h->time = (uint32_t)time(NULL);
+    h->uptime_ms = uptime_ms();
+    h->len = 0;
+    h->first_rec = CRASH_LOG_NO_REC;
+    cl->dirty = false;
+}
+
+// Grows the committed size so that block seq fits. The new clusters are
+// linked and the directory entry updated by one f_sync(); block writes that
+// follow stay inside the file and touch nothing but their own sector.
+static FRESULT reserve(crash_log_t *cl, uint32_t seq) {
+    FSIZE_t end = (FSIZE_t)(seq + 1) * CRASH_LOG_BLOCK_SIZE;
+    if (end <= cl->reserved) return FR_OK;
+    FSIZE_t size = cl->reserved + CRASH_LOG_RESERVE;
+    FRESULT fr = f_lseek(cl->fil, size);
+    if (FR_OK == fr && f_tell(cl->fil) != size) fr = FR_DENIED;  // Volume full
+    if (FR_OK == fr) fr = f_sync(cl->fil);
+    if (FR_OK != fr) {
+        DBG_PRINTF("%s: %d\n", __func__, fr);
+        return fr;
+    }
+    TRACE_PRINTF("%s: %lu\n", __func__, (unsigned long)size);
+    cl->reserved = size;
+    return FR_OK;
+}
+
+static FRESULT write_raw(crash_log_t *cl, const void *buf, uint32_t seq, uint32_t n) {
+    if (seq + n > cl->blocks) return FR_DENIED;  // Extent full
+    if (RES_OK != disk_write(cl->pdrv, buf, cl->lba + seq, n)) return FR_DISK_ERR;
+    return FR_OK;
+}
+
+// Writes the current block; full: it will not change again and may wait in
+// the burst buffer. The blocks in the buffer precede the current one, so
+// they and it go out in one multi-block write.
+static FRESULT write_blk_raw(crash_log_t *cl, bool full) {
+    crash_log_hdr_t *h = &cl->blk.hdr;
+    h->crc = blk_crc(&cl->blk);
+    if (!cl->burst) {
+        FRESULT fr = write_raw(cl, &cl->blk, h->seq, 1);
+        if (FR_OK == fr) cl->dirty = false;
+        return fr;
+    }
+    uint32_t first = h->seq - cl->burst_n;
+    uint32_t n = cl->burst_n;
+    if (full || h->len) cl->burst[n++] = cl->blk;  // An empty block is not worth a sector
+    if (full && n < cl->burst_max) {
+        cl->burst_n = n;
+        cl->dirty = false;
+        return FR_OK;
+    }
+    FRESULT fr = write_raw(cl, cl->burst, first, n);
+    if (FR_OK != fr) return fr;
+    cl->burst_n = 0;
+    cl->dirty = false;
+    return FR_OK;
+}
+
+static FRESULT write_blk(crash_log_t *cl, bool full) {
+    if (cl->blocks) return write_blk_raw(cl, full);
+    crash_log_hdr_t *h = &cl->blk.hdr;
+    FRESULT fr = reserve(cl, h->seq);
+    if (FR_OK != fr) return fr;
+    h->crc = blk_crc(&cl->blk);
+    fr = f_lseek(cl->fil, (FSIZE_t)h->seq * CRASH_LOG_BLOCK_SIZE);
+    if (FR_OK != fr) return fr;
+    UINT bw = 0;
+    // Sector aligned and sector sized: FatFs passes it straight to disk_write()
+    fr = f_write(cl->fil, &cl->blk, sizeof cl->blk, &bw);
+    if (FR_OK == fr && sizeof cl->blk != bw) fr = FR_DENIED;
+    if (FR_OK == fr) cl->dirty = false;
+    return fr;
+}
+
+FRESULT crash_log_start(crash_log_t *cl, FIL *fil) {
+    memset(cl, 0, sizeof *cl);
+    if (f_size(fil)) return FR_INVALID_PARAMETER;
+    cl->fil = fil;
+    cl->id = (uint32_t)time(NULL) ^ (uptime_ms() << 12) ^ (uint32_t)(uintptr_t)fil;
+    cl->id ^= (uint32_t)fil->obj.sclust;  // 0 until the first cluster is allocated
+    cl->blk.hdr.magic = CRASH_LOG_MAGIC;
+    cl->blk.hdr.id = cl->id;
+    cl->blk.hdr.seq = (uint32_t)-1;
+    next_block(cl);
+    return reserve(cl, 0);
+}
+
+FRESULT crash_log_start_raw(crash_log_t *cl, BYTE pdrv, LBA_t lba, uint32_t blocks,
+                            crash_log_blk_t *burst, uint32_t burst_blocks) {
+    memset(cl, 0, sizeof *cl);
+    if (!blocks) return FR_INVALID_PARAMETER;
+    cl->pdrv = pdrv;
+    cl->lba = lba;
+    cl->blocks = blocks;
+    if (burst && burst_blocks > 1) {
+        cl->burst = burst;
+        cl->burst_max = burst_blocks;
+    }
+    cl->id = (uint32_t)time(NULL) ^ (uptime_ms() << 12) ^ (uint32_t)lba;
+    cl->blk.hdr.magic = CRASH_LOG_MAGIC;
+    cl->blk.hdr.id = cl->id;
+    cl->blk.hdr.seq = (uint32_t)-1;
+    next_block(cl);
+    cl->blk.hdr.crc = blk_crc(&cl->blk);
+    return write_raw(cl, &cl->blk, 0, 1);
+}
+
+FRESULT crash_log_start_extent(crash_log_t *cl, FIL *fil, FSIZE_t size,
+                               crash_log_blk_t *burst, uint32_t burst_blocks) {
+    memset(cl, 0, sizeof *cl);
+    if (f_size(fil)) return FR_INVALID_PARAMETER;
+    size -= size % CRASH_LOG_BLOCK_SIZE;
+    // Contiguous and allocated now: the FAT is not touched again until finish
+    FRESULT fr = f_expand(fil, size, 1);
+    if (FR_OK != fr) {
+        DBG_PRINTF("%s: f_expand: %d\n", __func__, fr);
+        return fr;
+    }
+    FATFS *fs = fil->obj.fs;
+    LBA_t lba = fs->database + (LBA_t)fs->csize * (fil->obj.sclust - 2);
+    fr = crash_log_start_raw(cl, fs->pdrv, lba, (uint32_t)(size / CRASH_LOG_BLOCK_SIZE), burst,
+                             burst_blocks);
+    cl->fil = fil;
+    cl->reserved = size;
+    // Block 0 is in place before the directory entry gets the size
+    if (FR_OK == fr) fr = f_sync(fil);
+    return fr;
+}
+
+FRESULT crash_log_write(crash_log_t *cl, const void *data, UINT len) {
+    const uint8_t *p = data;
+    crash_log_hdr_t *h = &cl->blk.hdr;
+    if (cl->blocks &&
+        (uint64_t)(cl->blocks - h->seq) * CRASH_LOG_PAYLOAD - h->len < len)
+        return FR_DENIED;
+    if (CRASH_LOG_NO_REC == h->first_rec) h->first_rec = h->len;
+    h->records++;
+    while (len) {
+        UINT n = CRASH_LOG_PAYLOAD - h->len;
+        if (n > len) n = len;
+        memcpy(cl->blk.payload + h->len, p, n);
+        h->len += n;
+        cl->dirty = true;
+        p += n;
+        len -= n;
+        if (CRASH_LOG_PAYLOAD == h->len) {
+            FRESULT fr = write_blk(cl, true);
+            if (FR_OK != fr) return fr;
+            next_block(cl);
+        }
+    }
+    return FR_OK;
+}
+
+FRESULT crash_log_flush(crash_log_t *cl) {
+    if (!cl->dirty && !cl->burst_n) return FR_OK;
+    return write_blk(cl, false);
+}
+
+FRESULT crash_log_finish(crash_log_t *cl) {
+    FRESULT fr = crash_log_flush(cl);
+    if (FR_OK != fr) return fr;
+    if (cl->blocks && RES_OK != disk_ioctl(cl->pdrv, CTRL_SYNC, NULL)) return FR_DISK_ERR;
+    if (!cl->fil) return FR_OK;
+    fr = f_lseek(cl->fil, (FSIZE_t)crash_log_blocks(cl) * CRASH_LOG_BLOCK_SIZE);
+    if (FR_OK == fr) fr = f_truncate(cl->fil);
+    if (FR_OK == fr) fr = f_sync(cl->fil);
+    return fr;
+}
+
+FRESULT crash_log_valid_blocks(FIL *fil, uint32_t *blocks, crash_log_blk_t *last) {
+    *blocks = 0;
+    uint32_t n = f_size(fil) / CRASH_LOG_BLOCK_SIZE;
+    if (!n) return FR_OK;
+    FRESULT fr = read_blk(fil, 0, last);
+    if (FR_OK != fr || !crash_log_valid(last, last->hdr.id, 0)) return fr;
+    // Blocks are written in order, so the valid ones are a prefix
+    uint32_t id = last->hdr.id;
+    uint32_t lo = 0, hi = n;  // lo is valid, hi is not
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        fr = read_blk(fil, mid, last);
+        if (FR_OK != fr) return fr;
+        if (crash_log_valid(last, id, mid))
+            lo = mid;
+        else
+            hi = mid;
+    }
+    fr = read_blk(fil, lo, last);
+    if (FR_OK == fr) *blocks = lo + 1;
+    return fr;
+}
+
+FRESULT crash_log_recover(FIL *fil, crash_log_recovery_t *rec) {
+    static crash_log_blk_t blk;
+    memset(rec, 0, sizeof *rec);
+    uint32_t blocks;
+    FRESULT fr = crash_log_valid_blocks(fil, &blocks, &blk);
+    if (FR_OK != fr) return fr;
+    if (blocks) rec->records = blk.hdr.records;
+    rec->blocks = blocks;
+    rec->size = (FSIZE_t)blocks * CRASH_LOG_BLOCK_SIZE;
+    if (rec->size != f_size(fil)) {
+        rec->trimmed = true;
+        fr = f_lseek(fil, rec->size);
+        if (FR_OK == fr) fr = f_truncate(fil);
+        if (FR_OK == fr) fr = f_sync(fil);
+    }
+    TRACE_PRINTF("%s: %lu blocks, %lu records\n", __func__, (unsigned long)blocks,
+                 (unsigned long)rec->records);
+    return fr;
+}
+
+/* [] END OF FILE */
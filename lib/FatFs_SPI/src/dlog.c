@@ -0,0 +1,368 @@
+/* dlog.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+#include <stdio.h>
+#include <string.h>
+//
+#include "dlog.h"
+
+#if PICO_ON_DEVICE
+#include "hardware/sync.h"
+#endif
+
+_Static_assert(sizeof(dlog_rec_t) == 64, "dlog_rec_t layout");
+_Static_assert(DLOG_MAX_ARGS * 2 <= 16, "kinds must fit in dlog_rec_t.kinds");
+
+// Length up to which a string is kept whole when later arguments need room
+#define DLOG_STR_KEEP 12
+
+static uint64_t get_le(const uint8_t *p, unsigned n) {
+    uint64_t v = 0;
+    for (unsigned i = n; i--;) v = v << 8 | p[i];
+    return v;
+}
+
+// Next argument of rec; false if there is none. *s is set for strings.
+typedef struct {
+    const dlog_rec_t *rec;
+    unsigned arg;
+    unsigned pos;
+} arg_iter_t;
+
+static bool next_arg(arg_iter_t *it, unsigned *kind, uint64_t *u, const char **s) {
+    if (it->arg == DLOG_MAX_ARGS) return false;
+    *kind = (it->rec->kinds >> (2 * it->arg)) & 3;
+    if (DLOG_KIND_NONE == *kind) return false;
+    ++it->arg;
+    const uint8_t *p = it->rec->data + it->pos;
+    unsigned left = DLOG_DATA - it->pos;
+    if (DLOG_KIND_STR == *kind) {
+        size_t len = strnlen((const char *)p, left);
+        if (len == left) return false;  // Not terminated: damaged record
+        *s = (const char *)p;
+        it->pos += len + 1;
+        return true;
+    }
+    unsigned n = DLOG_KIND_64 == *kind ? 8 : 4;
+    if (n > left) return false;
+    *u = get_le(p, n);
+    it->pos += n;
+    return true;
+}
+
+static void put(char *buf, size_t size, size_t *len, const char *s, size_t n) {
+    if (*len + 1 < size) {
+        size_t room = size - 1 - *len;
+        memcpy(buf + *len, s, n < room ? n : room);
+    }
+    *len += n;
+}
+
+int dlog_format(char *buf, size_t size, const char *fmt, const dlog_rec_t *rec) {
+    arg_iter_t it = {rec, 0, 0};
+    size_t len = 0;
+    for (const char *p = fmt; *p;) {
+        if ('%' != *p) {
+            const char *q = strchr(p, '%');
+            size_t n = q ? (size_t)(q - p) : strlen(p);
+            put(buf, size, &len, p, n);
+            p += n;
+            continue;
+        }
+        // Conversion: rebuilt without the length modifiers, with ll for integers
+        char spec[24] = "%";
+        size_t sl = 1;
+        ++p;
+        while (*p && strchr("-+ #0", *p) && sl < 8) spec[sl++] = *p++;
+        int star[2] = {-1, -1};  // Width and precision given as arguments
+        for (unsigned part = 0; part < 2; ++part) {
+            if (1 == part) {
+                if ('.' != *p) break;
+                spec[sl++] = *p++;
+            }
+            if ('*' == *p) {
+                unsigned kind;
+                uint64_t u = 0;
+                const char *s;
+                ++p;
+                star[part] = next_arg(&it, &kind, &u, &s) && DLOG_KIND_STR != kind ? (int)u : 0;
+                spec[sl++] = '*';
+            } else {
+                while (*p >= '0' && *p <= '9' && sl < 16) spec[sl++] = *p++;
+                while (*p >= '0' && *p <= '9') ++p;
+            }
+        }
+        while (*p && strchr("hlLqjzt", *p)) ++p;
+        char conv = *p;
+        if (!conv) break;
+        ++p;
+        char out[64];
+        int n;
+        if ('%' == conv) {
+            put(buf, size, &len, "%", 1);
+            continue;
+        }
+        unsigned kind;
+        uint64_t u = 0;
+        const char *s = NULL;
+        if (!next_arg(&it, &kind, &u, &s) || (('s' == conv) != (DLOG_KIND_STR == kind)) ||
+            !strchr("diuoxXcps", conv)) {
+            put(buf, size, &len, "(?)", 3);
+            continue;
+        }
+        if ('s' == conv) {
+            spec[sl++] = 's';
+            spec[sl] = 0;
+            // Strings go straight to the output, which may be longer than out
+            char *dst = len + 1 < size ? buf + len : NULL;
+            size_t room = dst ? size - len : 0;
+            if (star[0] >= 0 && star[1] >= 0)
+                n = snprintf(dst, room, spec, star[0], star[1], s);
+            else if (star[0] >= 0 || star[1] >= 0)
+                n = snprintf(dst, room, spec, star[0] >= 0 ? star[0] : star[1], s);
+            else
+                n = snprintf(dst, room, spec, s);
+            if (n > 0) len += (size_t)n;
+            continue;
+        }
+        if ('p' == conv) {
+            n = snprintf(out, sizeof out, "0x%llx", (unsigned long long)u);
+            put(buf, size, &len, out, (size_t)n);
+            continue;
+        }
+        if ('c' == conv) {
+            memcpy(spec + sl, "c", 2);
+        } else {
+            spec[sl++] = 'l';
+            spec[sl++] = 'l';
+            spec[sl++] = conv;
+            spec[sl] = 0;
+        }
+        // Signed conversions extend the sign of 32 bit arguments
+        long long v = ('d' == conv || 'i' == conv) && DLOG_KIND_32 == kind ? (long long)(int32_t)u
+                      : 'c' == conv                                        ? (long long)(int)u
+                                                                           : (long long)u;
+        if (star[0] >= 0 && star[1] >= 0)
+            n = 'c' == conv ? snprintf(out, sizeof out, spec, star[0], star[1], (int)v)
+                            : snprintf(out, sizeof out, spec, star[0], star[1], v);
+        else if (star[0] >= 0 || star[1] >= 0) {
+            int w = star[0] >= 0 ? star[0] : star[1];
+            n = 'c' == conv ? snprintf(out, sizeof out, spec, w, (int)v)
+                            : snprintf(out, sizeof out, spec, w, v);
+        } else
+            n = 'c' == conv ? snprintf(out, sizeof out, spec, (int)v) : snprintf(out, sizeof out, spec, v);
+        if (n > 0) put(buf, size, &len, out, (size_t)n < sizeof out ? (size_t)n : sizeof out - 1);
+    }
+    if (size) buf[len < size ? len : size - 1] = 0;
+    return (int)len;
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+void dlog_hex_line(const dlog_rec_t *rec, char *line, size_t size) {
+    static const char digits[] = "0123456789abcdef";
+    if (size < DLOG_LINE_MAX) {
+        if (size) *line = 0;
+        return;
+    }
+    const uint8_t *p = (const uint8_t *)rec + 4;
+    memcpy(line, DLOG_LINE_TAG, sizeof DLOG_LINE_TAG - 1);
+    char *q = line + sizeof DLOG_LINE_TAG - 1;
+    for (size_t i = 0; i < DLOG_LINE_BYTES; ++i) {
+        *q++ = digits[p[i] >> 4];
+        *q++ = digits[p[i] & 15];
+    }
+    *q = 0;
+}
+
+bool dlog_parse_line(const char *line, dlog_rec_t *rec) {
+    size_t tag = strlen(DLOG_LINE_TAG);
+    if (strncmp(line, DLOG_LINE_TAG, tag)) return false;
+    line += tag;
+    uint8_t *p = (uint8_t *)rec + 4;
+    for (size_t i = 0; i < DLOG_LINE_BYTES; ++i) {
+        int hi = hex_digit(line[2 * i]);
+        int lo = hi < 0 ? -1 : hex_digit(line[2 * i + 1]);
+        if (lo < 0) return false;
+        p[i] = (uint8_t)(hi << 4 | lo);
+    }
+    rec->seq = 0;
+    return true;
+}
+
+#if DLOG
+
+_Static_assert(!(DLOG_DEPTH & (DLOG_DEPTH - 1)), "DLOG_DEPTH must be a power of two");
+
+// Bounds of the format section, defined by the linker
+extern const char __start_dlog_fmt[] __attribute__((weak));
+
+static dlog_rec_t ring[DLOG_DEPTH];
+static volatile uint32_t head;  // Tickets handed out
+static volatile uint32_t tail;  // Records drained
+static dlog_stats_t stats;
+static uint32_t dropped_seen;    // stats.dropped already reported
+static dlog_output_t output = DLOG_OUT_TEXT;
+#if PICO_ON_DEVICE
+static spin_lock_t *lock;
+#endif
+
+void dlog_init() {
+#if PICO_ON_DEVICE
+    if (!lock) lock = spin_lock_init(spin_lock_claim_unused(true));
+#endif
+}
+
+// Hands out the next slot, or returns false if the ring is full
+static bool reserve(uint32_t *ticket) {
+#if PICO_ON_DEVICE
+    if (!lock) return false;
+    uint32_t save = spin_lock_blocking(lock);
+    uint32_t h = head;
+    bool ok = h - tail < DLOG_DEPTH;
+    if (ok) {
+        head = h + 1;
+        ++stats.logged;
+        if (h + 1 - tail > stats.peak) stats.peak = h + 1 - tail;
+    } else
+        ++stats.dropped;
+    spin_unlock(lock, save);
+    *ticket = h;
+    return ok;
+#else
+    uint32_t h = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    do {
+        if (h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) >= DLOG_DEPTH) {
+            __atomic_fetch_add(&stats.dropped, 1, __ATOMIC_RELAXED);
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&head, &h, h + 1, true, __ATOMIC_ACQ_REL,
+                                          __ATOMIC_RELAXED));
+    __atomic_fetch_add(&stats.logged, 1, __ATOMIC_RELAXED);
+    uint32_t pending = h + 1 - __atomic_load_n(&tail, __ATOMIC_RELAXED);
+    uint32_t peak = __atomic_load_n(&stats.peak, __ATOMIC_RELAXED);
+    while (pending > peak && !__atomic_compare_exchange_n(&stats.peak, &peak, pending, true,
+                                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+    *ticket = h;
+    return true;
+#endif
+}
+
+void dlog_write(const char *fmt, uint32_t kinds, const dlog_arg_t *args) {
+    uint32_t now = SD_STATS_NOW_US();
+    uint32_t ticket;
+    if (!reserve(&ticket)) return;
+    dlog_rec_t *r = &ring[ticket & (DLOG_DEPTH - 1)];
+    r->t_us = now;
+    r->id = (uint16_t)(fmt - __start_dlog_fmt);
+    // Space kept for the arguments after each one, so that a long string is
+    // cut rather than what follows it (short strings kept whole)
+    unsigned need[DLOG_MAX_ARGS + 1] = {0};
+    for (int i = DLOG_MAX_ARGS - 1; i >= 0; --i) {
+        unsigned k = (kinds >> (2 * i)) & 3;
+        if (DLOG_KIND_NONE == k) continue;
+        unsigned n = DLOG_KIND_64 == k ? 8 : 4;
+        if (DLOG_KIND_STR == k)
+            n = args[i].s ? strnlen(args[i].s, DLOG_STR_KEEP - 1) + 1 : sizeof "(null)";
+        need[i] = need[i + 1] + n;
+    }
+    unsigned pos = 0;
+    uint32_t stored = 0;
+    for (unsigned i = 0; i < DLOG_MAX_ARGS; ++i) {
+        unsigned k = (kinds >> (2 * i)) & 3;
+        if (DLOG_KIND_NONE == k) break;
+        if (DLOG_KIND_STR == k) {
+            const char *s = args[i].s ? args[i].s : "(null)";
+            if (pos + need[i + 1] + 1 > DLOG_DATA) break;
+            unsigned room = DLOG_DATA - pos - need[i + 1];  // With the NUL
+            unsigned n = 0;
+            while (n + 1 < room && s[n]) {
+                r->data[pos + n] = (uint8_t)s[n];
+                ++n;
+            }
+            r->data[pos + n] = 0;
+            pos += n + 1;
+        } else {
+            unsigned n = DLOG_KIND_64 == k ? 8 : 4;
+            if (pos + n > DLOG_DATA) break;
+            uint64_t v = args[i].u;
+            for (unsigned b = 0; b < n; ++b, v >>= 8) r->data[pos + b] = (uint8_t)v;
+            pos += n;
+        }
+        stored |= k << (2 * i);
+    }
+    r->kinds = (uint16_t)stored;
+#if PICO_ON_DEVICE
+    __mem_fence_release();
+    r->seq = ticket + 1;
+#else
+    __atomic_store_n(&r->seq, ticket + 1, __ATOMIC_RELEASE);
+#endif
+}
+
+const char *dlog_fmt_of(const dlog_rec_t *rec) { return __start_dlog_fmt + rec->id; }
+
+bool dlog_take(dlog_rec_t *rec) {
+    uint32_t t = tail;
+    dlog_rec_t *slot = &ring[t & (DLOG_DEPTH - 1)];
+#if PICO_ON_DEVICE
+    if (slot->seq != t + 1) return false;
+    __mem_fence_acquire();
+    *rec = *slot;
+    __mem_fence_release();
+    tail = t + 1;
+#else
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != t + 1) return false;
+    *rec = *slot;
+    __atomic_store_n(&tail, t + 1, __ATOMIC_RELEASE);
+#endif
+    return true;
+}
+
+uint32_t dlog_drain(uint32_t max) {
+    uint32_t n = 0;
+    dlog_rec_t r;
+    // Each record is copied out first, so its slot is free during the output
+    for (; n < max && dlog_take(&r); ++n) {
+        if (DLOG_OUT_HEX == output) {
+            char line[DLOG_LINE_MAX];
+            dlog_hex_line(&r, line, sizeof line);
+            puts(line);
+        } else {
+            char text[256];
+            dlog_format(text, sizeof text, dlog_fmt_of(&r), &r);
+            fputs(text, stdout);
+        }
+    }
+    uint32_t dropped = stats.dropped;
+    if (dropped != dropped_seen) {
+        printf("[dlog] %lu messages dropped\n", (unsigned long)(dropped - dropped_seen));
+        dropped_seen = dropped;
+    }
+    return n;
+}
+
+void dlog_set_output(dlog_output_t out) { output = out; }
+
+dlog_output_t dlog_output() { return output; }
+
+void dlog_get_stats(dlog_stats_t *s) { *s = stats; }
+
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,123 @@
+/* export.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+//
+#if PICO_ON_DEVICE
+#include "pico/time.h"
+#endif
+//
+#include "ff.h"
+//
+#include "crc.h"
+#include "f_util.h"
+#include "my_debug.h"
+//
+#include "export.h"
+
+#define TRACE_PRINTF(fmt, args...)
+//#define TRACE_PRINTF printf
+
+#if !FF_USE_FORWARD
+#error "export needs FF_USE_FORWARD"
+#endif
+
+static_assert(EXPORT_FRAME % FF_MAX_SS == 0 && EXPORT_FRAME <= EXPORT_FRAME_MAX, "");
+static_assert(sizeof(export_hdr_t) == 20, "");
+
+static uint32_t now_us() {
+#if PICO_ON_DEVICE
+    return time_us_32();
+#else
+    return (uint32_t)((uint64_t)clock() * 1000000 / CLOCKS_PER_SEC);
+#endif
+}
+
+// The transfer in progress, for the f_forward() callback
+static struct {
+    export_out_t out;
+    uint16_t crc;
+} cur;
+
+static void send_frame(uint8_t type, uint32_t offset, uint32_t arg, const void *payload,
+                       uint16_t len) {
+    export_hdr_t h = {EXPORT_MAGIC, type, 0, len, offset, arg, 0, 0};
+    h.crc = crc16((const char *)&h, offsetof(export_hdr_t, crc));
+    cur.out(&h, sizeof h);
+    uint16_t crc = 0;
+    update_crc16(&crc, (const char *)payload, len);
+    if (len) cur.out(payload, len);
+    cur.out(&crc, sizeof crc);
+}
+
+// Streaming function: the data is in the file's sector buffer
+static UINT forward(const BYTE *p, UINT n) {
+    if (!n) return 1;  // Sense call: always ready, the output blocks instead
+    update_crc16(&cur.crc, (const char *)p, n);
+    cur.out(p, n);
+    return n;
+}
+
+FRESULT export_file(const TCHAR *path, uint32_t offset, uint32_t len, export_out_t out,
+                    export_stats_t *st) {
+    static FIL fil;
+    export_stats_t local;
+    if (!st) st = &local;
+    memset(st, 0, sizeof *st);
+    FRESULT fr = f_open(&fil, path, FA_READ);
+    if (FR_OK != fr) return fr;
+    cur.out = out;
+    uint32_t t0 = now_us();
+    FSIZE_t size = f_size(&fil);
+    if (offset > size) offset = (uint32_t)size;
+    uint32_t end = !len || size - offset < len ? (uint32_t)size : offset + len;
+    send_frame(EXPORT_BEGIN, offset, (uint32_t)size, path, (uint16_t)strlen(path));
+
+    fr = f_lseek(&fil, offset);
+    uint32_t pos = offset;
+    while (FR_OK == fr && pos < end) {
+        // Frames end on multiples of EXPORT_FRAME: all but the first and the
+        // last are whole, aligned sectors
+        uint32_t n = EXPORT_FRAME - pos % EXPORT_FRAME;
+        if (n > end - pos) n = end - pos;
+        export_hdr_t h = {EXPORT_MAGIC, EXPORT_DATA, 0, (uint16_t)n, pos, 0, 0, 0};
+        h.crc = crc16((const char *)&h, offsetof(export_hdr_t, crc));
+        out(&h, sizeof h);
+        cur.crc = 0;
+        UINT sent = 0;
+        fr = f_forward(&fil, forward, n, &sent);
+        if (FR_OK == fr && sent != n) fr = FR_INT_ERR;
+        if (FR_OK != fr) {
+            // The frame is cut short: its CRC fails and the receiver resumes
+            break;
+        }
+        out(&cur.crc, sizeof cur.crc);
+        pos += n;
+        st->bytes += n;
+        st->frames++;
+    }
+    send_frame(EXPORT_END, pos, fr, NULL, 0);
+    st->us = now_us() - t0;
+    FRESULT fr2 = f_close(&fil);
+    if (FR_OK == fr) fr = fr2;
+    if (FR_OK != fr)
+        DBG_PRINTF("%s: %s: %s (%d)\n", __func__, path, FRESULT_str(fr), fr);
+    TRACE_PRINTF("%s: %s: %llu bytes in %lu frames, %lu us\n", __func__, path,
+                 (unsigned long long)st->bytes, (unsigned long)st->frames,
+                 (unsigned long)st->us);
+    return fr;
+}
+
+/* [] END OF FILE */
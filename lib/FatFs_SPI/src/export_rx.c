@@ -0,0 +1,77 @@
+/* export_rx.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Receiving side of export.h: no file system calls, builds on the host too.
+
+#include <stddef.h>
+#include <string.h>
+//
+#include "crc.h"
+//
+#include "export.h"
+
+void export_rx_init(export_rx_t *rx) { memset(rx, 0, sizeof *rx); }
+
+static bool hdr_valid(const export_hdr_t *h) {
+    return EXPORT_MAGIC == h->magic && h->len <= EXPORT_FRAME_MAX &&
+           h->crc == crc16((const char *)h, offsetof(export_hdr_t, crc));
+}
+
+static void drop(export_rx_t *rx, size_t n) {
+    memmove(rx->buf, rx->buf + n, rx->have - n);
+    rx->have -= n;
+}
+
+void export_rx_feed(export_rx_t *rx, const void *data, size_t len, export_rx_cb_t cb,
+                    void *arg) {
+    const uint8_t *p = data;
+    while (len) {
+        size_t n = sizeof rx->buf - rx->have;
+        if (n > len) n = len;
+        memcpy(rx->buf + rx->have, p, n);
+        rx->have += n;
+        p += n;
+        len -= n;
+        for (;;) {
+            // Resynchronise on the magic number
+            size_t skip = 0;
+            uint32_t magic = EXPORT_MAGIC;
+            while (skip + sizeof magic <= rx->have && memcmp(rx->buf + skip, &magic, sizeof magic))
+                ++skip;
+            if (skip + sizeof magic > rx->have && rx->have >= sizeof magic)
+                skip = rx->have - (sizeof magic - 1);  // Keep what may start one
+            if (skip) {
+                rx->skipped += skip;
+                drop(rx, skip);
+            }
+            if (rx->have < sizeof(export_hdr_t)) break;
+            export_hdr_t h;
+            memcpy(&h, rx->buf, sizeof h);
+            if (!hdr_valid(&h)) {
+                rx->skipped++;
+                drop(rx, 1);
+                continue;
+            }
+            size_t total = sizeof h + h.len + 2;
+            if (rx->have < total) break;
+            const uint8_t *payload = rx->buf + sizeof h;
+            uint16_t crc = 0, sent;
+            update_crc16(&crc, (const char *)payload, h.len);
+            memcpy(&sent, payload + h.len, sizeof sent);
+            if (crc != sent) rx->bad++;
+            cb(arg, &h, payload, crc == sent);
+            drop(rx, total);
+        }
+    }
+}
+
+/* [] END OF FILE */
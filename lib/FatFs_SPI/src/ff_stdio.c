@@ -27,6 +27,133 @@ specific language governing permissions and limitations under the License.
 #define TRACE_PRINTF(fmt, args...) {}
 //#define TRACE_PRINTF printf
 
+enum { BUF_IDLE, BUF_READ, BUF_WRITE };
+
+static void init_stream(FF_FILE *s) {
+    memset(s, 0, sizeof *s);
+    s->size = FF_STDIO_BUFSIZE;
+    s->mode = s->size ? FF_IOFBF : FF_IONBF;
+}
+
+// Allocates the buffer at the first access; without memory the stream
+// goes on unbuffered
+static bool buffered(FF_FILE *s) {
+    if (!s->size) return false;
+    if (!s->buf) {
+        s->buf = malloc(s->size);
+        if (!s->buf) {
+            s->size = 0;
+            return false;
+        }
+        s->own = true;
+    }
+    return true;
+}
+
+// Writes out the data waiting in the buffer
+static FRESULT drain(FF_FILE *s) {
+    if (BUF_WRITE != s->state) return FR_OK;
+    UINT bw = 0;
+    FRESULT fr = f_write(&s->fil, s->buf, s->pos, &bw);
+    if (FR_OK == fr && bw != s->pos) fr = FR_DENIED;  // Volume full
+    memmove(s->buf, s->buf + bw, s->pos - bw);
+    s->pos -= bw;
+    if (!s->pos) s->state = BUF_IDLE;
+    return fr;
+}
+
+// Drops the read-ahead: FatFs' position goes back to the stream's
+static FRESULT unread(FF_FILE *s) {
+    if (BUF_READ != s->state) return FR_OK;
+    FRESULT fr = FR_OK;
+    if (s->pos < s->len) fr = f_lseek(&s->fil, f_tell(&s->fil) - (s->len - s->pos));
+    s->pos = s->len = 0;
+    s->state = BUF_IDLE;
+    return fr;
+}
+
+// Leaves the buffer idle with FatFs at the stream position
+static FRESULT settle(FF_FILE *s) { return BUF_WRITE == s->state ? drain(s) : unread(s); }
+
+static FSIZE_t tell(FF_FILE *s) {
+    if (BUF_READ == s->state) return f_tell(&s->fil) - (s->len - s->pos);
+    if (BUF_WRITE == s->state) return f_tell(&s->fil) + s->pos;
+    return f_tell(&s->fil);
+}
+
+// The read buffer is used up: FatFs is at the stream position
+static void consumed(FF_FILE *s) {
+    if (s->pos < s->len) return;
+    s->pos = s->len = 0;
+    s->state = BUF_IDLE;
+}
+
+static FRESULT fill(FF_FILE *s) {
+    UINT br = 0;
+    FRESULT fr = f_read(&s->fil, s->buf, s->size, &br);
+    s->pos = 0;
+    s->len = br;
+    s->state = br ? BUF_READ : BUF_IDLE;
+    return fr;
+}
+
+static FRESULT read_buf(FF_FILE *s, uint8_t *dst, size_t n, size_t *got) {
+    *got = 0;
+    FRESULT fr = drain(s);
+    if (FR_OK != fr) return fr;
+    while (n) {
+        if (BUF_READ == s->state) {
+            size_t k = s->len - s->pos < n ? s->len - s->pos : n;
+            memcpy(dst, s->buf + s->pos, k);
+            s->pos += k;
+            dst += k;
+            n -= k;
+            *got += k;
+            consumed(s);
+            continue;
+        }
+        if (!buffered(s) || n >= s->size) {
+            // Whole sectors go straight from the card to the caller
+            UINT br = 0;
+            fr = f_read(&s->fil, dst, n, &br);
+            *got += br;
+            return fr;
+        }
+        fr = fill(s);
+        if (FR_OK != fr || !s->len) return fr;
+    }
+    return FR_OK;
+}
+
+static FRESULT write_buf(FF_FILE *s, const uint8_t *src, size_t n, size_t *put) {
+    *put = 0;
+    FRESULT fr = unread(s);
+    if (FR_OK != fr) return fr;
+    const uint8_t *start = src;
+    while (n) {
+        if (buffered(s) && s->pos == s->size) {
+            fr = drain(s);
+            if (FR_OK != fr) return fr;
+        }
+        if (!buffered(s) || (!s->pos && n >= s->size)) {
+            UINT bw = 0;
+            fr = f_write(&s->fil, src, n, &bw);
+            if (FR_OK == fr && bw != n) fr = FR_DENIED;
+            *put += bw;
+            return fr;
+        }
+        size_t k = s->size - s->pos < n ? s->size - s->pos : n;
+        memcpy(s->buf + s->pos, src, k);
+        s->pos += k;
+        s->state = BUF_WRITE;
+        src += k;
+        n -= k;
+        *put += k;
+    }
+    if (FF_IOLBF == s->mode && memchr(start, '\n', *put)) fr = drain(s);
+    return fr;
+}
+
 static BYTE posix2mode(const char *pcMode) {
     if (0 == strcmp("r", pcMode)) return FA_READ;
     if (0 == strcmp("r+", pcMode)) return FA_READ | FA_WRITE;
@@ -94,12 +221,13 @@ FF_FILE *ff_fopen(const char *pcFile, const char *pcMode) {
     //  const TCHAR* path, /* [IN] File name */
     //  BYTE mode          /* [IN] Mode flags */
     //);
-    FIL *fp = malloc(sizeof(FIL));
+    FF_FILE *fp = malloc(sizeof(FF_FILE));
     if (!fp) {
         errno = ENOMEM;
         return NULL;
     }
-    FRESULT fr = f_open(fp, pcFile, posix2mode(pcMode));
+    init_stream(fp);
+    FRESULT fr = f_open(&fp->fil, pcFile, posix2mode(pcMode));
     errno = fresult2errno(fr);
     if (FR_OK != fr) {
         TRACE_PRINTF("%s error: %s (%d)\n", __func__, FRESULT_str(fr), fr);
@@ -113,10 +241,13 @@ int ff_fclose(FF_FILE *pxStream) {
     // FRESULT f_close (
     //  FIL* fp     /* [IN] Pointer to the file object */
     //);
-    FRESULT fr = f_close(pxStream);
+    FRESULT fr = drain(pxStream);
+    FRESULT fr2 = f_close(&pxStream->fil);
+    if (FR_OK == fr) fr = fr2;
     if (FR_OK != fr)
         TRACE_PRINTF("%s error: %s (%d)\n", __func__, FRESULT_str(fr), fr);
     errno = fresult2errno(fr);
+    if (pxStream->own) free(pxStream->buf);
     free(pxStream);
     if (FR_OK == fr)
         return 0;
@@ -152,8 +283,9 @@ size_t ff_fwrite(const void *pvBuffer, size_t xSize, size_t xItems,
     //  UINT* bw          /* [OUT] Pointer to the variable to return number of
     //  bytes written */
     //);
-    UINT bw = 0;
-    FRESULT fr = f_write(pxStream, pvBuffer, xSize * xItems, &bw);
+    if (!xSize) return 0;
+    size_t bw = 0;
+    FRESULT fr = write_buf(pxStream, pvBuffer, xSize * xItems, &bw);
     if (FR_OK != fr)
         TRACE_PRINTF("%s error: %s (%d)\n", __func__, FRESULT_str(fr), fr);
     errno = fresult2errno(fr);
@@ -168,8 +300,9 @@ size_t ff_fread(void *pvBuffer, size_t xSize, size_t xItems,
     //  UINT btr,    /* [IN] Number of bytes to read */
     //  UINT* br     /* [OUT] Number of bytes read */
     //);
-    UINT br = 0;
-    FRESULT fr = f_read(pxStream, pvBuffer, xSize * xItems, &br);
+    if (!xSize) return 0;
+    size_t br = 0;
+    FRESULT fr = read_buf(pxStream, pvBuffer, xSize * xItems, &br);
     if (FR_OK != fr)
         TRACE_PRINTF("%s error: %s (%d)\n", __func__, FRESULT_str(fr), fr);
     errno = fresult2errno(fr);
@@ -237,10 +370,15 @@ int ff_fputc(int iChar, FF_FILE *pxStream) {
     //  UINT* bw          /* [OUT] Pointer to the variable to return number of
     //  bytes written */
     //);
-    UINT bw = 0;
+    if (BUF_WRITE == pxStream->state && pxStream->pos < pxStream->size &&
+        FF_IOLBF != pxStream->mode) {
+        pxStream->buf[pxStream->pos++] = iChar;
+        return iChar;
+    }
+    size_t bw = 0;
     uint8_t buff[1];
     buff[0] = iChar;
-    FRESULT fr = f_write(pxStream, buff, 1, &bw);
+    FRESULT fr = write_buf(pxStream, buff, 1, &bw);
     if (FR_OK != fr)
         TRACE_PRINTF("%s error: %s (%d)\n", __func__, FRESULT_str(fr), fr);
     errno = fresult2errno(fr);
@@ -261,9 +399,11 @@ int ff_fgetc(FF_FILE *pxStream) {
     //  UINT btr,    /* [IN] Number of bytes to read */
     //  UINT* br     /* [OUT] Number of bytes read */
     //);
+    if (BUF_READ == pxStream->state && pxStream->pos + 1 < pxStream->len)
+        return pxStream->buf[pxStream->pos++];
     uint8_t buff[1] = {0};
-    UINT br;
-    FRESULT fr = f_read(pxStream, buff, 1, &br);
+    size_t br;
+    FRESULT fr = read_buf(pxStream, buff, 1, &br);
     if (FR_OK != fr)
         TRACE_PRINTF("%s error: %s (%d)\n", __func__, FRESULT_str(fr), fr);
     errno = fresult2errno(fr);
@@ -304,29 +444,38 @@ long ff_ftell(FF_FILE *pxStream) {
     // FSIZE_t f_tell (
     //  FIL* fp   /* [IN] File object */
     //);
-    FSIZE_t pos = f_tell(pxStream);
+    FSIZE_t pos = tell(pxStream);
     myASSERT(pos < LONG_MAX);
     return pos;
 }
 int ff_fseek(FF_FILE *pxStream, int iOffset, int iWhence) {
     TRACE_PRINTF("%s\n", __func__);
     FRESULT fr = -1;
+    FSIZE_t base = 0;
     switch (iWhence) {
         case FF_SEEK_CUR:  // The current file position.
-            if ((int)f_tell(pxStream) + iOffset < 0) return -1;
-            fr = f_lseek(pxStream, f_tell(pxStream) + iOffset);
+            base = tell(pxStream);
             break;
         case FF_SEEK_END:  // The end of the file.
-            if ((int)f_size(pxStream) + iOffset < 0) return -1;
-            fr = f_lseek(pxStream, f_size(pxStream) + iOffset);
+            base = ff_filelength(pxStream);
             break;
         case FF_SEEK_SET:  // The beginning of the file.
-            if (iOffset < 0) return -1;
-            fr = f_lseek(pxStream, iOffset);
             break;
         default:
             myASSERT(!"Bad iWhence");
     }
+    if ((long long)base + iOffset < 0) return -1;
+    FSIZE_t to = base + iOffset;
+    FF_FILE *s = pxStream;
+    if (BUF_READ == s->state && to <= f_tell(&s->fil) && to >= f_tell(&s->fil) - s->len) {
+        // Still inside the read buffer: no I/O
+        s->pos = s->len - (f_tell(&s->fil) - to);
+        consumed(s);
+        fr = FR_OK;
+    } else {
+        fr = settle(s);
+        if (FR_OK == fr) fr = f_lseek(&s->fil, to);
+    }
     errno = fresult2errno(fr);
     if (FR_OK == fr)
         return 0;
@@ -389,31 +538,32 @@ int ff_findnext(FF_FindData_t *pxFindData) {
 }
 FF_FILE *ff_truncate(const char *pcFileName, long lTruncateSize) {
     TRACE_PRINTF("%s\n", __func__);
-    FIL *fp = malloc(sizeof(FIL));
+    FF_FILE *fp = malloc(sizeof(FF_FILE));
     if (!fp) {
         errno = ENOMEM;
         return NULL;
     }
-    FRESULT fr = f_open(fp, pcFileName, FA_OPEN_APPEND | FA_WRITE);
+    init_stream(fp);
+    FRESULT fr = f_open(&fp->fil, pcFileName, FA_OPEN_APPEND | FA_WRITE);
     if (FR_OK != fr)
         printf("%s: f_open error: %s (%d)\n", __func__, FRESULT_str(fr), fr);
     errno = fresult2errno(fr);
     if (FR_OK != fr) return NULL;
-    while (f_tell(fp) < (FSIZE_t)lTruncateSize) {
+    while (f_tell(&fp->fil) < (FSIZE_t)lTruncateSize) {
         UINT bw = 0;
         char c = 0;
-        fr = f_write(fp, &c, 1, &bw);
+        fr = f_write(&fp->fil, &c, 1, &bw);
         if (FR_OK != fr)
             TRACE_PRINTF("%s error: %s (%d)\n", __func__, FRESULT_str(fr), fr);
         errno = fresult2errno(fr);
         if (1 != bw) return NULL;
     }
-    fr = f_lseek(fp, lTruncateSize);
+    fr = f_lseek(&fp->fil, lTruncateSize);
     errno = fresult2errno(fr);
     if (FR_OK != fr)
         printf("%s: f_lseek error: %s (%d)\n", __func__, FRESULT_str(fr), fr);
     if (FR_OK != fr) return NULL;
-    fr = f_truncate(fp);
+    fr = f_truncate(&fp->fil);
     if (FR_OK != fr)
         printf("%s: f_truncate error: %s (%d)\n", __func__, FRESULT_str(fr),
                fr);
@@ -425,7 +575,8 @@ FF_FILE *ff_truncate(const char *pcFileName, long lTruncateSize) {
 }
 int ff_seteof(FF_FILE *pxStream) {
     TRACE_PRINTF("%s\n", __func__);
-    FRESULT fr = f_truncate(pxStream);
+    FRESULT fr = settle(pxStream);
+    if (FR_OK == fr) fr = f_truncate(&pxStream->fil);
     errno = fresult2errno(fr);
     if (FR_OK == fr)
         return 0;
@@ -451,13 +602,83 @@ int ff_rename(const char *pcOldName, const char *pcNewName,
 }
 char *ff_fgets(char *pcBuffer, size_t xCount, FF_FILE *pxStream) {
     TRACE_PRINTF("%s\n", __func__);
-    TCHAR *p = f_gets(pcBuffer, xCount, pxStream);
+    // As fgets(): up to xCount - 1 bytes, stopping after a newline
+    FF_FILE *s = pxStream;
+    size_t n = 0;
+    bool nl = false;
+    FRESULT fr = drain(s);
+    while (FR_OK == fr && !nl && n + 1 < xCount) {
+        if (!buffered(s)) {
+            UINT br = 0;
+            fr = f_read(&s->fil, pcBuffer + n, 1, &br);
+            if (!br) break;
+            nl = '\n' == pcBuffer[n++];
+            continue;
+        }
+        // A line at a time out of the buffer
+        if (BUF_READ != s->state) {
+            fr = fill(s);
+            if (FR_OK != fr || !s->len) break;
+        }
+        size_t k = s->len - s->pos;
+        if (k > xCount - 1 - n) k = xCount - 1 - n;
+        const uint8_t *p = memchr(s->buf + s->pos, '\n', k);
+        if (p) {
+            k = p - (s->buf + s->pos) + 1;
+            nl = true;
+        }
+        memcpy(pcBuffer + n, s->buf + s->pos, k);
+        n += k;
+        s->pos += k;
+        consumed(s);
+    }
+    if (xCount) pcBuffer[n] = 0;
     // On success a pointer to pcBuffer is returned. If there is a read error
     // then NULL is returned and the task's errno is set to indicate the reason.
-    if (p == pcBuffer)
-        return pcBuffer;
-    else {
-        errno = EIO;
+    // At the end of the file NULL is returned.
+    if (FR_OK != fr) {
+        errno = fresult2errno(fr);
         return NULL;
     }
+    return n ? pcBuffer : NULL;
+}
+int ff_setvbuf(FF_FILE *pxStream, char *pcBuffer, int iMode, size_t xSize) {
+    TRACE_PRINTF("%s\n", __func__);
+    FF_FILE *s = pxStream;
+    if (BUF_IDLE != s->state || iMode < FF_IOFBF || iMode > FF_IONBF) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (s->own) free(s->buf);
+    s->buf = NULL;
+    s->own = false;
+    s->mode = iMode;
+    s->size = FF_IONBF == iMode ? 0 : xSize;
+    if (s->size && pcBuffer) {
+        s->buf = (uint8_t *)pcBuffer;
+    } else if (s->size && !buffered(s)) {
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+int ff_fflush(FF_FILE *pxStream) {
+    TRACE_PRINTF("%s\n", __func__);
+    FRESULT fr = drain(pxStream);
+    if (FR_OK == fr) fr = f_sync(&pxStream->fil);
+    errno = fresult2errno(fr);
+    if (FR_OK == fr)
+        return 0;
+    else
+        return FF_EOF;
+}
+void ff_rewind(FF_FILE *pxStream) { ff_fseek(pxStream, 0, FF_SEEK_SET); }
+long ff_filelength(FF_FILE *pxStream) {
+    FSIZE_t size = f_size(&pxStream->fil);
+    FSIZE_t pos = tell(pxStream);  // Writes still in the buffer may extend the file
+    return pos > size ? pos : size;
+}
+int ff_feof(FF_FILE *pxStream) {
+    if (BUF_READ == pxStream->state) return 0;
+    return tell(pxStream) >= (FSIZE_t)ff_filelength(pxStream);
 }
@@ -0,0 +1,418 @@
+/* flash_log.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+#include <string.h>
+//
+#if PICO_ON_DEVICE
+#include "hardware/flash.h"
+#include "pico/flash.h"
+#endif
+//
+#include "crc.h"
+//
+#include "flash_log.h"
+
+#define TRACE_PRINTF(fmt, args...)
+//#define TRACE_PRINTF printf
+
+#define SEC_HDR sizeof(flash_log_sec_hdr_t)
+#define REC_HDR sizeof(flash_log_rec_hdr_t)
+#define ERASED32 0xFFFFFFFF
+#define ERASED16 0xFFFF
+
+static uint32_t next_sec(const flash_log_t *fl, uint32_t s) {
+    return s + 1 < fl->sectors ? s + 1 : 0;
+}
+
+// Sectors from a to b, going forward
+static uint32_t distance(const flash_log_t *fl, uint32_t a, uint32_t b) {
+    return b >= a ? b - a : b + fl->sectors - a;
+}
+
+// Holds records not committed yet (tail to head)
+static bool is_live(const flash_log_t *fl, uint32_t s) {
+    return !fl->empty && distance(fl, fl->tail, s) <= distance(fl, fl->tail, fl->head.sec);
+}
+
+static const uint8_t *sec_ptr(const flash_log_t *fl, uint32_t s) {
+    return fl->dev.base + s * FLASH_LOG_SECTOR_SIZE;
+}
+
+static flash_log_sec_hdr_t read_hdr(const flash_log_t *fl, uint32_t s) {
+    flash_log_sec_hdr_t hdr;
+    memcpy(&hdr, sec_ptr(fl, s), sizeof hdr);
+    return hdr;
+}
+
+static uint16_t hdr_crc(const flash_log_sec_hdr_t *hdr) {
+    uint16_t crc = 0;
+    update_crc16(&crc, (const char *)hdr, offsetof(flash_log_sec_hdr_t, crc));
+    return crc;
+}
+
+static bool hdr_open(const flash_log_sec_hdr_t *hdr) {
+    return FLASH_LOG_MAGIC == hdr->magic && hdr->crc == hdr_crc(hdr);
+}
+
+// Erased, possibly with the erase count programmed
+static bool hdr_ready(const flash_log_sec_hdr_t *hdr) {
+    return ERASED32 == hdr->magic && ERASED32 == hdr->seq && ERASED16 == hdr->crc &&
+           ERASED16 == hdr->drained;
+}
+
+static uint32_t hdr_erases(const flash_log_t *fl, const flash_log_sec_hdr_t *hdr) {
+    if (hdr_open(hdr) || (hdr_ready(hdr) && ERASED32 != hdr->erases)) return hdr->erases;
+    return fl->max_erases;  // Torn or never erased by us: best guess
+}
+
+static bool blank(const uint8_t *p, size_t len) {
+    while (len--)
+        if (0xFF != *p++) return false;
+    return true;
+}
+
+static uint32_t page_start(uint32_t p) { return p ? p * FLASH_LOG_PAGE_SIZE : SEC_HDR; }
+
+// Programs only the header fields in hdr that are not 0xFF..
+static int program_hdr(flash_log_t *fl, uint32_t s, const flash_log_sec_hdr_t *hdr) {
+    uint8_t page[FLASH_LOG_PAGE_SIZE] __attribute__((aligned(4)));
+    memset(page, 0xFF, sizeof page);
+    memcpy(page, hdr, sizeof *hdr);
+    fl->stats.programs++;
+    return fl->dev.program(fl->dev.ctx, s * FLASH_LOG_SECTOR_SIZE, page);
+}
+
+// Erases sector s and records its new erase count
+static int erase_sector(flash_log_t *fl, uint32_t s) {
+    flash_log_sec_hdr_t hdr = read_hdr(fl, s);
+    uint32_t erases = hdr_erases(fl, &hdr) + 1;
+    TRACE_PRINTF("%s(%lu): %lu erases\n", __func__, s, erases);
+    int rc = fl->dev.erase(fl->dev.ctx, s * FLASH_LOG_SECTOR_SIZE);
+    fl->stats.erases++;
+    if (rc) return rc;
+    if (erases > fl->max_erases) fl->max_erases = erases;
+    memset(&hdr, 0xFF, sizeof hdr);
+    hdr.erases = erases;
+    return program_hdr(fl, s, &hdr);
+}
+
+int flash_log_flush(flash_log_t *fl) {
+    if (!fl->staged) return 0;
+    uint32_t page = fl->head.off / FLASH_LOG_PAGE_SIZE;
+    if (fl->head.off % FLASH_LOG_PAGE_SIZE == 0) page--;  // head is at the end of the page
+    fl->stats.programs++;
+    int rc = fl->dev.program(fl->dev.ctx,
+                             fl->head.sec * FLASH_LOG_SECTOR_SIZE + page * FLASH_LOG_PAGE_SIZE,
+                             fl->page);
+    if (rc) return rc;
+    memset(fl->page, 0xFF, sizeof fl->page);
+    fl->staged = false;
+    return 0;
+}
+
+// Opens the sector after the head (or the first one) for writing
+static int open_sector(flash_log_t *fl) {
+    int rc = flash_log_flush(fl);
+    if (rc) return rc;
+    uint32_t s = fl->empty ? fl->head.sec : next_sec(fl, fl->head.sec);
+    if (!fl->empty && s == fl->tail) return -1;  // Full
+    flash_log_sec_hdr_t hdr = read_hdr(fl, s);
+    if (!hdr_ready(&hdr) ||
+        !blank(sec_ptr(fl, s) + sizeof hdr.erases, FLASH_LOG_SECTOR_SIZE - sizeof hdr.erases)) {
+        // flash_log_maintain() did not get to it
+        fl->stats.inline_erases++;
+        rc = erase_sector(fl, s);
+        if (rc) return rc;
+        hdr = read_hdr(fl, s);
+    }
+    if (ERASED32 == hdr.erases) hdr.erases = fl->max_erases;
+    hdr.magic = FLASH_LOG_MAGIC;
+    hdr.seq = fl->seq + 1;
+    hdr.crc = hdr_crc(&hdr);
+    rc = program_hdr(fl, s, &hdr);
+    if (rc) return rc;
+    fl->seq = hdr.seq;
+    fl->head.sec = s;
+    fl->head.off = SEC_HDR;
+    if (fl->empty) {
+        fl->empty = false;
+        fl->tail = s;
+        fl->sent = fl->done = fl->head;
+    }
+    return 0;
+}
+
+bool flash_log_put(flash_log_t *fl, const void *rec, size_t len) {
+    if (!len || len > FLASH_LOG_MAX_RECORD) {
+        fl->stats.dropped++;
+        return false;
+    }
+    uint32_t need = REC_HDR + len;
+    int rc = 0;
+    if (fl->staged && 0 == fl->head.off % FLASH_LOG_PAGE_SIZE)
+        rc = flash_log_flush(fl);  // Page filled but its program failed
+    if (!rc && !fl->empty && fl->head.off % FLASH_LOG_PAGE_SIZE + need > FLASH_LOG_PAGE_SIZE &&
+        fl->head.off < FLASH_LOG_SECTOR_SIZE) {
+        // Does not fit in this page: the rest stays blank and ends it
+        rc = flash_log_flush(fl);
+        if (!rc) fl->head.off = (fl->head.off / FLASH_LOG_PAGE_SIZE + 1) * FLASH_LOG_PAGE_SIZE;
+    }
+    if (!rc && (fl->empty || fl->head.off >= FLASH_LOG_SECTOR_SIZE)) rc = open_sector(fl);
+    if (rc) {
+        fl->stats.dropped++;
+        return false;
+    }
+    flash_log_rec_hdr_t hdr = {.len = (uint16_t)len};
+    uint16_t crc = 0;
+    update_crc16(&crc, (const char *)&hdr.len, sizeof hdr.len);
+    update_crc16(&crc, (const char *)rec, len);
+    hdr.crc = crc;
+    uint8_t *p = fl->page + fl->head.off % FLASH_LOG_PAGE_SIZE;
+    memcpy(p, &hdr, sizeof hdr);
+    memcpy(p + sizeof hdr, rec, len);
+    fl->head.off += need;
+    fl->staged = true;
+    fl->pending++;
+    fl->stats.records++;
+    // A full page goes out now, so that at most one page is ever staged
+    if (fl->head.off % FLASH_LOG_PAGE_SIZE + REC_HDR + 1 > FLASH_LOG_PAGE_SIZE)
+        flash_log_flush(fl);
+    return true;
+}
+
+static bool same_pos(flash_log_pos_t a, flash_log_pos_t b) {
+    return a.sec == b.sec && a.off == b.off;
+}
+
+// Finds the next valid record at or after pos, up to the head, and moves pos
+// past it. Programmed data only: flush first.
+static bool next_rec(const flash_log_t *fl, flash_log_pos_t *pos, const uint8_t **data,
+                     uint16_t *len) {
+    for (;;) {
+        if (same_pos(*pos, fl->head) || (pos->sec == fl->head.sec && pos->off > fl->head.off)) {
+            *pos = fl->head;
+            return false;
+        }
+        if (pos->off >= FLASH_LOG_SECTOR_SIZE) {
+            pos->sec = next_sec(fl, pos->sec);
+            pos->off = SEC_HDR;
+            continue;
+        }
+        uint32_t in_page = pos->off % FLASH_LOG_PAGE_SIZE;
+        if (in_page + REC_HDR <= FLASH_LOG_PAGE_SIZE) {
+            const uint8_t *p = sec_ptr(fl, pos->sec) + pos->off;
+            flash_log_rec_hdr_t hdr;
+            memcpy(&hdr, p, sizeof hdr);
+            if (hdr.len && hdr.len <= FLASH_LOG_MAX_RECORD &&
+                in_page + REC_HDR + hdr.len <= FLASH_LOG_PAGE_SIZE) {
+                uint16_t crc = 0;
+                update_crc16(&crc, (const char *)&hdr.len, sizeof hdr.len);
+                update_crc16(&crc, (const char *)p + REC_HDR, hdr.len);
+                if (crc == hdr.crc) {
+                    *data = p + REC_HDR;
+                    *len = hdr.len;
+                    pos->off += REC_HDR + hdr.len;
+                    return true;
+                }
+            }
+        }
+        // End of the page: blank, too short for a record, or torn
+        pos->off = (pos->off / FLASH_LOG_PAGE_SIZE + 1) * FLASH_LOG_PAGE_SIZE;
+    }
+}
+
+int flash_log_drain(flash_log_t *fl, flash_log_write_t write, void *ctx) {
+    if (!fl->pending) return 0;
+    int rc = flash_log_flush(fl);
+    if (rc) return rc;
+    flash_log_pos_t pos = fl->sent;
+    const uint8_t *data;
+    uint16_t len;
+    while (next_rec(fl, &pos, &data, &len)) {
+        rc = write(ctx, data, len);
+        if (rc) return rc;
+        fl->sent = pos;
+        fl->pending--;
+        fl->unsynced++;
+        fl->stats.drained++;
+    }
+    fl->sent = pos;
+    return 0;
+}
+
+// Clears the drained bits of sector s that are set in mask
+static int mark_drained(flash_log_t *fl, uint32_t s, uint16_t mask) {
+    flash_log_sec_hdr_t hdr = read_hdr(fl, s);
+    if (!(hdr.drained & mask)) return 0;
+    uint16_t drained = hdr.drained & ~mask;
+    memset(&hdr, 0xFF, sizeof hdr);
+    hdr.drained = drained;
+    return program_hdr(fl, s, &hdr);
+}
+
+int flash_log_commit(flash_log_t *fl) {
+    fl->done = fl->sent;
+    fl->unsynced = 0;
+    if (fl->empty) return 0;
+    int rc;
+    while (fl->tail != fl->done.sec) {
+        rc = mark_drained(fl, fl->tail, 0xFFFF);
+        if (rc) return rc;
+        fl->tail = next_sec(fl, fl->tail);
+    }
+    // Only whole pages, and never the one still being written
+    uint32_t pages = fl->done.off / FLASH_LOG_PAGE_SIZE;
+    if (fl->done.sec == fl->head.sec && fl->head.off / FLASH_LOG_PAGE_SIZE < pages)
+        pages = fl->head.off / FLASH_LOG_PAGE_SIZE;
+    if (!pages) return 0;
+    return mark_drained(fl, fl->tail, pages >= FLASH_LOG_PAGES ? 0xFFFF : (1u << pages) - 1);
+}
+
+void flash_log_rewind(flash_log_t *fl) {
+    fl->pending += fl->unsynced;
+    fl->unsynced = 0;
+    fl->sent = fl->done;
+}
+
+int flash_log_maintain(flash_log_t *fl) {
+    uint32_t s = fl->head.sec;
+    for (uint32_t i = fl->empty ? 0 : 1; i <= FLASH_LOG_SPARE; ++i) {
+        if (i) s = next_sec(fl, s);
+        if (is_live(fl, s)) break;
+        flash_log_sec_hdr_t hdr = read_hdr(fl, s);
+        if (hdr_ready(&hdr)) continue;
+        int rc = erase_sector(fl, s);
+        return rc ? rc : 1;
+    }
+    return 0;
+}
+
+// Finds the end of the data in the head sector
+static void find_head(flash_log_t *fl) {
+    const uint8_t *sec = sec_ptr(fl, fl->head.sec);
+    flash_log_sec_hdr_t hdr = read_hdr(fl, fl->head.sec);
+    // The last page with anything programmed
+    uint32_t p = FLASH_LOG_PAGES - 1;
+    while (p && blank(sec + p * FLASH_LOG_PAGE_SIZE, FLASH_LOG_PAGE_SIZE)) p--;
+    // Its valid records, with next_rec() bounded by the end of the page
+    uint32_t page_end = (p + 1) * FLASH_LOG_PAGE_SIZE;
+    flash_log_pos_t pos = {fl->head.sec, page_start(p)}, end = pos;
+    fl->head.off = page_end;
+    const uint8_t *data;
+    uint16_t len;
+    while (next_rec(fl, &pos, &data, &len)) end = pos;
+    // Whatever follows them must be blank, or the page is not reused
+    if (!blank(sec + end.off, page_end - end.off)) {
+        fl->stats.torn++;
+    } else if (hdr.drained & (1u << p)) {
+        fl->head.off = end.off;
+    }
+}
+
+int flash_log_mount(flash_log_t *fl, const flash_log_dev_t *dev) {
+    memset(fl, 0, sizeof *fl);
+    fl->dev = *dev;
+    fl->sectors = dev->size / FLASH_LOG_SECTOR_SIZE;
+    memset(fl->page, 0xFF, sizeof fl->page);
+    if (fl->sectors < FLASH_LOG_SPARE + 2) return -1;
+    fl->empty = true;
+    bool have_tail = false;
+    uint32_t tail_seq = 0;
+    for (uint32_t s = 0; s < fl->sectors; ++s) {
+        flash_log_sec_hdr_t hdr = read_hdr(fl, s);
+        if (hdr_open(&hdr)) {
+            if (fl->empty || hdr.seq > fl->seq) {
+                fl->seq = hdr.seq;
+                fl->head.sec = s;
+            }
+            fl->empty = false;
+            if (hdr.drained && (!have_tail || hdr.seq < tail_seq)) {
+                have_tail = true;
+                tail_seq = hdr.seq;
+                fl->tail = s;
+            }
+        } else if (!hdr_ready(&hdr)) {
+            fl->stats.torn++;  // Torn erase or header: flash_log_maintain() erases it
+            continue;
+        } else if (ERASED32 == hdr.erases) {
+            continue;
+        }
+        if (hdr.erases > fl->max_erases) fl->max_erases = hdr.erases;
+    }
+    if (fl->empty) return 0;
+    if (!have_tail) fl->tail = fl->head.sec;
+    find_head(fl);
+
+    // Resume at the first page of the tail not marked drained
+    flash_log_sec_hdr_t hdr = read_hdr(fl, fl->tail);
+    uint32_t p = 0;
+    while (p < FLASH_LOG_PAGES && !(hdr.drained & (1u << p))) p++;
+    fl->done.sec = fl->tail;
+    fl->done.off = p < FLASH_LOG_PAGES ? page_start(p) : FLASH_LOG_SECTOR_SIZE;
+    if (fl->done.sec == fl->head.sec && fl->done.off > fl->head.off) fl->done = fl->head;
+    fl->sent = fl->done;
+
+    flash_log_pos_t pos = fl->done;
+    const uint8_t *data;
+    uint16_t len;
+    while (next_rec(fl, &pos, &data, &len)) fl->pending++;
+    TRACE_PRINTF("%s: head %lu:%lu tail %lu, %lu pending\n", __func__, fl->head.sec,
+                 fl->head.off, fl->tail, fl->pending);
+    return 0;
+}
+
+#if PICO_ON_DEVICE
+
+// Time allowed for the other core to stop running from flash
+#define LOCKOUT_TIMEOUT_MS 100
+
+typedef struct {
+    uint32_t offset;
+    const uint8_t *data;
+} flash_op_t;
+
+static void do_erase(void *param) {
+    flash_op_t *op = param;
+    flash_range_erase(op->offset, FLASH_SECTOR_SIZE);
+}
+
+static void do_program(void *param) {
+    flash_op_t *op = param;
+    flash_range_program(op->offset, op->data, FLASH_PAGE_SIZE);
+}
+
+static int pico_erase(void *ctx, uint32_t offset) {
+    flash_op_t op = {(uint32_t)(uintptr_t)ctx + offset, NULL};
+    return flash_safe_execute(do_erase, &op, LOCKOUT_TIMEOUT_MS);
+}
+
+static int pico_program(void *ctx, uint32_t offset, const uint8_t *data) {
+    flash_op_t op = {(uint32_t)(uintptr_t)ctx + offset, data};
+    return flash_safe_execute(do_program, &op, LOCKOUT_TIMEOUT_MS);
+}
+
+bool flash_log_pico_dev(flash_log_dev_t *dev, uint32_t size) {
+    extern char __flash_binary_end;
+    if (!size || size % FLASH_SECTOR_SIZE || size > PICO_FLASH_SIZE_BYTES) return false;
+    uint32_t region = PICO_FLASH_SIZE_BYTES - size;
+    if ((uintptr_t)&__flash_binary_end - XIP_BASE > region) return false;
+    dev->erase = pico_erase;
+    dev->program = pico_program;
+    dev->ctx = (void *)(uintptr_t)region;
+    dev->base = (const uint8_t *)XIP_BASE + region;
+    dev->size = size;
+    return true;
+}
+
+#endif
+
+/* [] END OF FILE */
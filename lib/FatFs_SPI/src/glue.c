@@ -28,6 +28,7 @@ specific language governing permissions and limitations under the License.
 #include "hw_config.h"
 #include "my_debug.h"
 #include "sd_card.h"
+#include "sd_trace.h"
 
 #define TRACE_PRINTF(fmt, args...)
 //#define TRACE_PRINTF printf  // task_printf
@@ -59,8 +60,11 @@ DSTATUS disk_initialize(
 
     sd_card_t *p_sd = sd_get_by_num(pdrv);
     if (!p_sd) return RES_PARERR;
+    uint32_t t0 = SD_STATS_NOW_US();
     // See http://elm-chan.org/fsw/ff/doc/dstat.html
-    return p_sd->init(p_sd);  
+    DSTATUS ds = p_sd->init(p_sd);
+    sd_trace(SD_TRACE_INIT, pdrv, 0, ds, t0);
+    return ds;
 }
 
 static int sdrc2dresult(int sd_rc) {
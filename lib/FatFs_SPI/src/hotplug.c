@@ -0,0 +1,103 @@
+/* hotplug.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+#include <string.h>
+//
+#if PICO_ON_DEVICE
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+//
+#include "sd_card.h"
+#endif
+//
+#include "hotplug.h"
+
+#define TRACE_PRINTF(fmt, args...)
+//#define TRACE_PRINTF printf
+
+void hotplug_init(hotplug_t *hp, hotplug_probe_t probe, void *ctx, uint32_t poll_ms,
+                  uint32_t settle_ms, bool periodic) {
+    memset(hp, 0, sizeof *hp);
+    hp->probe = probe;
+    hp->ctx = ctx;
+    hp->poll_us = poll_ms * 1000;
+    hp->settle_us = settle_ms * 1000;
+    hp->periodic = periodic;
+    hp->present = true;
+}
+
+void hotplug_lost(hotplug_t *hp) {
+    if (hp->present) hp->removals++;
+    hp->present = false;
+}
+
+hotplug_event_t hotplug_poll(hotplug_t *hp, uint64_t now_us) {
+    if (hp->signaled) {
+        // Let the contacts settle (and the card power up) before looking
+        hp->signaled = false;
+        hp->settling = true;
+        hp->next_us = now_us + hp->settle_us;
+        return HOTPLUG_NONE;
+    }
+    bool due = hp->settling || hp->periodic || !hp->present;
+    if (!due || now_us < hp->next_us) return HOTPLUG_NONE;
+    hp->settling = false;
+    hp->next_us = now_us + hp->poll_us;
+    hp->probes++;
+    bool present = hp->probe(hp->ctx);
+    TRACE_PRINTF("%s: present=%d was=%d\n", __func__, present, hp->present);
+    if (present == hp->present) return HOTPLUG_NONE;
+    hp->present = present;
+    if (present) {
+        hp->insertions++;
+        return HOTPLUG_INSERTED;
+    }
+    hp->removals++;
+    return HOTPLUG_REMOVED;
+}
+
+#if PICO_ON_DEVICE
+
+static hotplug_t *cd_hp;
+static uint cd_gpio;
+
+static void cd_irq_handler() {
+    uint32_t events = gpio_get_irq_event_mask(cd_gpio);
+    if (events & (GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE)) {
+        gpio_acknowledge_irq(cd_gpio, events);
+        hotplug_signal(cd_hp);
+    }
+}
+
+static bool sd_probe(void *ctx) {
+    sd_card_t *pSD = ctx;
+    // sd_card_detect() also sets STA_NOINIT when the socket is empty
+    if (pSD->use_card_detect) return sd_card_detect(pSD);
+    return pSD->sd_test_com(pSD);
+}
+
+void hotplug_sd_init(hotplug_t *hp, sd_card_t *pSD, uint32_t poll_ms) {
+    sd_init_driver();  // Sets up the card detect GPIO and sd_test_com
+    hotplug_init(hp, sd_probe, pSD, poll_ms, HOTPLUG_SETTLE_MS, !pSD->use_card_detect);
+    if (pSD->use_card_detect) {
+        cd_hp = hp;
+        cd_gpio = pSD->card_detect_gpio;
+        // A raw handler leaves the application's GPIO callback alone
+        gpio_add_raw_irq_handler(cd_gpio, cd_irq_handler);
+        gpio_set_irq_enabled(cd_gpio, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE, true);
+        irq_set_enabled(IO_IRQ_BANK0, true);
+    }
+}
+
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,207 @@
+/* log_index.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+//
+#include "ff.h"
+//
+#include "f_util.h"
+#include "my_debug.h"
+//
+#include "log_index.h"
+
+#define TRACE_PRINTF(fmt, args...)
+//#define TRACE_PRINTF printf
+
+#define ENTRY_OFS(ix) (sizeof(log_index_hdr_t) + (FSIZE_t)(ix) * sizeof(log_index_entry_t))
+
+static_assert(CRASH_LOG_BLOCK_SIZE % sizeof(log_index_entry_t) == 0, "");
+
+static uint32_t entry_check(uint32_t id, const log_index_entry_t *e) {
+    return id ^ e->block ^ e->record ^ e->time;
+}
+
+void log_index_path(const TCHAR *log_path, const char *ext, char *buf, size_t len) {
+    snprintf(buf, len, "%s", log_path);
+    char *dot = strrchr(buf, '.');
+    if (!dot || strchr(dot, '/')) dot = buf + strlen(buf);
+    snprintf(dot, len - (dot - buf), ".%s", ext);
+}
+
+static FRESULT create(log_index_t *ix, const TCHAR *log_path, uint32_t id, uint32_t every) {
+    memset(ix, 0, sizeof *ix);
+    char path[FF_LFN_BUF + 1];
+    log_index_path(log_path, LOG_INDEX_EXT, path, sizeof path);
+    FRESULT fr = f_open(&ix->fil, path, FA_CREATE_ALWAYS | FA_WRITE);
+    if (FR_OK != fr) return fr;
+    log_index_hdr_t hdr = {LOG_INDEX_MAGIC, id, every, 0};
+    UINT bw;
+    fr = f_write(&ix->fil, &hdr, sizeof hdr, &bw);
+    if (FR_OK == fr && sizeof hdr != bw) fr = FR_DENIED;
+    if (FR_OK != fr) {
+        f_close(&ix->fil);
+        f_unlink(path);
+        return fr;
+    }
+    ix->open = true;
+    ix->id = id;
+    ix->every = every ? every : 1;
+    return FR_OK;
+}
+
+static FRESULT append(log_index_t *ix, uint32_t block, uint32_t record, uint32_t time) {
+    log_index_entry_t e = {block, record, time, 0};
+    e.check = entry_check(ix->id, &e);
+    UINT bw;
+    FRESULT fr = f_write(&ix->fil, &e, sizeof e, &bw);
+    if (FR_OK == fr && sizeof e != bw) fr = FR_DENIED;
+    // A sector of entries went to the card: make the directory entry cover it
+    if (FR_OK == fr && 0 == f_tell(&ix->fil) % CRASH_LOG_BLOCK_SIZE) fr = f_sync(&ix->fil);
+    if (FR_OK == fr) {
+        ix->entries++;
+        ix->next = block - block % ix->every + ix->every;
+    }
+    return fr;
+}
+
+FRESULT log_index_open(log_index_t *ix, const TCHAR *log_path, uint32_t id, uint32_t every) {
+    FRESULT fr = create(ix, log_path, id, every);
+    if (FR_OK != fr)
+        DBG_PRINTF("%s: %s: %s (%d)\n", __func__, log_path, FRESULT_str(fr), fr);
+    return fr;
+}
+
+FRESULT log_index_note(log_index_t *ix, const crash_log_t *cl) {
+    const crash_log_hdr_t *h = &cl->blk.hdr;
+    if (!ix->open || h->seq < ix->next) return FR_OK;
+    // The block was started by this write, so nothing has started in it yet,
+    // unless the record filled it whole. Long records can skip the block due
+    // an entry; the one they land in is indexed instead.
+    uint32_t record = h->records;
+    if (CRASH_LOG_NO_REC != h->first_rec) record--;
+    FRESULT fr = append(ix, h->seq, record, h->time);
+    if (FR_OK != fr) {
+        // Stop indexing; the log goes on
+        DBG_PRINTF("%s: %s (%d)\n", __func__, FRESULT_str(fr), fr);
+        f_close(&ix->fil);
+        ix->open = false;
+    }
+    return fr;
+}
+
+FRESULT log_index_close(log_index_t *ix) {
+    if (!ix->open) return FR_OK;
+    ix->open = false;
+    TRACE_PRINTF("%s: %lu entries\n", __func__, (unsigned long)ix->entries);
+    return f_close(&ix->fil);
+}
+
+FRESULT log_index_build(const TCHAR *log_path, uint32_t every) {
+    static FIL log;  // Not on the stack, with the index's FIL and a block
+    static crash_log_blk_t blk;
+    static log_index_t ix;
+    FRESULT fr = f_open(&log, log_path, FA_READ);
+    if (FR_OK != fr) return fr;
+    uint32_t blocks = f_size(&log) / CRASH_LOG_BLOCK_SIZE;
+    UINT br = 0;
+    fr = f_read(&log, &blk, sizeof blk, &br);
+    if (FR_OK == fr && (sizeof blk != br || !crash_log_valid(&blk, blk.hdr.id, 0)))
+        fr = FR_NO_FILE;
+    if (FR_OK == fr) fr = create(&ix, log_path, blk.hdr.id, every);
+    for (uint32_t seq = 0; FR_OK == fr && seq < blocks; seq += ix.every) {
+        if (seq) {
+            fr = f_lseek(&log, (FSIZE_t)seq * CRASH_LOG_BLOCK_SIZE);
+            if (FR_OK == fr) fr = f_read(&log, &blk, sizeof blk, &br);
+            if (FR_OK != fr || sizeof blk != br || !crash_log_valid(&blk, ix.id, seq))
+                break;  // The end of the valid blocks
+        }
+        // Records started before the block: the running count less those
+        // starting in it
+        uint32_t started = 0;
+        if (CRASH_LOG_NO_REC != blk.hdr.first_rec) {
+            started = 1;
+            for (uint32_t i = blk.hdr.first_rec; i + 1 < blk.hdr.len; ++i)
+                started += '\n' == blk.payload[i];
+        }
+        fr = append(&ix, seq, blk.hdr.records - started, blk.hdr.time);
+    }
+    if (ix.open) {
+        FRESULT fr2 = log_index_close(&ix);
+        if (FR_OK == fr) fr = fr2;
+    }
+    f_close(&log);
+    if (FR_OK != fr)
+        DBG_PRINTF("%s: %s: %s (%d)\n", __func__, log_path, FRESULT_str(fr), fr);
+    return fr;
+}
+
+FRESULT log_index_open_read(FIL *fil, const TCHAR *log_path, uint32_t id, uint32_t *entries) {
+    char path[FF_LFN_BUF + 1];
+    log_index_path(log_path, LOG_INDEX_EXT, path, sizeof path);
+    *entries = 0;
+    FRESULT fr = f_open(fil, path, FA_READ);
+    if (FR_OK != fr) return fr;
+    log_index_hdr_t hdr;
+    UINT br = 0;
+    fr = f_read(fil, &hdr, sizeof hdr, &br);
+    if (FR_OK == fr &&
+        (sizeof hdr != br || LOG_INDEX_MAGIC != hdr.magic || id != hdr.id || !hdr.every))
+        fr = FR_NO_FILE;
+    if (FR_OK != fr) {
+        f_close(fil);
+        return fr;
+    }
+    *entries = (f_size(fil) - sizeof hdr) / sizeof(log_index_entry_t);
+    return FR_OK;
+}
+
+// Entry ix, or false if it is damaged or past the log
+static FRESULT read_entry(FIL *fil, uint32_t id, uint32_t blocks, uint32_t ix,
+                          log_index_entry_t *e, bool *ok) {
+    FRESULT fr = f_lseek(fil, ENTRY_OFS(ix));
+    UINT br = 0;
+    if (FR_OK == fr) fr = f_read(fil, e, sizeof *e, &br);
+    *ok = FR_OK == fr && sizeof *e == br && entry_check(id, e) == e->check && e->block < blocks;
+    return fr;
+}
+
+FRESULT log_index_lookup(FIL *fil, uint32_t id, uint32_t entries, uint32_t blocks, bool by_time,
+                         uint32_t key, log_index_entry_t *lo, bool *found, log_index_entry_t *hi,
+                         bool *next) {
+    *found = *next = false;
+    // Entries are valid up to some point, with keys that only grow:
+    // [0, l) is at or below key, [h, entries) above it or invalid
+    uint32_t l = 0, h = entries;
+    while (l < h) {
+        uint32_t mid = l + (h - l) / 2;
+        log_index_entry_t e;
+        bool ok;
+        FRESULT fr = read_entry(fil, id, blocks, mid, &e, &ok);
+        if (FR_OK != fr) return fr;
+        if (ok && (by_time ? e.time : e.record) <= key) {
+            l = mid + 1;
+            *lo = e;  // The last one taken is entry l - 1
+            *found = true;
+        } else {
+            h = mid;
+        }
+    }
+    if (l < entries) {
+        FRESULT fr = read_entry(fil, id, blocks, l, hi, next);  // Usually the same sector
+        if (FR_OK != fr) return fr;
+    }
+    return FR_OK;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,291 @@
+/* log_reader.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+#include <stdio.h>
+#include <string.h>
+//
+#include "ff.h"
+//
+#include "crc.h"
+#include "f_util.h"
+#include "my_debug.h"
+//
+#include "log_index.h"
+#include "log_reader.h"
+
+#define TRACE_PRINTF(fmt, args...)
+//#define TRACE_PRINTF printf
+
+#if !FF_USE_FASTSEEK
+#error "log_reader needs FF_USE_FASTSEEK"
+#endif
+
+static uint16_t map_crc(log_reader_map_t *m, const DWORD *table) {
+    uint16_t saved = m->crc;
+    m->crc = 0;
+    uint16_t crc = 0;
+    update_crc16(&crc, (const char *)m, sizeof *m);
+    update_crc16(&crc, (const char *)table, m->words * sizeof(DWORD));
+    m->crc = saved;
+    return crc;
+}
+
+static bool load_map(log_reader_t *r, const char *path) {
+    FIL fil;
+    if (FR_OK != f_open(&fil, path, FA_READ)) return false;
+    log_reader_map_t m;
+    UINT br = 0;
+    bool ok = FR_OK == f_read(&fil, &m, sizeof m, &br) && sizeof m == br &&
+              LOG_READER_MAP_MAGIC == m.magic && m.sclust == r->fil.obj.sclust &&
+              m.size == f_size(&r->fil) && m.words && m.words <= LOG_READER_CLMT;
+    if (ok) {
+        UINT want = m.words * sizeof(DWORD);
+        ok = FR_OK == f_read(&fil, r->clmt, want, &br) && want == br &&
+             m.crc == map_crc(&m, r->clmt) && m.words == r->clmt[0];
+    }
+    f_close(&fil);
+    return ok;
+}
+
+static void save_map(log_reader_t *r, const char *path) {
+    FIL fil;
+    FRESULT fr = f_open(&fil, path, FA_CREATE_ALWAYS | FA_WRITE);
+    if (FR_OK != fr) {
+        DBG_PRINTF("%s: f_open(%s): %s (%d)\n", __func__, path, FRESULT_str(fr), fr);
+        return;
+    }
+    log_reader_map_t m = {0};
+    m.magic = LOG_READER_MAP_MAGIC;
+    m.sclust = r->fil.obj.sclust;
+    m.size = f_size(&r->fil);
+    m.words = r->clmt[0];
+    m.crc = map_crc(&m, r->clmt);
+    UINT bw;
+    fr = f_write(&fil, &m, sizeof m, &bw);
+    if (FR_OK == fr) fr = f_write(&fil, r->clmt, m.words * sizeof(DWORD), &bw);
+    FRESULT fr2 = f_close(&fil);
+    if (FR_OK != fr || FR_OK != fr2) {
+        DBG_PRINTF("%s: %s failed\n", __func__, path);
+        f_unlink(path);
+    }
+}
+
+// The cluster link map table: from the map file, or built and saved
+static void map_file(log_reader_t *r, const TCHAR *path) {
+    char mpath[FF_LFN_BUF + 1];
+    log_index_path(path, LOG_READER_MAP_EXT, mpath, sizeof mpath);
+    r->fast = r->map_loaded = load_map(r, mpath);
+    if (!r->fast) {
+        r->clmt[0] = LOG_READER_CLMT;
+        r->fil.cltbl = r->clmt;
+        FRESULT fr = f_lseek(&r->fil, CREATE_LINKMAP);  // Walks the chain once
+        r->fast = FR_OK == fr;
+        if (r->fast)
+            save_map(r, mpath);
+        else
+            DBG_PRINTF("%s: %s: no link map (%s), %lu words needed\n", __func__, path,
+                       FRESULT_str(fr), (unsigned long)r->clmt[0]);
+    }
+    r->fil.cltbl = r->fast ? r->clmt : NULL;
+}
+
+static FRESULT read_blk(log_reader_t *r, uint32_t seq) {
+    if (seq == r->cached) return FR_OK;
+    r->cached = UINT32_MAX;
+    FRESULT fr = f_lseek(&r->fil, (FSIZE_t)seq * CRASH_LOG_BLOCK_SIZE);
+    if (FR_OK != fr) return fr;
+    UINT br = 0;
+    // Whole aligned sector: straight from the card into blk
+    fr = f_read(&r->fil, &r->blk, sizeof r->blk, &br);
+    if (FR_OK == fr && sizeof r->blk != br) fr = FR_INT_ERR;
+    if (FR_OK == fr && !crash_log_valid(&r->blk, r->id, seq)) fr = FR_INT_ERR;
+    if (FR_OK != fr) return fr;
+    r->reads++;
+    r->cached = seq;
+    return FR_OK;
+}
+
+// Search key of a block: its running record count, or its start time
+static FRESULT key_at(log_reader_t *r, uint32_t seq, bool by_time, uint32_t *key) {
+    FRESULT fr = read_blk(r, seq);
+    if (FR_OK == fr) *key = by_time ? r->blk.hdr.time : r->blk.hdr.records;
+    return fr;
+}
+
+// Last block whose key is <= target, or -1: interpolation search, with a
+// bisection step whenever a probe fails to halve the interval
+static FRESULT floor_block(log_reader_t *r, uint32_t target, bool by_time, int64_t *found) {
+    uint32_t klo, khi;
+    FRESULT fr = key_at(r, 0, by_time, &klo);
+    if (FR_OK != fr) return fr;
+    if (target < klo) {
+        *found = -1;
+        return FR_OK;
+    }
+    khi = by_time ? r->time_last : r->records;
+    if (target >= khi) {
+        *found = r->blocks - 1;
+        return FR_OK;
+    }
+    uint32_t lo = 0, hi = r->blocks - 1;  // key(lo) <= target < key(hi)
+    if (by_time && r->indexed) {
+        // Narrow [lo, hi] to the entries around target
+        log_index_entry_t el, eh;
+        bool found, next;
+        fr = log_index_lookup(&r->tix, r->id, r->tix_entries, r->blocks, true, target, &el,
+                              &found, &eh, &next);
+        if (FR_OK != fr) return fr;
+        if (found && el.block > lo) {
+            lo = el.block;
+            klo = el.time;
+        }
+        if (next && eh.block < hi) {
+            hi = eh.block;
+            khi = eh.time;
+        }
+    }
+    bool bisect = false;
+    while (hi - lo > 1) {
+        uint32_t width = hi - lo, mid;
+        if (bisect || khi == klo)
+            mid = lo + width / 2;
+        else
+            mid = lo + (uint32_t)((uint64_t)(target - klo) * width / (khi - klo));
+        if (mid <= lo) mid = lo + 1;
+        if (mid >= hi) mid = hi - 1;
+        uint32_t key;
+        fr = key_at(r, mid, by_time, &key);
+        if (FR_OK != fr) return fr;
+        if (key <= target) {
+            lo = mid;
+            klo = key;
+        } else {
+            hi = mid;
+            khi = key;
+        }
+        bisect = hi - lo > width / 2;
+    }
+    *found = lo;
+    return FR_OK;
+}
+
+// Moves to the first record starting at or after block seq
+static FRESULT seek_block(log_reader_t *r, uint32_t seq) {
+    for (; seq < r->blocks; ++seq) {
+        FRESULT fr = read_blk(r, seq);
+        if (FR_OK != fr) return fr;
+        if (CRASH_LOG_NO_REC != r->blk.hdr.first_rec) {
+            r->seq = seq;
+            r->ofs = r->blk.hdr.first_rec;
+            return FR_OK;
+        }
+    }
+    r->seq = r->blocks;
+    r->ofs = 0;
+    return FR_OK;
+}
+
+FRESULT log_reader_open(log_reader_t *r, const TCHAR *path) {
+    memset(r, 0, sizeof *r);
+    r->cached = UINT32_MAX;
+    FRESULT fr = f_open(&r->fil, path, FA_READ);
+    if (FR_OK != fr) return fr;
+    map_file(r, path);
+    fr = crash_log_valid_blocks(&r->fil, &r->blocks, &r->blk);
+    if (FR_OK == fr && r->blocks) {
+        r->id = r->blk.hdr.id;
+        r->records = r->blk.hdr.records;
+        r->time_last = r->blk.hdr.time;
+        r->cached = r->blocks - 1;
+        fr = read_blk(r, 0);
+        if (FR_OK == fr) r->time_first = r->blk.hdr.time;
+    }
+    if (FR_OK == fr) fr = seek_block(r, 0);
+    if (FR_OK != fr) {
+        DBG_PRINTF("%s: %s: %s (%d)\n", __func__, path, FRESULT_str(fr), fr);
+        f_close(&r->fil);
+        return fr;
+    }
+    r->indexed = r->blocks && FR_OK == log_index_open_read(&r->tix, path, r->id, &r->tix_entries);
+    if (r->indexed) {
+        // Its probes jump back and forth too; not saved, the index is small
+        r->tix_clmt[0] = LOG_READER_TIX_CLMT;
+        r->tix.cltbl = r->tix_clmt;
+        if (FR_OK != f_lseek(&r->tix, CREATE_LINKMAP)) r->tix.cltbl = NULL;
+    }
+    TRACE_PRINTF("%s: %s: %lu blocks, %lu records, map %s, %lu index entries\n", __func__,
+                 path, (unsigned long)r->blocks, (unsigned long)r->records,
+                 r->map_loaded ? "loaded" : r->fast ? "built" : "none",
+                 (unsigned long)r->tix_entries);
+    return FR_OK;
+}
+
+FRESULT log_reader_close(log_reader_t *r) {
+    if (r->indexed) f_close(&r->tix);
+    r->indexed = false;
+    return f_close(&r->fil);
+}
+
+FRESULT log_reader_seek_record(log_reader_t *r, uint32_t index) {
+    if (index >= r->records) return FR_INVALID_PARAMETER;
+    // The record starts in the first block whose running count exceeds index
+    int64_t b;
+    FRESULT fr = floor_block(r, index, false, &b);
+    if (FR_OK != fr) return fr;
+    fr = read_blk(r, (uint32_t)(b + 1));
+    if (FR_OK != fr) return fr;
+    // Records starting here: one per newline after first_rec, plus one
+    // running into the next block
+    const crash_log_hdr_t *h = &r->blk.hdr;
+    const uint8_t *p = r->blk.payload;
+    uint32_t started = 0;
+    for (uint32_t i = h->first_rec; i < h->len; ++i) started += '\n' == p[i];
+    if (h->len && '\n' != p[h->len - 1]) started++;
+    uint32_t skip = index - (h->records - started);
+    uint32_t ofs = h->first_rec;
+    for (; skip && ofs < h->len; ++ofs) skip -= '\n' == p[ofs];
+    if (skip) return FR_INT_ERR;  // Records without newlines
+    r->seq = (uint32_t)(b + 1);
+    r->ofs = ofs;
+    return FR_OK;
+}
+
+FRESULT log_reader_seek_time(log_reader_t *r, uint32_t time) {
+    if (!r->blocks) return FR_OK;
+    int64_t b;
+    FRESULT fr = floor_block(r, time, true, &b);
+    if (FR_OK != fr) return fr;
+    return seek_block(r, b < 0 ? 0 : (uint32_t)b);
+}
+
+FRESULT log_reader_read(log_reader_t *r, void *buf, UINT len, UINT *br) {
+    uint8_t *out = buf;
+    *br = 0;
+    while (len && r->seq < r->blocks) {
+        FRESULT fr = read_blk(r, r->seq);
+        if (FR_OK != fr) return fr;
+        UINT n = r->blk.hdr.len - r->ofs;
+        if (n > len) n = len;
+        memcpy(out, r->blk.payload + r->ofs, n);
+        out += n;
+        len -= n;
+        *br += n;
+        r->ofs += n;
+        if (r->ofs == r->blk.hdr.len) {
+            r->seq++;
+            r->ofs = 0;
+        }
+    }
+    return FR_OK;
+}
+
+/* [] END OF FILE */
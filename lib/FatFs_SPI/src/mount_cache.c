@@ -0,0 +1,305 @@
+/* mount_cache.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+#include <stddef.h>
+#include <string.h>
+//
+#include "hardware/sync.h"
+#include "pico/flash.h"
+#include "pico/multicore.h"
+#include "pico/stdlib.h"
+//
+#include "ff.h"
+#include "diskio.h"
+//
+#include "f_util.h"
+#include "my_debug.h"
+#include "util.h"  // calculate_checksum
+//
+#include "mount_cache.h"
+
+#define TRACE_PRINTF(fmt, args...)
+//#define TRACE_PRINTF printf
+
+#define MOUNT_CACHE_MAGIC 0x4D4E5443  // "MNTC"
+#define MOUNT_CACHE_VERSION 1
+
+// Boot sector offsets (see ff.c)
+#define BS_VolID 39          // FAT12/16: Volume serial number
+#define BS_VolID32 67        // FAT32: Volume serial number
+#define BPB_VolIDEx 100      // exFAT: Volume serial number
+#define BPB_VolFlagEx 106    // exFAT: Volume flags
+#define BPB_PercInUseEx 112  // exFAT: Percent in use
+
+typedef struct mount_cache_rec {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t fs_type;
+    uint8_t clean;  // 1: written at unmount; 0: volume was mounted since
+    uint32_t vsn;   // Volume serial number
+    uint32_t n_fatent;
+    uint32_t fsize;
+    uint32_t database;  // Low 32 bits are enough to tell volumes apart
+    uint32_t free_clst;
+    uint32_t last_clst;
+    uint32_t checksum;  // last, not included in checksum
+} mount_cache_rec_t;
+
+static mount_cache_stats_t last_stats;
+
+static uint32_t ld_le32(const BYTE *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+           (uint32_t)p[3] << 24;
+}
+
+static uint32_t elapsed_us(absolute_time_t since) {
+    return (uint32_t)absolute_time_diff_us(since, get_absolute_time());
+}
+
+// Reads the volume identity from the boot sector. The FATFS window is not
+// used so that FatFs' view of the volume is left untouched.
+static bool read_boot_info(FATFS *fs, uint32_t *vsn, BYTE *perc_in_use,
+                           bool *vol_dirty) {
+    BYTE buf[FF_MAX_SS];
+    if (RES_OK != disk_read(fs->pdrv, buf, fs->volbase, 1)) return false;
+    *perc_in_use = 0xFF;
+    *vol_dirty = false;
+    switch (fs->fs_type) {
+        case FS_EXFAT:
+            *vsn = ld_le32(buf + BPB_VolIDEx);
+            *perc_in_use = buf[BPB_PercInUseEx];
+            *vol_dirty = buf[BPB_VolFlagEx] & 0x02;
+            break;
+        case FS_FAT32:
+            *vsn = ld_le32(buf + BS_VolID32);
+            break;
+        default:
+            *vsn = ld_le32(buf + BS_VolID);
+    }
+    return true;
+}
+
+static void fill_rec(mount_cache_rec_t *rec, FATFS *fs, uint32_t vsn, bool clean) {
+    memset(rec, 0, sizeof *rec);
+    rec->magic = MOUNT_CACHE_MAGIC;
+    rec->version = MOUNT_CACHE_VERSION;
+    rec->fs_type = fs->fs_type;
+    rec->clean = clean;
+    rec->vsn = vsn;
+    rec->n_fatent = fs->n_fatent;
+    rec->fsize = fs->fsize;
+    rec->database = (uint32_t)fs->database;
+    rec->free_clst = fs->free_clst;
+    rec->last_clst = fs->last_clst;
+    rec->checksum = calculate_checksum((uint32_t *)rec, sizeof *rec);
+}
+
+static FRESULT write_rec(sd_card_t *pSD, const mount_cache_rec_t *rec) {
+    char path[16];
+    snprintf(path, sizeof path, "%s" MOUNT_CACHE_FILE, pSD->pcName);
+    FIL fil;
+    // Rewritten in place once it exists: no cluster allocation, no FAT update.
+    FRESULT fr = f_open(&fil, path, FA_OPEN_ALWAYS | FA_WRITE);
+    if (FR_OK != fr) return fr;
+    UINT bw = 0;
+    fr = f_write(&fil, rec, sizeof *rec, &bw);
+    if (FR_OK == fr && sizeof *rec != bw) fr = FR_DENIED;
+    FRESULT fr2 = f_close(&fil);
+    return FR_OK != fr ? fr : fr2;
+}
+
+// Decides whether the cached record may replace what FatFs found at mount.
+static mount_cache_src_t restore(sd_card_t *pSD) {
+    FATFS *fs = &pSD->fatfs;
+    uint32_t vsn;
+    BYTE perc_in_use;
+    bool vol_dirty;
+    if (!read_boot_info(fs, &vsn, &perc_in_use, &vol_dirty))
+        return MOUNT_CACHE_SRC_NONE;
+
+    char path[16];
+    snprintf(path, sizeof path, "%s" MOUNT_CACHE_FILE, pSD->pcName);
+    mount_cache_rec_t rec = {0};
+    FIL fil;
+    UINT br = 0;
+    FRESULT fr = f_open(&fil, path, FA_READ);
+    if (FR_OK == fr) {
+        fr = f_read(&fil, &rec, sizeof rec, &br);
+        f_close(&fil);
+    }
+    bool valid = FR_OK == fr && sizeof rec == br &&
+                 MOUNT_CACHE_MAGIC == rec.magic &&
+                 MOUNT_CACHE_VERSION == rec.version &&
+                 rec.checksum == calculate_checksum((uint32_t *)&rec, sizeof rec) &&
+                 rec.clean && rec.fs_type == fs->fs_type && rec.vsn == vsn &&
+                 rec.n_fatent == fs->n_fatent && rec.fsize == fs->fsize &&
+                 rec.database == (uint32_t)fs->database &&
+                 rec.free_clst <= fs->n_fatent - 2 &&
+                 rec.last_clst < fs->n_fatent;
+    if (valid && FS_EXFAT == fs->fs_type) {
+        // exFAT has no FSINFO; the boot sector's PercentInUse (if maintained)
+        // catches a volume modified elsewhere since our clean unmount.
+        if (vol_dirty) valid = false;
+        if (0xFF != perc_in_use) {
+            DWORD nclst = fs->n_fatent - 2;
+            uint32_t perc = (uint64_t)(nclst - rec.free_clst) * 100 / nclst;
+            if (perc + 1 < perc_in_use || perc > perc_in_use + 1U) valid = false;
+        }
+    }
+    mount_cache_src_t src = MOUNT_CACHE_SRC_NONE;
+    bool fsinfo_valid = fs->free_clst <= fs->n_fatent - 2;
+    if (fsinfo_valid) {
+        // FAT32 FSINFO was loaded by f_mount. Another host that modified the
+        // volume would also have updated FSINFO, so it wins on disagreement.
+        src = MOUNT_CACHE_SRC_FSINFO;
+        if (valid && rec.free_clst == fs->free_clst &&
+            fs->last_clst >= fs->n_fatent)
+            fs->last_clst = rec.last_clst;
+    } else if (valid) {
+        fs->free_clst = rec.free_clst;
+        fs->last_clst = rec.last_clst;
+        if (FS_FAT32 == fs->fs_type)
+            fs->fsi_flag |= 1;  // Repair FSINFO at the next sync
+        src = MOUNT_CACHE_SRC_CACHE;
+    }
+    TRACE_PRINTF("%s: valid=%d src=%d free=%lu\n", __func__, valid, src,
+                 (unsigned long)fs->free_clst);
+
+    // From now on the record describes a mounted (possibly dirty) volume.
+    if (valid || FR_NO_FILE != fr) {
+        fill_rec(&rec, fs, vsn, false);
+        fr = write_rec(pSD, &rec);
+        if (FR_OK != fr)
+            DBG_PRINTF("%s: write_rec error: %s (%d)\n", __func__, FRESULT_str(fr), fr);
+    }
+    return src;
+}
+
+FRESULT mount_cache_mount(sd_card_t *pSD, bool prewarm, mount_cache_stats_t *stats) {
+    mount_cache_stats_t st = {0};
+    absolute_time_t t0 = get_absolute_time();
+    FRESULT fr = f_mount(&pSD->fatfs, pSD->pcName, 1);
+    st.mount_us = elapsed_us(t0);
+    if (FR_OK == fr) {
+        t0 = get_absolute_time();
+        st.source = restore(pSD);
+        st.restore_us = elapsed_us(t0);
+        // A count from FSINFO or the record makes the scan redundant; the
+        // free cluster map then starts as "may have free clusters" and
+        // create_chain() narrows it down as it allocates.
+        bool known = pSD->fatfs.free_clst <= pSD->fatfs.n_fatent - 2;
+        if (prewarm && !known) {
+            FATFS *fs;
+            DWORD nclst;
+            t0 = get_absolute_time();
+#if FF_USE_FREEMAP && !FF_FS_READONLY
+            // One FAT pass both counts free clusters and builds the map that
+            // lets create_chain() skip fully allocated regions.
+            (void)fs;
+            (void)nclst;
+            if (FS_EXFAT != pSD->fatfs.fs_type)
+                fr = f_freemap(pSD->pcName);
+            else
+#endif
+                fr = f_getfree(pSD->pcName, &nclst, &fs);
+            st.getfree_us = elapsed_us(t0);
+            if (FR_OK == fr) st.source = MOUNT_CACHE_SRC_SCAN;
+        }
+        st.free_clst = pSD->fatfs.free_clst;
+        pSD->mounted = FR_OK == fr;
+    }
+    last_stats = st;
+    if (stats) *stats = st;
+    return fr;
+}
+
+FRESULT mount_cache_save(sd_card_t *pSD) {
+    FATFS *fs = &pSD->fatfs;
+    if (!fs->fs_type) return FR_NOT_ENABLED;
+    if (fs->free_clst > fs->n_fatent - 2) return FR_OK;  // Nothing worth caching
+    uint32_t vsn;
+    BYTE perc_in_use;
+    bool vol_dirty;
+    if (!read_boot_info(fs, &vsn, &perc_in_use, &vol_dirty)) return FR_DISK_ERR;
+    mount_cache_rec_t rec;
+    char path[16];
+    snprintf(path, sizeof path, "%s" MOUNT_CACHE_FILE, pSD->pcName);
+    if (FR_NO_FILE == f_stat(path, NULL)) {
+        // Creating the record allocates a cluster, so snapshot the counters
+        // only after it exists.
+        fill_rec(&rec, fs, vsn, false);
+        FRESULT fr = write_rec(pSD, &rec);
+        if (FR_OK != fr) return fr;
+    }
+    fill_rec(&rec, fs, vsn, true);
+    return write_rec(pSD, &rec);
+}
+
+/* Background mount on core 1 */
+
+enum { BG_IDLE, BG_BUSY, BG_DONE };
+static volatile int bg_state = BG_IDLE;
+static volatile FRESULT bg_result;
+static sd_card_t *bg_sd;
+
+static void bg_core1_entry() {
+    // Lets core 0 erase/program the flash (flash_log.c) while this runs;
+    // afterwards core 1 sits in the boot ROM, which the build declares
+    // safe (PICO_FLASH_ASSUME_CORE1_SAFE)
+    flash_safe_execute_core_init();
+    bg_result = mount_cache_mount(bg_sd, true, NULL);
+    flash_safe_execute_core_deinit();
+    __mem_fence_release();
+    bg_state = BG_DONE;
+}
+
+void mount_cache_start_background(sd_card_t *pSD) {
+    if (BG_IDLE != bg_state) return;
+    // Claim the SPI DMA channels and IRQ handlers on core 0, so that they
+    // keep being serviced after core 1 is done.
+    if (!sd_init_driver()) {
+        bg_result = FR_NOT_READY;
+        bg_state = BG_DONE;
+        return;
+    }
+    bg_sd = pSD;
+    bg_state = BG_BUSY;
+    multicore_reset_core1();
+    multicore_launch_core1(bg_core1_entry);
+}
+
+bool mount_cache_background_busy() { return BG_BUSY == bg_state; }
+
+bool mount_cache_background_done(FRESULT *result) {
+    if (BG_DONE != bg_state) return false;
+    __mem_fence_acquire();
+    if (result) *result = bg_result;
+    bg_state = BG_IDLE;
+    return true;
+}
+
+const mount_cache_stats_t *mount_cache_last_stats() { return &last_stats; }
+
+const char *mount_cache_src_str(mount_cache_src_t src) {
+    switch (src) {
+        case MOUNT_CACHE_SRC_FSINFO:
+            return "FSINFO";
+        case MOUNT_CACHE_SRC_CACHE:
+            return "cache";
+        case MOUNT_CACHE_SRC_SCAN:
+            return "scan";
+        default:
+            return "unknown";
+    }
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,296 @@
+/* msc_disk.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+#include <string.h>
+//
+#if PICO_ON_DEVICE && defined(LIB_TINYUSB_DEVICE)
+#include "tusb.h"
+#endif
+//
+#include "msc_disk.h"
+
+#define TRACE_PRINTF(fmt, args...)
+//#define TRACE_PRINTF printf
+
+static uint32_t clamp(uint32_t v, uint32_t lo, uint32_t hi) {
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+static bool overlaps(uint32_t a, uint32_t na, uint32_t b, uint32_t nb) {
+    return a < b + nb && b < a + na;
+}
+
+static int32_t fail(msc_disk_t *d) {
+    d->stats.errors++;
+    return -1;
+}
+
+static void drop_caches(msc_disk_t *d) {
+    d->ra_count = d->wb_count = 0;
+    d->ra_window = 1;
+    d->ra_next = UINT32_MAX;
+}
+
+void msc_disk_init(msc_disk_t *d, BYTE pdrv, uint32_t ra_blocks, uint32_t wb_blocks) {
+    memset(d, 0, offsetof(msc_disk_t, ra_buf));
+    d->pdrv = pdrv;
+    d->ra_max = ra_blocks ? clamp(ra_blocks, 1, MSC_DISK_RA_BLOCKS) : MSC_DISK_RA_BLOCKS;
+    d->wb_max = wb_blocks ? clamp(wb_blocks, 1, MSC_DISK_WB_BLOCKS) : MSC_DISK_WB_BLOCKS;
+    drop_caches(d);
+}
+
+DRESULT msc_disk_attach(msc_disk_t *d) {
+    if (MSC_DISK_OFF != d->state) return RES_OK;
+    if ((disk_status(d->pdrv) & STA_NOINIT) && (disk_initialize(d->pdrv) & STA_NOINIT))
+        return RES_NOTRDY;
+    LBA_t n;
+    DRESULT dr = disk_ioctl(d->pdrv, GET_SECTOR_COUNT, &n);
+    if (RES_OK != dr) return dr;
+    d->sectors = n > UINT32_MAX ? UINT32_MAX : (uint32_t)n;  // READ CAPACITY(10)
+    drop_caches(d);
+    d->write_error = false;
+    d->state = MSC_DISK_READY;
+    TRACE_PRINTF("%s: %lu sectors\n", __func__, (unsigned long)d->sectors);
+    return RES_OK;
+}
+
+DRESULT msc_disk_detach(msc_disk_t *d) {
+    if (MSC_DISK_OFF == d->state) return RES_OK;
+    DRESULT dr = msc_disk_sync(d);
+    drop_caches(d);
+    d->state = MSC_DISK_OFF;
+    return dr;
+}
+
+bool msc_disk_capacity(const msc_disk_t *d, uint32_t *block_count, uint16_t *block_size) {
+    if (!msc_disk_ready(d)) return false;
+    *block_count = d->sectors;
+    *block_size = MSC_DISK_BLOCK;
+    return true;
+}
+
+bool msc_disk_take_write_error(msc_disk_t *d) {
+    bool e = d->write_error;
+    d->write_error = false;
+    return e;
+}
+
+DRESULT msc_disk_flush(msc_disk_t *d) {
+    if (!d->wb_count) return RES_OK;
+    DRESULT dr = disk_write(d->pdrv, d->wb_buf, d->wb_lba, d->wb_count);
+    d->stats.writes++;
+    d->stats.blocks_written += d->wb_count;
+    d->wb_count = 0;  // Dropped on failure too: the host gets the error once
+    if (RES_OK != dr) d->write_error = true;
+    return dr;
+}
+
+DRESULT msc_disk_sync(msc_disk_t *d) {
+    DRESULT dr = msc_disk_flush(d);
+    if (RES_OK != dr) return dr;
+    return disk_ioctl(d->pdrv, CTRL_SYNC, NULL);
+}
+
+bool msc_disk_start_stop(msc_disk_t *d, bool start, bool load_eject) {
+    if (!load_eject) return true;
+    if (!start && MSC_DISK_READY == d->state) {
+        DRESULT dr = msc_disk_sync(d);
+        drop_caches(d);
+        d->state = MSC_DISK_EJECTED;
+        return RES_OK == dr;
+    }
+    if (start && MSC_DISK_EJECTED == d->state) d->state = MSC_DISK_READY;
+    return MSC_DISK_READY == d->state;
+}
+
+// A flush forced by a read or write: its error goes to that call
+static bool flush_now(msc_disk_t *d) {
+    if (RES_OK == msc_disk_flush(d)) return true;
+    d->write_error = false;
+    return false;
+}
+
+// Fills the read cache from block lba: the blocks asked for, or the
+// read-ahead window if larger
+static DRESULT fill(msc_disk_t *d, uint32_t lba, uint32_t want, bool sequential) {
+    if (sequential)
+        d->ra_window = d->ra_window * 2 < d->ra_max ? d->ra_window * 2 : d->ra_max;
+    else
+        d->ra_window = 1;
+    uint32_t n = want > d->ra_window ? want : d->ra_window;
+    if (n > MSC_DISK_RA_BLOCKS) n = MSC_DISK_RA_BLOCKS;
+    if (n > d->sectors - lba) n = d->sectors - lba;
+    d->ra_count = 0;
+    DRESULT dr = disk_read(d->pdrv, d->ra_buf, lba, n);
+    d->stats.reads++;
+    d->stats.blocks_read += n;
+    if (RES_OK != dr) return dr;
+    d->ra_lba = lba;
+    d->ra_count = n;
+    return RES_OK;
+}
+
+int32_t msc_disk_read10(msc_disk_t *d, uint32_t lba, uint32_t offset, void *buf, uint32_t len) {
+    d->stats.read_calls++;
+    if (!msc_disk_ready(d) || msc_disk_take_write_error(d)) return fail(d);
+    uint64_t pos = (uint64_t)lba * MSC_DISK_BLOCK + offset;
+    uint64_t end = pos + len;
+    if (end > (uint64_t)d->sectors * MSC_DISK_BLOCK) return fail(d);
+    uint32_t first = (uint32_t)(pos / MSC_DISK_BLOCK);
+    uint32_t last = (uint32_t)((end + MSC_DISK_BLOCK - 1) / MSC_DISK_BLOCK);
+    // Written blocks still in the buffer go to the card first
+    if (d->wb_count && overlaps(first, last - first, d->wb_lba, d->wb_count) && !flush_now(d))
+        return fail(d);
+    bool sequential = first == d->ra_next;
+    d->ra_next = last;
+    bool hit = true;
+    uint8_t *out = buf;
+    while (pos < end) {
+        uint32_t blk = (uint32_t)(pos / MSC_DISK_BLOCK);
+        if (blk < d->ra_lba || blk >= d->ra_lba + d->ra_count) {
+            // Within a call the stream is sequential by definition
+            if (RES_OK != fill(d, blk, last - blk, sequential || !hit)) return fail(d);
+            hit = false;
+        }
+        size_t at = (size_t)(pos - (uint64_t)d->ra_lba * MSC_DISK_BLOCK);
+        size_t n = (size_t)d->ra_count * MSC_DISK_BLOCK - at;
+        if (n > end - pos) n = (size_t)(end - pos);
+        memcpy(out, d->ra_buf + at, n);
+        out += n;
+        pos += n;
+    }
+    if (hit) d->stats.hits++;
+    d->stats.bytes_out += len;
+    return (int32_t)len;
+}
+
+int32_t msc_disk_write10(msc_disk_t *d, uint32_t lba, uint32_t offset, const void *buf,
+                         uint32_t len) {
+    d->stats.write_calls++;
+    if (!msc_disk_ready(d) || msc_disk_take_write_error(d)) return fail(d);
+    if (offset || !len || len % MSC_DISK_BLOCK) return fail(d);
+    uint32_t n = len / MSC_DISK_BLOCK;
+    if (lba >= d->sectors || n > d->sectors - lba) return fail(d);
+    // The read cache must not serve the old contents
+    if (d->ra_count && overlaps(lba, n, d->ra_lba, d->ra_count)) d->ra_count = 0;
+    if (d->wb_count && (lba != d->wb_lba + d->wb_count || d->wb_count + n > d->wb_max) &&
+        !flush_now(d))
+        return fail(d);
+    if (n >= d->wb_max) {
+        // As large as the buffer: straight to the card
+        DRESULT dr = disk_write(d->pdrv, buf, lba, n);
+        d->stats.writes++;
+        d->stats.blocks_written += n;
+        if (RES_OK != dr) return fail(d);
+    } else {
+        if (!d->wb_count) d->wb_lba = lba;
+        memcpy(d->wb_buf + (size_t)d->wb_count * MSC_DISK_BLOCK, buf, len);
+        d->wb_count += n;
+        if (d->wb_count == d->wb_max && !flush_now(d)) return fail(d);
+    }
+    d->stats.bytes_in += len;
+    return (int32_t)len;
+}
+
+#if PICO_ON_DEVICE && defined(LIB_TINYUSB_DEVICE) && CFG_TUD_MSC
+
+static msc_disk_t *usb_disk;
+
+void msc_disk_usb_bind(msc_disk_t *d) { usb_disk = d; }
+
+void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16],
+                        uint8_t product_rev[4]) {
+    (void)lun;
+    memcpy(vendor_id, "GY33LOG ", 8);
+    memcpy(product_id, "SD Card         ", 16);
+    memcpy(product_rev, "1.0 ", 4);
+}
+
+bool tud_msc_test_unit_ready_cb(uint8_t lun) {
+    (void)lun;
+    if (usb_disk && msc_disk_take_write_error(usb_disk)) {
+        tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00);  // Write error
+        return false;
+    }
+    if (!usb_disk || !msc_disk_ready(usb_disk)) {
+        tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x3A, 0x00);  // Medium not present
+        return false;
+    }
+    return true;
+}
+
+void tud_msc_capacity_cb(uint8_t lun, uint32_t *block_count, uint16_t *block_size) {
+    (void)lun;
+    if (!usb_disk || !msc_disk_capacity(usb_disk, block_count, block_size)) {
+        *block_count = 0;
+        *block_size = MSC_DISK_BLOCK;
+    }
+}
+
+bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool start, bool load_eject) {
+    (void)lun;
+    (void)power_condition;
+    return usb_disk && msc_disk_start_stop(usb_disk, start, load_eject);
+}
+
+bool tud_msc_is_writable_cb(uint8_t lun) {
+    (void)lun;
+    return true;
+}
+
+int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void *buffer,
+                          uint32_t bufsize) {
+    (void)lun;
+    return usb_disk ? msc_disk_read10(usb_disk, lba, offset, buffer, bufsize) : -1;
+}
+
+int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t *buffer,
+                           uint32_t bufsize) {
+    (void)lun;
+    return usb_disk ? msc_disk_write10(usb_disk, lba, offset, buffer, bufsize) : -1;
+}
+
+void tud_msc_write10_complete_cb(uint8_t lun) {
+    (void)lun;
+    if (usb_disk) msc_disk_flush(usb_disk);
+}
+
+int32_t tud_msc_scsi_cb(uint8_t lun, uint8_t const scsi_cmd[16], void *buffer,
+                        uint16_t bufsize) {
+    (void)buffer;
+    (void)bufsize;
+    switch (scsi_cmd[0]) {
+        case 0x35:  // SYNCHRONIZE CACHE(10)
+            if (usb_disk && RES_OK == msc_disk_sync(usb_disk)) return 0;
+            tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00);
+            return -1;
+        case SCSI_CMD_PREVENT_ALLOW_MEDIUM_REMOVAL:
+            return 0;
+        default:
+            tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00);  // Invalid command
+            return -1;
+    }
+}
+
+// Host gone (cable pulled, suspended): nothing may stay in the buffer
+void tud_umount_cb(void) {
+    if (usb_disk) msc_disk_flush(usb_disk);
+}
+
+void tud_suspend_cb(bool remote_wakeup_en) {
+    (void)remote_wakeup_en;
+    if (usb_disk) msc_disk_flush(usb_disk);
+}
+
+#endif
+
+/* [] END OF FILE */
@@ -13,7 +13,9 @@ specific language governing permissions and limitations under the License.
 */
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdlib.h>
 #include "my_debug.h"
+#include "dlog.h"
 
 void my_printf(const char *pcFormat, ...) {
     char pcBuffer[256] = {0};
@@ -28,12 +30,17 @@ void my_printf(const char *pcFormat, ...) {
 
 void my_assert_func(const char *file, int line, const char *func,
                     const char *pred) {
+    dlog_drain(DLOG_DEPTH);  // What was logged on the way here
     printf("assertion \"%s\" failed: file \"%s\", line %d, function: %s\n",
            pred, file, line, func);
     fflush(stdout);
+#if defined(__arm__)
     __asm volatile("cpsid i" : : : "memory"); /* Disable global interrupts. */
     while (1) {
         __asm("bkpt #0");
     };  // Stop in GUI as if at a breakpoint (if debugging, otherwise loop
         // forever)
+#else
+    abort();  // Built for the host simulation
+#endif
 }
@@ -0,0 +1,230 @@
+/* prof.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+#include <stdio.h>
+#include <string.h>
+//
+#include "prof.h"
+
+// The sampler needs Thumb code and the timer; a build of the firmware for
+// another CPU (the host simulation) gets the portable part only
+#if PICO_ON_DEVICE && defined(__arm__)
+#define PROF_ON_TARGET 1
+#else
+#define PROF_ON_TARGET 0
+#endif
+
+#if PROF_ON_TARGET
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+#endif
+
+_Static_assert(!(PROF_SLOTS & (PROF_SLOTS - 1)), "PROF_SLOTS must be a power of two");
+
+static prof_entry_t table[PROF_SLOTS];
+static prof_stats_t stats;
+static volatile bool paused;
+
+#if PROF_ON_TARGET
+
+// Whether the halfword before ret (a Thumb return address, bit 0 set) ends a
+// BL or a BLX to a register, i.e. whether ret is somewhere a call returns to.
+static bool is_return(uint32_t ret) {
+    const uint16_t *p = (const uint16_t *)(uintptr_t)(ret & ~1u);
+    uint16_t hw = p[-1];
+    if (0x4780 == (hw & 0xff87)) return true;  // BLX Rm
+    // BL: first halfword 11110..., second 11x1...
+    return 0xf000 == (p[-2] & 0xf800) && 0xd000 == (hw & 0xd000);
+}
+
+#else
+
+// The host has no Thumb code to look at: the program supplies the check.
+extern bool prof_host_is_return(uint32_t ret);
+#define is_return prof_host_is_return
+
+#endif
+
+static uint32_t hash(const prof_entry_t *e) {
+    uint32_t h = e->pc * 0x9e3779b1u ^ e->lr;
+    for (unsigned i = 0; i < PROF_DEPTH; ++i) h = (h ^ e->ret[i]) * 0x85ebca6bu;
+    return h ^ h >> 15;
+}
+
+void prof_sample(uint32_t pc, uint32_t lr, const uint32_t *sp, const uint32_t *end) {
+    if (paused) {
+        stats.missed++;
+        return;
+    }
+    prof_entry_t key = {0, pc, lr, {0}};
+    unsigned depth = 0;
+    // lr is usually the first return address on the stack too (pushed by the
+    // interrupted function's prologue): keep it once
+    uint32_t skip = lr | 1;
+    for (unsigned n = 0; sp < end && n < PROF_SCAN_WORDS && depth < PROF_DEPTH; ++sp, ++n) {
+        uint32_t w = *sp;
+        if (!(w & 1) || w < PROF_CODE_START + 4 || w >= PROF_CODE_END) continue;
+        if (w == skip) {
+            skip = 0;
+            continue;
+        }
+        if (is_return(w)) key.ret[depth++] = w;
+    }
+    uint32_t h = hash(&key);
+    for (unsigned i = 0; i < PROF_PROBES; ++i) {
+        prof_entry_t *e = &table[(h + i) & (PROF_SLOTS - 1)];
+        if (!e->count) {
+            *e = key;
+            e->count = 1;
+            stats.samples++;
+            return;
+        }
+        if (e->pc == key.pc && e->lr == key.lr && !memcmp(e->ret, key.ret, sizeof key.ret)) {
+            e->count++;
+            stats.samples++;
+            return;
+        }
+    }
+    stats.dropped++;
+}
+
+#if PROF_ON_TARGET
+
+extern uint32_t __StackTop;  // From the linker script: top of core 0's stack
+
+static int alarm_num = -1;
+static uint32_t period_us;
+
+// Called by prof_isr with the exception frame: r0-r3, r12, lr, pc, xPSR
+void __not_in_flash_func(prof_isr_c)(const uint32_t *frame) {
+    timer_hw->intr = 1u << alarm_num;
+    // The next one from the last deadline, so the rate does not drift, unless
+    // that has passed already (interrupts were off for long): the alarm only
+    // matches the exact count and would not fire for another 71 minutes
+    uint32_t next = timer_hw->alarm[alarm_num] + period_us;
+    if ((int32_t)(next - timer_hw->timerawl) < 2) next = timer_hw->timerawl + period_us;
+    timer_hw->alarm[alarm_num] = next;
+    // xPSR bit 9: the core aligned the frame with one more word
+    const uint32_t *sp = frame + 8 + (frame[7] >> 9 & 1);
+    const uint32_t *top = &__StackTop;
+    prof_sample(frame[6], frame[5], sp, sp < top ? top : sp);
+}
+
+// Thumb-1 shim: passes the stack the frame was pushed on (MSP or PSP, from
+// EXC_RETURN bit 2) to prof_isr_c.
+void __attribute__((naked)) __not_in_flash_func(prof_isr)(void) {
+    __asm volatile(
+        "movs r0, #4\n"
+        "mov r1, lr\n"
+        "tst r0, r1\n"
+        "beq 1f\n"
+        "mrs r0, psp\n"
+        "b 2f\n"
+        "1: mrs r0, msp\n"
+        "2: ldr r2, =prof_isr_c\n"
+        "bx r2\n"
+        ".ltorg\n");
+}
+
+bool prof_start(uint32_t hz) {
+    if (hz < 10 || hz > 10000) return false;
+    prof_stop();
+    alarm_num = hardware_alarm_claim_unused(false);
+    if (alarm_num < 0) return false;
+    period_us = 1000000 / hz;
+    stats.hz = hz;
+    unsigned irq = TIMER_IRQ_0 + alarm_num;
+    irq_set_exclusive_handler(irq, prof_isr);
+    // Highest priority: samples land in the other handlers too
+    irq_set_priority(irq, 0);
+    hw_set_bits(&timer_hw->inte, 1u << alarm_num);
+    irq_set_enabled(irq, true);
+    timer_hw->alarm[alarm_num] = timer_hw->timerawl + period_us;
+    return true;
+}
+
+void prof_stop() {
+    if (alarm_num < 0) return;
+    unsigned irq = TIMER_IRQ_0 + alarm_num;
+    irq_set_enabled(irq, false);
+    hw_clear_bits(&timer_hw->inte, 1u << alarm_num);
+    timer_hw->armed = 1u << alarm_num;  // Writing 1 disarms
+    timer_hw->intr = 1u << alarm_num;
+    irq_remove_handler(irq, prof_isr);
+    hardware_alarm_unclaim(alarm_num);
+    alarm_num = -1;
+    stats.hz = 0;
+}
+
+#else
+
+bool prof_start(uint32_t hz) {
+    if (hz < 10 || hz > 10000) return false;
+    stats.hz = hz;
+    return true;
+}
+void prof_stop() { stats.hz = 0; }
+
+#endif
+
+void prof_reset() {
+    paused = true;
+    memset(table, 0, sizeof table);
+    uint32_t hz = stats.hz;
+    memset(&stats, 0, sizeof stats);
+    stats.hz = hz;
+    paused = false;
+}
+
+void prof_get_stats(prof_stats_t *s) { *s = stats; }
+
+const prof_entry_t *prof_table() { return table; }
+
+// Where prof_print_step() is in the table
+static unsigned print_slot = PROF_SLOTS;
+
+void prof_print_begin() {
+    // The handler counts samples as missed instead of touching the table,
+    // until the last step
+    paused = true;
+    unsigned n = 0;
+    for (unsigned i = 0; i < PROF_SLOTS; ++i) n += !!table[i].count;
+    printf(PROF_LINE_TAG " %u %lu %lu %lu %lu %u\n", PROF_FORMAT_VERSION, (unsigned long)stats.hz,
+           (unsigned long)stats.samples, (unsigned long)stats.dropped, (unsigned long)stats.missed,
+           n);
+    print_slot = 0;
+}
+
+bool prof_print_step(unsigned max) {
+    char line[sizeof PROF_LINE_TAG + 3 * 9 + PROF_DEPTH * 9 + 1];
+    for (; max && print_slot < PROF_SLOTS; ++print_slot) {
+        const prof_entry_t *e = &table[print_slot];
+        if (!e->count) continue;
+        int len = snprintf(line, sizeof line, PROF_LINE_TAG "%lx %08lx %08lx",
+                           (unsigned long)e->count, (unsigned long)e->pc, (unsigned long)e->lr);
+        for (unsigned d = 0; d < PROF_DEPTH; ++d)
+            len += snprintf(line + len, sizeof line - len, " %08lx", (unsigned long)e->ret[d]);
+        printf("%s\n", line);  // One write per entry
+        --max;
+    }
+    if (print_slot < PROF_SLOTS) return false;
+    paused = false;
+    return true;
+}
+
+void prof_print() {
+    prof_print_begin();
+    prof_print_step(PROF_SLOTS);
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,233 @@
+/* ring_log.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+//
+#include "pico/stdlib.h"
+//
+#include "ff.h"
+#include "diskio.h"
+//
+#include "crc.h"
+#include "f_util.h"
+#include "my_debug.h"
+#include "util.h"  // calculate_checksum
+//
+#include "ring_log.h"
+
+#define TRACE_PRINTF(fmt, args...)
+//#define TRACE_PRINTF printf
+
+static_assert(sizeof(ring_log_blk_t) == RING_LOG_BLOCK_SIZE, "");
+static_assert(FF_MAX_SS == RING_LOG_BLOCK_SIZE, "ring_log assumes 512 byte sectors");
+
+static uint16_t blk_crc(ring_log_blk_t *blk) {
+    uint16_t saved = blk->hdr.crc;
+    blk->hdr.crc = 0;
+    uint16_t crc = 0;
+    update_crc16(&crc, (const char *)&blk->hdr, sizeof blk->hdr);
+    update_crc16(&crc, (const char *)blk->payload, blk->hdr.len);
+    blk->hdr.crc = saved;
+    return crc;
+}
+
+static FRESULT read_slot(ring_log_t *rl, uint32_t slot) {
+    if (RES_OK != disk_read(rl->pdrv, (BYTE *)&rl->blk, rl->lba + 1 + slot, 1))
+        return FR_DISK_ERR;
+    return FR_OK;
+}
+
+// True if blk is a block of this ring that belongs in slot
+static bool blk_valid(ring_log_t *rl, uint32_t slot) {
+    ring_log_blk_hdr_t *h = &rl->blk.hdr;
+    return RING_LOG_BLOCK_MAGIC == h->magic && rl->id == h->id && slot == h->seq % rl->nslots &&
+           h->len <= RING_LOG_PAYLOAD && h->crc == blk_crc(&rl->blk);
+}
+
+// True if blk holds this ring's block for sequence number seq
+static bool blk_is(ring_log_t *rl, uint32_t seq) {
+    return seq == rl->blk.hdr.seq && blk_valid(rl, seq % rl->nslots);
+}
+
+// Slot 0 is unreadable: either the ring is empty or the block was torn while
+// rewritten in place (the first block of a lap is flushed into slot 0 until
+// it fills). The other slots still hold the previous lap, and maybe more of
+// this one if slot 0 was damaged later, so the head follows the highest
+// sequence number among them.
+static FRESULT find_head_scan(ring_log_t *rl) {
+    bool any = false;
+    uint32_t last = 0;
+    for (uint32_t slot = 1; slot < rl->nslots; ++slot) {
+        FRESULT fr = read_slot(rl, slot);
+        if (FR_OK != fr) return fr;
+        if (!blk_valid(rl, slot)) continue;
+        if (!any || rl->blk.hdr.seq > last) last = rl->blk.hdr.seq;
+        any = true;
+    }
+    rl->seq = any ? last + 1 : 0;
+    TRACE_PRINTF("%s: next seq %lu\n", __func__, (unsigned long)rl->seq);
+    return FR_OK;
+}
+
+// Finds the sequence number to continue with. Slot 0 is written first in
+// every lap, so the slots written in its lap form a prefix of the file: the
+// end of that prefix is the head.
+static FRESULT find_head(ring_log_t *rl) {
+    FRESULT fr = read_slot(rl, 0);
+    if (FR_OK != fr) return fr;
+    ring_log_blk_hdr_t *h = &rl->blk.hdr;
+    if (!blk_valid(rl, 0)) return find_head_scan(rl);
+    uint32_t base = h->seq;
+    uint32_t lo = 0, hi = rl->nslots;  // slot lo is in the prefix, slot hi is not
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        fr = read_slot(rl, mid);
+        if (FR_OK != fr) return fr;
+        if (blk_is(rl, base + mid))
+            lo = mid;
+        else
+            hi = mid;
+    }
+    rl->seq = base + lo + 1;
+    TRACE_PRINTF("%s: head at slot %lu, next seq %lu\n", __func__,
+                 (unsigned long)lo, (unsigned long)rl->seq);
+    return FR_OK;
+}
+
+static void start_block(ring_log_t *rl) {
+    memset(&rl->blk.hdr, 0, sizeof rl->blk.hdr);
+    rl->blk.hdr.magic = RING_LOG_BLOCK_MAGIC;
+    rl->blk.hdr.id = rl->id;
+    rl->blk.hdr.seq = rl->seq;
+    rl->blk.hdr.time = (uint32_t)time(NULL);
+    rl->blk.hdr.uptime_us = time_us_64();
+    rl->blk.hdr.first_rec = RING_LOG_NO_REC;
+    rl->dirty = false;
+}
+
+static FRESULT write_block(ring_log_t *rl) {
+    rl->blk.hdr.crc = blk_crc(&rl->blk);
+    if (RES_OK != disk_write(rl->pdrv, (const BYTE *)&rl->blk,
+                             rl->lba + 1 + rl->seq % rl->nslots, 1))
+        return FR_DISK_ERR;
+    ++rl->blocks_written;
+    rl->dirty = false;
+    return FR_OK;
+}
+
+FRESULT ring_log_open(ring_log_t *rl, const TCHAR *path, FSIZE_t size) {
+    memset(rl, 0, sizeof *rl);
+    FIL fil;
+    FRESULT fr = f_open(&fil, path, FA_OPEN_ALWAYS | FA_READ | FA_WRITE);
+    if (FR_OK != fr) return fr;
+    if (!f_size(&fil)) {
+        size -= size % RING_LOG_BLOCK_SIZE;
+        if (size < 2 * RING_LOG_BLOCK_SIZE) {
+            fr = FR_INVALID_PARAMETER;
+        } else {
+            // Contiguous and allocated now: the FAT is never touched again
+            fr = f_expand(&fil, size, 1);
+        }
+        if (FR_OK != fr) {
+            DBG_PRINTF("%s: f_expand(%s): %s (%d)\n", __func__, path, FRESULT_str(fr), fr);
+            f_close(&fil);
+            f_unlink(path);
+            return fr;
+        }
+    }
+    // A single fragment means the file can be addressed as a sector range
+    DWORD clmt[4] = {count_of(clmt)};
+    fil.cltbl = clmt;
+    fr = f_lseek(&fil, CREATE_LINKMAP);
+    if (FR_NOT_ENOUGH_CORE == fr) {
+        DBG_PRINTF("%s: %s is fragmented\n", __func__, path);
+        fr = FR_DENIED;
+    }
+    FATFS *fs = fil.obj.fs;
+    rl->pdrv = fs->pdrv;
+    rl->lba = fs->database + (LBA_t)fs->csize * (fil.obj.sclust - 2);
+    uint32_t max_slots = f_size(&fil) / RING_LOG_BLOCK_SIZE - 1;
+    FRESULT fr2 = f_close(&fil);
+    if (FR_OK == fr) fr = fr2;
+    if (FR_OK != fr) return fr;
+
+    ring_log_super_t *sb = (ring_log_super_t *)&rl->blk;
+    if (RES_OK != disk_read(rl->pdrv, (BYTE *)&rl->blk, rl->lba, 1)) return FR_DISK_ERR;
+    if (RING_LOG_SUPER_MAGIC == sb->magic && RING_LOG_VERSION == sb->version &&
+        RING_LOG_BLOCK_SIZE == sb->block_size && sb->nslots &&
+        sb->nslots <= max_slots &&
+        sb->checksum == calculate_checksum((uint32_t *)sb, sizeof *sb)) {
+        rl->nslots = sb->nslots;
+        rl->id = sb->id;
+        fr = find_head(rl);
+    } else {
+        // New ring (or the superblock write was interrupted): the id keeps
+        // whatever the preallocated sectors held from being taken for blocks
+        memset(&rl->blk, 0, sizeof rl->blk);
+        sb->magic = RING_LOG_SUPER_MAGIC;
+        sb->version = RING_LOG_VERSION;
+        sb->block_size = RING_LOG_BLOCK_SIZE;
+        sb->nslots = max_slots;
+        sb->created = (uint32_t)time(NULL);
+        sb->id = (uint32_t)time_us_64() ^ sb->created ^ (uint32_t)rl->lba;
+        if (!sb->id) sb->id = 1;
+        sb->checksum = calculate_checksum((uint32_t *)sb, sizeof *sb);
+        if (RES_OK != disk_write(rl->pdrv, (BYTE *)&rl->blk, rl->lba, 1))
+            return FR_DISK_ERR;
+        rl->nslots = sb->nslots;
+        rl->id = sb->id;
+        rl->seq = 0;
+    }
+    if (FR_OK == fr) start_block(rl);
+    return fr;
+}
+
+FRESULT ring_log_write(ring_log_t *rl, const void *data, UINT len) {
+    const uint8_t *p = data;
+    bool rec_start = true;
+    while (len) {
+        if (rec_start && RING_LOG_NO_REC == rl->blk.hdr.first_rec)
+            rl->blk.hdr.first_rec = rl->blk.hdr.len;
+        rec_start = false;
+        UINT n = RING_LOG_PAYLOAD - rl->blk.hdr.len;
+        if (n > len) n = len;
+        memcpy(rl->blk.payload + rl->blk.hdr.len, p, n);
+        rl->blk.hdr.len += n;
+        rl->dirty = true;
+        p += n;
+        len -= n;
+        if (RING_LOG_PAYLOAD == rl->blk.hdr.len) {
+            FRESULT fr = write_block(rl);
+            if (FR_OK != fr) return fr;
+            ++rl->seq;
+            start_block(rl);
+        }
+    }
+    return FR_OK;
+}
+
+FRESULT ring_log_flush(ring_log_t *rl) {
+    if (!rl->dirty) return FR_OK;
+    return write_block(rl);
+}
+
+FRESULT ring_log_close(ring_log_t *rl) {
+    FRESULT fr = ring_log_flush(rl);
+    if (RES_OK != disk_ioctl(rl->pdrv, CTRL_SYNC, NULL) && FR_OK == fr)
+        fr = FR_DISK_ERR;
+    return fr;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,327 @@
+/* session.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+//
+#include "hardware/rtc.h"
+#include "pico/stdlib.h"
+#include "pico/util/datetime.h"
+//
+#include "ff.h"
+//
+#include "f_util.h"
+#include "my_debug.h"
+#include "util.h"  // calculate_checksum
+//
+#include "session.h"
+
+#define TRACE_PRINTF(fmt, args...)
+//#define TRACE_PRINTF printf
+
+#define SESSION_MAGIC 0x53455353  // "SESS"
+#define SESSION_VERSION 1
+// Names already taken (e.g. catalog lost or restored from a backup) are
+// skipped by bumping the sequence number, at most this many times.
+#define SESSION_MAX_TRIES 16
+
+typedef struct session_hdr {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t rec_size;
+    uint32_t next_seq;
+    uint32_t count;
+    uint32_t checksum;  // last, not included in checksum
+} session_hdr_t;
+
+#define REC_OFS(ix) (sizeof(session_hdr_t) + (FSIZE_t)(ix) * sizeof(session_info_t))
+
+static void catalog_path(sd_card_t *pSD, char *buf, size_t len) {
+    snprintf(buf, len, "%s" SESSION_CATALOG_FILE, pSD->pcName);
+}
+
+static bool rec_valid(const session_info_t *info) {
+    return info->seq &&
+           info->checksum == calculate_checksum((uint32_t *)info, sizeof *info);
+}
+
+static FRESULT read_at(FIL *fil, FSIZE_t ofs, void *buf, UINT len) {
+    FRESULT fr = f_lseek(fil, ofs);
+    if (FR_OK != fr) return fr;
+    UINT br = 0;
+    fr = f_read(fil, buf, len, &br);
+    if (FR_OK == fr && len != br) fr = FR_NO_FILE;
+    return fr;
+}
+
+static FRESULT write_at(FIL *fil, FSIZE_t ofs, const void *buf, UINT len) {
+    FRESULT fr = f_lseek(fil, ofs);
+    if (FR_OK != fr) return fr;
+    UINT bw = 0;
+    fr = f_write(fil, buf, len, &bw);
+    if (FR_OK == fr && len != bw) fr = FR_DENIED;  // Volume full
+    return fr;
+}
+
+// Reads the catalog header. A missing or damaged header is rebuilt from the
+// file size and the last record, so at most one record is read.
+static FRESULT read_hdr(FIL *fil, session_hdr_t *hdr) {
+    FRESULT fr = read_at(fil, 0, hdr, sizeof *hdr);
+    if (FR_OK == fr && SESSION_MAGIC == hdr->magic &&
+        SESSION_VERSION == hdr->version &&
+        sizeof(session_info_t) == hdr->rec_size &&
+        hdr->checksum == calculate_checksum((uint32_t *)hdr, sizeof *hdr))
+        return FR_OK;
+    if (FR_OK != fr && FR_NO_FILE != fr) return fr;
+
+    memset(hdr, 0, sizeof *hdr);
+    hdr->magic = SESSION_MAGIC;
+    hdr->version = SESSION_VERSION;
+    hdr->rec_size = sizeof(session_info_t);
+    hdr->next_seq = 1;
+    FSIZE_t size = f_size(fil);
+    if (size >= REC_OFS(1)) {
+        hdr->count = (size - REC_OFS(0)) / sizeof(session_info_t);
+        session_info_t last;
+        fr = read_at(fil, REC_OFS(hdr->count - 1), &last, sizeof last);
+        if (FR_OK != fr) return fr;
+        if (rec_valid(&last)) hdr->next_seq = last.seq + 1;
+    }
+    DBG_PRINTF("%s: catalog header rebuilt: count=%lu next_seq=%lu\n", __func__,
+               (unsigned long)hdr->count, (unsigned long)hdr->next_seq);
+    return FR_OK;
+}
+
+static FRESULT write_hdr(FIL *fil, session_hdr_t *hdr) {
+    hdr->checksum = calculate_checksum((uint32_t *)hdr, sizeof *hdr);
+    return write_at(fil, 0, hdr, sizeof *hdr);
+}
+
+static FRESULT write_rec(sd_card_t *pSD, uint32_t index, session_info_t *info) {
+    char path[24];
+    catalog_path(pSD, path, sizeof path);
+    FIL fil;
+    FRESULT fr = f_open(&fil, path, FA_OPEN_EXISTING | FA_WRITE);
+    if (FR_OK != fr) return fr;
+    info->checksum = calculate_checksum((uint32_t *)info, sizeof *info);
+    fr = write_at(&fil, REC_OFS(index), info, sizeof *info);
+    FRESULT fr2 = f_close(&fil);
+    return FR_OK != fr ? fr : fr2;
+}
+
+// Start date and time from the RTC; zeros if it was never set.
+static void get_start(uint32_t *date, uint32_t *start) {
+    datetime_t t = {0};
+    *date = 0;
+    *start = 0;
+    if (!rtc_get_datetime(&t) || t.year < 1980) return;
+    *date = (uint32_t)t.year * 10000 + t.month * 100 + t.day;
+    *start = (uint32_t)time(NULL);
+}
+
+void session_path(sd_card_t *pSD, const session_info_t *info, char *buf, size_t len) {
+    snprintf(buf, len, "%s/%08lu/%04lu." SESSION_FILE_EXT, pSD->pcName,
+             (unsigned long)info->date, (unsigned long)info->seq);
+}
+
+// extent: 0 for a file that grows, or its size allocated up front
+static FRESULT create(sd_card_t *pSD, session_t *s, FSIZE_t extent, crash_log_blk_t *burst,
+                      uint32_t burst_blocks) {
+    memset(s, 0, sizeof *s);
+    s->pSD = pSD;
+
+    char path[24];
+    catalog_path(pSD, path, sizeof path);
+    FIL cat;
+    FRESULT fr = f_open(&cat, path, FA_OPEN_ALWAYS | FA_READ | FA_WRITE);
+    if (FR_OK != fr) return fr;
+    session_hdr_t hdr;
+    fr = read_hdr(&cat, &hdr);
+    if (FR_OK != fr) goto out;
+
+    get_start(&s->info.date, &s->info.start);
+    char dir[16];
+    snprintf(dir, sizeof dir, "%s/%08lu", pSD->pcName, (unsigned long)s->info.date);
+    fr = f_mkdir(dir);
+    if (FR_EXIST == fr) fr = FR_OK;
+    if (FR_OK != fr) goto out;
+
+    s->info.seq = hdr.next_seq;
+    for (int i = 0; i < SESSION_MAX_TRIES; ++i, ++s->info.seq) {
+        session_path(pSD, &s->info, s->path, sizeof s->path);
+        fr = f_open(&s->fil, s->path, FA_CREATE_NEW | FA_WRITE);
+        if (FR_EXIST != fr) break;
+        TRACE_PRINTF("%s: %s exists\n", __func__, s->path);
+    }
+    if (FR_OK == fr) {
+        fr = extent ? crash_log_start_extent(&s->log, &s->fil, extent, burst, burst_blocks)
+                    : crash_log_start(&s->log, &s->fil);
+        if (FR_OK != fr) {
+            f_close(&s->fil);
+            f_unlink(s->path);
+        }
+    }
+    if (FR_OK != fr) goto out;
+
+    // Record first, then the header that makes it count: a reset in between
+    // only costs the record, and the file keeps its unique name.
+    s->index = hdr.count;
+    s->info.checksum = calculate_checksum((uint32_t *)&s->info, sizeof s->info);
+    fr = write_at(&cat, REC_OFS(s->index), &s->info, sizeof s->info);
+    if (FR_OK == fr) {
+        hdr.next_seq = s->info.seq + 1;
+        hdr.count = s->index + 1;
+        fr = write_hdr(&cat, &hdr);
+    }
+    if (FR_OK != fr) {
+        f_close(&s->fil);
+        f_unlink(s->path);
+    }
+    // Without an index the session still records; readers search the log
+    if (FR_OK == fr && !extent) log_index_open(&s->tix, s->path, s->log.id, LOG_INDEX_EVERY);
+out:;
+    FRESULT fr2 = f_close(&cat);
+    if (FR_OK != fr)
+        DBG_PRINTF("%s: %s (%d)\n", __func__, FRESULT_str(fr), fr);
+    return FR_OK != fr ? fr : fr2;
+}
+
+FRESULT session_create(sd_card_t *pSD, session_t *s) { return create(pSD, s, 0, NULL, 0); }
+
+FRESULT session_create_extent(sd_card_t *pSD, session_t *s, FSIZE_t size,
+                              crash_log_blk_t *burst, uint32_t burst_blocks) {
+    if (!size) return FR_INVALID_PARAMETER;
+    return create(pSD, s, size, burst, burst_blocks);
+}
+
+FRESULT session_write(session_t *s, const void *data, UINT len) {
+    FRESULT fr = crash_log_write(&s->log, data, len);
+    if (FR_OK == fr) log_index_note(&s->tix, &s->log);
+    return fr;
+}
+
+FRESULT session_flush(session_t *s) { return crash_log_flush(&s->log); }
+
+FRESULT session_close(session_t *s) {
+    log_index_close(&s->tix);
+    FRESULT fr = crash_log_finish(&s->log);
+    FRESULT fr2 = f_close(&s->fil);
+    if (FR_OK == fr) fr = fr2;
+    if (FR_OK != fr) return fr;  // Left open: session_recover() completes it
+    // An extent had no file system calls to spare while recording
+    if (s->log.blocks) log_index_build(s->path, LOG_INDEX_EVERY);
+    s->info.records = crash_log_records(&s->log);
+    s->info.size = f_size(&s->fil);
+    s->info.closed = SESSION_CLOSED;
+    return write_rec(s->pSD, s->index, &s->info);
+}
+
+FRESULT session_recover(sd_card_t *pSD, bool *recovered, session_info_t *info,
+                        crash_log_recovery_t *rec) {
+    *recovered = false;
+    uint32_t count;
+    FRESULT fr = session_count(pSD, &count, NULL);
+    if (FR_OK != fr || !count) return fr;
+    session_info_t last;
+    fr = session_get(pSD, count - 1, &last);
+    if (FR_INT_ERR == fr) return FR_OK;  // Record lost with the reset: nothing to complete
+    if (FR_OK != fr || SESSION_OPEN != last.closed) return fr;
+
+    char path[32];
+    session_path(pSD, &last, path, sizeof path);
+    FIL fil;
+    crash_log_recovery_t r;
+    fr = f_open(&fil, path, FA_OPEN_EXISTING | FA_READ | FA_WRITE);
+    if (FR_OK == fr) {
+        fr = crash_log_recover(&fil, &r);
+        FRESULT fr2 = f_close(&fil);
+        if (FR_OK == fr) fr = fr2;
+    } else if (FR_NO_FILE == fr) {
+        memset(&r, 0, sizeof r);
+        fr = FR_OK;
+    }
+    if (FR_OK != fr) {
+        DBG_PRINTF("%s: %s: %s (%d)\n", __func__, path, FRESULT_str(fr), fr);
+        return fr;
+    }
+    last.records = r.records;
+    last.size = r.size;
+    last.closed = SESSION_RECOVERED;
+    fr = write_rec(pSD, count - 1, &last);
+    if (FR_OK != fr) return fr;
+    *recovered = true;
+    if (info) *info = last;
+    if (rec) *rec = r;
+    return FR_OK;
+}
+
+FRESULT session_count(sd_card_t *pSD, uint32_t *count, uint32_t *next_seq) {
+    char path[24];
+    catalog_path(pSD, path, sizeof path);
+    FIL cat;
+    session_hdr_t hdr;
+    FRESULT fr = f_open(&cat, path, FA_READ);
+    if (FR_NO_FILE == fr) {
+        *count = 0;
+        if (next_seq) *next_seq = 1;
+        return FR_OK;
+    }
+    if (FR_OK != fr) return fr;
+    fr = read_hdr(&cat, &hdr);
+    f_close(&cat);
+    if (FR_OK != fr) return fr;
+    *count = hdr.count;
+    if (next_seq) *next_seq = hdr.next_seq;
+    return FR_OK;
+}
+
+FRESULT session_get(sd_card_t *pSD, uint32_t index, session_info_t *info) {
+    char path[24];
+    catalog_path(pSD, path, sizeof path);
+    FIL cat;
+    FRESULT fr = f_open(&cat, path, FA_READ);
+    if (FR_OK != fr) return fr;
+    fr = read_at(&cat, REC_OFS(index), info, sizeof *info);
+    f_close(&cat);
+    if (FR_OK != fr) return fr;
+    if (!rec_valid(info)) return FR_INT_ERR;
+    return FR_OK;
+}
+
+FRESULT session_list(sd_card_t *pSD, session_list_cb_t cb, void *arg) {
+    char path[24];
+    catalog_path(pSD, path, sizeof path);
+    FIL cat;
+    FRESULT fr = f_open(&cat, path, FA_READ);
+    if (FR_NO_FILE == fr) return FR_OK;
+    if (FR_OK != fr) return fr;
+    session_hdr_t hdr;
+    fr = read_hdr(&cat, &hdr);
+    if (FR_OK == fr) fr = f_lseek(&cat, REC_OFS(0));
+    session_info_t recs[8];
+    for (uint32_t ix = 0; FR_OK == fr && ix < hdr.count;) {
+        uint32_t n = hdr.count - ix;
+        if (n > count_of(recs)) n = count_of(recs);
+        UINT br = 0;
+        fr = f_read(&cat, recs, n * sizeof recs[0], &br);
+        if (FR_OK != fr || br != n * sizeof recs[0]) break;
+        for (uint32_t i = 0; i < n; ++i, ++ix)
+            if (rec_valid(&recs[i]) && !cb(&recs[i], arg)) goto out;
+    }
+out:
+    f_close(&cat);
+    return fr;
+}
+
+/* [] END OF FILE */
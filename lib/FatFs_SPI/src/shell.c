@@ -0,0 +1,135 @@
+/* shell.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// No file system or SDK calls: builds on the host too.
+
+#include <stdlib.h>
+#include <string.h>
+//
+#include "shell.h"
+
+void shell_init(shell_t *sh, const shell_cmd_t *cmds, size_t ncmds, shell_getc_t get_char,
+                shell_printf_t print) {
+    memset(sh, 0, sizeof *sh);
+    sh->cmds = cmds;
+    sh->ncmds = ncmds;
+    sh->get_char = get_char;
+    sh->print = print;
+}
+
+int shell_split(char *line, char **argv, int max) {
+    int argc = 0;
+    char *p = line;
+    for (;;) {
+        while (' ' == *p || '\t' == *p) ++p;
+        if (!*p) return argc;
+        if (argc == max) return -1;
+        char *out = p;
+        argv[argc++] = out;
+        bool quoted = false;
+        for (; *p && (quoted || (' ' != *p && '\t' != *p)); ++p) {
+            if ('"' == *p) quoted = !quoted;
+            else *out++ = *p;
+        }
+        if (quoted) return -1;
+        if (*p) ++p;  // Past the separator, which may be overwritten below
+        *out = '\0';
+    }
+}
+
+bool shell_parse_u32(const char *s, uint32_t min, uint32_t max, uint32_t *out) {
+    if (!s || !*s || '-' == *s) return false;
+    char *end;
+    unsigned long long v = strtoull(s, &end, 0);
+    if (*end || v < min || v > max) return false;
+    *out = (uint32_t)v;
+    return true;
+}
+
+static int help(shell_t *sh) {
+    sh->print("help\n");
+    for (size_t i = 0; i < sh->ncmds; ++i) {
+        const shell_cmd_t *c = &sh->cmds[i];
+        sh->print("%s%s%s: %s\n", c->name, c->args ? " " : "", c->args ? c->args : "", c->help);
+    }
+    return 0;
+}
+
+int shell_exec(shell_t *sh, char *line) {
+    char *argv[SHELL_ARGS_MAX + 1];
+    int argc = shell_split(line, argv, SHELL_ARGS_MAX);
+    if (!argc) return -1;
+    sh->stats.lines++;
+    if (argc < 0) {
+        sh->stats.errors++;
+        sh->print("error: too many words or unclosed quote\n");
+        return -1;
+    }
+    argv[argc] = NULL;
+    if (!strcmp(argv[0], "help")) return help(sh);
+    for (size_t i = 0; i < sh->ncmds; ++i) {
+        const shell_cmd_t *c = &sh->cmds[i];
+        if (strcmp(argv[0], c->name)) continue;
+        if (argc - 1 < c->min_args || argc - 1 > c->max_args) {
+            sh->stats.errors++;
+            sh->print("usage: %s%s%s\n", c->name, c->args ? " " : "", c->args ? c->args : "");
+            return -1;
+        }
+        int rc = c->fn(argc, argv);
+        if (rc) sh->stats.errors++;
+        return rc;
+    }
+    sh->stats.errors++;
+    sh->print("error: unknown command %s (help lists them)\n", argv[0]);
+    return -1;
+}
+
+void shell_job(shell_t *sh, shell_step_t step) { sh->job = step; }
+
+bool shell_poll(shell_t *sh, unsigned budget) {
+    if (sh->job) {
+        sh->stats.steps++;
+        if (sh->job()) sh->job = NULL;
+        return true;
+    }
+    bool any = false;
+    while (budget--) {
+        int c = sh->get_char();
+        if (c < 0) break;
+        any = true;
+        char prev = sh->last;
+        sh->last = (char)c;
+        if ('\n' == c && '\r' == prev) continue;  // The rest of a "\r\n"
+        if ('\r' == c || '\n' == c) {
+            bool dropped = sh->overflow;
+            sh->line[sh->len] = '\0';
+            sh->len = 0;
+            sh->overflow = false;
+            if (dropped) {
+                sh->stats.overflow++;
+                sh->print("error: line longer than %d characters\n", SHELL_LINE_MAX - 1);
+            } else {
+                shell_exec(sh, sh->line);
+            }
+            break;  // One line per call
+        }
+        if ('\b' == c || 0x7F == c) {
+            if (sh->len) sh->len--;
+            continue;
+        }
+        if (sh->len + 1 < sizeof sh->line) sh->line[sh->len++] = (char)c;
+        else sh->overflow = true;
+    }
+    return any;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,193 @@
+/* sink.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+#include <string.h>
+//
+#include "sink.h"
+
+static FRESULT count(sink_t *sk, FRESULT fr) {
+    if (FR_OK != fr) sk->stats.errors++;
+    return fr;
+}
+
+FRESULT sink_open(sink_t *sk) {
+    memset(&sk->stats, 0, sizeof sk->stats);
+    FRESULT fr = count(sk, sk->ops->open(sk->ctx));
+    sk->open = FR_OK == fr;
+    return fr;
+}
+
+FRESULT sink_append(sink_t *sk, const sink_rec_t *recs, size_t n) {
+    if (!sk->open) return FR_NOT_READY;
+    FRESULT fr = count(sk, sk->ops->append(sk->ctx, recs, n));
+    if (FR_OK != fr) return fr;
+    sk->stats.batches++;
+    sk->stats.records += n;
+    for (size_t i = 0; i < n; ++i) sk->stats.bytes += recs[i].len;
+    return FR_OK;
+}
+
+FRESULT sink_flush(sink_t *sk) {
+    if (!sk->open) return FR_NOT_READY;
+    sk->stats.flushes++;
+    return count(sk, sk->ops->flush(sk->ctx));
+}
+
+FRESULT sink_close(sink_t *sk) {
+    if (!sk->open) return FR_OK;
+    sk->open = false;
+    return count(sk, sk->ops->close(sk->ctx));
+}
+
+int sink_write(void *sk, const void *rec, size_t len) {
+    sink_rec_t r = {rec, len};
+    return sink_append(sk, &r, 1);
+}
+
+static FRESULT nop(void *ctx) {
+    (void)ctx;
+    return FR_OK;
+}
+
+/* RAM */
+
+static FRESULT mem_open(void *ctx) {
+    sink_mem_t *m = ctx;
+    m->used = 0;
+    m->wraps = 0;
+    return FR_OK;
+}
+
+static FRESULT mem_append(void *ctx, const sink_rec_t *recs, size_t n) {
+    sink_mem_t *m = ctx;
+    for (size_t i = 0; i < n; ++i) {
+        if (recs[i].len > m->size) return FR_DENIED;
+        if (m->used + recs[i].len > m->size) {
+            if (!m->wrap) return FR_DENIED;
+            m->used = 0;
+            m->wraps++;
+        }
+        memcpy(m->buf + m->used, recs[i].data, recs[i].len);
+        m->used += recs[i].len;
+    }
+    return FR_OK;
+}
+
+static const sink_ops_t mem_ops = {"mem", SINK_CAP_BOUNDED | SINK_CAP_NO_FS, mem_open,
+                                   mem_append, nop, nop};
+static const sink_ops_t mem_wrap_ops = {"mem",
+                                        SINK_CAP_BOUNDED | SINK_CAP_WRAPS | SINK_CAP_NO_FS,
+                                        mem_open, mem_append, nop, nop};
+
+void sink_mem_init(sink_t *sk, sink_mem_t *m, void *buf, size_t size, bool wrap) {
+    memset(m, 0, sizeof *m);
+    m->buf = buf;
+    m->size = size;
+    m->wrap = wrap;
+    memset(sk, 0, sizeof *sk);
+    sk->ops = wrap ? &mem_wrap_ops : &mem_ops;
+    sk->ctx = m;
+}
+
+/* Crash-consistent log file */
+
+static FRESULT file_open(void *ctx) {
+    sink_file_t *f = ctx;
+    FRESULT fr = f_open(&f->fil, f->path, FA_CREATE_ALWAYS | FA_WRITE);
+    if (FR_OK != fr) return fr;
+    fr = crash_log_start(&f->log, &f->fil);
+    if (FR_OK != fr) f_close(&f->fil);
+    return fr;
+}
+
+static FRESULT log_append(crash_log_t *cl, const sink_rec_t *recs, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        FRESULT fr = crash_log_write(cl, recs[i].data, recs[i].len);
+        if (FR_OK != fr) return fr;
+    }
+    return FR_OK;
+}
+
+static FRESULT file_append(void *ctx, const sink_rec_t *recs, size_t n) {
+    return log_append(&((sink_file_t *)ctx)->log, recs, n);
+}
+
+static FRESULT file_flush(void *ctx) { return crash_log_flush(&((sink_file_t *)ctx)->log); }
+
+static FRESULT file_close(void *ctx) {
+    sink_file_t *f = ctx;
+    FRESULT fr = crash_log_finish(&f->log);
+    FRESULT fr2 = f_close(&f->fil);
+    return FR_OK != fr ? fr : fr2;
+}
+
+static const sink_ops_t file_ops = {"file", SINK_CAP_DURABLE | SINK_CAP_CARD | SINK_CAP_FILE,
+                                    file_open, file_append, file_flush, file_close};
+
+void sink_file_init(sink_t *sk, sink_file_t *f, const TCHAR *path) {
+    memset(f, 0, sizeof *f);
+    f->path = path;
+    memset(sk, 0, sizeof *sk);
+    sk->ops = &file_ops;
+    sk->ctx = f;
+}
+
+/* Raw sectors */
+
+static FRESULT raw_open(void *ctx) {
+    sink_raw_t *r = ctx;
+    return crash_log_start_raw(&r->log, r->pdrv, r->lba, r->blocks, r->burst, SINK_BURST);
+}
+
+static FRESULT raw_append(void *ctx, const sink_rec_t *recs, size_t n) {
+    return log_append(&((sink_raw_t *)ctx)->log, recs, n);
+}
+
+static FRESULT raw_flush(void *ctx) { return crash_log_flush(&((sink_raw_t *)ctx)->log); }
+
+static FRESULT raw_close(void *ctx) { return crash_log_finish(&((sink_raw_t *)ctx)->log); }
+
+static const sink_ops_t raw_ops = {
+    "raw", SINK_CAP_DURABLE | SINK_CAP_CARD | SINK_CAP_BOUNDED | SINK_CAP_NO_FS,
+    raw_open, raw_append, raw_flush, raw_close};
+
+void sink_raw_init(sink_t *sk, sink_raw_t *r, BYTE pdrv, LBA_t lba, uint32_t blocks) {
+    memset(r, 0, sizeof *r);
+    r->pdrv = pdrv;
+    r->lba = lba;
+    r->blocks = blocks;
+    memset(sk, 0, sizeof *sk);
+    sk->ops = &raw_ops;
+    sk->ctx = r;
+}
+
+/* Internal flash */
+
+static FRESULT flash_append(void *ctx, const sink_rec_t *recs, size_t n) {
+    for (size_t i = 0; i < n; ++i)
+        if (!flash_log_put(ctx, recs[i].data, recs[i].len)) return FR_DENIED;
+    return FR_OK;
+}
+
+static FRESULT flash_flush(void *ctx) { return flash_log_flush(ctx) ? FR_DISK_ERR : FR_OK; }
+
+static const sink_ops_t flash_ops = {"flash",
+                                     SINK_CAP_DURABLE | SINK_CAP_BOUNDED | SINK_CAP_NO_FS, nop,
+                                     flash_append, flash_flush, flash_flush};
+
+void sink_flash_init(sink_t *sk, flash_log_t *fl) {
+    memset(sk, 0, sizeof *sk);
+    sk->ops = &flash_ops;
+    sk->ctx = fl;
+}
+
+/* [] END OF FILE */
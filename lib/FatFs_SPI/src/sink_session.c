@@ -0,0 +1,136 @@
+/* sink_session.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// Sinks over the card's session files and ring file (see sink.h)
+
+#include <stdio.h>
+#include <string.h>
+//
+#include "sink.h"
+
+/* One session file per open */
+
+static FRESULT session_open_cb(void *ctx) {
+    session_t *s = ctx;
+    return session_create(s->pSD, s);
+}
+
+static FRESULT session_append_cb(void *ctx, const sink_rec_t *recs, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        FRESULT fr = session_write(ctx, recs[i].data, recs[i].len);
+        if (FR_OK != fr) return fr;
+    }
+    return FR_OK;
+}
+
+static FRESULT session_flush_cb(void *ctx) { return session_flush(ctx); }
+
+static FRESULT session_close_cb(void *ctx) { return session_close(ctx); }
+
+static const sink_ops_t session_ops = {"session",
+                                       SINK_CAP_DURABLE | SINK_CAP_CARD | SINK_CAP_FILE,
+                                       session_open_cb, session_append_cb, session_flush_cb,
+                                       session_close_cb};
+
+void sink_session_init(sink_t *sk, session_t *s, sd_card_t *pSD) {
+    memset(s, 0, sizeof *s);
+    s->pSD = pSD;
+    memset(sk, 0, sizeof *sk);
+    sk->ops = &session_ops;
+    sk->ctx = s;
+}
+
+/* Session files in preallocated extents */
+
+static FRESULT extent_create(sink_extent_t *e) {
+    e->files++;
+    return session_create_extent(e->s->pSD, e->s, e->size, e->burst, SINK_BURST);
+}
+
+static FRESULT extent_open_cb(void *ctx) {
+    sink_extent_t *e = ctx;
+    e->files = 0;
+    return extent_create(e);
+}
+
+static FRESULT extent_append_cb(void *ctx, const sink_rec_t *recs, size_t n) {
+    sink_extent_t *e = ctx;
+    for (size_t i = 0; i < n; ++i) {
+        FRESULT fr = session_write(e->s, recs[i].data, recs[i].len);
+        if (FR_DENIED == fr) {
+            // Full: the record was refused whole and goes into the next file
+            fr = session_close(e->s);
+            if (FR_OK == fr) fr = extent_create(e);
+            if (FR_OK == fr) fr = session_write(e->s, recs[i].data, recs[i].len);
+        }
+        if (FR_OK != fr) return fr;
+    }
+    return FR_OK;
+}
+
+static FRESULT extent_flush_cb(void *ctx) { return session_flush(((sink_extent_t *)ctx)->s); }
+
+static FRESULT extent_close_cb(void *ctx) { return session_close(((sink_extent_t *)ctx)->s); }
+
+static const sink_ops_t extent_ops = {
+    "extent", SINK_CAP_DURABLE | SINK_CAP_CARD | SINK_CAP_FILE | SINK_CAP_NO_FS,
+    extent_open_cb, extent_append_cb, extent_flush_cb, extent_close_cb};
+
+void sink_extent_init(sink_t *sk, sink_extent_t *e, session_t *s, sd_card_t *pSD,
+                      FSIZE_t size) {
+    memset(s, 0, sizeof *s);
+    s->pSD = pSD;
+    memset(e, 0, sizeof *e);
+    e->s = s;
+    e->size = size;
+    memset(sk, 0, sizeof *sk);
+    sk->ops = &extent_ops;
+    sk->ctx = e;
+}
+
+/* Ring file */
+
+static FRESULT ring_open_cb(void *ctx) {
+    sink_ring_t *r = ctx;
+    return ring_log_open(&r->rl, r->path, r->size);
+}
+
+static FRESULT ring_append_cb(void *ctx, const sink_rec_t *recs, size_t n) {
+    sink_ring_t *r = ctx;
+    for (size_t i = 0; i < n; ++i) {
+        FRESULT fr = ring_log_write(&r->rl, recs[i].data, recs[i].len);
+        if (FR_OK != fr) return fr;
+    }
+    return FR_OK;
+}
+
+static FRESULT ring_flush_cb(void *ctx) { return ring_log_flush(&((sink_ring_t *)ctx)->rl); }
+
+static FRESULT ring_close_cb(void *ctx) { return ring_log_close(&((sink_ring_t *)ctx)->rl); }
+
+// Writes go to the preallocated slots through disk_write(), not FatFs
+static const sink_ops_t ring_ops = {
+    "ring",
+    SINK_CAP_DURABLE | SINK_CAP_CARD | SINK_CAP_FILE | SINK_CAP_BOUNDED | SINK_CAP_WRAPS |
+        SINK_CAP_NO_FS,
+    ring_open_cb, ring_append_cb, ring_flush_cb, ring_close_cb};
+
+void sink_ring_init(sink_t *sk, sink_ring_t *r, const TCHAR *path, FSIZE_t size) {
+    memset(r, 0, sizeof *r);
+    snprintf(r->path, sizeof r->path, "%s", path);
+    r->size = size;
+    memset(sk, 0, sizeof *sk);
+    sk->ops = &ring_ops;
+    sk->ctx = r;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,98 @@
+/* spill.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+#include <string.h>
+//
+#include "spill.h"
+
+// Each record is a length byte followed by the data; both may wrap around
+// the end of the buffer.
+#define HDR_SIZE 1
+
+static size_t wrap(const spill_t *sp, size_t pos) {
+    return pos >= sp->size ? pos - sp->size : pos;
+}
+
+static void copy_in(spill_t *sp, size_t pos, const void *src, size_t len) {
+    size_t first = sp->size - pos;
+    if (first > len) first = len;
+    memcpy(sp->buf + pos, src, first);
+    memcpy(sp->buf, (const uint8_t *)src + first, len - first);
+}
+
+static void copy_out(const spill_t *sp, size_t pos, void *dst, size_t len) {
+    size_t first = sp->size - pos;
+    if (first > len) first = len;
+    memcpy(dst, sp->buf + pos, first);
+    memcpy((uint8_t *)dst + first, sp->buf, len - first);
+}
+
+void spill_init(spill_t *sp, void *buf, size_t size) {
+    memset(sp, 0, sizeof *sp);
+    sp->buf = buf;
+    sp->size = size;
+}
+
+bool spill_put(spill_t *sp, const void *rec, size_t len) {
+    if (len > SPILL_MAX_RECORD || sp->used + HDR_SIZE + len > sp->size) {
+        sp->stats.dropped++;
+        return false;
+    }
+    uint8_t hdr = (uint8_t)len;
+    copy_in(sp, sp->head, &hdr, HDR_SIZE);
+    copy_in(sp, wrap(sp, sp->head + HDR_SIZE), rec, len);
+    sp->head = wrap(sp, sp->head + HDR_SIZE + len);
+    sp->used += HDR_SIZE + len;
+    if (sp->used > sp->stats.peak) sp->stats.peak = sp->used;
+    sp->pending++;
+    sp->stats.records++;
+    return true;
+}
+
+int spill_drain(spill_t *sp, spill_write_t write, void *ctx) {
+    uint8_t rec[SPILL_MAX_RECORD];  // For records split by the wrap
+    while (sp->pending) {
+        uint8_t len;
+        copy_out(sp, sp->sent, &len, HDR_SIZE);
+        size_t pos = wrap(sp, sp->sent + HDR_SIZE);
+        const void *p = sp->buf + pos;
+        if (pos + len > sp->size) {
+            copy_out(sp, pos, rec, len);
+            p = rec;
+        }
+        int rc = write(ctx, p, len);
+        if (rc) return rc;
+        sp->sent = wrap(sp, pos + len);
+        sp->sent_bytes += HDR_SIZE + len;
+        sp->pending--;
+        sp->unsynced++;
+        sp->stats.drained++;
+    }
+    return 0;
+}
+
+void spill_commit(spill_t *sp) {
+    sp->used -= sp->sent_bytes;
+    sp->sent_bytes = 0;
+    sp->tail = sp->sent;
+    sp->unsynced = 0;
+}
+
+void spill_rewind(spill_t *sp) {
+    sp->stats.rewound += sp->unsynced;
+    sp->pending += sp->unsynced;
+    sp->unsynced = 0;
+    sp->sent_bytes = 0;
+    sp->sent = sp->tail;
+}
+
+/* [] END OF FILE */
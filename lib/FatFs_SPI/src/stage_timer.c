@@ -0,0 +1,105 @@
+/* stage_timer.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+#include <stdio.h>
+#include <string.h>
+//
+#include "stage_timer.h"
+
+#if STAGE_TIMER
+
+#if STAGE_TIMER_CYCLES && PICO_ON_DEVICE
+#include "hardware/clocks.h"
+#endif
+
+stage_timer_stats_t stage_timer_stats[STAGE_TIMER_MAX];
+
+static const char *const *stage_names;
+static unsigned n_stages;
+
+void stage_timer_init(const char *const *names, unsigned n) {
+    stage_names = names;
+    n_stages = n < STAGE_TIMER_MAX ? n : STAGE_TIMER_MAX;
+#if STAGE_TIMER_CYCLES && PICO_ON_DEVICE
+    // Free running from the processor clock, no interrupt
+    systick_hw->rvr = STAGE_TIMER_MASK;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 0x5;  // CLKSOURCE | ENABLE
+#endif
+    stage_timer_reset();
+}
+
+void stage_timer_reset() { memset(stage_timer_stats, 0, sizeof stage_timer_stats); }
+
+uint32_t stage_timer_ticks_per_us() {
+#if STAGE_TIMER_CYCLES && PICO_ON_DEVICE
+    return clock_get_hz(clk_sys) / 1000000;
+#else
+    return 1;
+#endif
+}
+
+uint32_t stage_timer_percentile(unsigned stage, unsigned p) {
+    const stage_timer_stats_t *s = &stage_timer_stats[stage];
+    if (!s->count) return 0;
+    uint64_t want = ((uint64_t)s->count * p + 99) / 100;
+    if (!want) want = 1;
+    uint64_t seen = 0;
+    for (unsigned b = 0; b < STAGE_TIMER_N_BUCKETS; ++b) {
+        seen += s->bucket[b];
+        if (seen >= want) {
+            uint32_t bound = b == STAGE_TIMER_N_BUCKETS - 1 ? s->max : 2u << b;
+            return bound < s->max ? bound : s->max;
+        }
+    }
+    return s->max;
+}
+
+void stage_timer_print(int ref) {
+    uint32_t tpu = stage_timer_ticks_per_us();
+    uint64_t ref_sum = ref >= 0 && ref < (int)n_stages ? stage_timer_stats[ref].sum : 0;
+    printf("Stage times (us): n min mean p50 p99 max total%s | log2 buckets (%s)\n",
+           ref_sum ? " share" : "", 1 == tpu ? "us" : "cycles");
+    for (unsigned i = 0; i < n_stages; ++i) {
+        const stage_timer_stats_t *s = &stage_timer_stats[i];
+        if (!s->count) continue;
+        printf("%-6s: %lu %lu %lu %lu %lu %lu %llu", stage_names[i], (unsigned long)s->count,
+               (unsigned long)(s->min / tpu), (unsigned long)(s->sum / s->count / tpu),
+               (unsigned long)(stage_timer_percentile(i, 50) / tpu),
+               (unsigned long)(stage_timer_percentile(i, 99) / tpu), (unsigned long)(s->max / tpu),
+               (unsigned long long)(s->sum / tpu));
+        if (ref_sum) printf(" %lu.%lu%%", (unsigned long)(s->sum * 100 / ref_sum),
+                            (unsigned long)(s->sum * 1000 / ref_sum % 10));
+        printf(" |");
+        unsigned last = STAGE_TIMER_N_BUCKETS;
+        while (last && !s->bucket[last - 1]) --last;
+        for (unsigned b = 0; b < last; ++b) printf(" %lu", (unsigned long)s->bucket[b]);
+        printf("\n");
+    }
+}
+
+unsigned stage_timer_lines(char lines[][24], unsigned max_lines, unsigned width) {
+    uint32_t tpu = stage_timer_ticks_per_us();
+    if (width > 23) width = 23;
+    unsigned n = 0;
+    for (unsigned i = 0; i < n_stages && n < max_lines; ++i) {
+        const stage_timer_stats_t *s = &stage_timer_stats[i];
+        if (!s->count) continue;
+        snprintf(lines[n++], width + 1, "%-5.5s%5lu %5lu", stage_names[i],
+                 (unsigned long)(s->sum / s->count / tpu), (unsigned long)(s->max / tpu));
+    }
+    return n;
+}
+
+#endif
+
+/* [] END OF FILE */
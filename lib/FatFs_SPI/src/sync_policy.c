@@ -0,0 +1,81 @@
+/* sync_policy.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use 
+this file except in compliance with the License. You may obtain a copy of the 
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0 
+Unless required by applicable law or agreed to in writing, software distributed 
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR 
+CONDITIONS OF ANY KIND, either express or implied. See the License for the 
+specific language governing permissions and limitations under the License.
+*/
+#include <string.h>
+//
+#include "sync_policy.h"
+
+#define TRACE_PRINTF(fmt, args...)
+//#define TRACE_PRINTF printf
+
+#define MAX_BACKOFF 8
+
+static void update_interval(sync_policy_t *sp) {
+    const sync_policy_cfg_t *cfg = &sp->cfg;
+    // Spending avg_us every interval must stay within max_cost_permille
+    uint64_t ms = cfg->max_cost_permille
+                      ? (uint64_t)sp->m.avg_us / cfg->max_cost_permille
+                      : cfg->max_risk_ms;
+    if (ms < cfg->min_interval_ms) ms = cfg->min_interval_ms;
+    ms *= sp->backoff;
+    if (ms > cfg->max_risk_ms) ms = cfg->max_risk_ms;
+    sp->m.interval_ms = (uint32_t)ms;
+}
+
+void sync_policy_init(sync_policy_t *sp, const sync_policy_cfg_t *cfg) {
+    memset(sp, 0, sizeof *sp);
+    sp->cfg = *cfg;
+    if (sp->cfg.min_interval_ms > sp->cfg.max_risk_ms)
+        sp->cfg.min_interval_ms = sp->cfg.max_risk_ms;
+    sp->backoff = 1;
+    update_interval(sp);
+}
+
+bool sync_policy_wrote(sync_policy_t *sp, uint64_t now_us) {
+    if (!sp->pending) {
+        sp->pending = true;
+        sp->oldest_us = now_us;
+    }
+    return now_us - sp->oldest_us >= (uint64_t)sp->m.interval_ms * 1000;
+}
+
+void sync_policy_synced(sync_policy_t *sp, uint64_t start_us, uint64_t end_us) {
+    sync_policy_metrics_t *m = &sp->m;
+    uint32_t us = (uint32_t)(end_us - start_us);
+    if (sp->pending) {
+        uint32_t risk_ms = (uint32_t)((end_us - sp->oldest_us) / 1000);
+        if (risk_ms > m->max_risk_ms) m->max_risk_ms = risk_ms;
+    }
+    sp->pending = false;
+    m->syncs++;
+    m->total_us += us;
+    m->last_us = us;
+    if (us > m->max_us) m->max_us = us;
+
+    if (1 == m->syncs) {
+        m->avg_us = us;
+    } else if (us > SYNC_POLICY_STALL_FACTOR * m->avg_us) {
+        // Stall: believe it at once and space the next syncs out
+        m->stalls++;
+        m->avg_us = (m->avg_us + us) / 2;
+        if (sp->backoff < MAX_BACKOFF) sp->backoff *= 2;
+    } else {
+        // Normal sync: slow average (1/8), relax the back-off step by step
+        m->avg_us = m->avg_us - m->avg_us / 8 + us / 8;
+        if (sp->backoff > 1) sp->backoff /= 2;
+    }
+    update_interval(sp);
+    TRACE_PRINTF("%s: %lu us, avg %lu us, interval %lu ms\n", __func__, (unsigned long)us,
+                 (unsigned long)m->avg_us, (unsigned long)m->interval_ms);
+}
+
+/* [] END OF FILE */
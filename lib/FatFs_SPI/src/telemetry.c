@@ -0,0 +1,151 @@
+/* telemetry.c
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+// No file system or SDK calls: builds on the host too.
+
+#include <assert.h>
+#include <string.h>
+//
+#include "crc.h"
+//
+#include "telemetry.h"
+
+static_assert(sizeof(telemetry_hdr_t) == 16, "");
+static_assert(sizeof(telemetry_sample_t) == 12, "");
+static_assert(TELEMETRY_BATCH <= 255, "");
+
+size_t cobs_encode(const uint8_t *in, size_t len, uint8_t *out) {
+    size_t code_at = 0, o = 1;
+    uint8_t code = 1;
+    for (size_t i = 0; i < len; ++i) {
+        if (in[i]) {
+            out[o++] = in[i];
+            ++code;
+        }
+        if (!in[i] || 0xFF == code) {
+            out[code_at] = code;
+            code_at = o++;
+            code = 1;
+        }
+    }
+    out[code_at] = code;
+    return o;
+}
+
+size_t cobs_decode(const uint8_t *in, size_t len, uint8_t *out) {
+    size_t i = 0, o = 0;
+    while (i < len) {
+        uint8_t code = in[i++];
+        if (!code || i + code - 1 > len) return 0;
+        for (uint8_t k = 1; k < code; ++k) {
+            if (!in[i]) return 0;
+            out[o++] = in[i++];
+        }
+        if (0xFF != code && i < len) out[o++] = 0;
+    }
+    return o;
+}
+
+void telemetry_init(telemetry_t *t, telemetry_out_t out) {
+    memset(t, 0, sizeof *t);
+    t->out = out;
+    t->hdr.type = TELEMETRY_MAGIC;
+}
+
+void telemetry_flush(telemetry_t *t) {
+    if (!t->hdr.count) return;
+    static uint8_t frame[TELEMETRY_FRAME_MAX];
+    static uint8_t wire[TELEMETRY_WIRE_MAX];
+    t->hdr.seq = t->frames;
+    size_t len = sizeof t->hdr + t->hdr.count * sizeof t->samples[0];
+    memcpy(frame, &t->hdr, sizeof t->hdr);
+    memcpy(frame + sizeof t->hdr, t->samples, len - sizeof t->hdr);
+    uint16_t crc = crc16((const char *)frame, (int)len);
+    memcpy(frame + len, &crc, sizeof crc);
+    len += sizeof crc;
+    wire[0] = 0;
+    size_t n = 1 + cobs_encode(frame, len, wire + 1);
+    wire[n++] = 0;
+    t->out(wire, n);
+    t->frames++;
+    t->bytes += n;
+    t->hdr.count = 0;
+}
+
+void telemetry_put(telemetry_t *t, uint32_t n, uint32_t t_ms, uint16_t c, uint16_t r,
+                   uint16_t g, uint16_t b, uint8_t color) {
+    telemetry_hdr_t *h = &t->hdr;
+    if (h->count && (n != h->first + h->count || t_ms - h->t0_ms > TELEMETRY_MAX_AGE_MS))
+        telemetry_flush(t);
+    if (!h->count) {
+        h->first = n;
+        h->t0_ms = t_ms;
+    }
+    telemetry_sample_t *s = &t->samples[h->count++];
+    s->dt_ms = (uint16_t)(t_ms - h->t0_ms);
+    s->c = c;
+    s->r = r;
+    s->g = g;
+    s->b = b;
+    s->color = color;
+    s->reserved = 0;
+    if (TELEMETRY_BATCH == h->count) telemetry_flush(t);
+}
+
+void telemetry_rx_init(telemetry_rx_t *rx) { memset(rx, 0, sizeof *rx); }
+
+static void rx_frame(telemetry_rx_t *rx, telemetry_rx_cb_t cb, void *arg) {
+    static uint8_t frame[TELEMETRY_WIRE_MAX];
+    size_t len = cobs_decode(rx->buf, rx->have, frame);
+    telemetry_hdr_t h;
+    uint16_t crc;
+    bool ok = len >= sizeof h + sizeof crc;
+    if (ok) {
+        memcpy(&h, frame, sizeof h);
+        len -= sizeof crc;
+        memcpy(&crc, frame + len, sizeof crc);
+        ok = TELEMETRY_MAGIC == h.type && h.count && h.count <= TELEMETRY_BATCH &&
+             len == sizeof h + h.count * sizeof(telemetry_sample_t) &&
+             crc == crc16((const char *)frame, (int)len);
+    }
+    if (!ok) {
+        rx->bad++;
+        return;
+    }
+    if (rx->synced && h.seq != rx->next_seq) rx->lost += h.seq - rx->next_seq;
+    rx->synced = true;
+    rx->next_seq = h.seq + 1;
+    rx->frames++;
+    // The samples are copied out of the byte buffer to be aligned
+    static telemetry_sample_t samples[TELEMETRY_BATCH];
+    memcpy(samples, frame + sizeof h, h.count * sizeof samples[0]);
+    cb(arg, &h, samples);
+}
+
+void telemetry_rx_feed(telemetry_rx_t *rx, const void *data, size_t len, telemetry_rx_cb_t cb,
+                       void *arg) {
+    const uint8_t *p = data;
+    for (size_t i = 0; i < len; ++i) {
+        if (p[i]) {
+            if (rx->have < sizeof rx->buf) rx->buf[rx->have++] = p[i];
+            else rx->overflow = true;
+            continue;
+        }
+        // A delimiter: between two of them, nothing or a frame
+        if (rx->overflow) rx->bad++;
+        else if (rx->have) rx_frame(rx, cb, arg);
+        rx->have = 0;
+        rx->overflow = false;
+    }
+}
+
+/* [] END OF FILE */
@@ -42,6 +42,16 @@ void gy33_init(i2c_inst_t *i2c) {
     gy33_write_register(i2c, CONTROL_REG, 0x00);    // Configura ganho 1x
 }
 
+// Define o ganho do sensor (código 0 a 3: 1x, 4x, 16x, 60x)
+void gy33_set_ganho(i2c_inst_t *i2c, uint8_t codigo) {
+    gy33_write_register(i2c, CONTROL_REG, codigo & 0x03);
+}
+
+// Define o tempo de integração do ADC: (256 - atime) x 2,4 ms
+void gy33_set_atime(i2c_inst_t *i2c, uint8_t atime) {
+    gy33_write_register(i2c, ATIME_REG, atime);
+}
+
 // Lê os valores de cor do sensor
 void gy33_read_color(i2c_inst_t *i2c, uint16_t *r, uint16_t *g, uint16_t *b, uint16_t *c) {
     *c = gy33_read_register(i2c, CDATA_REG);        // Luz clara (intensidade total)
@@ -51,11 +61,11 @@ void gy33_read_color(i2c_inst_t *i2c, uint16_t *r, uint16_t *g, uint16_t *b, uin
 }
 
 // Identifica a cor com base nos valores RGB e intensidade
-const char* identificar_cor(uint16_t r, uint16_t g, uint16_t b, uint16_t c) {
-    if (c < 30) return "---";                       // Ambiente escuro
+cor_t classificar_cor(uint16_t r, uint16_t g, uint16_t b, uint16_t c) {
+    if (c < 30) return COR_ESCURO;                  // Ambiente escuro
     
     float total = r + g + b;
-    if (total == 0) return "---";                    // Sem dados válidos
+    if (total == 0) return COR_ESCURO;               // Sem dados válidos
     
     // Normalização dos componentes
     float rn = r / total;
@@ -65,24 +75,29 @@ const char* identificar_cor(uint16_t r, uint16_t g, uint16_t b, uint16_t c) {
     
     // Lógica de identificação de cores
     if (rg_ratio > 1.15) {
-        return (bn < 0.23) ? "Laranja" : "Vermelho";
+        return (bn < 0.23) ? COR_LARANJA : COR_VERMELHO;
     }
     if (rg_ratio > 0.85 && rg_ratio <= 1.15) {
-        return (c > 400) ? "Ouro" : "Amarelo";
+        return (c > 400) ? COR_OURO : COR_AMARELO;
     }
-    if (gn > rn && gn > bn) return "Verde";
-    if (bn > rn && bn > gn) return "Azul";
-    if (bn > 0.4 && rn > 0.3 && gn < 0.3) return "Violeta";
-    if (rg_ratio > 1.2 && c < 80 && c > 30) return "Marrom";
+    if (gn > rn && gn > bn) return COR_VERDE;
+    if (bn > rn && bn > gn) return COR_AZUL;
+    if (bn > 0.4 && rn > 0.3 && gn < 0.3) return COR_VIOLETA;
+    if (rg_ratio > 1.2 && c < 80 && c > 30) return COR_MARROM;
     
     // Detecção de cores neutras (tons de cinza)
     bool is_balanced = (rn > gn - 0.15 && rn < gn + 0.15) && 
                        (gn > bn - 0.15 && gn < bn + 0.15);
     if (is_balanced) {
-        if (c > 600) return "Branco";
-        if (c > 300) return "Prata";
-        if (c > 80) return "Cinza";
+        if (c > 600) return COR_BRANCO;
+        if (c > 300) return COR_PRATA;
+        if (c > 80) return COR_CINZA;
     }
     
-    return "Desconhecido";
+    return COR_DESCONHECIDA;
+}
+
+// Nome da cor identificada
+const char* identificar_cor(uint16_t r, uint16_t g, uint16_t b, uint16_t c) {
+    return nomes_cores[classificar_cor(r, g, b, c)];
 }
\ No newline at end of file
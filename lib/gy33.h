@@ -3,13 +3,23 @@
 
 #include "pico/stdlib.h"
 #include "hardware/i2c.h"
+#include "gy33_cores.h"
 
 //Inicializa o sensor de cor GY-33 (TCS34725).
 void gy33_init(i2c_inst_t *i2c);
 
+//Define o ganho do sensor (código 0 a 3: 1x, 4x, 16x, 60x).
+void gy33_set_ganho(i2c_inst_t *i2c, uint8_t codigo);
+
+//Define o tempo de integração: (256 - atime) x 2,4 ms.
+void gy33_set_atime(i2c_inst_t *i2c, uint8_t atime);
+
 //Lê os valores de cor brutos do sensor.
 void gy33_read_color(i2c_inst_t *i2c, uint16_t *r, uint16_t *g, uint16_t *b, uint16_t *c);
 
+//Analisa os valores RGB e retorna a cor mais provável.
+cor_t classificar_cor(uint16_t r, uint16_t g, uint16_t b, uint16_t c);
+
 //Analisa os valores RGB e retorna o nome da cor mais provável.
 const char* identificar_cor(uint16_t r, uint16_t g, uint16_t b, uint16_t c);
 
@@ -0,0 +1,29 @@
+#ifndef GY33_CORES_H
+#define GY33_CORES_H
+
+// Cores reconhecidas por classificar_cor(). O código é o que vai na telemetria
+// binária; host/tools/telemetry_recv usa esta tabela para voltar ao nome.
+// Novas cores entram no fim, para não mudar os códigos existentes.
+typedef enum {
+    COR_ESCURO,
+    COR_LARANJA,
+    COR_VERMELHO,
+    COR_OURO,
+    COR_AMARELO,
+    COR_VERDE,
+    COR_AZUL,
+    COR_VIOLETA,
+    COR_MARROM,
+    COR_BRANCO,
+    COR_PRATA,
+    COR_CINZA,
+    COR_DESCONHECIDA,
+    NUM_CORES
+} cor_t;
+
+static const char *const nomes_cores[NUM_CORES] = {
+    "---", "Laranja", "Vermelho", "Ouro", "Amarelo", "Verde", "Azul",
+    "Violeta", "Marrom", "Branco", "Prata", "Cinza", "Desconhecido",
+};
+
+#endif // GY33_CORES_H
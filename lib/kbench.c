@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "kbench.h"
+#include "crc.h"
+#include "ff.h"
+#include "gy33.h"
+#include "ssd1306.h"
+
+// --- Relógio ---
+
+// No Pico, os ciclos do SysTick; fora dele (a simulação no PC também define
+// PICO_ON_DEVICE), o relógio monotônico do sistema
+#if PICO_ON_DEVICE && defined(__arm__)
+#include "hardware/structs/systick.h"
+
+#define KBENCH_MASCARA 0xffffffu
+#define KBENCH_ALVO (1u << 20) // ~8 ms a 125 MHz, longe da volta dos 24 bits
+
+static void iniciar_relogio(void) {
+    // Mesma configuração do stage_timer.c com STAGE_TIMER_CYCLES=1
+    if (!(systick_hw->csr & 1)) {
+        systick_hw->rvr = KBENCH_MASCARA;
+        systick_hw->cvr = 0;
+        systick_hw->csr = 0x5; // CLKSOURCE | ENABLE
+    }
+}
+static uint64_t agora(void) { return KBENCH_MASCARA - systick_hw->cvr; }
+static uint64_t decorrido(uint64_t t0) { return (agora() - t0) & KBENCH_MASCARA; }
+const char *kbench_unidade(void) { return "cycles"; }
+#else
+#include <time.h>
+
+#define KBENCH_ALVO 10000000u // 10 ms
+
+static void iniciar_relogio(void) {}
+static uint64_t agora(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+static uint64_t decorrido(uint64_t t0) { return agora() - t0; }
+const char *kbench_unidade(void) { return "ns"; }
+#endif
+
+#define KBENCH_MAX_OPS (1u << 24)
+
+// --- Kernels ---
+
+// Leituras do sensor que passam por vários ramos de classificar_cor()
+typedef struct {
+    uint16_t c, r, g, b;
+} leitura_t;
+
+static const leitura_t leituras[] = {
+    {420, 300, 60, 50}, {380, 80, 220, 70}, {350, 60, 90, 200}, {900, 380, 340, 120},
+    {1000, 330, 340, 320}, {500, 280, 150, 60}, {150, 50, 50, 48}, {20, 6, 7, 6},
+};
+#define N_LEITURAS (sizeof(leituras) / sizeof(leituras[0]))
+
+// Um comando do cartão (CMD17, leitura de um bloco) sem o CRC, como o
+// sd_card.c o calcula a cada comando
+static uint32_t k_crc7(uint32_t n) {
+    char cmd[5] = {0x40 | 17, 0, 0, 0, 0};
+    uint32_t soma = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        cmd[4] = (char)i;
+        soma += (uint8_t)crc7(cmd, sizeof(cmd));
+    }
+    return soma;
+}
+
+// Um bloco de 512 bytes, como o CRC de dados de cada bloco lido ou gravado
+static uint32_t k_crc16(uint32_t n) {
+    static char bloco[512];
+    uint32_t soma = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        bloco[i % sizeof(bloco)] = (char)i;
+        soma += crc16(bloco, sizeof(bloco));
+    }
+    return soma;
+}
+
+static uint32_t k_identificar_cor(uint32_t n) {
+    uint32_t soma = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        const leitura_t *l = &leituras[i % N_LEITURAS];
+        soma += (uint8_t)identificar_cor(l->r, l->g, l->b, l->c)[0];
+    }
+    return soma;
+}
+
+// A linha gravada no cartão, no formato de process_continuous_capture()
+static uint32_t k_linha_csv(uint32_t n) {
+    char buffer[100];
+    uint32_t soma = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        const leitura_t *l = &leituras[i % N_LEITURAS];
+        soma += (uint32_t)sprintf(buffer, "%d,%u,%u,%u,%u,%s\n", (int)i + 1,
+                                  l->c, l->r, l->g, l->b, nomes_cores[i % NUM_CORES]);
+    }
+    return soma;
+}
+
+// Uma tela só para o teste: o display da captura não é tocado
+static ssd1306_t *tela(void) {
+    static ssd1306_t ssd;
+    if (!ssd.ram_buffer)
+        ssd1306_init(&ssd, WIDTH, HEIGHT, false, 0x3C, NULL);
+    return &ssd;
+}
+
+static uint32_t k_ssd1306_fill(uint32_t n) {
+    ssd1306_t *ssd = tela();
+    for (uint32_t i = 0; i < n; ++i)
+        ssd1306_fill(ssd, i & 1);
+    return ssd->ram_buffer[1];
+}
+
+// Uma das linhas da tela da captura
+static uint32_t k_ssd1306_draw_string(uint32_t n) {
+    ssd1306_t *ssd = tela();
+    for (uint32_t i = 0; i < n; ++i)
+        ssd1306_draw_string(ssd, "C: 1000 R: 300", 0, (uint8_t)(i % 6 * 10));
+    return ssd->ram_buffer[1];
+}
+
+// A metade alta da página de código (a baixa é ASCII e não passa pela tabela)
+static uint32_t k_ff_oem2uni(uint32_t n) {
+    uint32_t soma = 0;
+    for (uint32_t i = 0; i < n; ++i)
+        soma += ff_oem2uni((WCHAR)(0x80 + (i & 0x7F)), FF_CODE_PAGE);
+    return soma;
+}
+
+static uint32_t k_ff_uni2oem(uint32_t n) {
+    static WCHAR uni[128];
+    if (!uni[0])
+        for (unsigned i = 0; i < 128; ++i)
+            uni[i] = ff_oem2uni((WCHAR)(0x80 + i), FF_CODE_PAGE);
+    uint32_t soma = 0;
+    for (uint32_t i = 0; i < n; ++i)
+        soma += ff_uni2oem(uni[i & 0x7F], FF_CODE_PAGE);
+    return soma;
+}
+
+// Chamada pelo FatFs a cada arquivo criado ou gravado
+static uint32_t k_get_fattime(uint32_t n) {
+    uint32_t soma = 0;
+    for (uint32_t i = 0; i < n; ++i)
+        soma += get_fattime();
+    return soma;
+}
+
+const kbench_kernel_t kbench_kernels[] = {
+    {"crc7", k_crc7},
+    {"crc16", k_crc16},
+    {"identificar_cor", k_identificar_cor},
+    {"linha_csv", k_linha_csv},
+    {"ssd1306_fill", k_ssd1306_fill},
+    {"ssd1306_draw_string", k_ssd1306_draw_string},
+    {"ff_oem2uni", k_ff_oem2uni},
+    {"ff_uni2oem", k_ff_uni2oem},
+    {"get_fattime", k_get_fattime},
+};
+const unsigned kbench_num_kernels = sizeof(kbench_kernels) / sizeof(kbench_kernels[0]);
+
+const kbench_kernel_t *kbench_buscar(const char *nome) {
+    for (unsigned i = 0; i < kbench_num_kernels; ++i)
+        if (0 == strcmp(kbench_kernels[i].nome, nome))
+            return &kbench_kernels[i];
+    return NULL;
+}
+
+// --- Medida ---
+
+// O resultado de cada medida vai para cá, para o kernel não ser descartado
+static volatile uint32_t descarte;
+
+static uint64_t medir(const kbench_kernel_t *k, uint32_t n) {
+    uint64_t t0 = agora();
+    descarte += k->rodar(n);
+    return decorrido(t0);
+}
+
+bool kbench_medir(const kbench_kernel_t *k, kbench_result_t *r) {
+    iniciar_relogio();
+    medir(k, 1); // Aquece caches e inicializações preguiçosas
+
+    uint32_t n = 1;
+    while (medir(k, n) < KBENCH_ALVO) {
+        if (n >= KBENCH_MAX_OPS)
+            return false;
+        n *= 2;
+    }
+
+    // Ordenação por inserção: são poucas medidas
+    uint64_t por_op[KBENCH_MEDIDAS];
+    for (unsigned i = 0; i < KBENCH_MEDIDAS; ++i) {
+        uint64_t v = medir(k, n) * 100 / n;
+        unsigned j = i;
+        for (; j > 0 && por_op[j - 1] > v; --j)
+            por_op[j] = por_op[j - 1];
+        por_op[j] = v;
+    }
+    r->ops = n;
+    r->min_x100 = por_op[0];
+    r->med_x100 = por_op[KBENCH_MEDIDAS / 2];
+    return true;
+}
+
+void kbench_imprimir_cabecalho(void) {
+    printf("kbench,kernel,ops,min,median,unit\n");
+}
+
+void kbench_imprimir(const kbench_kernel_t *k, const kbench_result_t *r) {
+    printf("kbench,%s,%lu,%llu.%02u,%llu.%02u,%s\n", k->nome, (unsigned long)r->ops,
+           (unsigned long long)(r->min_x100 / 100), (unsigned)(r->min_x100 % 100),
+           (unsigned long long)(r->med_x100 / 100), (unsigned)(r->med_x100 % 100),
+           kbench_unidade());
+}
@@ -0,0 +1,51 @@
+#ifndef KBENCH_H
+#define KBENCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Microbenchmarks das rotinas de CPU do firmware, com o mesmo código no Pico
+// (comando "kbench" do terminal) e no PC (host/tools/kbench).
+//
+// Cada kernel executa n operações e devolve um valor que depende delas, para
+// que o compilador não as descarte. kbench_medir() dobra n até uma medida
+// passar de KBENCH_ALVO unidades e então repete a medida KBENCH_MEDIDAS vezes.
+// O menor tempo por operação é o número estável (interrupções só somam
+// tempo), e a mediana mostra o quanto elas pesaram.
+//
+// A unidade é o ciclo da CPU no Pico (SysTick, 24 bits) e o nanossegundo no
+// PC. As linhas saem em CSV, com o prefixo "kbench," para serem separadas do
+// resto da saída do terminal:
+//   kbench,kernel,ops,min,median,unit
+//   kbench,crc7,16384,182.25,182.31,cycles
+
+#define KBENCH_MEDIDAS 7
+
+typedef struct {
+    const char *nome;
+    uint32_t (*rodar)(uint32_t n);
+} kbench_kernel_t;
+
+typedef struct {
+    uint32_t ops;      // Operações por medida
+    uint64_t min_x100; // Unidades por operação x 100: a menor das medidas
+    uint64_t med_x100; // e a mediana
+} kbench_result_t;
+
+extern const kbench_kernel_t kbench_kernels[];
+extern const unsigned kbench_num_kernels;
+
+//Kernel pelo nome, ou NULL.
+const kbench_kernel_t *kbench_buscar(const char *nome);
+
+//"cycles" no Pico, "ns" no PC.
+const char *kbench_unidade(void);
+
+//Mede um kernel; falso se nem o maior n chega ao alvo (relógio parado).
+bool kbench_medir(const kbench_kernel_t *k, kbench_result_t *r);
+
+//Imprime o cabeçalho e a linha de um resultado, no formato acima.
+void kbench_imprimir_cabecalho(void);
+void kbench_imprimir(const kbench_kernel_t *k, const kbench_result_t *r);
+
+#endif // KBENCH_H
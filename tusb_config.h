@@ -0,0 +1,24 @@
+// Configuração da pilha USB (TinyUSB) da aplicação: a serial do stdio (CDC)
+// e o cartão SD como pendrive (MSC, lib/FatFs_SPI/include/msc_disk.h).
+// Com a pilha na aplicação, o pico_stdio_usb não a inicializa nem chama
+// tud_task(): isso é feito em main().
+
+#pragma once
+
+#define CFG_TUSB_RHPORT0_MODE OPT_MODE_DEVICE
+#define CFG_TUSB_OS OPT_OS_PICO
+
+#define CFG_TUD_ENDPOINT0_SIZE 64
+
+#define CFG_TUD_CDC 1
+#define CFG_TUD_MSC 1
+#define CFG_TUD_HID 0
+#define CFG_TUD_MIDI 0
+#define CFG_TUD_VENDOR 0
+
+#define CFG_TUD_CDC_RX_BUFSIZE 256
+#define CFG_TUD_CDC_TX_BUFSIZE 256
+
+// Pedaço de cada READ(10)/WRITE(10) entregue por chamada; múltiplo de 512,
+// pois o msc_disk só aceita escritas de blocos inteiros
+#define CFG_TUD_MSC_EP_BUFSIZE 4096
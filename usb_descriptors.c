@@ -0,0 +1,115 @@
+// Descritores USB do dispositivo composto: serial (CDC, usada pelo stdio)
+// e cartão SD (MSC). Substituem os do pico_stdio_usb, que só tem a serial.
+
+#include <string.h>
+//
+#include "pico/unique_id.h"
+#include "tusb.h"
+
+// IDs de teste do TinyUSB; o PID muda com as classes presentes, para o
+// sistema do PC não reaproveitar o driver de outra combinação
+#define USB_VID 0xCafe
+#define USB_PID (0x4000 | (CFG_TUD_CDC << 0) | (CFG_TUD_MSC << 1))
+#define USB_BCD 0x0200
+
+enum
+{
+    ITF_NUM_CDC = 0, // O stdio_usb usa a interface CDC 0
+    ITF_NUM_CDC_DATA,
+    ITF_NUM_MSC,
+    ITF_NUM_TOTAL
+};
+
+#define EPNUM_CDC_NOTIF 0x81
+#define EPNUM_CDC_OUT 0x02
+#define EPNUM_CDC_IN 0x82
+#define EPNUM_MSC_OUT 0x03
+#define EPNUM_MSC_IN 0x83
+
+#define CONFIG_TOTAL_LEN (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_MSC_DESC_LEN)
+
+enum
+{
+    STR_IDIOMA = 0,
+    STR_FABRICANTE,
+    STR_PRODUTO,
+    STR_SERIAL,
+    STR_CDC,
+    STR_MSC,
+};
+
+static const tusb_desc_device_t descritor_dispositivo = {
+    .bLength = sizeof(tusb_desc_device_t),
+    .bDescriptorType = TUSB_DESC_DEVICE,
+    .bcdUSB = USB_BCD,
+    // Dispositivo composto (IAD)
+    .bDeviceClass = TUSB_CLASS_MISC,
+    .bDeviceSubClass = MISC_SUBCLASS_COMMON,
+    .bDeviceProtocol = MISC_PROTOCOL_IAD,
+    .bMaxPacketSize0 = CFG_TUD_ENDPOINT0_SIZE,
+    .idVendor = USB_VID,
+    .idProduct = USB_PID,
+    .bcdDevice = 0x0100,
+    .iManufacturer = STR_FABRICANTE,
+    .iProduct = STR_PRODUTO,
+    .iSerialNumber = STR_SERIAL,
+    .bNumConfigurations = 1,
+};
+
+static const uint8_t descritor_configuracao[] = {
+    TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0x00, 250),
+    TUD_CDC_DESCRIPTOR(ITF_NUM_CDC, STR_CDC, EPNUM_CDC_NOTIF, 8, EPNUM_CDC_OUT, EPNUM_CDC_IN, 64),
+    TUD_MSC_DESCRIPTOR(ITF_NUM_MSC, STR_MSC, EPNUM_MSC_OUT, EPNUM_MSC_IN, 64),
+};
+
+static const char *const textos[] = {
+    [STR_FABRICANTE] = "Raspberry Pi",
+    [STR_PRODUTO] = "GY-33 Data Collector",
+    [STR_CDC] = "Serial",
+    [STR_MSC] = "Cartao SD",
+};
+
+const uint8_t *tud_descriptor_device_cb(void)
+{
+    return (const uint8_t *)&descritor_dispositivo;
+}
+
+const uint8_t *tud_descriptor_configuration_cb(uint8_t index)
+{
+    (void)index;
+    return descritor_configuracao;
+}
+
+// Textos em UTF-16; o número de série é o ID único da flash, como no stdio_usb
+const uint16_t *tud_descriptor_string_cb(uint8_t index, uint16_t langid)
+{
+    (void)langid;
+    static uint16_t desc[33];
+    char serial[2 * PICO_UNIQUE_BOARD_ID_SIZE_BYTES + 1];
+    const char *texto;
+    size_t n;
+    if (STR_IDIOMA == index)
+    {
+        desc[1] = 0x0409; // Inglês (EUA)
+        n = 1;
+    }
+    else
+    {
+        if (STR_SERIAL == index)
+        {
+            pico_get_unique_board_id_string(serial, sizeof(serial));
+            texto = serial;
+        }
+        else if (index < sizeof(textos) / sizeof(textos[0]) && textos[index])
+            texto = textos[index];
+        else
+            return NULL;
+        n = strlen(texto);
+        if (n > 32)
+            n = 32;
+        for (size_t i = 0; i < n; i++)
+            desc[1 + i] = (uint8_t)texto[i];
+    }
+    desc[0] = (uint16_t)((TUSB_DESC_STRING << 8) | (2 * n + 2));
+    return desc;
+}